@@ -0,0 +1,126 @@
+// Anomaly detection - notices rooms left on after the guest has gone and relays that no longer follow
+// their commands, from running statistics kept per room with no event history
+// Every statistic is an exponentially weighted mean and mean absolute deviation, updated in O(1) integer
+// steps per event (the ESP32-C3 has no FPU). A value more than ANOMALY_K deviations above the mean is an
+// outlier, and outliers are clipped before they update the statistic, so a fault does not teach the
+// detector that the fault is normal.
+//
+// Per room:
+//   stay        log2 of how long the room stays on - a room whose guests stay a week is not flagged on day 3
+//   tap gap     log2 of the time between taps at its door while it is on - a tap shows someone is still using it
+//   current     current-sense reading with the relay on, and with it off
+//   mismatch    weighted share of recent readings that disagree with the relay state
+// Alerts:
+//   ANOMALY_LONG_STAY  on for an outlying time and silent for an outlying time - probably left on when vacant
+//   ANOMALY_STUCK_ON   current keeps flowing with the relay off - welded contacts
+//   ANOMALY_STUCK_OFF  no current with the relay on - open contacts, a blown lamp or a tripped breaker
+// Each alert is raised once and stays raised until the condition clears.
+//
+// The detector is portable C++ so the host replay tool measures it on labelled traces; sampling is firmware-only.
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ANOMALY_SHIFT         4       // EWMA weight 1/16 - roughly the last 16 stays or readings
+#ifndef ANOMALY_K
+#define ANOMALY_K             4       // Deviations above the mean that make an outlier - lower catches more left-on
+#endif                                // rooms sooner, and flags more genuine long stays with them
+#define ANOMALY_WARMUP        8       // Samples before a statistic may raise an alert
+#define ANOMALY_MIN_STAY_MS   (4UL * 3600 * 1000)  // Never flag a stay shorter than this
+#define ANOMALY_MIN_LOG_DEV   128     // Deviation floor for log2 statistics, Q8 - half a doubling
+#define ANOMALY_MIN_CURRENT_DEV 8     // Deviation floor for current readings, ADC counts
+#define ANOMALY_SETTLE_MS     2000    // Readings this soon after a switch are skipped - lamps take a moment
+#define ANOMALY_MISMATCH_SHIFT 3      // Mismatch weight 1/8 - a relay flash or one noisy reading never adds up
+#define ANOMALY_MISMATCH_RAISE 58982  // Mismatch share that raises a stuck alert, Q16 - 0.9
+#define ANOMALY_MISMATCH_CLEAR 6554   // Share below which it clears, Q16 - 0.1
+#ifndef ANOMALY_CURRENT_THRESHOLD
+#define ANOMALY_CURRENT_THRESHOLD 200 // Reading that means current flows, until the on and off levels are learned
+#endif
+
+// Alert bits
+#define ANOMALY_LONG_STAY 0x01
+#define ANOMALY_STUCK_ON  0x02
+#define ANOMALY_STUCK_OFF 0x04
+
+// Running mean and mean absolute deviation, both scaled by 16
+struct AnomalyStat {
+  int32_t mean;
+  int32_t dev;
+  uint16_t samples;                 // Saturates - only the warm-up needs it
+};
+
+// What the detector has learned about a room - small enough to keep in NVS across restarts
+struct AnomalyModel {
+  AnomalyStat stay;                 // log2 ms, Q8
+  AnomalyStat tapGap;               // log2 ms, Q8
+  AnomalyStat currentOn;            // ADC counts
+  AnomalyStat currentOff;
+};
+
+// Detector state of one room
+struct AnomalyRoom {
+  AnomalyModel model;
+  bool on;                          // Relay state last reported
+  bool tapped;                      // A tap has been seen - tap gaps need two
+  uint32_t switchedMs;              // When the relay last switched
+  uint32_t lastTapMs;
+  uint32_t mismatch;                // Weighted share of readings disagreeing with the relay, Q16
+  uint8_t alerts;                   // Alerts raised and not yet cleared
+};
+
+// Function to fold one value into a statistic
+void anomalyStatAdd(AnomalyStat *s, int32_t x, int32_t minDev);
+
+// Function to check whether a value lies above the statistic's outlier threshold - false during warm-up
+bool anomalyStatHigh(const AnomalyStat *s, int32_t x, int32_t minDev);
+
+// Function to compute log2 of a positive value in Q8 - an O(1) approximation, exact at powers of two
+int32_t anomalyLog2(uint32_t x);
+
+// Function to start a room with an empty model
+void anomalyRoomInit(AnomalyRoom *r, bool on, uint32_t nowMs);
+
+// Function to note the relay switching - a finished stay updates the stay statistic
+void anomalySwitched(AnomalyRoom *r, bool on, uint32_t nowMs);
+
+// Function to note a tap at the room's door
+void anomalyTap(AnomalyRoom *r, uint32_t nowMs);
+
+// Function to check an occupied room for a stay left on - returns the alerts newly raised
+uint8_t anomalyCheckStay(AnomalyRoom *r, uint32_t nowMs);
+
+// Function to feed one current-sense reading - returns the alerts newly raised
+uint8_t anomalyCurrent(AnomalyRoom *r, uint16_t reading, uint32_t nowMs);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef ANOMALY_ENABLED
+#define ANOMALY_ENABLED 0           // Enable from build_flags (-DANOMALY_ENABLED=1)
+#endif
+// Current-sense input per room, -1 where none is fitted - e.g. -DANOMALY_CURRENT_PINS="{2,4}" for a current
+// transformer or hall sensor on an ADC pin. Stuck relays are only detected in rooms that have one
+#ifndef ANOMALY_CURRENT_PINS
+#define ANOMALY_CURRENT_PINS {-1, -1}
+#endif
+#define ANOMALY_SAMPLE_MS  1000     // Current readings and stay checks this often per room
+#define ANOMALY_SAVE_MS    (6UL * 3600 * 1000)  // Learned models written to NVS this often
+
+extern uint32_t anomalyEvents;      // Events fed to the detector
+extern uint32_t anomalyAlerts;      // Alerts raised
+extern uint32_t anomalyMaxUs;       // Longest single detector update
+
+// Function to load the learned models and start from the current room state
+void anomalyBegin();
+
+// Function to note a tap at a room's door - accepted or not, it shows someone is there
+void anomalyRecordTap(uint8_t room);
+
+// Function to follow relay changes, sample current and check stays - alert(room, bits) reports each new alert;
+// call from the main loop, only while the relays follow the room state
+void anomalyPoll(void (*alert)(uint8_t room, uint8_t alerts));
+#endif
+
+#endif
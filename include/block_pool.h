@@ -0,0 +1,43 @@
+// Block pool - fixed-size blocks for log lines, event records and outbound frames, kept off the general heap
+// Strings and frames allocated from the heap one after another, each with its own size and lifetime,
+// leave holes between the allocations that live on. After weeks the heap has plenty of free bytes and no
+// single hole big enough for the next Wi-Fi buffer. A pool is one static array of equal blocks for one
+// type, so a freed block is exactly the size the next request of that type needs, and the heap never
+// sees those allocations at all.
+//
+// Free blocks form a linked stack by index. alloc pops and free pushes, each with one compare-and-swap
+// of the head. The head carries a counter beside the index, so a block popped and pushed again while
+// another task was between its read and its swap cannot be mistaken for an unchanged stack. No task ever
+// waits on another, and alloc and free may be called from interrupts. The ESP32-C3 has no atomic
+// instructions; ESP-IDF performs each compare-and-swap with interrupts masked for a few cycles.
+//
+// Portable C++ so the host soak test runs the same code.
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// One pool - storage and links are arrays of count entries supplied by the owner, usually static
+struct BlockPool {
+  uint8_t *storage;
+  uint16_t blockSize;
+  uint16_t count;
+  std::atomic<uint16_t> *links;     // Next free block per block, index + 1, 0 ends the stack
+  std::atomic<uint32_t> head;       // Counter << 16 | index + 1 of the first free block
+  std::atomic<uint32_t> used;       // Blocks handed out now
+  std::atomic<uint32_t> peak;       // Most handed out at once
+  std::atomic<uint32_t> exhausted;  // Allocations refused because every block was out
+};
+
+// Function to set up a pool over storage for count blocks of blockSize bytes - before any task uses it
+void blockPoolInit(BlockPool *pool, void *storage, uint16_t blockSize, uint16_t count, std::atomic<uint16_t> *links);
+
+// Function to take a block - NULL when every block is out, counted in exhausted. O(1), never waits
+void *blockPoolAlloc(BlockPool *pool);
+
+// Function to return a block - NULL is ignored, and so is a pointer that is not a block of this pool
+void blockPoolFree(BlockPool *pool, void *block);
+
+#endif
@@ -0,0 +1,133 @@
+// Card list - the cards authorized for each room, distributed from the host as signed deltas instead of
+// being compiled into the firmware
+// The host keeps the master card/room assignments (tools/card_dist.cpp) and remembers the last list version
+// each controller acknowledged. A change is sent to a controller as the difference between its acknowledged
+// list and its current one - only the cards added, moved or removed - so one guest checking in costs a
+// few bytes per controller rather than the whole list.
+//
+// Update blob, one UDP datagram (little-endian):
+//   'C' 'L' 'D' 'U' | format (1) | flags (1) | controller id (2) | base version (4) | version (4)
+//   | remove count (2) | add count (2) | removed UIDs (4 each) | added cards: UID (4), room (1)
+//   | tag (16) - HMAC-SHA256 over everything before it with the site key, truncated
+// Both lists are sorted by UID. An add for a card already listed moves it to the new room. A blob applies
+// only to the controller it names and only on top of its base version, so replayed or reordered blobs do
+// nothing. A delta too large for one datagram is split into parts: every part names the same base, only
+// the last carries CARD_FLAG_FINAL and advances the version, and all removes come before any add. Adds
+// and removes are idempotent, so a lost part is simply resent with the rest. Until the final part is in,
+// the list remembers the version its parts lead to; a part leading anywhere else (the master moved on
+// while the final part was lost) is refused with CARD_MIXED, and the host resends the whole list with
+// CARD_FLAG_RESET rather than trust a list that is at its base version in name only.
+//
+// Acknowledgement, sent back to whoever sent the blob:
+//   'C' 'L' 'D' 'A' | format (1) | result (1) | controller id (2) | version (4) | tag (16)
+//
+// The codec is portable C++ so the host tool shares it; the UDP listener and NVS storage are firmware-only.
+#ifndef CARD_LIST_H
+#define CARD_LIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CARD_LIST_FORMAT      1
+#define CARD_LIST_CAPACITY    256   // Cards per controller
+#define CARD_LIST_UID_SIZE    4     // UID bytes per card - as stored for room owners
+#define CARD_LIST_HEADER_SIZE 20    // Bytes before the removed UIDs
+#define CARD_LIST_ADD_SIZE    5     // UID and room
+#define CARD_LIST_TAG_SIZE    16    // Truncated HMAC bytes
+#define CARD_LIST_ACK_SIZE    (10 + CARD_LIST_TAG_SIZE)
+#define CARD_LIST_BLOB_MAX    1400  // Largest blob - fits one UDP datagram without IP fragmentation
+#define CARD_LIST_UDP_PORT    4230  // Update blobs arrive here; acknowledgements go back to the sender
+
+// Blob flags
+#define CARD_FLAG_FINAL 0x01        // Last part - applying it advances the list to the blob's version
+#define CARD_FLAG_RESET 0x02        // Clear the list before applying - first part of a full list
+
+// One authorized card
+struct CardEntry {
+  uint8_t uid[CARD_LIST_UID_SIZE];
+  uint8_t room;                     // Room index on the controller
+};
+
+// A controller's list - entries sorted by UID for binary search
+struct CardList {
+  uint32_t version;                 // Master version the list matches, 0 before the first update
+  uint32_t partial;                 // Version the parts applied since then lead to, 0 when none are
+  uint16_t count;
+  CardEntry entries[CARD_LIST_CAPACITY];
+};
+
+// A verified blob - points into the received datagram, nothing is copied
+struct CardDelta {
+  uint8_t flags;
+  uint16_t controller;
+  uint32_t baseVersion;
+  uint32_t version;
+  uint16_t removeCount;
+  uint16_t addCount;
+  const uint8_t *removes;           // removeCount UIDs
+  const uint8_t *adds;              // addCount UID + room records
+};
+
+// Result of applying a blob - also the result byte of the acknowledgement
+enum CardApply {
+  CARD_APPLIED,       // Applied - the list is at the blob's version, or still at its base for a non-final part
+  CARD_STALE,         // The list is not at the blob's base version - the host sends a delta from the version acked
+  CARD_FOREIGN,       // The blob is for another controller
+  CARD_FULL,          // The list would exceed CARD_LIST_CAPACITY - nothing was changed
+  CARD_INVALID,       // Bad tag, format or ordering
+  CARD_MIXED          // The list holds parts of an update to another version - the host resends the full list
+};
+
+// Function to start an empty list at version 0
+void cardListInit(CardList *list);
+
+// Function to look up a card - returns its room index, or -1 if it is not listed
+int cardListFind(const CardList *list, const uint8_t *uid);
+
+// Function to verify and parse a blob - false for damaged, forged or badly ordered blobs
+bool cardDeltaDecode(const uint8_t *blob, size_t len, const uint8_t *key, size_t keyLen, CardDelta *delta);
+
+// Function to apply a verified blob in place - one merge pass each for the removes and the adds, no copy
+CardApply cardListApply(CardList *list, uint16_t controller, const CardDelta *delta);
+
+// Function to sign and serialize a blob - removes and adds must be sorted by UID; returns its size, 0 if
+// it does not fit in capacity
+size_t cardDeltaEncode(uint8_t *buf, size_t capacity, const CardDelta *delta, const uint8_t *key, size_t keyLen);
+
+// Functions to build and check an acknowledgement
+size_t cardAckEncode(uint8_t buf[CARD_LIST_ACK_SIZE], uint16_t controller, uint32_t version, uint8_t result,
+                     const uint8_t *key, size_t keyLen);
+bool cardAckDecode(const uint8_t *buf, size_t len, const uint8_t *key, size_t keyLen, uint16_t *controller,
+                   uint32_t *version, uint8_t *result);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+// Distributed card lists are off unless enabled from build_flags (-DCARD_LIST_ENABLED=1)
+#ifndef CARD_LIST_ENABLED
+#define CARD_LIST_ENABLED 0
+#endif
+#ifndef CARD_LIST_SITE_KEY
+#define CARD_LIST_SITE_KEY "change-this-card-key"  // HMAC key shared by the host tool and every controller
+#endif
+#ifndef CARD_LIST_CONTROLLER_ID
+#define CARD_LIST_CONTROLLER_ID 1    // Unique id of this controller - the same as SYNC_CONTROLLER_ID when both are used
+#endif
+
+extern CardList cardList;            // This controller's cards
+extern uint32_t cardListUpdates;     // Blobs applied
+extern uint32_t cardListRejected;    // Blobs refused - forged, foreign, stale or too large
+extern uint32_t cardListApplyUs;     // Verify and apply time of the last blob applied
+
+// Function to load the list from NVS and open the UDP port
+void cardListBegin();
+
+// Function to receive update blobs - call on every loop() pass; never blocks
+void cardListPoll();
+
+// Function to look up a card in the distributed list - room index, or -1 if it is not listed
+// Until the first update arrives (version 0) the list is empty and the compiled cards stay in force
+int cardListRoom(const uint8_t *uid);
+#endif
+
+#endif
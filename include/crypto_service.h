@@ -0,0 +1,50 @@
+// Crypto service - message authentication and encryption for card payloads, signed data and the event journal
+// On the controller the work goes to mbedTLS, which the ESP32 core builds with the SHA and AES peripherals
+// enabled; host builds use the portable software implementations so tools produce identical results.
+// The software versions are compiled on the controller too, for the comparison benchmark.
+#ifndef CRYPTO_SERVICE_H
+#define CRYPTO_SERVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRYPTO_SHA256_SIZE  32  // SHA-256 digest size in bytes
+#define CRYPTO_SHA1_SIZE    20  // SHA-1 digest size in bytes
+#define CRYPTO_AES_KEY_SIZE 16  // AES-128 key size in bytes
+#define CRYPTO_AES_BLOCK    16  // AES block size in bytes
+
+// Function to compute HMAC-SHA256 of data with the given key - hardware on the controller
+void cryptoHmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len,
+                      uint8_t out[CRYPTO_SHA256_SIZE]);
+
+// Function to encrypt or decrypt with AES-128 in counter mode - hardware on the controller
+// The counter block starts at iv and increments per 16 bytes; an iv must never repeat under one key
+void cryptoAesCtr(const uint8_t key[CRYPTO_AES_KEY_SIZE], const uint8_t iv[CRYPTO_AES_BLOCK],
+                  const uint8_t *in, uint8_t *out, size_t len);
+
+// Function to compute SHA-1 - only for protocols that mandate it (the WebSocket handshake), never for security
+void cryptoSha1(const uint8_t *data, size_t len, uint8_t out[CRYPTO_SHA1_SIZE]);
+
+// Software implementations - used on the host and for the hardware comparison benchmark
+void cryptoSoftHmacSha256(const uint8_t *key, size_t keyLen, const uint8_t *data, size_t len,
+                          uint8_t out[CRYPTO_SHA256_SIZE]);
+void cryptoSoftAesCtr(const uint8_t key[CRYPTO_AES_KEY_SIZE], const uint8_t iv[CRYPTO_AES_BLOCK],
+                      const uint8_t *in, uint8_t *out, size_t len);
+void cryptoSoftSha1(const uint8_t *data, size_t len, uint8_t out[CRYPTO_SHA1_SIZE]);
+
+// Function to compare two byte strings in constant time - for checking authentication tags
+bool cryptoEqual(const uint8_t *a, const uint8_t *b, size_t len);
+
+// Function to compute CRC-32 (IEEE 802.3) - catches flash and transfer corruption, not tampering
+uint32_t cryptoCrc32(const uint8_t *data, size_t len);
+
+#ifdef ARDUINO
+#ifndef CRYPTO_BENCHMARK_AT_BOOT
+#define CRYPTO_BENCHMARK_AT_BOOT 0   // Print hardware vs software timings on Serial during setup()
+#endif
+
+// Function to time a card-signature check and a journal record encryption on both paths and print the results
+void cryptoPrintBenchmark();
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+// Display compositor - alerts drawn as an overlay on the title bar, and the panel sent only where a frame changed
+// An alert used to clear the whole screen and hold it for the alert time, so a room switched on or off
+// meanwhile did not show until the alert went, and every denial of a card tapped again and again repainted
+// the whole panel. Now the status screen is always drawn, and an active alert is drawn over its title bar -
+// the room rows below stay live. The same alert posted again while it is showing is not drawn again: its
+// repeat counter goes up and its time starts over.
+//
+// The SSD1306 takes its memory in pages of 8 pixel rows, with a column and page window for each write. A
+// shadow copy holds what the panel shows; each flush compares the frame with it and sends, per page, only
+// the columns from the first changed byte to the last. An alert appearing or expiring sends the overlay
+// rows and nothing else, a repeat sends just its counter.
+//
+// The diff and the alert state are portable C++ so the host simulator measures the same code; the I2C
+// writes are firmware-only.
+#ifndef DISPLAY_COMPOSITOR_H
+#define DISPLAY_COMPOSITOR_H
+
+#include <stdint.h>
+
+#define DISPLAY_MAX_PAGES   8       // 64 rows - the tallest SSD1306
+#define DISPLAY_I2C_CHUNK   31      // Data bytes per I2C write after the control byte - fits every core's Wire buffer
+#define ALERT_TEXT_SIZE     22      // One line of 6-pixel characters across 128 pixels, with its terminator
+#define ALERT_UID_SIZE      10
+
+// Changed columns of one page - first > last when nothing changed
+struct DisplaySpan {
+  uint8_t first, last;
+};
+
+// Alert shown over the title bar
+struct AlertOverlay {
+  bool active;
+  char title[ALERT_TEXT_SIZE];
+  char detail[ALERT_TEXT_SIZE];
+  uint8_t uid[ALERT_UID_SIZE];
+  uint8_t uidSize;
+  uint16_t repeats;                 // Identical alerts folded into this one, itself included
+  uint32_t shownMs;                 // Last posting - the overlay stays the alert time after it
+  uint16_t burstAlerts;             // Alerts posted since the overlay appeared
+  uint16_t burstFrames;             // Frames sent since then, the one taking it down included
+  uint32_t burstBytes;              // Bytes those frames put on the bus
+};
+
+// Function to compare a frame with what the panel shows - fills each page's span and brings shadow up to date.
+// all marks every column, for the first frame when the panel's memory is unknown
+void displayDiff(const uint8_t *frame, uint8_t *shadow, uint8_t width, uint8_t pages, DisplaySpan *spans, bool all);
+
+// Function to count the bytes sending the spans puts on the bus - per changed page one command write for the
+// window, then the data in chunks, each write with its address and control byte
+uint32_t displayBusBytes(const DisplaySpan *spans, uint8_t pages);
+
+// Function to count the bytes of a whole frame sent the same way - what every repaint used to cost
+uint32_t displayFullFrameBytes(uint8_t width, uint8_t pages);
+
+// Function to post an alert - true if it is the one already showing, which only counts another repeat and
+// starts its time over; a different alert replaces it
+bool alertOverlayPost(AlertOverlay *a, const char *title, const char *detail, const uint8_t *uid, uint8_t uidSize,
+                      uint32_t nowMs);
+
+// Function to take the overlay down once durationMs has passed since its last posting - true when it just went
+bool alertOverlayExpire(AlertOverlay *a, uint32_t nowMs, uint32_t durationMs);
+
+// Function to count a frame sent during an alert burst - ignored outside one
+void alertOverlayCountFrame(AlertOverlay *a, uint32_t bytes);
+
+#ifdef ARDUINO
+#include <Adafruit_SSD1306.h>
+#include <Wire.h>
+
+// Display counters
+extern uint32_t displayFrames;      // Flushes that sent anything
+extern uint32_t displayBytes;       // Bytes put on the bus by them
+
+// Function to send what changed in the display's buffer since the last flush - the panel must be at rotation 0.
+// Returns the bytes put on the bus, 0 if nothing changed
+uint32_t displayFlush(Adafruit_SSD1306 *display, TwoWire *wire, uint8_t address);
+#endif
+
+#endif
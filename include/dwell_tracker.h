@@ -0,0 +1,105 @@
+// Staff dwell tracking - pairs entry and exit taps per badge to measure time spent in each room
+// A badge is in at most one room at a time, so the open visit lives in the badge's own entry of a fixed
+// open-addressing table (linear probing on a UID hash): a tap is one lookup whatever the ward size.
+// A tap in another room, or an exit long after the entry, closes the old visit as a missed exit - it
+// is counted but credits no time, so totals never include guessed durations.
+// Totals are rolling: per badge and per room, seconds and visits fall into hourly buckets covering the
+// last DWELL_WINDOW_BUCKETS hours, plus all-time counters. No tap history is stored.
+// Times are seconds from a clock that never steps - on the controller, seconds since boot, not the wall clock.
+#ifndef DWELL_TRACKER_H
+#define DWELL_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef DWELL_TABLE_SIZE
+#define DWELL_TABLE_SIZE     64     // Badge slots - a power of two; keep staff under 3/4 of it for short probes
+#endif
+#define DWELL_UID_SIZE       4      // UID bytes per badge
+#define DWELL_TIMEOUT_S      3600   // A visit open longer than this is closed as a missed exit
+#define DWELL_MIN_VISIT_S    5      // A second tap sooner than this is a duplicate read, not an exit
+#define DWELL_BUCKET_S       3600   // Rolling total bucket width
+#define DWELL_WINDOW_BUCKETS 8      // Buckets in the rolling window - one 8-hour shift
+#define DWELL_NO_ROOM        0xFFFF // Room value of a badge with no open visit
+
+// Rolling seconds and visits over the last DWELL_WINDOW_BUCKETS buckets
+struct DwellWindow {
+  uint32_t bucket;                          // Absolute bucket number (time / DWELL_BUCKET_S) of the newest bucket
+  uint32_t seconds[DWELL_WINDOW_BUCKETS];
+  uint16_t visits[DWELL_WINDOW_BUCKETS];
+};
+
+// Totals for one badge or one room
+struct DwellTotals {
+  DwellWindow window;                       // Rolling totals
+  uint32_t seconds;                         // All-time dwell seconds
+  uint32_t visits;                          // All-time paired visits
+  uint32_t missedExits;                     // Visits closed without an exit tap
+};
+
+// One badge slot
+struct DwellBadge {
+  uint8_t uid[DWELL_UID_SIZE];
+  bool used;
+  uint16_t room;                            // Room of the open visit, or DWELL_NO_ROOM
+  uint32_t enteredAt;                       // Entry time of the open visit
+  DwellTotals totals;
+};
+
+// Pairing engine - rooms are supplied by the caller so a ward and a two-room controller share the code
+struct DwellTracker {
+  DwellBadge badges[DWELL_TABLE_SIZE];
+  DwellTotals *rooms;                       // One entry per room
+  uint16_t roomCount;
+  uint16_t badgeCount;                      // Slots in use
+  uint16_t expireCursor;                    // Next slot the incremental timeout sweep looks at
+  uint32_t openVisits;                      // Visits currently open
+  uint32_t tableFull;                       // Taps refused because no slot was free
+  uint32_t maxProbe;                        // Longest probe sequence seen
+};
+
+// Outcome of a tap
+enum DwellResult {
+  DWELL_ENTERED,      // Visit opened
+  DWELL_EXITED,       // Visit closed and credited
+  DWELL_DUPLICATE,    // Repeat read right after the entry - ignored
+  DWELL_REJECTED      // Table full or room out of range
+};
+
+// Function to start tracking - rooms must hold roomCount zeroed entries
+void dwellInit(DwellTracker *t, DwellTotals *rooms, uint16_t roomCount);
+
+// Function to pair one tap - duration receives the credited seconds on DWELL_EXITED
+DwellResult dwellTap(DwellTracker *t, const uint8_t uid[DWELL_UID_SIZE], uint16_t room, uint32_t now, uint32_t *duration);
+
+// Function to close timed-out visits - looks at a few slots per call so it can run from loop()
+void dwellExpire(DwellTracker *t, uint32_t now, uint16_t slots);
+
+// Function to look up a badge's totals - NULL if the badge has never tapped
+const DwellTotals *dwellBadgeTotals(const DwellTracker *t, const uint8_t uid[DWELL_UID_SIZE]);
+
+// Functions to sum a rolling window up to now
+uint32_t dwellWindowSeconds(const DwellWindow *w, uint32_t now);
+uint32_t dwellWindowVisits(const DwellWindow *w, uint32_t now);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef DWELL_TRACKING_ENABLED
+#define DWELL_TRACKING_ENABLED 0    // Enable from build_flags (-DDWELL_TRACKING_ENABLED=1) - staff badges come from the site config
+#endif
+#ifndef DWELL_READER_ROOM
+#define DWELL_READER_ROOM 0         // Room whose door the local reader serves for staff taps
+#endif
+#define DWELL_REPORT_S 900          // Seconds between rolling-total reports on Serial
+
+extern DwellTracker dwellTracker;   // The controller's tracker
+
+// Function to pair a staff tap at a room's door - duration receives the credited seconds on exit
+DwellResult dwellRecordTap(const uint8_t *uid, uint16_t room, uint32_t *duration);
+
+// Function to close timed-out visits and report totals now and then - call while waiting
+void dwellMaintain();
+#endif
+
+#endif
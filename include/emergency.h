@@ -0,0 +1,93 @@
+// Emergency broadcast - one signed multicast datagram switches every output in the building on at once
+// Commands sent to each controller in turn take hundreds of round trips to reach the last one. Here the
+// host sends one datagram to a multicast group that every controller has joined, so the whole fleet hears
+// it in the same radio frame. Wi-Fi does not acknowledge or retry multicast frames, so the broadcaster
+// repeats the same datagram on a short schedule and a controller that missed the first copy catches a later one.
+//
+// Datagram (little-endian):
+//   'E' 'M' 'R' 'G' | format (1) | scene (1) | site id (2) | seq (4) | tag (16)
+//   tag - HMAC-SHA256 over everything before it with the site key, truncated
+// The broadcaster raises seq with every command. A controller acts only on a seq above the last one it
+// acted on, so repeats of the same command cost a header compare and old commands cannot be replayed.
+//
+// The codec is portable C++ so the host broadcaster and test harness share it; the listener task is firmware-only.
+#ifndef EMERGENCY_H
+#define EMERGENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EMERGENCY_FORMAT    1
+#define EMERGENCY_TAG_SIZE  16
+#define EMERGENCY_SIZE      (12 + EMERGENCY_TAG_SIZE)
+#define EMERGENCY_GROUP     "239.255.42.1"  // Site-local multicast group every controller joins
+#define EMERGENCY_UDP_PORT  4240
+
+// Scenes
+#define EMERGENCY_SCENE_CLEAR  0   // Back to normal - every output follows its room again
+#define EMERGENCY_SCENE_ALL_ON 1   // Evacuation - every output on until cleared
+
+// Receiver state - the last command acted on
+struct EmergencyReceiver {
+  uint16_t site;                   // Site this controller belongs to
+  uint32_t seq;                    // Sequence number of the last command acted on
+  uint8_t scene;                   // Scene in force
+};
+
+// Result of feeding one datagram to a receiver
+enum EmergencyResult {
+  EMERGENCY_ACT,       // New command - scene updated, switch the outputs
+  EMERGENCY_REPEAT,    // Retransmission or replay of a command already acted on
+  EMERGENCY_INVALID    // Bad tag, format, scene or site
+};
+
+// Function to sign and serialize a command - returns EMERGENCY_SIZE
+size_t emergencyEncode(uint8_t buf[EMERGENCY_SIZE], uint16_t site, uint32_t seq, uint8_t scene,
+                       const uint8_t *key, size_t keyLen);
+
+// Function to start a receiver with no command acted on
+void emergencyReceiverInit(EmergencyReceiver *rx, uint16_t site);
+
+// Function to check one datagram and act on it - repeats are recognized before the tag is computed
+EmergencyResult emergencyReceive(EmergencyReceiver *rx, const uint8_t *buf, size_t len, const uint8_t *key, size_t keyLen);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+// The emergency listener is off unless enabled from build_flags (-DEMERGENCY_ENABLED=1)
+#ifndef EMERGENCY_ENABLED
+#define EMERGENCY_ENABLED 0
+#endif
+#ifndef EMERGENCY_SITE_KEY
+#define EMERGENCY_SITE_KEY "change-this-emergency-key"  // HMAC key shared by the broadcaster and every controller
+#endif
+#ifndef EMERGENCY_SITE_ID
+#define EMERGENCY_SITE_ID 1          // Building id - the same key may serve several buildings on one network
+#endif
+#define EMERGENCY_TASK_PRIORITY 10   // Above loop() so a command preempts it, below the Wi-Fi and TCP/IP tasks
+#define EMERGENCY_REASSERT_MS   20   // While a scene holds, outputs are driven again this often
+
+// Scene changes reported to loop() - the listener task has already switched the outputs
+enum EmergencyEvent {
+  EMERGENCY_EVENT_NONE,
+  EMERGENCY_EVENT_STARTED,   // Outputs forced on
+  EMERGENCY_EVENT_CLEARED    // Outputs released - the caller drives them from the room state again
+};
+
+extern uint32_t emergencyCommands;   // Commands acted on
+extern uint32_t emergencyRepeats;    // Retransmissions ignored
+extern uint32_t emergencyRejected;   // Datagrams refused - forged, damaged or for another site
+extern uint32_t emergencySwitchUs;   // Datagram received to last output switched, for the last command
+
+// Function to start the listener task - relay pins must already be outputs; a scene in force before a
+// restart is resumed at once
+void emergencyBegin(const uint8_t *pins, uint8_t count);
+
+// Function to check whether a scene is holding the outputs - loop() leaves them alone meanwhile
+bool emergencyActive();
+
+// Function to collect a scene change and save it - call on every loop() pass
+EmergencyEvent emergencyPoll();
+#endif
+
+#endif
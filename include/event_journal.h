@@ -0,0 +1,201 @@
+// Event journal - persistent, append-only record of every tap decision
+// Records are fixed 32-byte slots in a ring of flash sectors. The sequence number stays in clear
+// so the head can be found after a reboot; the rest of the record can be encrypted at rest with
+// AES-128-CTR (counter block derived from the sequence number) and carries a CRC-32 of the plaintext.
+// The ring logic is plain C++ over a small storage interface so host tools can run it on RAM.
+//
+// Record layout: seq (4) | time (4) | type (1) | room (1) | UID (4) | reserved (14) | CRC-32 (4)
+//
+// The last two slots of each sector hold a summary written when the sector fills: time range, a room
+// bitmask and a Bloom filter of UIDs. Queries read one summary per sector and decode records only in
+// sectors that can match. Summary layout, encrypted after the first 8 bytes like a record:
+//   'J' 'S' 'U' 'M' | first seq (4) | min time (4) | max time (4) | events (1) | reserved (3) |
+//   room mask (8, bit room % 64) | UID Bloom filter (32) | CRC-32 (4)
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JOURNAL_RECORD_SIZE  32                                        // Bytes per record slot
+#define JOURNAL_SECTOR_SIZE  4096                                      // Flash erase unit
+#define JOURNAL_SLOTS_PER_SECTOR (JOURNAL_SECTOR_SIZE / JOURNAL_RECORD_SIZE)
+#define JOURNAL_SUMMARY_SIZE 64                                        // Sector summary - occupies the last two slots
+#define JOURNAL_EVENTS_PER_SECTOR (JOURNAL_SLOTS_PER_SECTOR - JOURNAL_SUMMARY_SIZE / JOURNAL_RECORD_SIZE)
+#define JOURNAL_BLOOM_BYTES  32                                        // UID Bloom filter per sector - 256 bits
+#define JOURNAL_UID_SIZE     4                                         // UID bytes stored per event
+#define JOURNAL_NO_ROOM      0xFF                                      // Room value for events without a room
+#define JOURNAL_EMPTY_SEQ    0xFFFFFFFF                                // Sequence number of an erased slot
+#define JOURNAL_COMMAND_MAX  64                                        // Longest audit command line kept
+
+// Event types
+#define JOURNAL_BOOT            1  // Controller started
+#define JOURNAL_CHECK_IN        2  // Room assigned to a card
+#define JOURNAL_CHECK_OUT       3  // Owner left the room
+#define JOURNAL_DENIED_UNKNOWN  4  // Card not authorized for any room
+#define JOURNAL_DENIED_OCCUPIED 5  // Card's room already taken
+#define JOURNAL_DENIED_REVOKED  6  // Card on the revocation list
+#define JOURNAL_STAFF_IN        7  // Staff badge entered the reader's room
+#define JOURNAL_STAFF_OUT       8  // Staff badge left the reader's room
+#define JOURNAL_REMOTE_ON       9  // Room switched on by the building-management system
+#define JOURNAL_REMOTE_OFF     10  // Room switched off by the building-management system
+#define JOURNAL_VACANT         11  // Room switched off by its occupancy sensors as empty
+#define JOURNAL_DENIED_WRONG_DOOR 12  // Card tapped at a door that does not serve its room
+
+// One decoded event
+struct JournalEvent {
+  uint32_t seq;                       // Sequence number - assigned by journalAppend()
+  uint32_t time;                      // Seconds - wall clock once set, otherwise since boot
+  uint8_t type;                       // One of the JOURNAL_ event types
+  uint8_t room;                       // Room index or JOURNAL_NO_ROOM
+  uint8_t uid[JOURNAL_UID_SIZE];      // Card UID, zero when not applicable
+};
+
+// Index summary of one sector - kept in RAM for the sector being written
+struct JournalSummary {
+  uint32_t firstSeq;                  // Sequence number of the sector's first event
+  uint32_t minTime;                   // Earliest event time in the sector
+  uint32_t maxTime;                   // Latest event time in the sector
+  uint8_t count;                      // Events in the sector
+  uint8_t roomMask[8];                // Bit room % 64 set for every room seen
+  uint8_t uidBloom[JOURNAL_BLOOM_BYTES];  // Three bits per UID seen
+};
+
+// Audit query - every condition must match
+struct JournalQuery {
+  uint32_t fromTime;                  // Earliest event time, inclusive
+  uint32_t toTime;                    // Latest event time, inclusive
+  uint8_t room;                       // Room index, or JOURNAL_NO_ROOM for any room
+  bool matchUid;                      // True to only return events for uid
+  uint8_t uid[JOURNAL_UID_SIZE];
+};
+
+// Work done by a query - shows how much of the journal the summaries ruled out
+struct JournalQueryStats {
+  uint32_t sectorsSkipped;            // Sectors ruled out by their summary
+  uint32_t sectorsScanned;            // Sectors whose records were decoded
+  uint32_t recordsRead;               // Records decoded
+};
+
+// Called for each matching event, oldest first - return false to stop the query
+typedef bool (*JournalVisitor)(const JournalEvent *event, void *ctx);
+
+// Position of a query run a few records at a time - events written after the start are left out.
+// The sequence number keeps the answer right if the head laps the cursor: the walk starts over
+// from the oldest sector and skips everything already visited.
+struct JournalCursor {
+  uint32_t slot;                      // Next slot to look at
+  uint32_t sectorSeq;                 // First sequence number of that slot's sector when the cursor entered it
+  uint32_t sectorsLeft;               // Sectors still to walk, the cursor's one included
+  uint32_t lastSeq;                   // Newest event visited or ruled out, JOURNAL_EMPTY_SEQ before the first
+  uint32_t endSeq;                    // First sequence number written after the query started
+  uint32_t matches;                   // Matching events visited so far
+  bool done;                          // True once every event before endSeq has been seen
+  JournalQueryStats stats;            // Work done so far
+};
+
+// Flash-like storage - erase sets a sector to 0xFF, writes only go to erased bytes
+struct JournalStorage {
+  uint32_t size;                                                  // Bytes available, a multiple of the sector size
+  bool (*read)(uint32_t offset, void *buf, size_t len);
+  bool (*write)(uint32_t offset, const void *buf, size_t len);
+  bool (*erase)(uint32_t offset);                                 // Erase the sector at offset
+};
+
+// Journal state
+struct Journal {
+  const JournalStorage *storage;      // Backing storage
+  uint32_t sectorCount;               // Sectors in the ring
+  uint32_t head;                      // Slot index the next record goes to
+  uint32_t nextSeq;                   // Sequence number of the next record
+  uint32_t erasedSector;              // Sector already erased ahead of the head, or JOURNAL_EMPTY_SEQ
+  bool encrypt;                       // True to encrypt records at rest
+  uint8_t key[16];                    // AES-128 key when encrypting
+  JournalSummary open;                // Summary of the sector being written - sealed into flash when it fills
+};
+
+// Function to open a journal - finds the head after a reboot; key is NULL for plaintext records
+bool journalOpen(Journal *j, const JournalStorage *storage, const uint8_t *key);
+
+// Function to serialize an event into a record - assigns the next sequence number and encrypts if enabled
+void journalEncode(Journal *j, JournalEvent *event, uint8_t record[JOURNAL_RECORD_SIZE]);
+
+// Function to write an encoded record at the head - erases the next sector if idle work has not
+// The event is the one passed to journalEncode(); it feeds the sector summary
+bool journalWrite(Journal *j, const JournalEvent *event, const uint8_t record[JOURNAL_RECORD_SIZE]);
+
+// Function to encode and write an event in one step
+bool journalAppend(Journal *j, JournalEvent *event);
+
+// Function to read and decode the record in a slot - returns false for empty or damaged slots
+bool journalRead(const Journal *j, uint32_t slot, JournalEvent *event);
+
+// Function to do idle work - seals a full sector and erases the next so appends never wait for either
+void journalPrepare(Journal *j);
+
+// Function to count the slots in the ring, summary slots included
+uint32_t journalSlots(const Journal *j);
+
+// Function to run an audit query oldest to newest - returns the number of matching events visited
+uint32_t journalQuery(const Journal *j, const JournalQuery *q, JournalVisitor visit, void *ctx, JournalQueryStats *stats);
+
+// Function to start a query that is run in steps - it covers the events written so far
+void journalQueryStart(const Journal *j, JournalCursor *c);
+
+// Function to run a query for at most budget sector summaries and records - returns true once it is done
+// A visitor returning false pauses the query after that event; the next step carries on from there
+bool journalQueryStep(const Journal *j, const JournalQuery *q, JournalCursor *c, uint32_t budget, JournalVisitor visit,
+                      void *ctx);
+
+// Function to parse an audit command - false if the line is not one
+//   audit [room N] [uid XXXXXXXX] [from T] [to T]
+// Rooms are numbered from 1 as on the display, the UID is hex as printed, times are seconds as recorded;
+// anything left out matches every event
+bool journalParseQuery(const char *line, JournalQuery *q);
+
+#ifdef ARDUINO
+// Firmware side - journal in the data partition named below
+#include <Arduino.h>
+
+#ifndef JOURNAL_ENABLED
+#define JOURNAL_ENABLED 0                 // Enable from build_flags (-DJOURNAL_ENABLED=1)
+#endif
+#ifndef JOURNAL_PARTITION_LABEL
+#define JOURNAL_PARTITION_LABEL "spiffs"  // Default partition table's SPIFFS partition, used raw
+#endif
+#ifndef JOURNAL_ENCRYPT
+#define JOURNAL_ENCRYPT 1                 // Encrypt records at rest with JOURNAL_KEY
+#endif
+#ifndef JOURNAL_AUDIT_BUDGET
+#define JOURNAL_AUDIT_BUDGET 16           // Summaries and records an audit reads per background call
+#endif
+#ifndef JOURNAL_KEY
+#define JOURNAL_KEY {0x6a, 0x6f, 0x75, 0x72, 0x6e, 0x61, 0x6c, 0x2d, 0x6b, 0x65, 0x79, 0x2d, 0x30, 0x30, 0x30, 0x31}
+#endif
+
+extern Journal eventJournal;              // The controller's journal
+extern uint32_t journalLastEncodeUs;      // Time to build and encrypt the last record
+extern uint32_t journalLastWriteUs;       // Time to write the last record to flash
+
+// Function to open the journal partition and log a boot event
+void journalBegin();
+
+// Function to log one tap decision - room < 0 and uid NULL when not applicable
+void journalRecord(uint8_t type, int room, const uint8_t *uid);
+
+// Function to do idle journal work - call while waiting
+void journalMaintain();
+
+// Function to start printing the events matching an audit query to Serial - replaces an audit in progress
+void journalAudit(const JournalQuery *q);
+
+// Function to carry on with the audit in progress - call while waiting
+// Each call reads at most JOURNAL_AUDIT_BUDGET summaries and records and prints at most one match, and only
+// when the Serial transmit buffer has room for it, so a query over the whole journal never holds up a tap
+void journalAuditPoll();
+
+// Function to take one Serial byte of a command line - starts the audit once a complete "audit" line is in
+void journalCommandByte(uint8_t c);
+#endif
+
+#endif
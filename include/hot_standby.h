@@ -0,0 +1,151 @@
+// Hot-standby controller pair - optional redundant mode where two controllers share relays and readers
+// The active controller streams room deltas to its partner over UDP; the standby takes over when heartbeats stop
+// A hardware supervisor routes the shared relay and reader lines to whichever controller asserts HS_SUPERVISOR_PIN
+//
+// Heartbeat silence alone cannot tell a dead partner from a controller that is itself cut off. A standby
+// therefore only takes over when it can show the partner is not driving the lines: with the partner's
+// supervisor output wired back to an input (HS_PEER_CLAIM_PIN), that line must be low; without the wire, its
+// own Wi-Fi link must be up. If both controllers ever claim the lines, the wire makes the non-preferred one let go.
+// Without the wire, an active controller that loses only its own link keeps the lines while its partner takes
+// over, until the network is back and the higher term wins - fit the wire where that matters.
+//
+// Packets (little-endian):
+//   'H' 'S' | flags (1) | reserved (1) | term (4) | counter (4) | state-sync message | tag (16)
+//   counter - packets sent by this controller since boot; it only goes up
+//   tag - HMAC-SHA256 over everything before it with the site key, truncated
+// Packets from any address but the partner's, or without a valid tag, are dropped before they are read.
+// The tag does not show a packet is fresh, so a recorded heartbeat could otherwise hold a standby back
+// for ever: packets from an active partner are only taken with a term no lower than the last one heard,
+// and within that term a counter above the last one heard. Snapshot requests from a standby are not checked -
+// a replayed one only costs a snapshot. After a reboot the first active packet heard sets the baseline.
+// Packets carrying this controller's own preferred flag are its own, reflected back, and are dropped too.
+//
+// The role and replication logic is portable C++ so the host simulator runs two controllers over loopback;
+// the socket and pins are firmware-only.
+#ifndef HOT_STANDBY_H
+#define HOT_STANDBY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "state_sync.h"
+
+#define HS_HEADER_SIZE   12
+#define HS_TAG_SIZE      16      // Truncated HMAC bytes
+#define HS_MAX_PACKET    (HS_HEADER_SIZE + SYNC_MAX_MESSAGE + HS_TAG_SIZE)
+#define HS_LINK_ID       0       // Controller id used inside replication messages
+
+#define HS_FLAG_ACTIVE    0x01   // Sender currently drives the relays
+#define HS_FLAG_PREFERRED 0x02   // Sender is the preferred primary
+
+// Timing - failover must stay longer than the worst loop() stall between hotStandbyPoll() calls
+#define HS_HEARTBEAT_MS     50   // Interval between heartbeats from the active controller
+#define HS_FAILOVER_MS      300  // Heartbeat silence after which the standby takes over
+#define HS_STANDBY_GRACE_MS 150  // Extra wait for the non-preferred controller so the preferred one wins ties
+#define HS_SNAPSHOT_RETRY_MS 100 // Minimum interval between snapshot requests from the standby
+
+// Events returned by a poll - the caller claims or releases relays and reader on a role change
+enum HotStandbyEvent {
+  HS_EVENT_NONE,      // No role change
+  HS_EVENT_PROMOTED,  // This controller just became active
+  HS_EVENT_DEMOTED    // This controller just handed control back to its partner
+};
+
+// What the partner's supervisor output shows
+enum HsPeerClaim {
+  HS_CLAIM_UNWIRED,   // No wire - only the network can tell
+  HS_CLAIM_RELEASED,  // Partner is not driving the shared lines
+  HS_CLAIM_HELD       // Partner is driving them
+};
+
+// Replication state of one controller
+struct HsNode {
+  bool preferred;                   // Wins when both controllers take over at once
+  bool active;                      // Drives the relays and reader
+  bool applied;                     // The last packet changed rx - its changed rooms go into the room table
+  bool linkWasUp;                   // Link state at the last tick - the partner gets a new window when it comes up
+  uint32_t term;                    // Takeover generation - the higher term wins if both controllers are active
+  uint32_t lastSentSeq;             // Room sequence number covered by the last delta sent
+  uint32_t peerSeq;                 // Latest sequence number advertised by the partner
+  uint32_t lastPeerHeard;           // When the last packet from an active partner arrived
+  uint32_t lastHeartbeat;           // When this controller last sent a heartbeat
+  uint32_t lastSnapshotReq;         // When this standby last asked for a snapshot
+  uint32_t txCount;                 // Packets sent since boot - the counter in every packet
+  uint32_t peerTerm;                // Term of the last packet taken from an active partner
+  uint32_t peerCount;               // Its counter - anything not above it in the same term is a replay
+  SyncReceiver rx;                  // Partner's state as seen by this standby - detects missed deltas
+
+  // Failover and replication metrics - readable over Serial for commissioning
+  uint32_t lastFailoverMs;          // Heartbeat silence before the last takeover, in milliseconds
+  uint32_t failoverSeqLag;          // Partner sequence minus applied sequence at takeover - 0 means no divergence
+  uint32_t deltasSent;              // Delta packets sent while active
+  uint32_t deltasApplied;           // Delta packets applied while standby
+  uint32_t gapsDetected;            // Missed deltas detected while standby
+  uint32_t snapshotsSent;           // Full snapshots sent in reply to gap requests
+  uint32_t rejected;                // Packets dropped for a bad tag
+  uint32_t replayed;                // Tagged packets dropped as stale or reflected - an older term, a counter
+                                    // already seen, or our own packet sent back
+};
+
+// How a controller reaches its partner, and what it replicates
+struct HsPort {
+  void (*send)(void *ctx, const uint8_t *pkt, size_t len);  // Sends one packet to the partner
+  void *ctx;
+  const uint8_t *key;               // Site key packets are signed with
+  size_t keyLen;
+  SyncRoomView rooms;               // Room table sent while active
+  const uint32_t *roomSeq;          // Its sequence number
+};
+
+// Function to start a controller in standby - the partner gets a full failover window from nowMs
+void hsInit(HsNode *n, bool preferred, uint32_t nowMs);
+
+// Function to handle one packet from the partner's address - returns a role change if the partner outranks
+// this controller. n->applied says whether rx changed
+HotStandbyEvent hsReceive(HsNode *n, const HsPort *port, const uint8_t *pkt, size_t len, uint32_t nowMs);
+
+// Function to stream changes and heartbeats while active, or take over once the partner is silent and shown
+// not to drive the lines. changedMask lists the rooms changed since n->lastSentSeq
+HotStandbyEvent hsTick(HsNode *n, const HsPort *port, uint32_t changedMask, uint32_t nowMs, bool linkUp,
+                       HsPeerClaim peerClaim);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+// Redundant mode is off unless enabled from build_flags (-DHOT_STANDBY_ENABLED=1)
+#ifndef HOT_STANDBY_ENABLED
+#define HOT_STANDBY_ENABLED 0
+#endif
+
+// Set to 1 on the board that should win when both boot together, 0 on its partner
+#ifndef HS_PREFERRED_PRIMARY
+#define HS_PREFERRED_PRIMARY 1
+#endif
+
+// Network settings - the partner controller's address; Wi-Fi is joined in setup()
+#ifndef HS_PEER_ADDRESS
+#define HS_PEER_ADDRESS "192.168.1.51"   // IP address of the partner controller
+#endif
+#define HS_UDP_PORT 4210                 // UDP port used by both controllers for replication traffic
+#ifndef HS_SITE_KEY
+#define HS_SITE_KEY "change-this-standby-key"  // HMAC key shared by both controllers of the pair
+#endif
+
+#define HS_SUPERVISOR_PIN 1      // Output to the supervisor - HIGH while this controller drives relays and reader
+#ifndef HS_PEER_CLAIM_PIN
+#define HS_PEER_CLAIM_PIN -1     // Input wired to the partner's HS_SUPERVISOR_PIN - -1 if not fitted
+#endif
+
+// Replication state and metrics
+extern HsNode hsNode;
+
+// Function to start replication - opens the UDP port and starts in standby
+void hotStandbyBegin();
+
+// Function to service replication - call on every loop() pass and while waiting
+HotStandbyEvent hotStandbyPoll();
+
+// Function to check whether this controller currently drives the relays and reader
+bool hotStandbyIsActive();
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+// Modbus slave - exposes the room state table to building-management systems over Modbus TCP or RTU
+// The map points straight at the room state arrays: a read walks the arrays into the response frame,
+// with no snapshot copy and no text formatting in between. Coil writes go to a callback that switches
+// rooms through the same path as a card tap, so state sync, the journal and the display all follow.
+//
+// Map (addresses 0-based, room r = room r+1):
+//   coils             r               relay on (read/write)             - relayOn[]
+//   discrete inputs   r               room has an owner card            - relayHasOwner[]
+//   input/holding     2r, 2r+1        owner UID, card byte order        - relayOwner[]     (read only)
+//   registers         100+2r, +1      room version, high word first     - roomVersion[]
+//                     200, 201        room state sequence number        - roomStateSeq
+//
+// The PDU handler is portable C++ so the host benchmark shares it; the TCP and RTU servers are firmware-only.
+#ifndef MODBUS_SLAVE_H
+#define MODBUS_SLAVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Function codes served
+#define MODBUS_READ_COILS          0x01
+#define MODBUS_READ_DISCRETE       0x02
+#define MODBUS_READ_HOLDING        0x03
+#define MODBUS_READ_INPUT          0x04
+#define MODBUS_WRITE_COIL          0x05
+#define MODBUS_WRITE_COILS         0x0F
+
+// Exception codes
+#define MODBUS_EX_FUNCTION         0x01  // Function code not served
+#define MODBUS_EX_ADDRESS          0x02  // Address range outside the map
+#define MODBUS_EX_VALUE            0x03  // Malformed request
+#define MODBUS_EX_DEVICE           0x04  // Write refused by the room command path
+
+#define MODBUS_MAX_PDU             253   // Largest PDU in either framing
+#define MODBUS_MAX_READ_BITS       2000  // Largest coil/discrete read, from the specification
+#define MODBUS_MAX_READ_REGS       125   // Largest register read, from the specification
+#define MODBUS_MBAP_SIZE           7     // TCP header: transaction (2) | protocol (2) | length (2) | unit (1)
+#define MODBUS_TCP_MAX_ADU         (MODBUS_MBAP_SIZE + MODBUS_MAX_PDU)
+#define MODBUS_RTU_MAX_ADU         (1 + MODBUS_MAX_PDU + 2)
+
+// How a register region is stored in memory
+enum ModbusRegionKind {
+  MODBUS_BYTES,   // Byte array - two bytes per register, in memory order
+  MODBUS_U32      // uint32_t array - two registers per value, high word first
+};
+
+// A run of registers served from one array
+struct ModbusRegion {
+  uint16_t start;     // First register address
+  uint16_t count;     // Registers in the region
+  uint8_t kind;       // ModbusRegionKind
+  const void *data;
+};
+
+// The map - arrays are read at request time, so it never goes stale
+struct ModbusMap {
+  const bool *coils;                 // Coil values
+  uint16_t coilCount;
+  const bool *discretes;             // Discrete input values
+  uint16_t discreteCount;
+  const ModbusRegion *regions;       // Register regions in ascending address order, served to FC3 and FC4
+  uint8_t regionCount;
+  bool (*writeCoil)(uint16_t address, bool on);  // Command path for coil writes - false refuses the write
+};
+
+// Function to compute the RTU frame CRC (CRC-16/MODBUS: reflected polynomial 0xA001, initial value 0xFFFF)
+uint16_t modbusCrc16(const uint8_t *data, size_t len);
+
+// Function to answer one request PDU - returns the response PDU length (an exception response on error)
+size_t modbusHandlePdu(const ModbusMap *map, const uint8_t *req, size_t len, uint8_t *resp, size_t cap);
+
+// Function to answer one Modbus TCP ADU - returns the response length, 0 if the header is malformed
+size_t modbusHandleTcp(const ModbusMap *map, const uint8_t *adu, size_t len, uint8_t *resp, size_t cap);
+
+// Function to find the length of the Modbus TCP ADU at the start of a stream - 0 until the header is in,
+// more than MODBUS_TCP_MAX_ADU if the header is malformed and the connection should be dropped
+size_t modbusTcpLength(const uint8_t *buf, size_t len);
+
+// Function to answer one Modbus RTU frame for the given unit - returns the response length,
+// 0 for frames that are damaged, for another unit, or broadcast (acted on but never answered)
+size_t modbusHandleRtu(const ModbusMap *map, uint8_t unit, const uint8_t *frame, size_t len, uint8_t *resp, size_t cap);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef MODBUS_ENABLED
+#define MODBUS_ENABLED 0           // Enable from build_flags (-DMODBUS_ENABLED=1)
+#endif
+#ifndef MODBUS_TCP
+#define MODBUS_TCP 1               // Serve Modbus TCP on the Wi-Fi link
+#endif
+#ifndef MODBUS_TCP_PORT
+#define MODBUS_TCP_PORT 502
+#endif
+#define MODBUS_TCP_CLIENTS 2       // Connections served at once - a BMS head end and a commissioning laptop
+#ifndef MODBUS_RTU
+#define MODBUS_RTU 0               // Serve Modbus RTU on Serial1 through an RS-485 transceiver
+#endif
+#ifndef MODBUS_UNIT_ID
+#define MODBUS_UNIT_ID 1           // RTU slave address - TCP accepts any unit id
+#endif
+#ifndef MODBUS_RTU_BAUD
+#define MODBUS_RTU_BAUD 19200
+#endif
+#ifndef MODBUS_RTU_RX_PIN
+#define MODBUS_RTU_RX_PIN 9        // Same wiring as the OSDP bus - the two cannot share the UART
+#endif
+#ifndef MODBUS_RTU_TX_PIN
+#define MODBUS_RTU_TX_PIN 1
+#endif
+
+// Request counters
+extern uint32_t modbusRequests;    // Requests answered
+extern uint32_t modbusExceptions;  // Of those, answered with an exception
+extern uint32_t modbusMaxUs;       // Longest time from a complete request to its response being written
+
+// Function to start the servers - roomCommand switches a room the way a card tap would; call after wifiManagerBegin()
+void modbusBegin(bool (*roomCommand)(uint16_t room, bool on));
+
+// Function to serve pending requests - call while waiting
+void modbusPoll();
+#endif
+
+#endif
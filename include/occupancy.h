@@ -0,0 +1,129 @@
+// Occupancy sensing - PIR motion and door-contact inputs per room, so an empty room is switched off
+// without waiting for the owner to tap out
+// Inputs are never polled. A GPIO interrupt on either edge only timestamps the input and arms a one-shot
+// hardware timer; when the timer fires, every input that has been quiet for the debounce time is read
+// once and, if its level really changed, queued as one event. A bouncing door contact therefore costs a
+// few short interrupts and yields a single event, and an idle room costs nothing at all.
+//
+// Vacancy rules, evaluated only for rooms that are on:
+//   door contact and PIR   motion after the door closed means someone is inside - the room stays on,
+//                          however still they are, until the door opens again. A door that closes with
+//                          no motion within OCC_CLOSE_GRACE_MS means whoever closed it left.
+//   door open, or PIR only no motion for OCC_IDLE_MS
+//   door contact only      never - a closed door alone says nothing about who is behind it
+//
+// The debouncer and the room rules are portable C++ so the host simulator drives them with simulated edges;
+// the interrupt and timer wiring is firmware-only.
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OCC_MAX_INPUTS     32       // Inputs per debouncer - one bit each in the masks
+#define OCC_QUEUE_SIZE     32       // Debounced events waiting for the main loop - a power of two
+#define OCC_DEBOUNCE_US    20000    // Quiet time before an input is read - reed contacts bounce for a few ms
+#ifndef OCC_CLOSE_GRACE_MS
+#define OCC_CLOSE_GRACE_MS 120000   // Motion expected this soon after the door closes on someone inside
+#endif
+#ifndef OCC_IDLE_MS
+#define OCC_IDLE_MS        1800000  // No motion this long with the door open, or without a door contact
+#endif
+
+// Input kinds - input n of a room set is room n / 2, kind n % 2
+enum OccupancyKind {
+  OCC_PIR,    // Motion sensor - active while it sees motion
+  OCC_DOOR    // Door contact - active while the door is open
+};
+
+// One debounced change of an input
+struct OccupancyEvent {
+  uint8_t input;
+  bool active;
+  uint32_t edgeUs;      // First edge of the burst that led to it
+  uint32_t settledUs;   // When the timer read the settled level
+};
+
+// Debounce state - written by the edge and timer interrupts, events read by the main loop
+struct OccupancyDebouncer {
+  uint8_t inputs;
+  uint32_t debounceUs;
+  volatile uint32_t pendingMask;          // Inputs with an edge not yet settled
+  volatile uint32_t levelMask;            // Last reported level per input
+  volatile bool timerArmed;
+  volatile uint32_t firstEdgeUs[OCC_MAX_INPUTS];
+  volatile uint32_t lastEdgeUs[OCC_MAX_INPUTS];
+  OccupancyEvent queue[OCC_QUEUE_SIZE];
+  volatile uint8_t head, tail;            // Single producer (timer interrupt), single consumer (loop)
+  volatile uint32_t edges;                // Edge interrupts taken
+  volatile uint32_t timerFires;           // Timer interrupts taken
+  volatile uint32_t glitches;             // Bursts that settled back at the level already reported
+  volatile uint32_t dropped;              // Events lost to a full queue
+};
+
+// Vacancy state of one room
+struct OccupancyRoom {
+  bool pirFitted, doorFitted;
+  bool motion;            // PIR active now
+  bool doorOpen;
+  bool latched;           // Motion seen since the door last closed - occupied until it opens
+  uint32_t lastMotionMs;
+  uint32_t closedMs;      // When the door last closed
+};
+
+// Function to set up a debouncer - initial is each input's level at start, bit n for input n
+void occupancyInit(OccupancyDebouncer *d, uint8_t inputs, uint32_t debounceUs, uint32_t initial);
+
+// Function to note an edge on an input - interrupt context; returns true if the timer must be armed
+// for debounceUs, false if it is already running
+bool occupancyEdge(OccupancyDebouncer *d, uint8_t input, uint32_t nowUs);
+
+// Function to settle the inputs that have been quiet for the debounce time - timer interrupt context
+// level(input) reads an input's current level. Returns microseconds until the next input is due,
+// to re-arm the timer with, or 0 when nothing is pending
+uint32_t occupancySettle(OccupancyDebouncer *d, uint32_t nowUs, bool (*level)(uint8_t input));
+
+// Function to take the oldest debounced event - main loop; false if there is none
+bool occupancyNextEvent(OccupancyDebouncer *d, OccupancyEvent *ev);
+
+// Function to start a room's vacancy timing afresh - call when the room is switched on
+void occupancyRoomOn(OccupancyRoom *room, uint32_t nowMs);
+
+// Function to apply one debounced event to its room
+void occupancyApply(OccupancyRoom *room, uint8_t kind, bool active, uint32_t nowMs);
+
+// Function to check whether an occupied room has been left - false with *nextCheckMs set to the milliseconds
+// until the answer could change on its own (0 if only an input event can change it)
+bool occupancyVacant(const OccupancyRoom *room, uint32_t nowMs, uint32_t *nextCheckMs);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef OCCUPANCY_ENABLED
+#define OCCUPANCY_ENABLED 0         // Enable from build_flags (-DOCCUPANCY_ENABLED=1)
+#endif
+// Input pins per room, -1 where a sensor is not fitted - e.g. -DOCC_PIR_PINS="{20,21}". The ESP32-C3 has
+// few spare GPIOs once the reader, display and relays are wired, so there are no defaults
+#ifndef OCC_PIR_PINS
+#define OCC_PIR_PINS  {-1, -1}      // PIR output, active high
+#endif
+#ifndef OCC_DOOR_PINS
+#define OCC_DOOR_PINS {-1, -1}      // Reed contact to ground, pulled up - high while the door is open
+#endif
+#define OCC_TIMER      0            // Hardware timer used for debounce
+#define OCC_REPORT_MS  60000        // Interrupt rate and latency on Serial this often
+
+// Sensor counters
+extern uint32_t occupancyEvents;        // Debounced events handled
+extern uint32_t occupancyVacated;       // Rooms switched off as empty
+extern uint32_t occupancyLatencyMaxUs;  // Longest time from an input's first edge to its event being acted on
+
+// Function to attach the input interrupts and the debounce timer
+void occupancyBegin();
+
+// Function to act on debounced events and vacancy timeouts - vacate(room) switches an empty room off;
+// call from the main loop. Costs one queue check and one time comparison while nothing is happening
+void occupancyPoll(void (*vacate)(uint8_t room));
+#endif
+
+#endif
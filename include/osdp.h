@@ -0,0 +1,191 @@
+// OSDP control panel - polls remote card readers on an RS-485 bus so one controller can serve many doors
+// The bus is half duplex: one command out, one reply back, one reader at a time. osdpService() runs that
+// exchange as a non-blocking state machine, picks the next reader by due time and adapts each reader's
+// poll interval to its activity - a door that just read a card is polled fast, a quiet one backs off.
+// Commands (LED, buzzer) wait in a small per-reader queue and go out in place of that reader's next poll.
+// Card reads are queued for the main loop, which puts them through the same checks as the local reader.
+// Bus statistics: line utilization, and per door the longest gap between polls and the reply-to-decision time.
+//
+// Frame: SOM 0x53 | address (1, bit 7 set in replies) | length (2, whole frame) | control (1) | code (1) |
+//        data | CRC-16 (2, CRC-16/AUG-CCITT)
+// Control: bits 0-1 sequence number (0 resets the reader, then 1, 2, 3, 1, ...), bit 2 set for CRC-16.
+// Secure channel is not implemented - the bus has to be physically protected.
+//
+// The protocol and scheduler are portable C++ so the host simulator shares them; the UART glue is firmware-only.
+#ifndef OSDP_H
+#define OSDP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define OSDP_SOM            0x53
+#define OSDP_REPLY_FLAG     0x80    // Set in the address byte of replies
+#define OSDP_CTRL_CRC       0x04    // Control bit: frame ends in a CRC-16
+#define OSDP_HEADER_SIZE    6       // SOM through command/reply code
+#define OSDP_MAX_DATA       32      // Largest data block sent or accepted
+#define OSDP_MAX_FRAME      (OSDP_HEADER_SIZE + OSDP_MAX_DATA + 2)
+
+// Commands
+#define OSDP_CMD_POLL       0x60
+#define OSDP_CMD_ID         0x61
+#define OSDP_CMD_LED        0x69
+#define OSDP_CMD_BUZ        0x6A
+
+// Replies
+#define OSDP_REPLY_ACK      0x40
+#define OSDP_REPLY_NAK      0x41
+#define OSDP_REPLY_RAW      0x50    // Card data: reader (1) | format (1) | bit count (2) | data
+#define OSDP_REPLY_BUSY     0x79
+
+#define OSDP_MAX_READERS       32   // Readers on one bus, addresses 0..31
+#define OSDP_QUEUE_DEPTH       4    // Commands waiting per reader
+#define OSDP_CARD_QUEUE        8    // Card reads waiting for the main loop
+#define OSDP_UID_SIZE          4    // Card bytes passed on - 32-bit CSN readers
+#define OSDP_REPLY_TIMEOUT_MS  200  // Reply deadline from the OSDP specification
+#define OSDP_OFFLINE_RETRIES   3    // Missed replies before a reader is marked offline
+#define OSDP_OFFLINE_RETRY_MS  1000 // How often an offline reader is tried again
+#define OSDP_POLL_FAST_MS      10   // Poll interval of a reader that has just been used
+#define OSDP_POLL_IDLE_MS      200  // Poll interval of a quiet reader
+#define OSDP_HEAT_MAX          1024 // Activity score - set on a card read, loses 1/8 per second (half-life about 5 s)
+#define OSDP_HEAT_STEP_MS      1000
+
+// A parsed frame
+struct OsdpFrame {
+  uint8_t addr;                     // Address without the reply flag
+  bool reply;
+  uint8_t seq;
+  uint8_t code;
+  uint8_t len;                      // Data bytes
+  uint8_t data[OSDP_MAX_DATA];
+};
+
+// Serial port - both calls must return at once
+struct OsdpPort {
+  size_t (*write)(const uint8_t *buf, size_t len);
+  size_t (*read)(uint8_t *buf, size_t cap);  // Bytes available now, possibly none
+};
+
+// One queued command
+struct OsdpCommand {
+  uint8_t code;
+  uint8_t len;
+  uint8_t data[16];
+};
+
+// One card read waiting for a decision
+struct OsdpCardRead {
+  uint8_t reader;                   // Reader index (= bus address)
+  uint8_t uid[OSDP_UID_SIZE];
+  uint32_t receivedMs;              // When the reply carrying it arrived
+};
+
+// One reader on the bus
+struct OsdpReader {
+  uint8_t seq;                      // Sequence number of the last command sent
+  bool online;
+  uint8_t misses;                   // Consecutive missed replies
+  bool resend;                      // Repeat the last command with the same sequence number
+  uint16_t heat;                    // Activity score - sets the poll interval
+  uint32_t heatMs;                  // When heat last decayed
+  uint32_t nextPollMs;              // When this reader is due
+  uint32_t lastPollMs;              // When it was last sent anything
+  OsdpCommand queue[OSDP_QUEUE_DEPTH];
+  uint8_t queueHead, queueCount;
+
+  // Statistics
+  uint32_t polls;                   // Exchanges completed
+  uint32_t timeouts;                // Replies missed
+  uint32_t cards;                   // Cards read
+  uint32_t pollGapMax;              // Longest gap between polls while online - worst wait for a new card
+  uint32_t latencyTotalMs;          // Reply-to-decision time summed over cards
+  uint32_t latencyMaxMs;
+};
+
+// The bus and its scheduler
+struct OsdpBus {
+  const OsdpPort *port;
+  uint32_t baud;
+  bool adaptive;                    // False polls every reader at OSDP_POLL_IDLE_MS - for comparison
+  uint8_t readerCount;
+  OsdpReader readers[OSDP_MAX_READERS];
+
+  int8_t current;                   // Reader awaiting a reply, or -1
+  uint8_t currentCode;              // Command sent to it
+  uint32_t sentMs;
+  uint8_t rx[OSDP_MAX_FRAME];
+  uint8_t rxLen;
+
+  OsdpCardRead cards[OSDP_CARD_QUEUE];
+  uint8_t cardHead, cardCount;
+
+  uint32_t startMs;                 // Statistics period start
+  uint64_t wireUs;                  // Time the line carried bits - for utilization
+  uint32_t heldMs;                  // Time the bus was held for an exchange, reply waits included
+  uint32_t cardsDropped;            // Reads lost because the main loop fell behind
+};
+
+// Function to compute the OSDP frame CRC (CRC-16/AUG-CCITT: polynomial 0x1021, initial value 0x1D0F)
+uint16_t osdpCrc16(const uint8_t *data, size_t len);
+
+// Function to build a frame - returns its length, 0 if it does not fit
+size_t osdpBuild(uint8_t *buf, size_t cap, uint8_t addr, bool reply, uint8_t seq, uint8_t code,
+                 const uint8_t *data, size_t len);
+
+// Function to find a frame at the start of buf - returns bytes used (> 0 with frame filled),
+// 0 if more bytes are needed, or -n to drop n bytes of line noise
+int osdpParse(const uint8_t *buf, size_t len, OsdpFrame *frame);
+
+// Function to start a bus with readers at addresses 0..readerCount-1
+void osdpInit(OsdpBus *bus, const OsdpPort *port, uint32_t baud, uint8_t readerCount, uint32_t nowMs);
+
+// Function to advance the bus - sends, receives and times out without waiting; call as often as possible
+void osdpService(OsdpBus *bus, uint32_t nowMs);
+
+// Function to queue a command for a reader - false if its queue is full
+bool osdpQueueCommand(OsdpBus *bus, uint8_t reader, uint8_t code, const uint8_t *data, size_t len);
+
+// Function to take the oldest card read - false if none is waiting
+bool osdpNextCard(OsdpBus *bus, OsdpCardRead *read);
+
+// Function to report a decision on a card read - records latency and flashes the reader green or red
+void osdpCardHandled(OsdpBus *bus, const OsdpCardRead *read, bool granted, uint32_t nowMs);
+
+// Function to compute the share of time the line was busy since osdpInit, in percent
+float osdpUtilization(const OsdpBus *bus, uint32_t nowMs);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef OSDP_ENABLED
+#define OSDP_ENABLED 0              // Enable from build_flags (-DOSDP_ENABLED=1)
+#endif
+#ifndef OSDP_READERS
+#define OSDP_READERS 16             // Readers on the bus, addresses 0..OSDP_READERS-1
+#endif
+#ifndef OSDP_BAUD
+#define OSDP_BAUD 115200
+#endif
+#ifndef OSDP_RX_PIN
+#define OSDP_RX_PIN 9               // From the RS-485 transceiver - idles high, so the GPIO9 boot strap still reads high
+#endif
+#ifndef OSDP_TX_PIN
+#define OSDP_TX_PIN 1               // To the transceiver - shared with the hot-standby supervisor pin
+#endif
+#ifndef OSDP_DE_PIN
+#define OSDP_DE_PIN -1              // Driver enable, or -1 for a transceiver with automatic direction control
+#endif
+#define OSDP_REPORT_MS 60000        // Bus statistics on Serial this often
+
+// The room each reader's door serves comes from the site config (doors section); without one, reader n
+// stands at room n+1's door and readers past the last room serve none
+
+extern OsdpBus osdpBus;             // The controller's reader bus
+
+// Function to open the RS-485 UART and start polling
+void osdpBegin();
+
+// Function to run the bus and print statistics now and then - call while waiting
+void osdpPoll();
+#endif
+
+#endif
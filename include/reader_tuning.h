@@ -0,0 +1,91 @@
+// Reader tuning - adaptive antenna gain, read-error classification and recovery for MFRC522 readers
+// Each reader keeps a success rate per gain setting and moves to the best one, so readers in
+// metal door frames settle on a gain that reads on the first tap instead of the library default.
+// Status codes from the MFRC522 layer are counted per error class and acted on: collisions and
+// bit errors are re-selected at once, repeated timeouts soft-reset the PCD, and persistent noise
+// on an empty field backs polling off.
+#ifndef READER_TUNING_H
+#define READER_TUNING_H
+
+#include <Arduino.h>
+#include <MFRC522.h>
+
+#define READER_GAIN_COUNT    6     // Distinct receiver gains (18, 23, 33, 38, 43, 48 dB)
+#define READER_START_GAIN    2     // Index of the gain to start from - 33 dB, the chip's reset value
+#define READER_TUNE_WINDOW   16    // Read attempts between gain decisions
+#define READER_EXPLORE_EVERY 4     // Every Nth window tries a neighbouring gain instead of the best one
+#define READER_MAX_RETRIES   2     // Immediate re-select attempts after a collision or bit error
+#define READER_TIMEOUT_RESET 3     // Consecutive select timeouts before the PCD is soft-reset
+#define READER_NOISE_STREAK  4     // Consecutive noisy polls before polling backs off
+#define READER_BACKOFF_MIN_MS 10   // First backoff interval on a noisy field
+#define READER_BACKOFF_MAX_MS 160  // Longest backoff - bounds the extra latency for a real tap
+#define READER_TAP_WINDOW_MS 3000  // Failed taps closer together than this count towards the same user
+#define READER_REPORT_EVERY  32    // Successful reads between statistics reports on Serial
+
+// Error classes counted from MFRC522 status codes
+enum ReaderErrorClass {
+  READER_ERR_NO_CARD,     // REQA timed out - empty field, the normal idle result
+  READER_ERR_TIMEOUT,     // A detected card stopped answering during select
+  READER_ERR_COLLISION,   // Several cards answered and anticollision could not resolve them
+  READER_ERR_CRC,         // CRC mismatch in a card response
+  READER_ERR_PROTOCOL,    // Parity, framing or protocol error, or an invalid response
+  READER_ERR_INTERNAL,    // Buffer or internal library error
+  READER_ERR_COUNT
+};
+
+// Per-reader tuning state and statistics
+struct ReaderTuning {
+  MFRC522 *reader;                          // Reader being tuned
+  byte gainIndex;                           // Current gain, index into the gain table
+  uint16_t successRate[READER_GAIN_COUNT];  // First-attempt success rate per gain, x1000, exponentially weighted
+  uint16_t attempts[READER_GAIN_COUNT];     // First attempts made at each gain
+  byte windowAttempts;                      // Attempts since the last gain decision
+  uint16_t windows;                         // Gain decisions made - drives exploration
+  MFRC522::Uid lastUid;                     // UID of the last card read - used to re-select it directly
+  bool haveLastUid;                         // True once a card has been read
+
+  // Tap tracking for taps-to-success and time-to-decision
+  byte pendingTaps;                         // Failed taps since the last successful read
+  unsigned long firstTapUs;                 // When the first of those taps was detected
+  unsigned long lastTapMs;                  // When the last tap was detected
+
+  // Statistics
+  uint32_t detections;                      // Cards detected in the field
+  uint32_t reads;                           // Successful reads
+  uint32_t retriesRecovered;                // Reads that only succeeded on an immediate retry
+  uint32_t failedTaps;                      // Detections that ended without a UID
+  uint32_t decisions;                       // Decisions recorded by readerRecordDecision()
+  uint32_t tapsToSuccessTotal;              // Sum of taps needed per decision
+  uint64_t decisionUsTotal;                 // Sum of first-tap-to-decision times in microseconds
+
+  // Error classification and recovery
+  uint32_t errors[READER_ERR_COUNT];        // Status codes seen per error class
+  byte timeoutStreak;                       // Consecutive select timeouts
+  byte noiseStreak;                         // Consecutive noisy polls on the field
+  uint16_t backoffMs;                       // Current polling backoff, 0 when the field is clean
+  unsigned long backoffUntil;               // Polling resumes at this millis() value
+  uint32_t softResets;                      // PCD soft resets after repeated timeouts
+  uint32_t backoffs;                        // Times polling backed off for noise
+  unsigned long errorSinceUs;               // When the first unrecovered error occurred, 0 if none
+  uint32_t recoveries;                      // Successful reads that followed an error
+  uint32_t lastRecoveryUs;                  // Error-to-successful-read time of the last recovery
+  uint32_t maxRecoveryUs;                   // Longest error-to-successful-read time
+  uint64_t recoveryUsTotal;                 // Sum of recovery times
+};
+
+// Function to start tuning a reader - call after PCD_Init()
+void readerTuningBegin(ReaderTuning *t, MFRC522 *reader);
+
+// Function to re-apply the current gain - call after anything that re-initializes the reader
+void readerApplyGain(ReaderTuning *t);
+
+// Function to detect and read a card, recovering from read errors - true when reader->uid is valid
+bool readerReadCard(ReaderTuning *t);
+
+// Function to record that the card just read has been decided on - closes the tap for the statistics
+void readerRecordDecision(ReaderTuning *t);
+
+// Function to print the tuning statistics on Serial
+void readerPrintStats(const ReaderTuning *t);
+
+#endif
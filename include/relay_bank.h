@@ -0,0 +1,43 @@
+// Relay bank - switches a group of outputs with one store to the GPIO set register and one to the clear register
+// digitalWrite() looks up its pin and writes it alone, so relays that should switch together change one call
+// apart, and every call pays the lookup again. A bank collects the levels wanted and relayBankCommit() writes
+// every pin going high in one store to GPIO.out_w1ts and every pin going low in one store to GPIO.out_w1tc.
+// Pins switching the same way change on the same clock edge; the two directions are one bus write apart.
+// The set and clear registers only touch the pins named, so a commit never undoes an output another task has
+// just driven - a read-modify-write of GPIO.out could.
+//
+// The ESP32-C3's GPIO 0-21 all sit in the first output register. The pending masks are portable; the
+// register writes are firmware-only.
+#ifndef RELAY_BANK_H
+#define RELAY_BANK_H
+
+#include <stdint.h>
+
+// Changes waiting for a commit - a pin is in at most one of the masks
+struct RelayBank {
+  uint32_t high;                    // Pins to drive high
+  uint32_t low;                     // Pins to drive low
+};
+
+// Function to queue a level for one pin - the last level queued before a commit wins
+void relayBankWrite(RelayBank *bank, uint8_t pin, bool high);
+
+// Function to queue the same level for several pins
+void relayBankWriteAll(RelayBank *bank, const uint8_t *pins, uint8_t count, bool high);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef RELAY_BANK_BENCHMARK_AT_BOOT
+#define RELAY_BANK_BENCHMARK_AT_BOOT 0  // Print bank vs digitalWrite timings on Serial during setup()
+#endif
+
+// Function to apply the queued levels and empty the bank - safe from any task, the pins must be outputs
+void relayBankCommit(RelayBank *bank);
+
+// Function to time switching the pins with digitalWrite and with a bank, and the skew between the first and
+// last pin on each path - writes the level the pins already have, so no relay moves
+void relayBankPrintBenchmark(const uint8_t *pins, uint8_t count);
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+// Offline revocation - lost cards are revoked through signed, versioned deltas carried on site cards
+// A door merges a newer delta during a normal tap and writes its own newer delta back to the card,
+// so revocations spread from the front desk to standalone doors without any network.
+//
+// Card block layout (48 bytes, three MIFARE Classic data blocks of one sector):
+//   'R' | count (1) | base version (2) | version (2) | UIDs (REVOCATION_DELTA_MAX x 4) | reserved (2) | tag (8)
+// The tag is HMAC-SHA256 over the first 40 bytes with the site key, truncated to 8 bytes.
+// A delta lists every card revoked after the base version up to the version.
+#ifndef REVOCATION_H
+#define REVOCATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define REVOCATION_CAPACITY   128   // Revoked cards kept per door - the oldest is dropped when full
+#define REVOCATION_DELTA_MAX  8     // Revoked cards carried per card block
+#define REVOCATION_UID_SIZE   4     // UID bytes per revoked card
+#define REVOCATION_BLOCK_SIZE 48    // Bytes of card storage used by a delta
+#define REVOCATION_TAG_SIZE   8     // Truncated HMAC bytes
+#define REVOCATION_SIGNED_SIZE (REVOCATION_BLOCK_SIZE - REVOCATION_TAG_SIZE)
+
+// One revoked card with the list version that introduced it
+struct RevocationEntry {
+  uint8_t uid[REVOCATION_UID_SIZE];
+  uint16_t version;
+};
+
+// A door's revocation filter - entries sorted by UID for binary search
+struct RevocationList {
+  uint16_t version;                                // Newest version fully merged
+  uint8_t count;                                   // Entries in use
+  RevocationEntry entries[REVOCATION_CAPACITY];
+};
+
+// A delta as carried on a card
+struct RevocationDelta {
+  uint16_t baseVersion;                            // Version the delta builds on
+  uint16_t version;                                // Version after applying the delta
+  uint8_t count;                                   // Revoked cards carried
+  uint8_t uids[REVOCATION_DELTA_MAX][REVOCATION_UID_SIZE];
+};
+
+// Result of merging a card's delta
+enum RevocationMerge {
+  REVOCATION_STALE,     // Card carries nothing the door lacks - the list is unchanged
+  REVOCATION_MERGED,    // Entries added and the door's version advanced
+  REVOCATION_PARTIAL    // Entries added, but the door missed versions before the delta's base
+};
+
+// Function to start an empty list
+void revocationInit(RevocationList *list);
+
+// Function to check whether a card is revoked - binary search over the sorted entries
+bool revocationContains(const RevocationList *list, const uint8_t *uid);
+
+// Function to add one revoked card at the given version - returns false if it was already listed
+bool revocationAdd(RevocationList *list, const uint8_t *uid, uint16_t version);
+
+// Function to merge a verified card delta into the list - anything but REVOCATION_STALE changed it and needs saving
+RevocationMerge revocationMerge(RevocationList *list, const RevocationDelta *delta);
+
+// Function to build the newest delta a door can hand on - as many recent versions as fit on a card
+void revocationMakeDelta(const RevocationList *list, RevocationDelta *delta);
+
+// Function to sign and serialize a delta into a card block
+void revocationEncode(const RevocationDelta *delta, const uint8_t *key, size_t keyLen,
+                      uint8_t block[REVOCATION_BLOCK_SIZE]);
+
+// Function to verify and parse a card block - returns false for blank, foreign or forged blocks
+bool revocationDecode(const uint8_t block[REVOCATION_BLOCK_SIZE], const uint8_t *key, size_t keyLen,
+                      RevocationDelta *delta);
+
+#ifdef ARDUINO
+// Firmware side - reads and writes deltas on MIFARE Classic cards during a tap
+#include <Arduino.h>
+#include <MFRC522.h>
+
+// Card propagation is off unless enabled from build_flags (-DREVOCATION_ENABLED=1)
+#ifndef REVOCATION_ENABLED
+#define REVOCATION_ENABLED 0
+#endif
+#ifndef REVOCATION_SITE_KEY
+#define REVOCATION_SITE_KEY "change-this-site-key"  // HMAC key shared by the front desk and every door
+#endif
+#ifndef REVOCATION_WRITE_BACK
+#define REVOCATION_WRITE_BACK 1      // Write the door's newer delta back to carrier cards
+#endif
+#define REVOCATION_CARD_KEY {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}  // MIFARE key A of the carrier sector
+#define REVOCATION_FIRST_BLOCK   4   // First data block of sector 1 - blocks 4, 5 and 6 hold the delta
+#define REVOCATION_TRAILER_BLOCK 7   // Sector trailer used for authentication
+#define REVOCATION_TAP_BUDGET_US 60000  // Card I/O plus merge must stay within this share of a tap
+
+extern RevocationList revocationList;      // This door's revocation filter
+extern uint32_t revocationLastTapUs;       // Card read, merge, save and write-back time of the last carrier tap
+extern uint32_t revocationLastMergeUs;     // Merge time of the last newer delta
+extern uint32_t revocationMerges;          // Newer deltas merged
+extern uint32_t revocationWriteBacks;      // Deltas written back to carrier cards
+extern uint32_t revocationOverBudget;      // Carrier taps that exceeded REVOCATION_TAP_BUDGET_US
+
+// Function to load the revocation filter from NVS
+void revocationBegin();
+
+// Function to exchange deltas with the card in the field - call after the card is selected
+void revocationProcessCard(MFRC522 &reader);
+
+// Function to check whether a card UID is revoked on this door
+bool revocationIsRevoked(const uint8_t *uid);
+#endif
+
+#endif
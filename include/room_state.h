@@ -0,0 +1,62 @@
+// Room state table - shared occupancy and ownership state for every room served by the controller
+// Kept in plain arrays so other modules (replication, telemetry) can read and apply state by room index
+// The arrays belong to loop(): it writes them, and code running in loop() reads them directly. Code in any
+// other task takes a roomStateSnapshot() instead - every change is published through a seqlock, so such a
+// reader gets all rooms as of one moment, never one room's new state beside another's old one.
+#ifndef ROOM_STATE_H
+#define ROOM_STATE_H
+
+#include <Arduino.h>
+
+#define NUM_ROOMS 2          // Number of rooms (relays) served by this controller - one bit each in change masks
+#define UID_SIZE  4          // Number of UID bytes stored per room owner - matches the 4-byte MIFARE UIDs in use
+#define ALL_ROOMS_MASK ((uint32_t)((1ULL << NUM_ROOMS) - 1))  // Change mask with every room set
+
+// Room state arrays - index 0 is room 1, index 1 is room 2, and so on
+extern bool relayOn[NUM_ROOMS];                 // Status of each relay - tracks whether the room is occupied
+extern byte relayOwner[NUM_ROOMS][UID_SIZE];    // UID of the card that activated each relay
+extern bool relayHasOwner[NUM_ROOMS];           // Ownership flag per relay - indicates if the room has an assigned user
+
+// Change tracking - lets replication send only the rooms that changed
+extern uint32_t roomStateSeq;               // Sequence number - incremented on every room state change
+extern uint32_t roomVersion[NUM_ROOMS];     // Value of roomStateSeq when each room last changed
+
+// Consistent copy of the whole table - for readers outside loop()
+struct RoomSnapshot {
+  uint32_t seq;                             // roomStateSeq at the copy
+  uint32_t version[NUM_ROOMS];
+  bool on[NUM_ROOMS];
+  bool hasOwner[NUM_ROOMS];
+  byte owner[NUM_ROOMS][UID_SIZE];
+};
+
+// Function to assign a room to a card - marks the relay on and records the owner
+void checkInRoom(byte room, const byte *uid);
+
+// Function to switch a room on without a card - remote command from a building-management system, no owner
+void occupyRoom(byte room);
+
+// Function to release a room - marks the relay off and clears ownership
+void checkOutRoom(byte room);
+
+// Function to overwrite one room with replicated state - used by a standby controller
+// seq is the sender's sequence number for the change so versions stay comparable across controllers
+void applyRoomState(byte room, bool on, bool hasOwner, const byte *owner, uint32_t seq);
+
+// Function to take the sender's sequence number after replicated rooms are applied - republishes the table
+// so snapshots carry it, also when it moved back after a snapshot from a partner that is behind
+void followRoomStateSeq(uint32_t seq);
+
+// Function to find the room owned by a card - returns the room index or -1 if the card owns none
+int findOwnedRoom(const byte *uid);
+
+// Function to check whether every room is occupied
+bool allRoomsOccupied();
+
+// Function to build a bit mask of the rooms changed after a given sequence number
+uint32_t roomsChangedSince(uint32_t seq);
+
+// Function to copy every room as of one moment - safe from any task, and never makes loop() wait
+void roomStateSnapshot(RoomSnapshot *out);
+
+#endif
@@ -0,0 +1,40 @@
+// Seqlock - a few dozen bytes of state that one task updates while other tasks take copies, with no lock
+// The writer makes the sequence odd, writes the payload and makes it even again. A reader reads the
+// sequence, copies the payload and reads the sequence again; an odd or changed sequence means it raced a
+// write and copies again. The writer never waits for a reader, so the card-scan path pays a short copy
+// per change and no lock latency, however many readers there are.
+//
+// The payload is kept in 32-bit atomic words, loaded and stored relaxed, so a copy that races a write is
+// still defined behaviour; the fences order the words against the sequence. The ESP32-C3 is single-core
+// and every access here is a plain load or store plus a fence - no atomic read-modify-write instructions,
+// which the chip lacks.
+//
+// Portable C++ so the host benchmark measures the same code under real contention.
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define SEQLOCK_MAX_WORDS 32        // Largest payload in 32-bit words - 128 bytes
+
+struct SeqLock {
+  std::atomic<uint32_t> seq;        // Odd while a write is in progress
+  std::atomic<uint32_t> words[SEQLOCK_MAX_WORDS];
+};
+
+// Function to start a seqlock with an all-zero payload
+void seqlockInit(SeqLock *lock);
+
+// Function to publish a new payload - one writer only; never blocks
+void seqlockWrite(SeqLock *lock, const void *data, size_t len);
+
+// Function to try one consistent copy of the payload - false if it raced a write, and out may then be torn
+bool seqlockTryRead(const SeqLock *lock, void *out, size_t len);
+
+// Function to check whether a write is in progress - a reader that keeps failing while this holds should
+// let the writer run rather than spin
+bool seqlockWriting(const SeqLock *lock);
+
+#endif
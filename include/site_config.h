@@ -0,0 +1,158 @@
+// Site configuration - a versioned binary blob that changes per-site settings without a rebuild
+// The blob is kept in NVS and used in place: boot only checks the header and section table, and each
+// section's CRC-32 is checked the first time that section is asked for. Missing, damaged or unknown-version
+// sections leave the compiled defaults in force. tools/config_compiler.cpp builds blobs from JSON.
+//
+// Layout (little-endian):
+//   header  'L' 'C' 'F' 'G' | format (1) | section count (1) | total size (2) | revision (4) | CRC-32 (4)
+//           the header CRC covers the first 12 header bytes and the section table
+//   table   per section: id (1) | section version (1) | length (2) | offset (4) | CRC-32 of the body (4)
+//   bodies  section data at the offsets given in the table
+//
+// New fields are only ever appended to a section, so a longer section of the same version still loads;
+// a section whose layout changes gets a new version number and older firmware ignores it.
+//
+// The blob sets cards, staff badges and pins, so an upload over Serial must be followed by a tag -
+// HMAC-SHA256 over the whole blob with the site config key, truncated. The CRCs only catch damage.
+// An upload must also carry a higher revision than the blob in force, so an older signed blob cannot
+// bring back cards, badges or door mappings a later revision removed.
+//
+// The codec is portable C++ so the host compiler shares it; the NVS loader below is firmware-only.
+#ifndef SITE_CONFIG_H
+#define SITE_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CONFIG_FORMAT_VERSION 1     // Header and table layout - blobs with another format are rejected
+#define CONFIG_HEADER_SIZE    16    // Bytes before the section table
+#define CONFIG_ENTRY_SIZE     12    // Bytes per section table entry
+#define CONFIG_MAX_SECTIONS   32    // Sections per blob - one bit each in the check masks
+#define CONFIG_MAX_SIZE       1024  // Largest blob accepted
+#define CONFIG_TAG_SIZE       16    // Truncated HMAC bytes sent after an uploaded blob
+
+// Section ids
+#define CONFIG_SECTION_PINS    1    // v1: SDA, SCL, SCK, MISO, MOSI pins (1 byte each)
+#define CONFIG_SECTION_READER  2    // v1: SS pin, RST pin, starting gain index
+#define CONFIG_SECTION_ROOMS   3    // v1: room count, then per room: relay pin, relay power pin
+#define CONFIG_SECTION_CARDS   4    // v1: card count, then per card: room index (0-based), UID (4)
+#define CONFIG_SECTION_TIMINGS 5    // v1: alert ms (4), pause after a tap ms (4), relay flash ms (2), relay test ms (2)
+#define CONFIG_SECTION_STAFF   6    // v1: badge count, then per badge: UID (4)
+#define CONFIG_SECTION_DOORS   7    // v1: door count, then per OSDP door: room index (0-based) or CONFIG_NO_ROOM
+
+#define CONFIG_NO_ROOM         0xFF // Door without a room - a corridor or shared entrance reader
+
+// A blob opened for reading - points into the caller's buffer, nothing is copied
+struct ConfigBlob {
+  const uint8_t *data;
+  size_t size;
+  uint8_t sectionCount;
+  uint32_t revision;       // Site revision number set by the compiler
+  uint32_t checkedMask;    // Table entries whose body CRC has been checked
+  uint32_t validMask;      // Table entries whose body CRC matched
+};
+
+// A blob under construction - the table is reserved up front, bodies follow in the order added
+struct ConfigBuilder {
+  uint8_t *buf;
+  size_t capacity;
+  size_t used;
+  uint8_t sectionCount;
+  uint8_t added;
+  bool overflow;
+};
+
+// Function to open a blob - checks the header and table only, so its cost does not grow with section sizes
+bool configOpen(ConfigBlob *blob, const uint8_t *data, size_t size);
+
+// Function to find a section of the given version - checks its CRC on first use, NULL if missing or damaged
+const uint8_t *configSection(ConfigBlob *blob, uint8_t id, uint8_t version, size_t *len);
+
+// Function to check every section body - for accepting a new blob before it replaces the stored one
+bool configVerifyAll(ConfigBlob *blob);
+
+// Function to compute the upload tag of a blob
+void configSign(const uint8_t *data, size_t size, const uint8_t *key, size_t keyLen, uint8_t tag[CONFIG_TAG_SIZE]);
+
+// Function to check the upload tag of a blob - constant time
+bool configCheckTag(const uint8_t *data, size_t size, const uint8_t *key, size_t keyLen, const uint8_t *tag);
+
+// Result of checking an uploaded blob
+enum ConfigUpload {
+  CONFIG_UPLOAD_OK,         // Signed, intact and newer - store it
+  CONFIG_UPLOAD_BAD_TAG,    // Not signed with the site key
+  CONFIG_UPLOAD_DAMAGED,    // Signed, but the header or a section fails its CRC
+  CONFIG_UPLOAD_OLD         // Signed and intact, but not newer than the revision in force
+};
+
+// Function to check an uploaded blob and its tag against the revision in force - blob is opened on success
+ConfigUpload configCheckUpload(ConfigBlob *blob, const uint8_t *data, size_t size, const uint8_t *tag,
+                               const uint8_t *key, size_t keyLen, uint32_t currentRevision);
+
+// Functions to build a blob - begin with the number of sections that will be added, end returns the size (0 on error)
+void configBuildBegin(ConfigBuilder *b, uint8_t *buf, size_t capacity, uint8_t sectionCount, uint32_t revision);
+bool configBuildSection(ConfigBuilder *b, uint8_t id, uint8_t version, const uint8_t *data, size_t len);
+size_t configBuildEnd(ConfigBuilder *b);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include "room_state.h"
+
+#ifndef SITE_CONFIG_ENABLED
+#define SITE_CONFIG_ENABLED 1           // Load the site config blob from NVS at boot
+#endif
+#ifndef SITE_CONFIG_UPLOAD
+#define SITE_CONFIG_UPLOAD 0            // Accept a new signed blob over Serial - enable from build_flags for commissioning
+#endif
+#ifndef SITE_CONFIG_SITE_KEY
+#define SITE_CONFIG_SITE_KEY "change-this-config-key"  // HMAC key shared by the config compiler and every controller
+#endif
+#define SITE_CONFIG_NAMESPACE "config"  // NVS namespace holding the blob
+#define SITE_CONFIG_UPLOAD_GAP_MS 1000  // An upload that pauses longer than this is discarded
+
+// Bus pins
+struct SitePins {
+  byte sda, scl, sck, miso, mosi;
+};
+
+// RFID reader wiring and tuning
+struct SiteReader {
+  byte ssPin, rstPin, startGain;
+};
+
+// Timings
+struct SiteTimings {
+  uint32_t alertMs;       // How long an alert stays on the display
+  uint32_t tapPauseMs;    // Pause after a tap before the next scan
+  uint16_t flashMs;       // Relay flash half-period for denied taps
+  uint16_t relayTestMs;   // On-time per relay in the boot relay test
+};
+
+// Boot cost
+extern uint32_t siteConfigRevision;    // Revision of the loaded blob, 0 when running on compiled defaults
+extern uint32_t siteConfigLoadUs;      // NVS read plus header check
+extern uint32_t siteConfigSectionUs;   // Total spent checking and decoding sections on first use
+
+// Function to load the blob from NVS - call first in setup(); compiled defaults stay in force without one
+void siteConfigBegin();
+
+// Functions to overwrite compiled defaults with the blob's values - false leaves the defaults untouched
+bool siteConfigPins(SitePins *pins);
+bool siteConfigReader(SiteReader *reader);
+bool siteConfigRooms(byte relayPins[NUM_ROOMS], byte powerPins[NUM_ROOMS]);
+bool siteConfigCards(byte cards[NUM_ROOMS][UID_SIZE]);
+bool siteConfigTimings(SiteTimings *timings);
+
+// Function to copy up to max staff badge UIDs - returns how many were copied, 0 without a staff section
+byte siteConfigStaff(byte staff[][UID_SIZE], byte max);
+
+// Function to set the room each of count OSDP doors serves - doors the blob does not list, or lists with a room
+// outside the build's capacity, get CONFIG_NO_ROOM
+bool siteConfigDoors(byte doorRooms[], byte count);
+
+// Function to take one Serial byte for a signed blob upload - false if it is not part of one
+// Restarts once a valid blob is stored; always false unless SITE_CONFIG_UPLOAD is set
+bool siteConfigUploadByte(uint8_t c);
+#endif
+
+#endif
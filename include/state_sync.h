@@ -0,0 +1,101 @@
+// State-sync protocol - publishes room occupancy as compact, sequence-numbered deltas
+// The codec half is plain C++ with no Arduino dependencies so host-side receivers can share it
+//
+// Wire format (little-endian):
+//   'S' | type (1) | controller id (2) | seq (4) | prevSeq (4) | room count (1)
+//   | occupancy bitmap (B) | changed mask (B)          where B = (room count + 7) / 8 bytes
+//   then one record per room in the changed mask: owner flag (1) [+ owner UID (SYNC_UID_SIZE) if owned]
+// A delta applies only on top of prevSeq. Receivers that see any other prevSeq have missed a
+// message and ask for a snapshot; heartbeats carry the current seq so a lost final delta is noticed.
+#ifndef STATE_SYNC_H
+#define STATE_SYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SYNC_MAX_ROOMS 32    // Largest room count a message can describe - one bit each in the masks
+#define SYNC_UID_SIZE  4     // Owner UID bytes per room record
+#define SYNC_MAX_MESSAGE (13 + 2 * (SYNC_MAX_ROOMS / 8) + SYNC_MAX_ROOMS * (1 + SYNC_UID_SIZE))
+
+// Message types
+#define SYNC_MSG_DELTA        1  // Rooms changed since prevSeq
+#define SYNC_MSG_SNAPSHOT     2  // Every room - sent on request or at startup
+#define SYNC_MSG_HEARTBEAT    3  // No rooms - carries the current seq and occupancy bitmap
+#define SYNC_MSG_SNAPSHOT_REQ 4  // Receiver missed a delta and asks for a snapshot
+
+// Read-only view of a room table - the codec never copies the state it encodes
+struct SyncRoomView {
+  uint8_t roomCount;                          // Number of rooms described
+  const bool *on;                             // Relay on per room
+  const bool *hasOwner;                       // Ownership flag per room
+  const uint8_t (*owner)[SYNC_UID_SIZE];      // Owner UID per room
+};
+
+// Receiver-side copy of one controller's state, with gap detection
+struct SyncReceiver {
+  uint16_t controllerId;                      // Controller this receiver follows
+  bool synced;                                // False until the first snapshot arrives
+  uint32_t seq;                               // Sequence number of the state held
+  uint8_t roomCount;                          // Rooms reported by the controller
+  uint32_t occupied;                          // Occupancy bitmap
+  uint32_t owned;                             // Ownership bitmap
+  uint8_t owner[SYNC_MAX_ROOMS][SYNC_UID_SIZE];  // Owner UID per room
+  uint32_t changedMask;                       // Rooms changed by the last applied message
+  uint32_t gaps;                              // Missed messages detected
+};
+
+// Result of feeding one message to a receiver
+enum SyncResult {
+  SYNC_APPLIED,     // State updated - changedMask lists the rooms
+  SYNC_CURRENT,     // Heartbeat or duplicate - state already up to date
+  SYNC_GAP,         // A delta was missed - request a snapshot
+  SYNC_INVALID      // Malformed or for another controller
+};
+
+// Function to encode a message - returns the encoded length, or 0 if buf is too small
+size_t syncEncode(uint8_t *buf, size_t cap, uint8_t type, uint16_t controllerId,
+                  uint32_t seq, uint32_t prevSeq, uint32_t changedMask, const SyncRoomView &rooms);
+
+// Function to read the type and controller id of a message without decoding it - returns false if malformed
+bool syncPeek(const uint8_t *buf, size_t len, uint8_t *type, uint16_t *controllerId);
+
+// Function to reset a receiver to follow one controller
+void syncReceiverInit(SyncReceiver *rx, uint16_t controllerId);
+
+// Function to apply one message to a receiver
+SyncResult syncReceive(SyncReceiver *rx, const uint8_t *buf, size_t len);
+
+// Function to measure the size of the equivalent full-state JSON publish - used for bandwidth comparison
+size_t syncJsonSize(uint16_t controllerId, uint32_t seq, const SyncRoomView &rooms);
+
+#ifdef ARDUINO
+// Firmware publisher - streams deltas to a fleet collector over UDP
+#include <Arduino.h>
+
+// Publishing is off unless enabled from build_flags (-DSTATE_SYNC_ENABLED=1)
+#ifndef STATE_SYNC_ENABLED
+#define STATE_SYNC_ENABLED 0
+#endif
+#ifndef SYNC_COLLECTOR_ADDRESS
+#define SYNC_COLLECTOR_ADDRESS "192.168.1.10"  // IP address of the fleet collector
+#endif
+#ifndef SYNC_CONTROLLER_ID
+#define SYNC_CONTROLLER_ID 1                   // Unique id of this controller within the fleet
+#endif
+#define SYNC_UDP_PORT 4220                     // Collector listens here; snapshot requests come back to it
+#define SYNC_HEARTBEAT_MS 10000                // Interval between heartbeats - bounds how long a lost delta goes unnoticed
+
+// Publisher metrics - wire bytes compared against a naive full-state JSON publish of the same changes
+extern uint32_t syncMessagesSent;   // Messages sent, including heartbeats and snapshots
+extern uint32_t syncBytesSent;      // Bytes sent on the wire
+extern uint32_t syncJsonBytes;      // Bytes a full-state JSON publish would have sent for the same deltas
+extern uint32_t syncSnapshotsSent;  // Snapshots sent in reply to gap requests
+
+// Function to start publishing - opens the UDP port; the collector asks for a snapshot on first contact
+void stateSyncBegin();
+
+// Function to service publishing - call on every loop() pass and while waiting
+void stateSyncPoll();
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+// Web UI - a small status page served by the controller itself, from assets compiled into flash
+// tools/web_pack.py gzips everything in web/ at build time and writes include/web_assets.h, so a request
+// is answered with a header built in a stack buffer followed by the stored gzip bytes, written to the
+// socket straight from flash - nothing is compressed, templated or copied into the heap per request.
+// Scripts and stylesheets carry a content hash in their name and are cached by the browser for a year;
+// index.html is revalidated by ETag, so a reload usually costs one 304 and a deploy is picked up at once.
+// Live room state comes as JSON from /api/state, or pushed over a WebSocket on /ws whenever it changes.
+//
+// The HTTP parsing, header and JSON building are portable C++ so the host benchmark shares them;
+// the server itself is firmware-only.
+#ifndef WEB_UI_H
+#define WEB_UI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WEB_MAX_PATH        48    // Longest request path kept - longer paths are answered 404
+#define WEB_MAX_ETAG        16    // Longest If-None-Match value kept - ours are 10 characters
+#define WEB_WS_KEY_SIZE     24    // Sec-WebSocket-Key is 16 bytes in base64
+#define WEB_WS_ACCEPT_SIZE  28    // Sec-WebSocket-Accept is a SHA-1 in base64
+#define WEB_HEADER_MAX      320   // Largest response header built
+
+// One asset in flash, as generated into web_assets.h - data is always gzip
+struct WebAsset {
+  const char *path;     // Request path, hashed name for everything but /index.html
+  const char *type;     // Content-Type
+  const char *etag;     // Quoted content hash
+  bool immutable;       // Name changes with content - cache for a year, never revalidate
+  const uint8_t *data;
+  size_t len;
+};
+
+// The parts of a request the server acts on
+struct WebRequest {
+  bool get;                             // GET or HEAD - anything else is answered 405
+  bool head;                            // HEAD - header only
+  bool keepAlive;                       // Connection stays open after the response
+  bool upgrade;                         // WebSocket upgrade requested
+  char path[WEB_MAX_PATH + 1];          // Path without the query string, empty if too long
+  char ifNoneMatch[WEB_MAX_ETAG + 1];
+  char wsKey[WEB_WS_KEY_SIZE + 1];
+};
+
+// Per-request figures reported by the server - and shown on the page itself
+struct WebStats {
+  uint32_t requests;      // Responses sent, including 304s - WebSocket pushes are not requests
+  uint32_t ttfbTotalUs;   // Sum of times from the request's first byte to its response header being written
+  uint32_t ttfbMaxUs;
+  uint32_t heapMax;       // Most heap in use by one request, from its first byte to its last response byte
+};
+
+// What the state JSON reports - pointers into the room state table, read at build time
+struct WebStateView {
+  const bool *on;
+  const bool *owned;
+  uint8_t rooms;
+  uint32_t seq;
+  uint32_t uptimeS;
+  uint32_t freeHeap;
+  const WebStats *stats;
+};
+
+// Function to parse a request header - returns the header length once the blank line is in, 0 until then,
+// -1 for a header that is not HTTP or does not fit the buffer
+int webParseRequest(const char *buf, size_t len, WebRequest *req);
+
+// Function to find an asset by request path - "/" serves /index.html; NULL if there is none
+const WebAsset *webFindAsset(const WebAsset *assets, size_t count, const char *path);
+
+// Function to build the response header for an asset - a 304 if the request already holds its ETag
+// Returns the header length; *notModified tells the caller not to send the body
+size_t webAssetHeader(const WebAsset *asset, const WebRequest *req, bool *notModified, char *out, size_t cap);
+
+// Function to build a header for a JSON body of the given length - never cached
+size_t webJsonHeader(size_t bodyLen, bool keepAlive, char *out, size_t cap);
+
+// Function to build an empty response with a status code - 404, 405 or 400
+size_t webStatusHeader(int code, char *out, size_t cap);
+
+// Function to build the room state JSON - returns its length, 0 if it does not fit
+size_t webStateJson(const WebStateView *view, char *out, size_t cap);
+
+// Function to build the 101 response that accepts a WebSocket upgrade
+size_t webSocketAcceptHeader(const char *key, char *out, size_t cap);
+
+// Function to build the header of an unmasked server-to-client text frame - returns its length (2 or 4)
+size_t webSocketFrameHeader(size_t payloadLen, uint8_t out[4]);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef WEB_UI_ENABLED
+#define WEB_UI_ENABLED 0           // Enable from build_flags (-DWEB_UI_ENABLED=1)
+#endif
+#ifndef WEB_UI_PORT
+#define WEB_UI_PORT 80
+#endif
+#define WEB_UI_CLIENTS    4        // Browsers open a few parallel connections for the page's assets
+#define WEB_SEND_SLICE    1436     // Body bytes per write - one TCP segment, so a slow client holds no more
+#define WEB_SLICES_PER_POLL 4      // Slices per client per poll - bounds the time one call spends sending
+#define WEB_IDLE_MS       10000    // Keep-alive connections with nothing to do are closed after this
+#define WEB_WS_MIN_MS     250      // Shortest gap between WebSocket pushes - a burst of taps sends one update
+#define WEB_WS_REFRESH_MS 5000     // Push at least this often anyway, so uptime and heap figures stay current
+
+extern WebStats webStats;
+
+// Function to start the server - call after wifiManagerBegin()
+void webUiBegin();
+
+// Function to serve pending requests and push state changes - call while waiting
+void webUiPoll();
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+// Wi-Fi connection manager - keeps the station link up without ever blocking loop()
+// Driver events only bump counters; wifiManagerPoll() runs the state machine from loop() in O(1),
+// reconnecting with exponential backoff and holding outbound UDP frames in a queue while the link is down.
+// Each queued frame remembers the socket it is to leave from, so replies come back to the port its
+// sender listens on.
+//
+// The state machine and the queue are portable C++ so the host simulator drives them with scripted driver
+// events; the driver calls are firmware-only.
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WIFI_BACKOFF_MIN_MS     500    // First reconnect delay after losing the link
+#define WIFI_BACKOFF_MAX_MS     30000  // Longest reconnect delay
+#define WIFI_CONNECT_TIMEOUT_MS 10000  // An attempt without an IP address after this long counts as failed
+#define WIFI_QUEUE_SLOTS        16     // Outbound frames held while the link is down
+#define WIFI_FRAME_MAX          192    // Largest outbound frame - fits a full state-sync snapshot
+#define WIFI_FLUSH_PER_POLL     4      // Frames sent per poll - bounds the time spent in one loop() pass
+
+// Connection states
+enum WifiState {
+  WIFI_STATE_CONNECTING,  // Attempt in progress
+  WIFI_STATE_CONNECTED,   // Link up with an IP address
+  WIFI_STATE_BACKOFF      // Waiting before the next attempt
+};
+
+// What a step of the state machine asks of the driver - each returns at once, the result arrives as an event
+enum WifiAction {
+  WIFI_ACTION_NONE,
+  WIFI_ACTION_CONNECT,    // Start an attempt - WiFi.begin()
+  WIFI_ACTION_DISCONNECT  // Stop the driver's own attempt so it does not race ours - WiFi.disconnect()
+};
+
+// Connection state machine
+struct WifiLink {
+  WifiState state;
+  uint32_t stateSince;              // When the current state was entered
+  uint32_t backoffMs;               // Current reconnect delay
+  bool up;                          // Link up with an IP address
+  uint32_t connects;                // Successful connections
+  uint32_t disconnects;             // Link losses and failed attempts
+};
+
+// One queued outbound frame
+struct WifiFrame {
+  void *socket;                     // Socket to send from - a WiFiUDP in the firmware
+  uint32_t dest;                    // Destination address, as IPAddress stores it
+  uint16_t port;
+  uint8_t len;
+  uint8_t data[WIFI_FRAME_MAX];
+};
+
+// Ring of outbound frames
+struct WifiQueue {
+  WifiFrame frames[WIFI_QUEUE_SLOTS];
+  uint8_t head;                     // Next frame to send
+  uint8_t count;                    // Frames waiting
+  uint32_t dropped;                 // Frames refused because the queue was full
+};
+
+// Function to start the state machine with its first attempt under way
+void wifiLinkInit(WifiLink *link, uint32_t nowMs);
+
+// Function to run one step - gotIp and lost say whether those driver events came since the last step,
+// associated whether the driver reports the station connected now, noise is any random number for the
+// backoff jitter. Returns what to ask of the driver
+WifiAction wifiLinkStep(WifiLink *link, uint32_t nowMs, bool gotIp, bool lost, bool associated, uint32_t noise);
+
+// Function to empty a queue
+void wifiQueueInit(WifiQueue *q);
+
+// Function to add a frame at the back - false if it is too long or the queue is full
+bool wifiQueuePush(WifiQueue *q, void *socket, uint32_t dest, uint16_t port, const uint8_t *data, size_t len);
+
+// Function to take the frame at the front off the queue - NULL if empty. Valid until the next push
+const WifiFrame *wifiQueuePop(WifiQueue *q);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <WiFiUdp.h>
+
+// Wi-Fi network used by the optional network features
+#ifndef WIFI_SSID
+#define WIFI_SSID "lighting-ctrl"      // Wi-Fi network name
+#endif
+#ifndef WIFI_PASSWORD
+#define WIFI_PASSWORD ""               // Wi-Fi password
+#endif
+
+// Modem sleep between DTIM beacons saves power but delays received packets by up to a beacon interval,
+// which would eat into the hot-standby failover window, Modbus response times and emergency broadcasts
+// (multicast is held at the access point until the next DTIM beacon) - so it is off with any of them
+#ifndef WIFI_MODEM_SLEEP
+#define WIFI_MODEM_SLEEP (!HOT_STANDBY_ENABLED && !(MODBUS_ENABLED && MODBUS_TCP) && !EMERGENCY_ENABLED)
+#endif
+
+#ifndef WIFI_NTP_SERVER
+#define WIFI_NTP_SERVER "pool.ntp.org"  // Sets the clock so journal times are wall-clock UTC
+#endif
+
+// Link metrics
+extern WifiLink wifiLink;              // State and connection counters
+extern uint32_t wifiPollMaxUs;         // Longest wifiManagerPoll() - shows the cost added to loop()
+
+// Function to start the station and register for driver events - returns immediately
+void wifiManagerBegin();
+
+// Function to run the connection state machine and flush queued frames - call on every loop() pass
+void wifiManagerPoll();
+
+// Function to check whether the link is up - a cached flag, cheap enough for every packet
+bool wifiManagerLinkUp();
+
+// Function to queue a UDP frame for sending from socket - held while the link is down, false if the queue
+// is full. The socket must be bound (begin()) to the port the receiver replies to; it must outlive the frame
+bool wifiQueueSend(WiFiUDP *socket, const IPAddress &dest, uint16_t port, const uint8_t *data, size_t len);
+
+// Function to report queue drops
+uint32_t wifiQueueDropped();
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+// Zero-cross switching - relay contacts made and broken at the mains voltage zero, not wherever loop() happens
+// to be in the cycle
+// A contact closing near the peak of the cycle draws the full inrush of the LED drivers through an arc, and
+// every check-in and check-out does it again; that arcing is what wears the relays out. An optocoupler on the
+// mains gives an edge at every zero crossing. The edge interrupt keeps a filtered half-period, and from it a
+// switch request works out when the next usable zero will come. Each relay edge is fired early by the relay's
+// own operate time (coil on to contacts closed) or release time (coil off to contacts open), so the contacts
+// move at the zero and not the coil. A one-shot hardware timer fires the edges, each at its own offset, and
+// its interrupt writes the pins through the GPIO set and clear registers.
+//
+// Nothing waits: a switch request only queues its pins and arms the timer. A later request for a pin replaces
+// any edge for it still pending, so the last request wins, as with a relay bank. Until the detector has seen
+// ZC_LOCK_EDGES plausible half-cycles in a row - at boot, with the detector unplugged, or through a burst of
+// noise - relays are switched at once, as before.
+//
+// The period tracker and the schedule are portable C++ so the host simulator drives them with a synthetic
+// mains signal; the interrupts and timer are firmware-only.
+#ifndef ZERO_CROSS_H
+#define ZERO_CROSS_H
+
+#include <stdint.h>
+#include "relay_bank.h"
+
+#define ZC_MIN_HALF_US  7000        // Shortest half-cycle accepted - 71 Hz
+#define ZC_MAX_HALF_US  12000       // Longest - 42 Hz; 50 and 60 Hz mains need no setting
+#define ZC_LOCK_EDGES   4           // Plausible half-cycles in a row before switching is synchronized
+#define ZC_WINDOW       32          // An edge is a crossing within 1/32 of a half-cycle of when one is due
+#define ZC_LEAD_US      200         // Least time between a request and its edge - arming the timer, taking the irq
+#define ZC_SLACK_US     20          // An edge due this soon is fired by the irq already running
+#define ZC_MAX_PENDING  8           // Edges waiting for the timer - one per distinct fire time
+
+// Period tracker - written by the edge interrupt
+struct ZeroCross {
+  int32_t offsetUs;                 // From the detector's edge to the true zero - positive if the edge leads
+  volatile uint32_t crossUs;        // Filtered time of the last crossing's detector edge
+  volatile uint32_t half16;         // Filtered half-period in 1/16 us
+  volatile uint8_t good;            // Plausible half-cycles in a row, saturating
+  volatile uint32_t edges;          // Edges accepted
+  volatile uint32_t glitches;       // Edges between crossings - noise, ignored
+  volatile uint32_t missed;         // Crossings bridged because their edge never came
+  volatile uint32_t unlocks;        // Times the tracker lost lock - no crossing for over a cycle
+};
+
+// One edge waiting for the timer - the pins to drive high and low when it fires
+struct ZcEdge {
+  uint32_t fireUs;
+  uint32_t high, low;
+};
+
+// Edges waiting for the timer, unordered - the loop adds, the timer interrupt takes
+struct ZcSchedule {
+  ZcEdge pending[ZC_MAX_PENDING];
+  uint8_t count;
+};
+
+// Function to start a tracker with no lock - offsetUs from the detector's edge to the zero
+void zeroCrossInit(ZeroCross *zc, int32_t offsetUs);
+
+// Function to note a detector edge - interrupt context
+void zeroCrossEdge(ZeroCross *zc, uint32_t nowUs);
+
+// Function to check whether the tracker is locked - enough good half-cycles, and the last not too long ago
+bool zeroCrossLocked(const ZeroCross *zc, uint32_t nowUs);
+
+// Function to find when to fire an edge so the contacts move compensationUs later, on a zero crossing at
+// least ZC_LEAD_US away - false if the tracker is not locked
+bool zeroCrossFireTime(const ZeroCross *zc, uint32_t nowUs, uint32_t compensationUs, uint32_t *fireUs);
+
+// Function to queue a bank's edges - pins going high fire at highUs, pins going low at lowUs. The pins are
+// first taken out of every edge already pending. False if the schedule cannot hold both, with nothing changed
+bool zcScheduleAdd(ZcSchedule *s, const RelayBank *bank, uint32_t highUs, uint32_t lowUs);
+
+// Function to drop the pins from every pending edge - before they are switched some other way
+void zcScheduleCancel(ZcSchedule *s, uint32_t pins);
+
+// Function to take every edge due by nowUs + ZC_SLACK_US into a bank - true if edges remain, with *nextUs the
+// earliest of them
+bool zcScheduleDue(ZcSchedule *s, uint32_t nowUs, RelayBank *due, uint32_t *nextUs);
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+#ifndef ZERO_CROSS_ENABLED
+#define ZERO_CROSS_ENABLED 0        // Enable from build_flags (-DZERO_CROSS_ENABLED=1)
+#endif
+#ifndef ZC_PIN
+#define ZC_PIN           -1         // Detector output, e.g. an H11AA1 - a rising edge at every crossing
+#endif
+#ifndef ZC_DETECT_OFFSET_US
+#define ZC_DETECT_OFFSET_US 0       // Detector edge to true zero - measure once per detector with a scope
+#endif
+#ifndef ZC_OPERATE_US
+#define ZC_OPERATE_US    7000       // Coil on to contacts closed - from the relay datasheet or a scope
+#endif
+#ifndef ZC_RELEASE_US
+#define ZC_RELEASE_US    3500       // Coil off to contacts open
+#endif
+#define ZC_TIMER         1          // Hardware timer used for the edges - occupancy has timer 0
+#define ZC_REPORT_MS     60000      // Switching statistics on Serial this often
+
+// Switching counters
+extern uint32_t zeroCrossSwitches;      // Relay edges fired on a crossing
+extern uint32_t zeroCrossUnsynced;      // Relay changes made at once - no lock, or the schedule was full
+extern uint32_t zeroCrossLateMaxUs;     // Longest delay from an edge's fire time to its register write
+
+// Function to attach the detector interrupt and the edge timer
+void zeroCrossBegin();
+
+// Function to apply a bank's levels on the next zero crossing - at once without a lock; empties the bank.
+// Call in place of relayBankCommit() for mains relays
+void zeroCrossCommit(RelayBank *bank);
+
+// Function to apply a bank's levels at once, dropping any edge still pending for its pins - for emergency
+// lighting, which cannot wait for a crossing
+void zeroCrossCommitNow(RelayBank *bank);
+
+// Function to print switching statistics and CPU cost per switch now and then - call from the main loop
+void zeroCrossPoll();
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+#include "anomaly.h"
+#include <string.h>
+
+// Function to find a statistic's outlier threshold, scaled by 16 like the statistic
+static int32_t anomalyLimit(const AnomalyStat *s, int32_t minDev) {
+  int32_t dev = s->dev > minDev * 16 ? s->dev : minDev * 16;
+  return s->mean + ANOMALY_K * dev;
+}
+
+// Function to fold one value into a statistic - a plain average over the warm-up so the first values do not
+// dominate, then a 1/16 weight; once warmed up, values beyond the outlier threshold count as the threshold
+void anomalyStatAdd(AnomalyStat *s, int32_t x, int32_t minDev) {
+  int32_t x16 = x * 16;
+  if (s->samples >= ANOMALY_WARMUP) {
+    int32_t high = anomalyLimit(s, minDev), low = 2 * s->mean - high;
+    if (x16 > high) x16 = high;
+    if (x16 < low) x16 = low;
+  }
+  int32_t diff = x16 - s->mean;
+  int32_t absDiff = diff < 0 ? -diff : diff;
+  if (s->samples < (1 << ANOMALY_SHIFT)) {
+    int32_t n = s->samples + 1;
+    s->mean += diff / n;
+    s->dev += (absDiff - s->dev) / n;
+  }
+  else {
+    s->mean += diff >> ANOMALY_SHIFT;
+    s->dev += (absDiff - s->dev) >> ANOMALY_SHIFT;
+  }
+  if (s->samples < 0xFFFF) s->samples++;
+}
+
+// Function to check whether a value lies above the statistic's outlier threshold - false during warm-up
+bool anomalyStatHigh(const AnomalyStat *s, int32_t x, int32_t minDev) {
+  return s->samples >= ANOMALY_WARMUP && x * 16 > anomalyLimit(s, minDev);
+}
+
+// Function to compute log2 in Q8 - the top bit gives the integer part, the next 8 bits a linear fraction
+int32_t anomalyLog2(uint32_t x) {
+  if (x == 0) return 0;
+  int32_t msb = 31 - __builtin_clz(x);
+  uint32_t frac = msb >= 8 ? x >> (msb - 8) : x << (8 - msb);
+  return msb << 8 | (frac & 0xFF);
+}
+
+// Function to start a room with an empty model
+void anomalyRoomInit(AnomalyRoom *r, bool on, uint32_t nowMs) {
+  memset(r, 0, sizeof(*r));
+  r->on = on;
+  r->switchedMs = nowMs;
+}
+
+// Function to note the relay switching - a finished stay updates the stay statistic, and the mismatch
+// evidence starts again for the new relay state
+void anomalySwitched(AnomalyRoom *r, bool on, uint32_t nowMs) {
+  if (on == r->on) return;
+  if (!on) {
+    uint32_t stay = nowMs - r->switchedMs;
+    anomalyStatAdd(&r->model.stay, anomalyLog2(stay > 0 ? stay : 1), ANOMALY_MIN_LOG_DEV);
+    r->alerts &= ~ANOMALY_LONG_STAY;
+  }
+  r->on = on;
+  r->switchedMs = nowMs;
+  r->mismatch = 0;
+}
+
+// Function to note a tap at the room's door - only gaps ending while the room is on are learned, since the
+// question is how long an occupied room normally goes without anyone at the door
+void anomalyTap(AnomalyRoom *r, uint32_t nowMs) {
+  if (r->tapped && r->on) {
+    uint32_t gap = nowMs - r->lastTapMs;
+    anomalyStatAdd(&r->model.tapGap, anomalyLog2(gap > 0 ? gap : 1), ANOMALY_MIN_LOG_DEV);
+  }
+  r->tapped = true;
+  r->lastTapMs = nowMs;
+}
+
+// Function to check an occupied room for a stay left on - the stay must be an outlier for this room, and so
+// must the silence at its door once enough taps have been seen to judge it
+uint8_t anomalyCheckStay(AnomalyRoom *r, uint32_t nowMs) {
+  if (!r->on || (r->alerts & ANOMALY_LONG_STAY)) return 0;
+  uint32_t elapsed = nowMs - r->switchedMs;
+  if (elapsed < ANOMALY_MIN_STAY_MS || !anomalyStatHigh(&r->model.stay, anomalyLog2(elapsed), ANOMALY_MIN_LOG_DEV)) return 0;
+  uint32_t silence = r->tapped ? nowMs - r->lastTapMs : elapsed;
+  if (r->model.tapGap.samples >= ANOMALY_WARMUP &&
+      !anomalyStatHigh(&r->model.tapGap, anomalyLog2(silence > 0 ? silence : 1), ANOMALY_MIN_LOG_DEV)) return 0;
+  r->alerts |= ANOMALY_LONG_STAY;
+  return ANOMALY_LONG_STAY;
+}
+
+// Function to feed one current-sense reading - a reading counts as current flowing above the midpoint of the
+// learned on and off levels; only readings that agree with the relay teach those levels
+uint8_t anomalyCurrent(AnomalyRoom *r, uint16_t reading, uint32_t nowMs) {
+  if (nowMs - r->switchedMs < ANOMALY_SETTLE_MS) return 0;
+  const AnomalyStat *on = &r->model.currentOn, *off = &r->model.currentOff;
+  int32_t threshold = ANOMALY_CURRENT_THRESHOLD;
+  if (on->samples >= ANOMALY_WARMUP && off->samples >= ANOMALY_WARMUP && on->mean > off->mean + 2 * ANOMALY_MIN_CURRENT_DEV * 16) {
+    threshold = (on->mean + off->mean) / 32;
+  }
+  bool flowing = reading > threshold;
+  int32_t target = 0;
+  if (flowing == r->on) anomalyStatAdd(r->on ? &r->model.currentOn : &r->model.currentOff, reading, ANOMALY_MIN_CURRENT_DEV);
+  else target = 65536;
+  r->mismatch += (target - (int32_t)r->mismatch) >> ANOMALY_MISMATCH_SHIFT;
+
+  // The alert for the current relay state - a stuck-on alert clears only once an off period shows no current
+  uint8_t stuck = r->on ? ANOMALY_STUCK_OFF : ANOMALY_STUCK_ON;
+  if (r->mismatch <= ANOMALY_MISMATCH_CLEAR) r->alerts &= ~stuck;
+  if (r->mismatch < ANOMALY_MISMATCH_RAISE || (r->alerts & stuck)) return 0;
+  r->alerts |= stuck;
+  return stuck;
+}
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#include "room_state.h"
+
+uint32_t anomalyEvents = 0;
+uint32_t anomalyAlerts = 0;
+uint32_t anomalyMaxUs = 0;
+
+#if ANOMALY_ENABLED
+static const int8_t anomalyPins[NUM_ROOMS] = ANOMALY_CURRENT_PINS;
+static AnomalyRoom anomalyRooms[NUM_ROOMS];
+static uint32_t anomalySeenSeq = 0;             // roomStateSeq when relay changes were last looked for
+static uint32_t anomalySampleMs = 0;
+static uint32_t anomalySaveMs = 0;
+
+// Function to count one detector update and keep the longest
+static void anomalyTimed(uint32_t startUs) {
+  uint32_t us = micros() - startUs;
+  if (us > anomalyMaxUs) anomalyMaxUs = us;
+  anomalyEvents++;
+}
+
+// Function to keep what has been learned across a restart - weeks of stays would otherwise start over
+static void anomalySave() {
+  AnomalyModel models[NUM_ROOMS];
+  for (byte room = 0; room < NUM_ROOMS; room++) models[room] = anomalyRooms[room].model;
+  Preferences prefs;
+  prefs.begin("anomaly");
+  prefs.putBytes("models", models, sizeof(models));
+  prefs.end();
+}
+#endif
+
+// Function to load the learned models and start from the current room state
+void anomalyBegin() {
+#if ANOMALY_ENABLED
+  uint32_t now = millis();
+  AnomalyModel models[NUM_ROOMS];
+  Preferences prefs;
+  prefs.begin("anomaly", true);  // Read-only
+  bool saved = prefs.getBytes("models", models, sizeof(models)) == sizeof(models);  // Not after a room count change
+  prefs.end();
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    anomalyRoomInit(&anomalyRooms[room], relayOn[room], now);
+    if (saved) anomalyRooms[room].model = models[room];
+  }
+  anomalySeenSeq = roomStateSeq;
+  anomalySampleMs = anomalySaveMs = now;
+#endif
+}
+
+// Function to note a tap at a room's door
+void anomalyRecordTap(uint8_t room) {
+#if ANOMALY_ENABLED
+  if (room >= NUM_ROOMS) return;  // A remote door without a room on this controller
+  uint32_t start = micros();
+  anomalyTap(&anomalyRooms[room], millis());
+  anomalyTimed(start);
+#endif
+}
+
+// Function to follow relay changes, sample current and check stays
+void anomalyPoll(void (*alert)(uint8_t room, uint8_t alerts)) {
+#if ANOMALY_ENABLED
+  uint32_t now = millis();
+  if (roomStateSeq != anomalySeenSeq) {
+    // A room switched by any path - tap, BMS, sensors, replication
+    for (byte room = 0; room < NUM_ROOMS; room++) {
+      if (relayOn[room] == anomalyRooms[room].on) continue;
+      uint32_t start = micros();
+      anomalySwitched(&anomalyRooms[room], relayOn[room], now);
+      anomalyTimed(start);
+    }
+    anomalySeenSeq = roomStateSeq;
+  }
+  if (now - anomalySampleMs < ANOMALY_SAMPLE_MS) return;
+  anomalySampleMs = now;
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    int reading = anomalyPins[room] >= 0 ? analogRead(anomalyPins[room]) : -1;  // Outside the timing - the ADC is slow
+    uint32_t start = micros();
+    uint8_t raised = anomalyCheckStay(&anomalyRooms[room], now);
+    if (reading >= 0) raised |= anomalyCurrent(&anomalyRooms[room], reading, now);
+    anomalyTimed(start);
+    if (raised) {
+      anomalyAlerts++;
+      alert(room, raised);
+    }
+  }
+  if (now - anomalySaveMs >= ANOMALY_SAVE_MS) {
+    anomalySave();
+    anomalySaveMs = now;
+  }
+#endif
+}
+#endif
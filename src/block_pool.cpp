@@ -0,0 +1,50 @@
+#include "block_pool.h"
+
+// Function to set up a pool - every block starts free, in address order
+void blockPoolInit(BlockPool *pool, void *storage, uint16_t blockSize, uint16_t count, std::atomic<uint16_t> *links) {
+  pool->storage = (uint8_t *)storage;
+  pool->blockSize = blockSize;
+  pool->count = count < 0xFFFF ? count : 0xFFFE;  // Index + 1 must fit the head's low half
+  pool->links = links;
+  for (uint16_t i = 0; i < pool->count; i++) links[i].store(i + 1 < pool->count ? i + 2 : 0, std::memory_order_relaxed);
+  pool->head.store(pool->count > 0 ? 1 : 0, std::memory_order_release);
+  pool->used.store(0, std::memory_order_relaxed);
+  pool->peak.store(0, std::memory_order_relaxed);
+  pool->exhausted.store(0, std::memory_order_relaxed);
+}
+
+// Function to take a block - pops the free stack; the counter in the head changes on every swap, so a
+// link read from a block that has since been taken and returned fails the swap instead of being used
+void *blockPoolAlloc(BlockPool *pool) {
+  uint32_t head = pool->head.load(std::memory_order_acquire);
+  uint16_t index;
+  for (;;) {
+    index = head & 0xFFFF;
+    if (index == 0) {
+      pool->exhausted.fetch_add(1, std::memory_order_relaxed);
+      return NULL;
+    }
+    uint32_t next = ((head >> 16) + 1) << 16 | pool->links[index - 1].load(std::memory_order_relaxed);
+    if (pool->head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) break;
+  }
+  uint32_t used = pool->used.fetch_add(1, std::memory_order_relaxed) + 1;
+  uint32_t peak = pool->peak.load(std::memory_order_relaxed);
+  while (used > peak && !pool->peak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+  }
+  return pool->storage + (size_t)(index - 1) * pool->blockSize;
+}
+
+// Function to return a block - pushes it on the free stack; the release swap publishes its link
+void blockPoolFree(BlockPool *pool, void *block) {
+  if (block == NULL || (uint8_t *)block < pool->storage) return;
+  size_t offset = (uint8_t *)block - pool->storage;
+  if (offset % pool->blockSize != 0 || offset / pool->blockSize >= pool->count) return;
+  uint16_t index = offset / pool->blockSize + 1;
+  uint32_t head = pool->head.load(std::memory_order_relaxed);
+  uint32_t next;
+  do {
+    pool->links[index - 1].store(head & 0xFFFF, std::memory_order_relaxed);
+    next = ((head >> 16) + 1) << 16 | index;
+  } while (!pool->head.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+  pool->used.fetch_sub(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,273 @@
+#include "card_list.h"
+#include "crypto_service.h"
+#include <string.h>
+
+static const uint8_t cardBlobMagic[4] = {'C', 'L', 'D', 'U'};
+static const uint8_t cardAckMagic[4] = {'C', 'L', 'D', 'A'};
+
+static void cardPut16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void cardPut32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+}
+
+static uint16_t cardGet16(const uint8_t *p) {
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t cardGet32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int cardCompare(const uint8_t *a, const uint8_t *b) {
+  return memcmp(a, b, CARD_LIST_UID_SIZE);
+}
+
+// Function to start an empty list at version 0
+void cardListInit(CardList *list) {
+  memset(list, 0, sizeof(*list));
+}
+
+// Function to look up a card - binary search over the sorted entries
+int cardListFind(const CardList *list, const uint8_t *uid) {
+  int lo = 0, hi = list->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = cardCompare(list->entries[mid].uid, uid);
+    if (cmp == 0) return list->entries[mid].room;
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return -1;
+}
+
+// Function to verify and parse a blob - the tag is checked before anything else is trusted
+bool cardDeltaDecode(const uint8_t *blob, size_t len, const uint8_t *key, size_t keyLen, CardDelta *delta) {
+  if (len < CARD_LIST_HEADER_SIZE + CARD_LIST_TAG_SIZE || len > CARD_LIST_BLOB_MAX) return false;
+  if (memcmp(blob, cardBlobMagic, 4) != 0 || blob[4] != CARD_LIST_FORMAT) return false;
+  uint16_t removes = cardGet16(blob + 16), adds = cardGet16(blob + 18);
+  if (len != (size_t)CARD_LIST_HEADER_SIZE + removes * CARD_LIST_UID_SIZE + adds * CARD_LIST_ADD_SIZE + CARD_LIST_TAG_SIZE) return false;
+
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, blob, len - CARD_LIST_TAG_SIZE, mac);
+  if (!cryptoEqual(mac, blob + len - CARD_LIST_TAG_SIZE, CARD_LIST_TAG_SIZE)) return false;
+
+  delta->flags = blob[5];
+  delta->controller = cardGet16(blob + 6);
+  delta->baseVersion = cardGet32(blob + 8);
+  delta->version = cardGet32(blob + 12);
+  delta->removeCount = removes;
+  delta->addCount = adds;
+  delta->removes = blob + CARD_LIST_HEADER_SIZE;
+  delta->adds = delta->removes + removes * CARD_LIST_UID_SIZE;
+
+  // Both lists strictly ascending and disjoint - the in-place merges rely on it
+  for (uint16_t i = 1; i < removes; i++) {
+    if (cardCompare(delta->removes + (i - 1) * CARD_LIST_UID_SIZE, delta->removes + i * CARD_LIST_UID_SIZE) >= 0) return false;
+  }
+  for (uint16_t i = 1; i < adds; i++) {
+    if (cardCompare(delta->adds + (i - 1) * CARD_LIST_ADD_SIZE, delta->adds + i * CARD_LIST_ADD_SIZE) >= 0) return false;
+  }
+  for (uint16_t i = 0, j = 0; i < removes && j < adds;) {
+    int cmp = cardCompare(delta->removes + i * CARD_LIST_UID_SIZE, delta->adds + j * CARD_LIST_ADD_SIZE);
+    if (cmp == 0) return false;
+    if (cmp < 0) i++;
+    else j++;
+  }
+  return true;
+}
+
+// Function to apply a verified blob in place
+// The final size is worked out first, so a blob that would overflow the list is refused with the list untouched
+CardApply cardListApply(CardList *list, uint16_t controller, const CardDelta *delta) {
+  if (delta->controller != controller) return CARD_FOREIGN;
+  if (delta->baseVersion != list->version) return CARD_STALE;
+  if (!(delta->flags & CARD_FLAG_RESET) && list->partial != 0 && list->partial != delta->version) return CARD_MIXED;
+
+  uint16_t count = (delta->flags & CARD_FLAG_RESET) ? 0 : list->count;
+  int removed = 0, moved = 0;
+  for (uint16_t i = 0, j = 0; i < count && j < delta->removeCount;) {
+    int cmp = cardCompare(list->entries[i].uid, delta->removes + j * CARD_LIST_UID_SIZE);
+    if (cmp == 0) removed++;
+    if (cmp <= 0) i++;
+    if (cmp >= 0) j++;
+  }
+  for (uint16_t i = 0, j = 0; i < count && j < delta->addCount;) {
+    int cmp = cardCompare(list->entries[i].uid, delta->adds + j * CARD_LIST_ADD_SIZE);
+    if (cmp == 0) moved++;  // Already listed - only its room changes
+    if (cmp <= 0) i++;
+    if (cmp >= 0) j++;
+  }
+  int total = count - removed + delta->addCount - moved;
+  if (total > CARD_LIST_CAPACITY) return CARD_FULL;
+
+  // Removes - compact forwards
+  uint16_t kept = 0;
+  for (uint16_t i = 0, j = 0; i < count; i++) {
+    while (j < delta->removeCount && cardCompare(delta->removes + j * CARD_LIST_UID_SIZE, list->entries[i].uid) < 0) j++;
+    if (j < delta->removeCount && cardCompare(delta->removes + j * CARD_LIST_UID_SIZE, list->entries[i].uid) == 0) continue;
+    if (kept != i) list->entries[kept] = list->entries[i];
+    kept++;
+  }
+
+  // Adds - merge backwards from the end of the final list, so no entry is overwritten before it moves
+  int i = kept - 1, j = delta->addCount - 1, k = total - 1;
+  while (j >= 0) {
+    const uint8_t *add = delta->adds + j * CARD_LIST_ADD_SIZE;
+    int cmp = i >= 0 ? cardCompare(list->entries[i].uid, add) : -1;
+    if (cmp > 0) {
+      list->entries[k--] = list->entries[i--];
+      continue;
+    }
+    memcpy(list->entries[k].uid, add, CARD_LIST_UID_SIZE);
+    list->entries[k--].room = add[CARD_LIST_UID_SIZE];
+    if (cmp == 0) i--;  // Moved card - replaced where it stood
+    j--;
+  }
+  list->count = total;
+  if (delta->flags & CARD_FLAG_FINAL) list->version = delta->version;
+  list->partial = (delta->flags & CARD_FLAG_FINAL) ? 0 : delta->version;  // Later parts must lead to the same version
+  return CARD_APPLIED;
+}
+
+// Function to sign and serialize a blob
+size_t cardDeltaEncode(uint8_t *buf, size_t capacity, const CardDelta *delta, const uint8_t *key, size_t keyLen) {
+  size_t len = CARD_LIST_HEADER_SIZE + delta->removeCount * CARD_LIST_UID_SIZE + delta->addCount * CARD_LIST_ADD_SIZE +
+               CARD_LIST_TAG_SIZE;
+  if (len > capacity || len > CARD_LIST_BLOB_MAX) return 0;
+  memcpy(buf, cardBlobMagic, 4);
+  buf[4] = CARD_LIST_FORMAT;
+  buf[5] = delta->flags;
+  cardPut16(buf + 6, delta->controller);
+  cardPut32(buf + 8, delta->baseVersion);
+  cardPut32(buf + 12, delta->version);
+  cardPut16(buf + 16, delta->removeCount);
+  cardPut16(buf + 18, delta->addCount);
+  uint8_t *p = buf + CARD_LIST_HEADER_SIZE;
+  memcpy(p, delta->removes, delta->removeCount * CARD_LIST_UID_SIZE);
+  p += delta->removeCount * CARD_LIST_UID_SIZE;
+  memcpy(p, delta->adds, delta->addCount * CARD_LIST_ADD_SIZE);
+
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, buf, len - CARD_LIST_TAG_SIZE, mac);
+  memcpy(buf + len - CARD_LIST_TAG_SIZE, mac, CARD_LIST_TAG_SIZE);
+  return len;
+}
+
+// Function to build an acknowledgement - signed too, so a forged one cannot make the host stop sending
+size_t cardAckEncode(uint8_t buf[CARD_LIST_ACK_SIZE], uint16_t controller, uint32_t version, uint8_t result,
+                     const uint8_t *key, size_t keyLen) {
+  memcpy(buf, cardAckMagic, 4);
+  buf[4] = CARD_LIST_FORMAT;
+  buf[5] = result;
+  cardPut16(buf + 6, controller);
+  cardPut32(buf + 8, version);
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, buf, CARD_LIST_ACK_SIZE - CARD_LIST_TAG_SIZE, mac);
+  memcpy(buf + CARD_LIST_ACK_SIZE - CARD_LIST_TAG_SIZE, mac, CARD_LIST_TAG_SIZE);
+  return CARD_LIST_ACK_SIZE;
+}
+
+// Function to check an acknowledgement
+bool cardAckDecode(const uint8_t *buf, size_t len, const uint8_t *key, size_t keyLen, uint16_t *controller,
+                   uint32_t *version, uint8_t *result) {
+  if (len != CARD_LIST_ACK_SIZE || memcmp(buf, cardAckMagic, 4) != 0 || buf[4] != CARD_LIST_FORMAT) return false;
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, buf, CARD_LIST_ACK_SIZE - CARD_LIST_TAG_SIZE, mac);
+  if (!cryptoEqual(mac, buf + CARD_LIST_ACK_SIZE - CARD_LIST_TAG_SIZE, CARD_LIST_TAG_SIZE)) return false;
+  *result = buf[5];
+  *controller = cardGet16(buf + 6);
+  *version = cardGet32(buf + 8);
+  return true;
+}
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#include <WiFiUdp.h>
+#include "room_state.h"
+#include "wifi_manager.h"
+
+CardList cardList;                    // This controller's cards
+uint32_t cardListUpdates = 0;
+uint32_t cardListRejected = 0;
+uint32_t cardListApplyUs = 0;
+
+#if CARD_LIST_ENABLED
+static const uint8_t cardListKey[] = CARD_LIST_SITE_KEY;
+#define CARD_LIST_KEY_LEN (sizeof(cardListKey) - 1)  // Without the string terminator
+
+static WiFiUDP cardUdp;
+
+// Function to persist the list so it survives a power cut
+static void cardListSave() {
+  Preferences prefs;
+  prefs.begin("cards");
+  prefs.putUInt("ver", cardList.version);
+  prefs.putUInt("part", cardList.partial);
+  prefs.putBytes("list", cardList.entries, cardList.count * sizeof(CardEntry));
+  prefs.end();
+}
+#endif
+
+// Function to load the list from NVS and open the UDP port
+void cardListBegin() {
+  cardListInit(&cardList);
+#if CARD_LIST_ENABLED
+  Preferences prefs;
+  prefs.begin("cards", true);  // Read-only
+  cardList.version = prefs.getUInt("ver", 0);
+  cardList.partial = prefs.getUInt("part", 0);
+  size_t bytes = prefs.getBytes("list", cardList.entries, sizeof(cardList.entries));
+  cardList.count = bytes / sizeof(CardEntry);
+  prefs.end();
+  cardUdp.begin(CARD_LIST_UDP_PORT);
+#endif
+}
+
+// Function to receive update blobs - one datagram per call keeps the loop pass short
+void cardListPoll() {
+#if CARD_LIST_ENABLED
+  static uint8_t buf[CARD_LIST_BLOB_MAX];
+  if (!wifiManagerLinkUp() || cardUdp.parsePacket() <= 0) return;
+  int len = cardUdp.read(buf, sizeof(buf));
+  if (len < CARD_LIST_HEADER_SIZE || (buf[6] | buf[7] << 8) != CARD_LIST_CONTROLLER_ID) return;  // Another controller's blob
+
+  unsigned long start = micros();
+  CardDelta delta;
+  CardApply result = CARD_INVALID;
+  if (cardDeltaDecode(buf, len, cardListKey, CARD_LIST_KEY_LEN, &delta)) {
+    result = cardListApply(&cardList, CARD_LIST_CONTROLLER_ID, &delta);
+  }
+  if (result == CARD_APPLIED) {
+    cardListApplyUs = micros() - start;
+    cardListSave();
+    cardListUpdates++;
+    if (delta.flags & CARD_FLAG_FINAL) {
+      Serial.printf("Cards: version %lu, %u cards, applied in %lu us\n", (unsigned long)cardList.version,
+                    cardList.count, (unsigned long)cardListApplyUs);
+    }
+  }
+  else cardListRejected++;
+  if (result == CARD_MIXED) {
+    Serial.printf("Cards: holding parts of version %lu, asking for the full list\n", (unsigned long)cardList.partial);
+  }
+  if (result == CARD_INVALID) return;  // Forged or damaged - not worth an answer
+
+  // Answer with the version now held - after a stale blob that tells the host where to start the next delta
+  uint8_t ack[CARD_LIST_ACK_SIZE];
+  cardAckEncode(ack, CARD_LIST_CONTROLLER_ID, cardList.version, result, cardListKey, CARD_LIST_KEY_LEN);
+  cardUdp.beginPacket(cardUdp.remoteIP(), cardUdp.remotePort());
+  cardUdp.write(ack, sizeof(ack));
+  cardUdp.endPacket();
+#endif
+}
+
+// Function to look up a card in the distributed list - rooms this controller does not have are ignored
+int cardListRoom(const uint8_t *uid) {
+  int room = cardListFind(&cardList, uid);
+  return room < NUM_ROOMS ? room : -1;
+}
+#endif
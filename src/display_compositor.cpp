@@ -0,0 +1,130 @@
+#include "display_compositor.h"
+#include <string.h>
+
+// Function to compare a frame with the shadow - one pass per page, remembering the first and last change
+void displayDiff(const uint8_t *frame, uint8_t *shadow, uint8_t width, uint8_t pages, DisplaySpan *spans, bool all) {
+  for (uint8_t p = 0; p < pages; p++) {
+    const uint8_t *row = frame + p * width;
+    uint8_t *seen = shadow + p * width;
+    spans[p].first = 1;
+    spans[p].last = 0;
+    if (all) {
+      spans[p].first = 0;
+      spans[p].last = width - 1;
+    }
+    else {
+      for (uint8_t x = 0; x < width; x++) {
+        if (row[x] == seen[x]) continue;
+        if (spans[p].first > spans[p].last) spans[p].first = x;
+        spans[p].last = x;
+      }
+    }
+    if (spans[p].first <= spans[p].last) {
+      memcpy(seen + spans[p].first, row + spans[p].first, spans[p].last - spans[p].first + 1);
+    }
+  }
+}
+
+// Function to count bus bytes - the window is one write of address, control byte and six commands
+uint32_t displayBusBytes(const DisplaySpan *spans, uint8_t pages) {
+  uint32_t bytes = 0;
+  for (uint8_t p = 0; p < pages; p++) {
+    if (spans[p].first > spans[p].last) continue;
+    uint32_t data = spans[p].last - spans[p].first + 1;
+    bytes += 8 + data + 2 * ((data + DISPLAY_I2C_CHUNK - 1) / DISPLAY_I2C_CHUNK);
+  }
+  return bytes;
+}
+
+// Function to count a whole frame's bus bytes
+uint32_t displayFullFrameBytes(uint8_t width, uint8_t pages) {
+  DisplaySpan spans[DISPLAY_MAX_PAGES];
+  for (uint8_t p = 0; p < pages; p++) spans[p] = {0, (uint8_t)(width - 1)};
+  return displayBusBytes(spans, pages);
+}
+
+// Function to copy text into a fixed line, cut to fit
+static void alertCopy(char *to, const char *from) {
+  strncpy(to, from, ALERT_TEXT_SIZE - 1);
+  to[ALERT_TEXT_SIZE - 1] = '\0';
+}
+
+// Function to post an alert - compared on both lines and the card, so another card's denial is shown as its own
+bool alertOverlayPost(AlertOverlay *a, const char *title, const char *detail, const uint8_t *uid, uint8_t uidSize,
+                      uint32_t nowMs) {
+  if (uidSize > ALERT_UID_SIZE) uidSize = ALERT_UID_SIZE;
+  a->shownMs = nowMs;
+  a->burstAlerts++;
+  if (a->active && strncmp(a->title, title, ALERT_TEXT_SIZE - 1) == 0 &&
+      strncmp(a->detail, detail, ALERT_TEXT_SIZE - 1) == 0 && a->uidSize == uidSize &&
+      memcmp(a->uid, uid, uidSize) == 0) {
+    if (a->repeats < 999) a->repeats++;  // Three digits on the title bar
+    return true;
+  }
+  a->active = true;
+  alertCopy(a->title, title);
+  alertCopy(a->detail, detail);
+  memcpy(a->uid, uid, uidSize);
+  a->uidSize = uidSize;
+  a->repeats = 1;
+  return false;
+}
+
+// Function to take the overlay down after its time
+bool alertOverlayExpire(AlertOverlay *a, uint32_t nowMs, uint32_t durationMs) {
+  if (!a->active || nowMs - a->shownMs <= durationMs) return false;
+  a->active = false;
+  return true;
+}
+
+// Function to count a frame sent during an alert burst - the burst lasts until its numbers are taken and cleared
+void alertOverlayCountFrame(AlertOverlay *a, uint32_t bytes) {
+  if (a->burstAlerts == 0 || bytes == 0) return;  // No burst, or nothing changed on the panel
+  a->burstFrames++;
+  a->burstBytes += bytes;
+}
+
+#ifdef ARDUINO
+uint32_t displayFrames = 0;
+uint32_t displayBytes = 0;
+
+static uint8_t displayShadow[DISPLAY_MAX_PAGES * 128];  // What the panel shows
+static bool displayShadowValid = false;                 // False until the first frame has been sent whole
+
+// Function to send the changed spans - a window per page, then its data in chunks
+uint32_t displayFlush(Adafruit_SSD1306 *display, TwoWire *wire, uint8_t address) {
+  uint8_t width = display->width();
+  uint8_t pages = display->height() / 8;
+  if (width > 128 || pages > DISPLAY_MAX_PAGES) return 0;
+  const uint8_t *frame = display->getBuffer();
+  DisplaySpan spans[DISPLAY_MAX_PAGES];
+  displayDiff(frame, displayShadow, width, pages, spans, !displayShadowValid);
+  displayShadowValid = true;
+  for (uint8_t p = 0; p < pages; p++) {
+    if (spans[p].first > spans[p].last) continue;
+    wire->beginTransmission(address);
+    wire->write((uint8_t)0x00);  // Control byte - commands follow
+    wire->write((uint8_t)SSD1306_PAGEADDR);
+    wire->write(p);
+    wire->write(p);
+    wire->write((uint8_t)SSD1306_COLUMNADDR);
+    wire->write(spans[p].first);
+    wire->write(spans[p].last);
+    wire->endTransmission();
+    for (uint16_t x = spans[p].first; x <= spans[p].last; x += DISPLAY_I2C_CHUNK) {
+      uint16_t n = spans[p].last + 1 - x;
+      if (n > DISPLAY_I2C_CHUNK) n = DISPLAY_I2C_CHUNK;
+      wire->beginTransmission(address);
+      wire->write((uint8_t)0x40);  // Control byte - display data follows
+      wire->write(frame + p * width + x, n);
+      wire->endTransmission();
+    }
+  }
+  uint32_t bytes = displayBusBytes(spans, pages);
+  if (bytes) {
+    displayFrames++;
+    displayBytes += bytes;
+  }
+  return bytes;
+}
+#endif
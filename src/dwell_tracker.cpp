@@ -0,0 +1,178 @@
+#include "dwell_tracker.h"
+#include <string.h>
+
+static_assert((DWELL_TABLE_SIZE & (DWELL_TABLE_SIZE - 1)) == 0, "DWELL_TABLE_SIZE must be a power of two");
+
+// Function to hash a UID to its home slot - FNV-1a, high half folded in since its low bits mix poorly
+static uint16_t dwellHome(const uint8_t uid[DWELL_UID_SIZE]) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < DWELL_UID_SIZE; i++) h = (h ^ uid[i]) * 16777619u;
+  return (h ^ (h >> 16)) & (DWELL_TABLE_SIZE - 1);
+}
+
+// Function to find a badge's slot, or the free slot it would take - NULL when absent and the table is full
+// Slots are never freed (staff badges are a bounded set), so probing stops at the first free slot
+static DwellBadge *dwellFind(DwellTracker *t, const uint8_t uid[DWELL_UID_SIZE]) {
+  uint16_t slot = dwellHome(uid);
+  for (uint32_t probe = 1; probe <= DWELL_TABLE_SIZE; probe++) {
+    DwellBadge *b = &t->badges[slot];
+    if (!b->used || memcmp(b->uid, uid, DWELL_UID_SIZE) == 0) {
+      if (probe > t->maxProbe) t->maxProbe = probe;
+      return b;
+    }
+    slot = (slot + 1) & (DWELL_TABLE_SIZE - 1);
+  }
+  return NULL;
+}
+
+// Function to move a window forward to the bucket holding now, clearing buckets that fell out
+static void dwellWindowAdvance(DwellWindow *w, uint32_t now) {
+  uint32_t bucket = now / DWELL_BUCKET_S;
+  if (bucket <= w->bucket) return;
+  uint32_t steps = bucket - w->bucket;
+  if (steps > DWELL_WINDOW_BUCKETS) steps = DWELL_WINDOW_BUCKETS;
+  for (uint32_t i = 1; i <= steps; i++) {
+    uint32_t index = (w->bucket + i) % DWELL_WINDOW_BUCKETS;
+    w->seconds[index] = 0;
+    w->visits[index] = 0;
+  }
+  w->bucket = bucket;
+}
+
+// Function to sum the part of a window that is still inside the rolling period at now
+static uint32_t dwellWindowSum(const DwellWindow *w, uint32_t now, bool visits) {
+  uint32_t bucket = now / DWELL_BUCKET_S;
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < DWELL_WINDOW_BUCKETS; i++) {
+    uint32_t b = w->bucket - i;  // Bucket number held at this position
+    if (b > bucket || bucket - b >= DWELL_WINDOW_BUCKETS) continue;
+    sum += visits ? w->visits[b % DWELL_WINDOW_BUCKETS] : w->seconds[b % DWELL_WINDOW_BUCKETS];
+  }
+  return sum;
+}
+
+uint32_t dwellWindowSeconds(const DwellWindow *w, uint32_t now) {
+  return dwellWindowSum(w, now, false);
+}
+
+uint32_t dwellWindowVisits(const DwellWindow *w, uint32_t now) {
+  return dwellWindowSum(w, now, true);
+}
+
+// Function to credit one paired visit to a set of totals, in the bucket of the exit time
+static void dwellCredit(DwellTotals *totals, uint32_t seconds, uint32_t now) {
+  dwellWindowAdvance(&totals->window, now);
+  uint32_t index = totals->window.bucket % DWELL_WINDOW_BUCKETS;
+  totals->window.seconds[index] += seconds;
+  totals->window.visits[index]++;
+  totals->seconds += seconds;
+  totals->visits++;
+}
+
+// Function to close a badge's open visit without an exit tap
+static void dwellMissed(DwellTracker *t, DwellBadge *b) {
+  b->totals.missedExits++;
+  t->rooms[b->room].missedExits++;
+  b->room = DWELL_NO_ROOM;
+  t->openVisits--;
+}
+
+// Function to start tracking - rooms must hold roomCount zeroed entries
+void dwellInit(DwellTracker *t, DwellTotals *rooms, uint16_t roomCount) {
+  memset(t, 0, sizeof(*t));
+  t->rooms = rooms;
+  t->roomCount = roomCount;
+}
+
+// Function to pair one tap - duration receives the credited seconds on DWELL_EXITED
+DwellResult dwellTap(DwellTracker *t, const uint8_t uid[DWELL_UID_SIZE], uint16_t room, uint32_t now, uint32_t *duration) {
+  if (room >= t->roomCount) return DWELL_REJECTED;
+  DwellBadge *b = dwellFind(t, uid);
+  if (b == NULL) {
+    t->tableFull++;
+    return DWELL_REJECTED;
+  }
+  if (!b->used) {
+    memcpy(b->uid, uid, DWELL_UID_SIZE);
+    b->used = true;
+    b->room = DWELL_NO_ROOM;
+    t->badgeCount++;
+  }
+
+  if (b->room == room) {
+    uint32_t elapsed = now - b->enteredAt;
+    if (elapsed < DWELL_MIN_VISIT_S) return DWELL_DUPLICATE;
+    if (elapsed <= DWELL_TIMEOUT_S) {
+      dwellCredit(&b->totals, elapsed, now);
+      dwellCredit(&t->rooms[room], elapsed, now);
+      b->room = DWELL_NO_ROOM;
+      t->openVisits--;
+      if (duration) *duration = elapsed;
+      return DWELL_EXITED;
+    }
+  }
+
+  // Any open visit left now had its exit missed - this tap opens a new one
+  if (b->room != DWELL_NO_ROOM) dwellMissed(t, b);
+  b->room = room;
+  b->enteredAt = now;
+  t->openVisits++;
+  return DWELL_ENTERED;
+}
+
+// Function to close timed-out visits - looks at a few slots per call so it can run from loop()
+void dwellExpire(DwellTracker *t, uint32_t now, uint16_t slots) {
+  for (uint16_t i = 0; i < slots && t->openVisits > 0; i++) {
+    DwellBadge *b = &t->badges[t->expireCursor];
+    t->expireCursor = (t->expireCursor + 1) & (DWELL_TABLE_SIZE - 1);
+    if (b->used && b->room != DWELL_NO_ROOM && now - b->enteredAt > DWELL_TIMEOUT_S) dwellMissed(t, b);
+  }
+}
+
+// Function to look up a badge's totals - NULL if the badge has never tapped
+const DwellTotals *dwellBadgeTotals(const DwellTracker *t, const uint8_t uid[DWELL_UID_SIZE]) {
+  DwellBadge *b = dwellFind((DwellTracker *)t, uid);
+  return b != NULL && b->used ? &b->totals : NULL;
+}
+
+#ifdef ARDUINO
+#include "room_state.h"
+#include <esp_timer.h>
+
+static_assert(DWELL_UID_SIZE == UID_SIZE && DWELL_READER_ROOM < NUM_ROOMS, "dwell tracker does not match the room table");
+
+DwellTracker dwellTracker;
+static DwellTotals dwellRooms[NUM_ROOMS];
+static bool dwellStarted = false;
+static uint32_t dwellLastReport = 0;
+
+// Function to read seconds since boot - time(NULL) steps when SNTP first sets or corrects the clock,
+// which would turn every open visit into a missed exit or wrap its duration
+static uint32_t dwellNow() {
+  return esp_timer_get_time() / 1000000;
+}
+
+// Function to pair a staff tap at a room's door - duration receives the credited seconds on exit
+DwellResult dwellRecordTap(const uint8_t *uid, uint16_t room, uint32_t *duration) {
+  if (!dwellStarted) {
+    dwellInit(&dwellTracker, dwellRooms, NUM_ROOMS);
+    dwellStarted = true;
+  }
+  return dwellTap(&dwellTracker, uid, room, dwellNow(), duration);
+}
+
+// Function to close timed-out visits and report totals now and then - call while waiting
+void dwellMaintain() {
+  if (!dwellStarted) return;
+  uint32_t now = dwellNow();
+  dwellExpire(&dwellTracker, now, 4);
+  if (now - dwellLastReport < DWELL_REPORT_S) return;
+  dwellLastReport = now;
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    const DwellTotals *r = &dwellRooms[room];
+    Serial.printf("Dwell room %u: %lu s in %lu visits this shift, %lu missed exits\n", room + 1,
+                  (unsigned long)dwellWindowSeconds(&r->window, now), (unsigned long)dwellWindowVisits(&r->window, now),
+                  (unsigned long)r->missedExits);
+  }
+}
+#endif
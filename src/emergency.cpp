@@ -0,0 +1,192 @@
+#include "emergency.h"
+#include "crypto_service.h"
+#include <string.h>
+
+static const uint8_t emergencyMagic[4] = {'E', 'M', 'R', 'G'};
+
+static uint32_t emergencyGet32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Function to sign and serialize a command
+size_t emergencyEncode(uint8_t buf[EMERGENCY_SIZE], uint16_t site, uint32_t seq, uint8_t scene,
+                       const uint8_t *key, size_t keyLen) {
+  memcpy(buf, emergencyMagic, 4);
+  buf[4] = EMERGENCY_FORMAT;
+  buf[5] = scene;
+  buf[6] = site;
+  buf[7] = site >> 8;
+  for (int i = 0; i < 4; i++) buf[8 + i] = seq >> (8 * i);
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, buf, EMERGENCY_SIZE - EMERGENCY_TAG_SIZE, mac);
+  memcpy(buf + EMERGENCY_SIZE - EMERGENCY_TAG_SIZE, mac, EMERGENCY_TAG_SIZE);
+  return EMERGENCY_SIZE;
+}
+
+// Function to start a receiver with no command acted on
+void emergencyReceiverInit(EmergencyReceiver *rx, uint16_t site) {
+  rx->site = site;
+  rx->seq = 0;
+  rx->scene = EMERGENCY_SCENE_CLEAR;
+}
+
+// Function to check one datagram and act on it - most datagrams are repeats, so the seq is compared first
+// and the HMAC only computed for a command not yet seen
+EmergencyResult emergencyReceive(EmergencyReceiver *rx, const uint8_t *buf, size_t len, const uint8_t *key, size_t keyLen) {
+  if (len != EMERGENCY_SIZE || memcmp(buf, emergencyMagic, 4) != 0 || buf[4] != EMERGENCY_FORMAT) return EMERGENCY_INVALID;
+  if ((buf[6] | buf[7] << 8) != rx->site || buf[5] > EMERGENCY_SCENE_ALL_ON) return EMERGENCY_INVALID;
+  uint32_t seq = emergencyGet32(buf + 8);
+  if (seq <= rx->seq) return EMERGENCY_REPEAT;  // Forged low seqs end here too - they cannot change anything
+
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, buf, EMERGENCY_SIZE - EMERGENCY_TAG_SIZE, mac);
+  if (!cryptoEqual(mac, buf + EMERGENCY_SIZE - EMERGENCY_TAG_SIZE, EMERGENCY_TAG_SIZE)) return EMERGENCY_INVALID;
+  rx->seq = seq;
+  rx->scene = buf[5];
+  return EMERGENCY_ACT;
+}
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include "zero_cross.h"
+#include "wifi_manager.h"
+
+uint32_t emergencyCommands = 0;
+uint32_t emergencyRepeats = 0;
+uint32_t emergencyRejected = 0;
+uint32_t emergencySwitchUs = 0;
+
+#if EMERGENCY_ENABLED
+static const uint8_t emergencyKey[] = EMERGENCY_SITE_KEY;
+#define EMERGENCY_KEY_LEN (sizeof(emergencyKey) - 1)  // Without the string terminator
+
+static EmergencyReceiver emergencyRx;             // Owned by the listener task
+static const uint8_t *emergencyPins;
+static uint8_t emergencyPinCount;
+
+// Shared with loop() - the task writes the scene before the seq, and loop() reads them in the other order,
+// so it never pairs a new seq with the scene it replaced
+static volatile uint8_t emergencyScene = EMERGENCY_SCENE_CLEAR;
+static volatile uint32_t emergencySeq = 0;
+
+static uint32_t emergencySavedSeq = 0;            // loop() side - last command written to NVS
+static uint8_t emergencyReportedScene = EMERGENCY_SCENE_CLEAR;
+
+// Function to force every output on - straight from the task, no room state involved, all in one register write
+static void emergencyDrive() {
+  RelayBank bank = {0, 0};
+  relayBankWriteAll(&bank, emergencyPins, emergencyPinCount, HIGH);
+  zeroCrossCommitNow(&bank);  // At once, and no switch-off queued for a crossing may follow
+}
+
+// Function to open the socket and join the group - -1 if the stack refuses, retried later
+// Membership is kept across reconnects; the stack reports the group again whenever the link comes back
+static int emergencyOpen() {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+  if (sock < 0) return -1;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(EMERGENCY_UDP_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  ip_mreq group = {};
+  group.imr_multiaddr.s_addr = inet_addr(EMERGENCY_GROUP);
+  group.imr_interface.s_addr = htonl(INADDR_ANY);
+  timeval wait = {0, EMERGENCY_REASSERT_MS * 1000};  // recv() returns at least this often to reassert outputs
+  if (bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0 ||
+      setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait)) < 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+// Listener task - sleeps in recv() and preempts loop() the moment a datagram arrives, so a command is never
+// held up behind a card read, a relay flash or a flash write
+static void emergencyTask(void *arg) {
+  int sock = -1;
+  uint8_t buf[EMERGENCY_SIZE + 1];                // One spare byte so an oversized datagram shows as the wrong length
+  uint32_t lastDriveMs = 0;
+  for (;;) {
+    if (sock < 0 && wifiManagerLinkUp()) sock = emergencyOpen();
+    int len = -1;
+    if (sock >= 0) len = recv(sock, buf, sizeof(buf), 0);
+    else vTaskDelay(pdMS_TO_TICKS(EMERGENCY_REASSERT_MS));
+
+    if (len > 0) {
+      uint32_t start = micros();
+      EmergencyResult result = emergencyReceive(&emergencyRx, buf, len, emergencyKey, EMERGENCY_KEY_LEN);
+      if (result == EMERGENCY_ACT) {
+        emergencyScene = emergencyRx.scene;
+        emergencySeq = emergencyRx.seq;
+        if (emergencyRx.scene == EMERGENCY_SCENE_ALL_ON) {
+          emergencyDrive();
+          lastDriveMs = millis();
+        }
+        emergencySwitchUs = micros() - start;
+        emergencyCommands++;
+      }
+      else if (result == EMERGENCY_REPEAT) emergencyRepeats++;
+      else emergencyRejected++;
+    }
+
+    // A tap, a relay flash or the building-management system may have switched an output off since
+    if (emergencyScene == EMERGENCY_SCENE_ALL_ON && millis() - lastDriveMs >= EMERGENCY_REASSERT_MS) {
+      emergencyDrive();
+      lastDriveMs = millis();
+    }
+  }
+}
+#endif
+
+// Function to start the listener task - a scene saved before a restart is back in force before loop() runs
+void emergencyBegin(const uint8_t *pins, uint8_t count) {
+#if EMERGENCY_ENABLED
+  emergencyPins = pins;
+  emergencyPinCount = count;
+  emergencyReceiverInit(&emergencyRx, EMERGENCY_SITE_ID);
+  Preferences prefs;
+  prefs.begin("emerg", true);  // Read-only
+  emergencyRx.seq = prefs.getUInt("seq", 0);
+  emergencyRx.scene = prefs.getUChar("scene", EMERGENCY_SCENE_CLEAR);
+  prefs.end();
+  emergencySavedSeq = emergencySeq = emergencyRx.seq;
+  emergencyScene = emergencyRx.scene;
+  if (emergencyScene == EMERGENCY_SCENE_ALL_ON) emergencyDrive();
+  xTaskCreate(emergencyTask, "emergency", 3072, NULL, EMERGENCY_TASK_PRIORITY, NULL);
+#endif
+}
+
+// Function to check whether a scene is holding the outputs
+bool emergencyActive() {
+#if EMERGENCY_ENABLED
+  return emergencyScene == EMERGENCY_SCENE_ALL_ON;
+#else
+  return false;
+#endif
+}
+
+// Function to collect a scene change and save it - NVS writes stay out of the listener task
+EmergencyEvent emergencyPoll() {
+#if EMERGENCY_ENABLED
+  uint32_t seq = emergencySeq;
+  uint8_t scene = emergencyScene;
+  if (seq != emergencySavedSeq) {
+    Preferences prefs;
+    prefs.begin("emerg");
+    prefs.putUInt("seq", seq);  // A replay of this command after a restart is still refused
+    prefs.putUChar("scene", scene);
+    prefs.end();
+    emergencySavedSeq = seq;
+  }
+  if (scene == emergencyReportedScene) return EMERGENCY_EVENT_NONE;
+  emergencyReportedScene = scene;
+  return scene == EMERGENCY_SCENE_ALL_ON ? EMERGENCY_EVENT_STARTED : EMERGENCY_EVENT_CLEARED;
+#else
+  return EMERGENCY_EVENT_NONE;
+#endif
+}
+#endif
@@ -0,0 +1,599 @@
+#include "event_journal.h"
+#include "crypto_service.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JOURNAL_CRC_OFFSET (JOURNAL_RECORD_SIZE - 4)   // CRC-32 covers everything before it
+
+static void journalPut32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t journalGet32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Function to encrypt or decrypt the part of a record after the sequence number
+// The counter block is the sequence number plus a fixed tag, so every record has its own keystream
+static void journalCrypt(const Journal *j, uint8_t record[JOURNAL_RECORD_SIZE]) {
+  uint8_t iv[CRYPTO_AES_BLOCK] = {0};
+  memcpy(iv, record, 4);
+  memcpy(iv + 4, "JRNL", 4);
+  cryptoAesCtr(j->key, iv, record + 4, record + 4, JOURNAL_RECORD_SIZE - 4);
+}
+
+// Function to count the slots in the ring, summary slots included
+uint32_t journalSlots(const Journal *j) {
+  return j->sectorCount * JOURNAL_SLOTS_PER_SECTOR;
+}
+
+static const uint8_t journalSummaryMagic[4] = {'J', 'S', 'U', 'M'};
+
+// Function to pick the three Bloom filter bits for a UID - FNV-1a, one byte of the hash per bit
+static void journalBloomBits(const uint8_t uid[JOURNAL_UID_SIZE], uint8_t bits[3]) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < JOURNAL_UID_SIZE; i++) h = (h ^ uid[i]) * 16777619u;
+  bits[0] = h;
+  bits[1] = h >> 8;
+  bits[2] = h >> 16;
+}
+
+static bool journalUidSet(const uint8_t uid[JOURNAL_UID_SIZE]) {
+  for (int i = 0; i < JOURNAL_UID_SIZE; i++) {
+    if (uid[i]) return true;
+  }
+  return false;
+}
+
+// Function to start the summary of a fresh sector
+static void journalSummaryReset(JournalSummary *sum, uint32_t firstSeq) {
+  memset(sum, 0, sizeof(*sum));
+  sum->firstSeq = firstSeq;
+  sum->minTime = 0xFFFFFFFF;
+}
+
+// Function to fold one event into a sector summary
+static void journalSummaryAdd(JournalSummary *sum, const JournalEvent *event) {
+  if (event->time < sum->minTime) sum->minTime = event->time;
+  if (event->time > sum->maxTime) sum->maxTime = event->time;
+  if (event->room != JOURNAL_NO_ROOM) sum->roomMask[(event->room % 64) / 8] |= 1 << (event->room % 8);
+  if (journalUidSet(event->uid)) {
+    uint8_t bits[3];
+    journalBloomBits(event->uid, bits);
+    for (int i = 0; i < 3; i++) sum->uidBloom[bits[i] / 8] |= 1 << (bits[i] % 8);
+  }
+  sum->count++;
+}
+
+// Function to check whether a sector can hold matches - false positives are possible, misses are not
+static bool journalSummaryMayMatch(const JournalSummary *sum, const JournalQuery *q) {
+  if (sum->count == 0 || sum->maxTime < q->fromTime || sum->minTime > q->toTime) return false;
+  if (q->room != JOURNAL_NO_ROOM && !(sum->roomMask[(q->room % 64) / 8] & (1 << (q->room % 8)))) return false;
+  if (q->matchUid) {
+    uint8_t bits[3];
+    journalBloomBits(q->uid, bits);
+    for (int i = 0; i < 3; i++) {
+      if (!(sum->uidBloom[bits[i] / 8] & (1 << (bits[i] % 8)))) return false;
+    }
+  }
+  return true;
+}
+
+static bool journalEventMatches(const JournalEvent *event, const JournalQuery *q) {
+  if (event->time < q->fromTime || event->time > q->toTime) return false;
+  if (q->room != JOURNAL_NO_ROOM && event->room != q->room) return false;
+  return !q->matchUid || memcmp(event->uid, q->uid, JOURNAL_UID_SIZE) == 0;
+}
+
+// Function to encrypt or decrypt a summary after its clear magic and first sequence number
+static void journalSummaryCrypt(const Journal *j, uint8_t buf[JOURNAL_SUMMARY_SIZE]) {
+  uint8_t iv[CRYPTO_AES_BLOCK] = {0};
+  memcpy(iv, buf + 4, 4);
+  memcpy(iv + 4, "JSUM", 4);
+  cryptoAesCtr(j->key, iv, buf + 8, buf + 8, JOURNAL_SUMMARY_SIZE - 8);
+}
+
+// Function to read the summary sealed into a sector - false if the sector is not sealed or the summary is damaged
+static bool journalSummaryRead(const Journal *j, uint32_t sector, JournalSummary *sum) {
+  uint8_t buf[JOURNAL_SUMMARY_SIZE];
+  uint32_t offset = (sector * JOURNAL_SLOTS_PER_SECTOR + JOURNAL_EVENTS_PER_SECTOR) * JOURNAL_RECORD_SIZE;
+  if (!j->storage->read(offset, buf, sizeof(buf)) || memcmp(buf, journalSummaryMagic, 4) != 0) return false;
+  if (j->encrypt) journalSummaryCrypt(j, buf);
+  if (cryptoCrc32(buf, JOURNAL_SUMMARY_SIZE - 4) != journalGet32(buf + JOURNAL_SUMMARY_SIZE - 4)) return false;
+
+  sum->firstSeq = journalGet32(buf + 4);
+  sum->minTime = journalGet32(buf + 8);
+  sum->maxTime = journalGet32(buf + 12);
+  sum->count = buf[16];
+  memcpy(sum->roomMask, buf + 20, sizeof(sum->roomMask));
+  memcpy(sum->uidBloom, buf + 28, sizeof(sum->uidBloom));
+  return true;
+}
+
+// Function to write the summary of a full sector into its last slots - the head then moves to the next sector
+static bool journalSeal(Journal *j) {
+  uint8_t buf[JOURNAL_SUMMARY_SIZE] = {0};
+  const JournalSummary *sum = &j->open;
+  memcpy(buf, journalSummaryMagic, 4);
+  journalPut32(buf + 4, sum->firstSeq);
+  journalPut32(buf + 8, sum->minTime);
+  journalPut32(buf + 12, sum->maxTime);
+  buf[16] = sum->count;
+  memcpy(buf + 20, sum->roomMask, sizeof(sum->roomMask));
+  memcpy(buf + 28, sum->uidBloom, sizeof(sum->uidBloom));
+  journalPut32(buf + JOURNAL_SUMMARY_SIZE - 4, cryptoCrc32(buf, JOURNAL_SUMMARY_SIZE - 4));
+  if (j->encrypt) journalSummaryCrypt(j, buf);
+
+  bool ok = j->storage->write(j->head * JOURNAL_RECORD_SIZE, buf, sizeof(buf));
+  j->head = (j->head - JOURNAL_EVENTS_PER_SECTOR + JOURNAL_SLOTS_PER_SECTOR) % journalSlots(j);
+  return ok;
+}
+
+// Function to read the clear sequence number of a slot
+static uint32_t journalSlotSeq(const Journal *j, uint32_t slot) {
+  uint8_t seq[4];
+  if (!j->storage->read(slot * JOURNAL_RECORD_SIZE, seq, sizeof(seq))) return JOURNAL_EMPTY_SEQ;
+  return journalGet32(seq);
+}
+
+// Function to open a journal - finds the head after a reboot; key is NULL for plaintext records
+bool journalOpen(Journal *j, const JournalStorage *storage, const uint8_t *key) {
+  memset(j, 0, sizeof(*j));
+  j->storage = storage;
+  j->sectorCount = storage->size / JOURNAL_SECTOR_SIZE;
+  j->erasedSector = JOURNAL_EMPTY_SEQ;
+  j->encrypt = key != NULL;
+  if (key) memcpy(j->key, key, sizeof(j->key));
+  if (j->sectorCount < 2) return false;  // Need one sector to write while the next is erased
+
+  // The newest sector is the one whose first record has the highest sequence number
+  uint32_t newestSector = JOURNAL_EMPTY_SEQ;
+  uint32_t newestSeq = 0;
+  for (uint32_t sector = 0; sector < j->sectorCount; sector++) {
+    uint32_t seq = journalSlotSeq(j, sector * JOURNAL_SLOTS_PER_SECTOR);
+    if (seq == JOURNAL_EMPTY_SEQ) continue;
+    if (newestSector == JOURNAL_EMPTY_SEQ || seq > newestSeq) {
+      newestSector = sector;
+      newestSeq = seq;
+    }
+  }
+  if (newestSector == JOURNAL_EMPTY_SEQ) return true;  // Blank journal - start at slot 0
+
+  // Walk the newest sector to its last written slot - a torn record still uses its slot
+  uint32_t start = newestSector * JOURNAL_SLOTS_PER_SECTOR;
+  uint32_t end = start + JOURNAL_EVENTS_PER_SECTOR;
+  uint32_t slot = start + 1;
+  uint32_t lastSeq = newestSeq;
+  for (; slot < end; slot++) {
+    uint32_t seq = journalSlotSeq(j, slot);
+    if (seq == JOURNAL_EMPTY_SEQ) break;
+    lastSeq = seq;
+  }
+  j->nextSeq = lastSeq + 1;
+  if (slot == end && journalSlotSeq(j, end) != JOURNAL_EMPTY_SEQ) {
+    j->head = (start + JOURNAL_SLOTS_PER_SECTOR) % journalSlots(j);  // Sealed - continue in the next sector
+    return true;
+  }
+
+  // Rebuild the summary of the unsealed sector - at most one sector of records to decode
+  j->head = slot;
+  journalSummaryReset(&j->open, newestSeq);
+  JournalEvent event;
+  for (slot = start; slot < j->head; slot++) {
+    if (journalRead(j, slot, &event)) journalSummaryAdd(&j->open, &event);
+  }
+  return true;
+}
+
+// Function to serialize an event into a record - assigns the next sequence number and encrypts if enabled
+void journalEncode(Journal *j, JournalEvent *event, uint8_t record[JOURNAL_RECORD_SIZE]) {
+  event->seq = j->nextSeq++;
+  memset(record, 0, JOURNAL_RECORD_SIZE);
+  journalPut32(record, event->seq);
+  journalPut32(record + 4, event->time);
+  record[8] = event->type;
+  record[9] = event->room;
+  memcpy(record + 10, event->uid, JOURNAL_UID_SIZE);
+  journalPut32(record + JOURNAL_CRC_OFFSET, cryptoCrc32(record, JOURNAL_CRC_OFFSET));
+  if (j->encrypt) journalCrypt(j, record);
+}
+
+// Function to write an encoded record at the head - erases the next sector if idle work has not
+bool journalWrite(Journal *j, const JournalEvent *event, const uint8_t record[JOURNAL_RECORD_SIZE]) {
+  if (j->head % JOURNAL_SLOTS_PER_SECTOR == JOURNAL_EVENTS_PER_SECTOR) journalSeal(j);  // Idle work did not get to it
+
+  uint32_t sector = j->head / JOURNAL_SLOTS_PER_SECTOR;
+  if (j->head % JOURNAL_SLOTS_PER_SECTOR == 0) {
+    if (j->erasedSector != sector && !j->storage->erase(sector * JOURNAL_SECTOR_SIZE)) return false;  // Entering a sector that still holds old records
+    journalSummaryReset(&j->open, event->seq);
+  }
+  if (j->erasedSector == sector) j->erasedSector = JOURNAL_EMPTY_SEQ;  // Now in use
+
+  bool ok = j->storage->write(j->head * JOURNAL_RECORD_SIZE, record, JOURNAL_RECORD_SIZE);
+  journalSummaryAdd(&j->open, event);
+  j->head++;  // Advance even on failure - the slot may be half written; the summary slots follow the last event
+  return ok;
+}
+
+// Function to encode and write an event in one step
+bool journalAppend(Journal *j, JournalEvent *event) {
+  uint8_t record[JOURNAL_RECORD_SIZE];
+  journalEncode(j, event, record);
+  return journalWrite(j, event, record);
+}
+
+// Function to read and decode the record in a slot - returns false for empty or damaged slots
+bool journalRead(const Journal *j, uint32_t slot, JournalEvent *event) {
+  uint8_t record[JOURNAL_RECORD_SIZE];
+  if (slot % JOURNAL_SLOTS_PER_SECTOR >= JOURNAL_EVENTS_PER_SECTOR) return false;  // Summary slot
+  if (!j->storage->read(slot * JOURNAL_RECORD_SIZE, record, sizeof(record))) return false;
+  if (journalGet32(record) == JOURNAL_EMPTY_SEQ) return false;
+  if (j->encrypt) journalCrypt(j, record);
+  if (cryptoCrc32(record, JOURNAL_CRC_OFFSET) != journalGet32(record + JOURNAL_CRC_OFFSET)) return false;
+
+  event->seq = journalGet32(record);
+  event->time = journalGet32(record + 4);
+  event->type = record[8];
+  event->room = record[9];
+  memcpy(event->uid, record + 10, JOURNAL_UID_SIZE);
+  return true;
+}
+
+// Function to do idle work - seals a full sector and erases the next so appends never wait for either
+// This gives up the oldest sector of history a little early in exchange for no erase on the tap path
+void journalPrepare(Journal *j) {
+  if (j->head % JOURNAL_SLOTS_PER_SECTOR == JOURNAL_EVENTS_PER_SECTOR) journalSeal(j);
+  uint32_t next = (j->head / JOURNAL_SLOTS_PER_SECTOR + 1) % j->sectorCount;
+  if (j->head % JOURNAL_SLOTS_PER_SECTOR == 0) next = j->head / JOURNAL_SLOTS_PER_SECTOR;  // Head sits on a sector start
+  if (j->erasedSector == next) return;
+  if (j->storage->erase(next * JOURNAL_SECTOR_SIZE)) j->erasedSector = next;
+}
+
+// Function to run an audit query oldest to newest - returns the number of matching events visited
+// Sealed sectors are ruled in or out by their summary; the sector being written uses the summary in RAM
+uint32_t journalQuery(const Journal *j, const JournalQuery *q, JournalVisitor visit, void *ctx, JournalQueryStats *stats) {
+  JournalQueryStats unused;
+  if (stats == NULL) stats = &unused;
+  memset(stats, 0, sizeof(*stats));
+
+  // The newest records are in the head's sector, or the one before if the head has just moved on
+  uint32_t current = j->head / JOURNAL_SLOTS_PER_SECTOR;
+  if (j->head % JOURNAL_SLOTS_PER_SECTOR == 0) current = (current + j->sectorCount - 1) % j->sectorCount;
+  bool currentOpen = j->head % JOURNAL_SLOTS_PER_SECTOR != 0;
+
+  uint32_t matches = 0;
+  for (uint32_t i = 1; i <= j->sectorCount; i++) {
+    uint32_t sector = (current + i) % j->sectorCount;
+    uint32_t first = sector * JOURNAL_SLOTS_PER_SECTOR;
+    JournalSummary sum;
+    bool known;
+    if (sector == current && currentOpen) {
+      sum = j->open;
+      known = true;
+    }
+    else {
+      known = journalSummaryRead(j, sector, &sum);
+      if (!known && journalSlotSeq(j, first) == JOURNAL_EMPTY_SEQ) continue;  // Erased sector
+    }
+    if (known && !journalSummaryMayMatch(&sum, q)) {
+      stats->sectorsSkipped++;
+      continue;
+    }
+
+    // Unsealed sectors (written before summaries, or cut short by a reset) are scanned in full
+    stats->sectorsScanned++;
+    for (uint32_t slot = first; slot < first + JOURNAL_EVENTS_PER_SECTOR; slot++) {
+      JournalEvent event;
+      if (!journalRead(j, slot, &event)) {
+        if (journalSlotSeq(j, slot) == JOURNAL_EMPTY_SEQ) break;  // End of the written part
+        continue;  // Torn record
+      }
+      stats->recordsRead++;
+      if (!journalEventMatches(&event, q)) continue;
+      matches++;
+      if (visit != NULL && !visit(&event, ctx)) return matches;
+    }
+  }
+  return matches;
+}
+
+// Function to point a cursor at the oldest sector - the first step, and the restart after the head laps it
+static void journalCursorRewind(const Journal *j, JournalCursor *c) {
+  uint32_t current = j->head / JOURNAL_SLOTS_PER_SECTOR;
+  if (j->head % JOURNAL_SLOTS_PER_SECTOR == 0) current = (current + j->sectorCount - 1) % j->sectorCount;
+  c->slot = (current + 1) % j->sectorCount * JOURNAL_SLOTS_PER_SECTOR;
+  c->sectorsLeft = j->sectorCount;
+}
+
+static void journalCursorNextSector(const Journal *j, JournalCursor *c) {
+  c->slot = (c->slot / JOURNAL_SLOTS_PER_SECTOR + 1) % j->sectorCount * JOURNAL_SLOTS_PER_SECTOR;
+  if (--c->sectorsLeft == 0) c->done = true;
+}
+
+static bool journalCursorSeen(const JournalCursor *c, uint32_t seq) {
+  return c->lastSeq != JOURNAL_EMPTY_SEQ && seq <= c->lastSeq;
+}
+
+// Function to start a query that is run in steps - it covers the events written so far
+void journalQueryStart(const Journal *j, JournalCursor *c) {
+  memset(c, 0, sizeof(*c));
+  c->lastSeq = JOURNAL_EMPTY_SEQ;
+  c->endSeq = j->nextSeq;
+  journalCursorRewind(j, c);
+}
+
+// Function to run a query for at most budget sector summaries and records - returns true once it is done
+// Same walk as journalQuery(), but it can stop anywhere; appends between steps only move the head
+bool journalQueryStep(const Journal *j, const JournalQuery *q, JournalCursor *c, uint32_t budget, JournalVisitor visit,
+                      void *ctx) {
+  // A sector erased and rewritten since the last step no longer holds what the cursor was reading
+  uint32_t first = c->slot - c->slot % JOURNAL_SLOTS_PER_SECTOR;
+  if (!c->done && c->slot != first && journalSlotSeq(j, first) != c->sectorSeq) journalCursorRewind(j, c);
+
+  for (uint32_t work = 0; !c->done && work < budget; work++) {
+    if (c->lastSeq != JOURNAL_EMPTY_SEQ && c->lastSeq + 1 >= c->endSeq) {
+      c->done = true;
+      break;
+    }
+    uint32_t sector = c->slot / JOURNAL_SLOTS_PER_SECTOR;
+    first = sector * JOURNAL_SLOTS_PER_SECTOR;
+
+    // Entering a sector - rule it in or out as a whole
+    if (c->slot == first) {
+      c->sectorSeq = journalSlotSeq(j, first);
+      if (c->sectorSeq == JOURNAL_EMPTY_SEQ) {  // Erased sector
+        journalCursorNextSector(j, c);
+        continue;
+      }
+      if (!journalCursorSeen(c, c->sectorSeq) && c->sectorSeq >= c->endSeq) {  // Written after the start
+        c->done = true;
+        break;
+      }
+      JournalSummary sum;
+      bool known;
+      if (j->head % JOURNAL_SLOTS_PER_SECTOR != 0 && j->head / JOURNAL_SLOTS_PER_SECTOR == sector) {
+        sum = j->open;
+        known = true;
+      }
+      else {
+        known = journalSummaryRead(j, sector, &sum);
+      }
+      if (known && sum.count > 0 && journalCursorSeen(c, sum.firstSeq + sum.count - 1)) {  // Visited before a restart
+        journalCursorNextSector(j, c);
+        continue;
+      }
+      if (known && !journalSummaryMayMatch(&sum, q)) {
+        c->stats.sectorsSkipped++;
+        if (sum.count > 0) c->lastSeq = sum.firstSeq + sum.count - 1;
+        journalCursorNextSector(j, c);
+        continue;
+      }
+      c->stats.sectorsScanned++;
+    }
+
+    if (c->slot >= first + JOURNAL_EVENTS_PER_SECTOR) {
+      journalCursorNextSector(j, c);
+      continue;
+    }
+    JournalEvent event;
+    if (!journalRead(j, c->slot, &event)) {
+      if (journalSlotSeq(j, c->slot) == JOURNAL_EMPTY_SEQ) journalCursorNextSector(j, c);  // End of the written part
+      else c->slot++;  // Torn record
+      continue;
+    }
+    c->slot++;
+    c->stats.recordsRead++;
+    if (journalCursorSeen(c, event.seq)) continue;
+    if (event.seq >= c->endSeq) {
+      c->done = true;
+      break;
+    }
+    c->lastSeq = event.seq;
+    if (!journalEventMatches(&event, q)) continue;
+    c->matches++;
+    if (visit != NULL && !visit(&event, ctx)) break;
+  }
+  return c->done;
+}
+
+// Function to find the next space-separated word - *len is 0 at the end of the line
+static const char *journalWord(const char *p, const char **word, size_t *len) {
+  while (*p == ' ') p++;
+  *word = p;
+  while (*p != ' ' && *p != '\0') p++;
+  *len = p - *word;
+  return p;
+}
+
+static bool journalWordIs(const char *word, size_t len, const char *text) {
+  return len == strlen(text) && memcmp(word, text, len) == 0;
+}
+
+// Function to parse a whole word as an unsigned number - false on any other character
+static bool journalNumber(const char *word, size_t len, int base, uint32_t *out) {
+  if (len == 0 || len > 10) return false;
+  char buf[11];
+  memcpy(buf, word, len);
+  buf[len] = '\0';
+  for (size_t i = 0; i < len; i++) {
+    bool digit = buf[i] >= '0' && buf[i] <= '9';
+    bool hex = (buf[i] >= 'a' && buf[i] <= 'f') || (buf[i] >= 'A' && buf[i] <= 'F');
+    if (!digit && !(base == 16 && hex)) return false;
+  }
+  unsigned long v = strtoul(buf, NULL, base);
+  if (v > 0xFFFFFFFFUL) return false;
+  *out = v;
+  return true;
+}
+
+// Function to parse an audit command - false if the line is not one
+bool journalParseQuery(const char *line, JournalQuery *q) {
+  q->fromTime = 0;
+  q->toTime = 0xFFFFFFFF;
+  q->room = JOURNAL_NO_ROOM;
+  q->matchUid = false;
+  memset(q->uid, 0, JOURNAL_UID_SIZE);
+
+  const char *key;
+  size_t keyLen;
+  line = journalWord(line, &key, &keyLen);
+  if (!journalWordIs(key, keyLen, "audit")) return false;
+
+  // Key and value pairs in any order
+  for (;;) {
+    line = journalWord(line, &key, &keyLen);
+    if (keyLen == 0) break;
+    const char *value;
+    size_t valueLen;
+    line = journalWord(line, &value, &valueLen);
+    uint32_t v;
+    if (journalWordIs(key, keyLen, "room")) {
+      if (!journalNumber(value, valueLen, 10, &v) || v < 1 || v > JOURNAL_NO_ROOM) return false;
+      q->room = v - 1;
+    }
+    else if (journalWordIs(key, keyLen, "uid")) {
+      if (valueLen != 2 * JOURNAL_UID_SIZE || !journalNumber(value, valueLen, 16, &v)) return false;
+      q->matchUid = true;
+      for (int i = 0; i < JOURNAL_UID_SIZE; i++) q->uid[i] = v >> (8 * (JOURNAL_UID_SIZE - 1 - i));  // Printed first byte first
+    }
+    else if (journalWordIs(key, keyLen, "from")) {
+      if (!journalNumber(value, valueLen, 10, &q->fromTime)) return false;
+    }
+    else if (journalWordIs(key, keyLen, "to")) {
+      if (!journalNumber(value, valueLen, 10, &q->toTime)) return false;
+    }
+    else {
+      return false;
+    }
+  }
+  return q->fromTime <= q->toTime;
+}
+
+#ifdef ARDUINO
+#include <esp_partition.h>
+#include <time.h>
+
+Journal eventJournal;                     // The controller's journal
+uint32_t journalLastEncodeUs = 0;
+uint32_t journalLastWriteUs = 0;
+
+static const esp_partition_t *journalPartition = NULL;
+static bool journalReady = false;         // False until the partition is found and opened
+
+#define JOURNAL_AUDIT_LINE_MAX 64         // Longest match line an audit prints
+static JournalQuery auditQuery;           // Audit in progress
+static JournalCursor auditCursor;
+static unsigned long auditStartMs = 0;
+static bool auditRunning = false;
+
+static bool partitionRead(uint32_t offset, void *buf, size_t len) {
+  return esp_partition_read(journalPartition, offset, buf, len) == ESP_OK;
+}
+
+static bool partitionWrite(uint32_t offset, const void *buf, size_t len) {
+  return esp_partition_write(journalPartition, offset, buf, len) == ESP_OK;
+}
+
+static bool partitionErase(uint32_t offset) {
+  return esp_partition_erase_range(journalPartition, offset, JOURNAL_SECTOR_SIZE) == ESP_OK;
+}
+
+static JournalStorage journalFlash = {0, partitionRead, partitionWrite, partitionErase};
+
+// Function to open the journal partition and log a boot event
+void journalBegin() {
+  journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+  if (journalPartition == NULL) {
+    Serial.println("Journal partition not found");
+    return;
+  }
+  journalFlash.size = journalPartition->size - journalPartition->size % JOURNAL_SECTOR_SIZE;
+
+#if JOURNAL_ENCRYPT
+  static const uint8_t key[16] = JOURNAL_KEY;
+  journalReady = journalOpen(&eventJournal, &journalFlash, key);
+#else
+  journalReady = journalOpen(&eventJournal, &journalFlash, NULL);
+#endif
+  journalRecord(JOURNAL_BOOT, -1, NULL);
+}
+
+// Function to log one tap decision - room < 0 and uid NULL when not applicable
+void journalRecord(uint8_t type, int room, const uint8_t *uid) {
+  if (!journalReady) return;
+
+  JournalEvent event;
+  event.time = time(NULL);  // UTC once SNTP has set the clock, seconds since boot before that
+  event.type = type;
+  event.room = room < 0 ? JOURNAL_NO_ROOM : room;
+  if (uid) memcpy(event.uid, uid, JOURNAL_UID_SIZE);
+  else memset(event.uid, 0, JOURNAL_UID_SIZE);
+
+  uint8_t record[JOURNAL_RECORD_SIZE];
+  unsigned long start = micros();
+  journalEncode(&eventJournal, &event, record);
+  unsigned long encoded = micros();
+  journalWrite(&eventJournal, &event, record);
+  journalLastEncodeUs = encoded - start;
+  journalLastWriteUs = micros() - encoded;
+}
+
+// Function to do idle journal work - call while waiting
+void journalMaintain() {
+  if (journalReady) journalPrepare(&eventJournal);
+}
+
+// Function to print one audit match
+static bool journalPrintEvent(const JournalEvent *event, void *ctx) {
+  Serial.printf("#%lu t=%lu type=%u room=%d uid=%02X%02X%02X%02X\n", (unsigned long)event->seq, (unsigned long)event->time,
+                event->type, event->room == JOURNAL_NO_ROOM ? -1 : event->room + 1,
+                event->uid[0], event->uid[1], event->uid[2], event->uid[3]);
+  return false;  // One line per poll - the next may not fit in the transmit buffer
+}
+
+// Function to start printing the events matching an audit query to Serial - replaces an audit in progress
+void journalAudit(const JournalQuery *q) {
+  if (!journalReady) {
+    Serial.println("Audit: journal not open");
+    return;
+  }
+  if (auditRunning) Serial.println("Audit: previous audit cancelled");
+  auditQuery = *q;
+  journalQueryStart(&eventJournal, &auditCursor);
+  auditStartMs = millis();
+  auditRunning = true;
+}
+
+// Function to carry on with the audit in progress - call while waiting
+void journalAuditPoll() {
+  if (!auditRunning || Serial.availableForWrite() < JOURNAL_AUDIT_LINE_MAX) return;  // Printing would block
+  if (!journalQueryStep(&eventJournal, &auditQuery, &auditCursor, JOURNAL_AUDIT_BUDGET, journalPrintEvent, NULL)) return;
+
+  auditRunning = false;
+  Serial.printf("Audit: %lu matches, %lu sectors read, %lu skipped, %lu records, %lu ms\n",
+                (unsigned long)auditCursor.matches, (unsigned long)auditCursor.stats.sectorsScanned,
+                (unsigned long)auditCursor.stats.sectorsSkipped, (unsigned long)auditCursor.stats.recordsRead,
+                millis() - auditStartMs);
+}
+
+// Function to take one Serial byte of a command line - starts the audit once a complete "audit" line is in
+void journalCommandByte(uint8_t c) {
+  static char line[JOURNAL_COMMAND_MAX + 1];
+  static size_t lineLen = 0;
+  static bool overflow = false;  // Line too long - dropped at its end
+
+  if (c != '\n' && c != '\r') {
+    if (lineLen < JOURNAL_COMMAND_MAX) line[lineLen++] = c;
+    else overflow = true;
+    return;
+  }
+  if (lineLen == 0) return;  // Blank line, or the second half of CR LF
+  line[lineLen] = '\0';
+
+  JournalQuery q;
+  if (!overflow && journalParseQuery(line, &q)) journalAudit(&q);
+  else if (strncmp(line, "audit", 5) == 0) Serial.println("Audit: usage: audit [room N] [uid XXXXXXXX] [from T] [to T]");
+  lineLen = 0;
+  overflow = false;
+}
+#endif
@@ -0,0 +1,246 @@
+#include "hot_standby.h"
+#include "crypto_service.h"
+#include <string.h>
+
+// Function to sign and send one packet to the partner - the payload is encoded from the room table
+static void hsSend(HsNode *n, const HsPort *port, uint8_t type, uint32_t prevSeq, uint32_t mask) {
+  uint8_t pkt[HS_MAX_PACKET];
+  pkt[0] = 'H';
+  pkt[1] = 'S';
+  pkt[2] = (n->active ? HS_FLAG_ACTIVE : 0) | (n->preferred ? HS_FLAG_PREFERRED : 0);
+  pkt[3] = 0;
+  pkt[4] = n->term; pkt[5] = n->term >> 8; pkt[6] = n->term >> 16; pkt[7] = n->term >> 24;
+  n->txCount++;
+  pkt[8] = n->txCount; pkt[9] = n->txCount >> 8; pkt[10] = n->txCount >> 16; pkt[11] = n->txCount >> 24;
+
+  size_t len = syncEncode(pkt + HS_HEADER_SIZE, sizeof(pkt) - HS_HEADER_SIZE - HS_TAG_SIZE, type, HS_LINK_ID,
+                          *port->roomSeq, prevSeq, mask, port->rooms);
+  if (len == 0) return;
+  len += HS_HEADER_SIZE;
+
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(port->key, port->keyLen, pkt, len, mac);
+  memcpy(pkt + len, mac, HS_TAG_SIZE);
+  port->send(port->ctx, pkt, len + HS_TAG_SIZE);
+}
+
+// Function to ask the active partner for a full snapshot after a missed delta - rate limited
+static void hsRequestSnapshot(HsNode *n, const HsPort *port, uint32_t nowMs) {
+  if (nowMs - n->lastSnapshotReq < HS_SNAPSHOT_RETRY_MS) return;
+  n->lastSnapshotReq = nowMs;
+  hsSend(n, port, SYNC_MSG_SNAPSHOT_REQ, 0, 0);
+}
+
+// Function to hand the lines back - the partner's state is authoritative from now on
+static void hsStepDown(HsNode *n, const HsPort *port, uint32_t nowMs) {
+  n->active = false;
+  syncReceiverInit(&n->rx, HS_LINK_ID);
+  n->lastPeerHeard = nowMs;
+  hsRequestSnapshot(n, port, nowMs);
+}
+
+// Function to start a controller in standby - the partner gets a full failover window from nowMs
+void hsInit(HsNode *n, bool preferred, uint32_t nowMs) {
+  memset(n, 0, sizeof(*n));
+  n->preferred = preferred;
+  syncReceiverInit(&n->rx, HS_LINK_ID);
+  n->lastPeerHeard = nowMs;
+  n->lastSnapshotReq = nowMs - HS_SNAPSHOT_RETRY_MS;
+}
+
+// Function to handle one packet from the partner's address - the tag is checked before anything is read
+HotStandbyEvent hsReceive(HsNode *n, const HsPort *port, const uint8_t *pkt, size_t len, uint32_t nowMs) {
+  n->applied = false;
+  if (len < HS_HEADER_SIZE + HS_TAG_SIZE || pkt[0] != 'H' || pkt[1] != 'S') return HS_EVENT_NONE;  // Not a replication packet
+  len -= HS_TAG_SIZE;
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(port->key, port->keyLen, pkt, len, mac);
+  if (!cryptoEqual(mac, pkt + len, HS_TAG_SIZE)) {
+    n->rejected++;
+    return HS_EVENT_NONE;
+  }
+
+  bool peerActive = pkt[2] & HS_FLAG_ACTIVE;
+  bool peerPreferred = pkt[2] & HS_FLAG_PREFERRED;
+  uint32_t term = (uint32_t)pkt[4] | ((uint32_t)pkt[5] << 8) | ((uint32_t)pkt[6] << 16) | ((uint32_t)pkt[7] << 24);
+  uint32_t count = (uint32_t)pkt[8] | ((uint32_t)pkt[9] << 8) | ((uint32_t)pkt[10] << 16) | ((uint32_t)pkt[11] << 24);
+  const uint8_t *msg = pkt + HS_HEADER_SIZE;
+  size_t msgLen = len - HS_HEADER_SIZE;
+  uint8_t type;
+  uint16_t linkId;
+  if (!syncPeek(msg, msgLen, &type, &linkId)) return HS_EVENT_NONE;
+
+  // One controller of the pair is the preferred primary - a packet with our own flag is ours, sent back to us
+  if (peerPreferred == n->preferred) {
+    n->replayed++;
+    return HS_EVENT_NONE;
+  }
+
+  // Freshness - an active partner's packets must move forward, or a recorded heartbeat would stop failover
+  if (peerActive) {
+    if (term < n->peerTerm || (term == n->peerTerm && count <= n->peerCount)) {
+      n->replayed++;
+      return HS_EVENT_NONE;
+    }
+    if (!n->active && term < n->term) {
+      // Behind our own generation - left from holding the lines until the wire made us let go. The request
+      // carries our term, and the partner takes it up
+      n->replayed++;
+      hsRequestSnapshot(n, port, nowMs);
+      return HS_EVENT_NONE;
+    }
+    n->peerTerm = term;
+    n->peerCount = count;
+  }
+
+  if (n->active) {
+    if (!peerActive && term > n->term) n->term = term;  // A standby that outranks us - so it takes our packets
+    if (type == SYNC_MSG_SNAPSHOT_REQ) {
+      hsSend(n, port, SYNC_MSG_SNAPSHOT, 0, (uint32_t)((1ULL << port->rooms.roomCount) - 1));  // Resend every room
+      n->snapshotsSent++;
+      return HS_EVENT_NONE;
+    }
+    // Both controllers active - the higher term wins, the preferred primary wins a tie
+    if (peerActive && (term > n->term || (term == n->term && peerPreferred && !n->preferred))) {
+      n->term = term;
+      hsStepDown(n, port, nowMs);
+      return HS_EVENT_DEMOTED;
+    }
+    return HS_EVENT_NONE;
+  }
+
+  if (!peerActive) return HS_EVENT_NONE;  // Two standbys - nothing to follow yet
+
+  n->lastPeerHeard = nowMs;  // Any packet from the active partner counts as a heartbeat
+  n->term = term;
+  n->peerSeq = (uint32_t)msg[4] | ((uint32_t)msg[5] << 8) | ((uint32_t)msg[6] << 16) | ((uint32_t)msg[7] << 24);
+
+  SyncResult result = syncReceive(&n->rx, msg, msgLen);
+  if (result == SYNC_APPLIED) {
+    n->applied = true;
+    if (type == SYNC_MSG_DELTA) n->deltasApplied++;
+  }
+  else if (result == SYNC_GAP) {
+    n->gapsDetected++;
+    hsRequestSnapshot(n, port, nowMs);  // Missed a delta - ask for the full state
+  }
+  return HS_EVENT_NONE;
+}
+
+// Function to stream changes and heartbeats while active, or take over once the partner is silent
+HotStandbyEvent hsTick(HsNode *n, const HsPort *port, uint32_t changedMask, uint32_t nowMs, bool linkUp,
+                       HsPeerClaim peerClaim) {
+  if (n->active) {
+    // Both claiming the lines - the wire settles it at once, without waiting for the network
+    if (peerClaim == HS_CLAIM_HELD && !n->preferred) {
+      hsStepDown(n, port, nowMs);
+      return HS_EVENT_DEMOTED;
+    }
+    // Stream rooms changed since the last delta
+    if (changedMask) {
+      hsSend(n, port, SYNC_MSG_DELTA, n->lastSentSeq, changedMask);
+      n->lastSentSeq = *port->roomSeq;
+      n->deltasSent++;
+    }
+    if (nowMs - n->lastHeartbeat >= HS_HEARTBEAT_MS) {
+      hsSend(n, port, SYNC_MSG_HEARTBEAT, 0, 0);
+      n->lastHeartbeat = nowMs;
+    }
+    return HS_EVENT_NONE;
+  }
+
+  // Silence while our own link was down says nothing about the partner - count it again from when it is back
+  if (linkUp && !n->linkWasUp) n->lastPeerHeard = nowMs;
+  n->linkWasUp = linkUp;
+
+  // Take over once the partner has been silent for the failover window - and is shown not to drive the lines,
+  // by the wire or else by our own link being up, so a controller that is only cut off stays in standby
+  uint32_t timeout = HS_FAILOVER_MS + (n->preferred ? 0 : HS_STANDBY_GRACE_MS);
+  bool partnerOff = peerClaim == HS_CLAIM_RELEASED || (peerClaim == HS_CLAIM_UNWIRED && linkUp);
+  if (nowMs - n->lastPeerHeard <= timeout || !partnerOff) return HS_EVENT_NONE;
+  n->active = true;
+  n->term++;  // New generation so a recovering partner steps down
+  n->lastFailoverMs = nowMs - n->lastPeerHeard;
+  n->failoverSeqLag = n->peerSeq - n->rx.seq;
+  n->lastSentSeq = *port->roomSeq;  // Partner gets a snapshot when it asks
+  n->lastHeartbeat = nowMs - HS_HEARTBEAT_MS;  // Announce the takeover at once
+  return HS_EVENT_PROMOTED;
+}
+
+#ifdef ARDUINO
+#include "room_state.h"
+#include "wifi_manager.h"
+#include <WiFiUdp.h>
+
+WiFiUDP hsUdp;          // UDP socket shared by sending and receiving
+IPAddress hsPeer;       // Partner controller address
+HsNode hsNode;
+
+static const uint8_t hsKey[] = HS_SITE_KEY;
+#define HS_KEY_LEN (sizeof(hsKey) - 1)  // Without the string terminator
+
+// Function to put one packet on the air to the partner
+static void hsUdpSend(void *ctx, const uint8_t *pkt, size_t len) {
+  hsUdp.beginPacket(hsPeer, HS_UDP_PORT);
+  hsUdp.write(pkt, len);
+  hsUdp.endPacket();
+}
+
+static const HsPort hsPort = {hsUdpSend, NULL, hsKey, HS_KEY_LEN, {NUM_ROOMS, relayOn, relayHasOwner, relayOwner},
+                              &roomStateSeq};
+
+// Function to copy rooms the receiver just updated into the room state arrays
+static void hsApplyReceived() {
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    if (!(hsNode.rx.changedMask & (1UL << room))) continue;
+    applyRoomState(room, hsNode.rx.occupied & (1UL << room), hsNode.rx.owned & (1UL << room),
+                   hsNode.rx.owner[room], hsNode.rx.seq);
+  }
+  followRoomStateSeq(hsNode.rx.seq);  // The partner's position, including after a snapshot - republished with it
+}
+
+// Function to read the partner's supervisor output
+static HsPeerClaim hsPeerClaim() {
+  if (HS_PEER_CLAIM_PIN < 0) return HS_CLAIM_UNWIRED;
+  return digitalRead(HS_PEER_CLAIM_PIN) == HIGH ? HS_CLAIM_HELD : HS_CLAIM_RELEASED;
+}
+
+// Function to start replication - opens the UDP port and starts in standby
+void hotStandbyBegin() {
+  pinMode(HS_SUPERVISOR_PIN, OUTPUT);
+  digitalWrite(HS_SUPERVISOR_PIN, LOW);  // Do not claim the shared lines until we know the partner is silent
+  if (HS_PEER_CLAIM_PIN >= 0) pinMode(HS_PEER_CLAIM_PIN, INPUT_PULLDOWN);  // A dead partner reads as released
+
+  hsPeer.fromString(HS_PEER_ADDRESS);
+  hsUdp.begin(HS_UDP_PORT);
+  hsInit(&hsNode, HS_PREFERRED_PRIMARY, millis());  // Give the partner a full failover window after boot
+}
+
+// Function to service replication - call on every loop() pass and while waiting
+HotStandbyEvent hotStandbyPoll() {
+  HotStandbyEvent event = HS_EVENT_NONE;
+
+  // Drain received packets - several may arrive between polls; only the partner's address is listened to
+  uint8_t pkt[HS_MAX_PACKET];
+  while (hsUdp.parsePacket() > 0) {
+    int len = hsUdp.read(pkt, sizeof(pkt));
+    if (len <= 0 || !(hsUdp.remoteIP() == hsPeer)) continue;
+    HotStandbyEvent e = hsReceive(&hsNode, &hsPort, pkt, len, millis());
+    if (hsNode.applied) hsApplyReceived();
+    if (e != HS_EVENT_NONE) event = e;
+  }
+
+  HotStandbyEvent e = hsTick(&hsNode, &hsPort, roomsChangedSince(hsNode.lastSentSeq), millis(), wifiManagerLinkUp(),
+                             hsPeerClaim());
+  if (e != HS_EVENT_NONE) event = e;
+
+  if (event == HS_EVENT_PROMOTED) digitalWrite(HS_SUPERVISOR_PIN, HIGH);  // Claim the shared relays and reader
+  if (event == HS_EVENT_DEMOTED) digitalWrite(HS_SUPERVISOR_PIN, LOW);    // Release them to the partner
+  return event;
+}
+
+// Function to check whether this controller currently drives the relays and reader
+bool hotStandbyIsActive() {
+  return hsNode.active;
+}
+#endif
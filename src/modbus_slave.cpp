@@ -0,0 +1,289 @@
+#include "modbus_slave.h"
+#include <string.h>
+
+uint16_t modbusCrc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+static uint16_t modbusWord(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static size_t modbusException(const uint8_t *req, uint8_t code, uint8_t *resp) {
+  resp[0] = req[0] | 0x80;
+  resp[1] = code;
+  return 2;
+}
+
+// Function to pack bits straight from a bool array into a response, least significant bit first
+static size_t modbusReadBits(const bool *bits, uint16_t count, const uint8_t *req, size_t len, uint8_t *resp) {
+  if (len != 5) return modbusException(req, MODBUS_EX_VALUE, resp);
+  uint16_t addr = modbusWord(req + 1), qty = modbusWord(req + 3);
+  if (qty == 0 || qty > MODBUS_MAX_READ_BITS) return modbusException(req, MODBUS_EX_VALUE, resp);
+  if ((uint32_t)addr + qty > count) return modbusException(req, MODBUS_EX_ADDRESS, resp);
+  uint8_t bytes = (qty + 7) / 8;
+  resp[0] = req[0];
+  resp[1] = bytes;
+  memset(resp + 2, 0, bytes);
+  for (uint16_t i = 0; i < qty; i++) {
+    if (bits[addr + i]) resp[2 + i / 8] |= 1 << (i % 8);
+  }
+  return 2 + bytes;
+}
+
+// Function to copy registers from the regions into a response - byte arrays go across with one memcpy per region
+static size_t modbusReadRegisters(const ModbusMap *map, const uint8_t *req, size_t len, uint8_t *resp) {
+  if (len != 5) return modbusException(req, MODBUS_EX_VALUE, resp);
+  uint16_t reg = modbusWord(req + 1), qty = modbusWord(req + 3);
+  if (qty == 0 || qty > MODBUS_MAX_READ_REGS) return modbusException(req, MODBUS_EX_VALUE, resp);
+
+  uint8_t *out = resp + 2;
+  uint16_t left = qty;
+  for (uint8_t i = 0; i < map->regionCount && left > 0; i++) {
+    const ModbusRegion *r = &map->regions[i];
+    if (reg >= r->start + r->count) continue;
+    if (reg < r->start) break;  // Gap in the map
+    uint16_t offset = reg - r->start;
+    uint16_t n = r->count - offset < left ? r->count - offset : left;
+    if (r->kind == MODBUS_BYTES) {
+      memcpy(out, (const uint8_t *)r->data + offset * 2, n * 2);
+    }
+    else {
+      const uint32_t *values = (const uint32_t *)r->data;
+      for (uint16_t k = 0; k < n; k++) {
+        uint32_t v = values[(offset + k) / 2];
+        uint16_t word = (offset + k) % 2 == 0 ? v >> 16 : v & 0xFFFF;
+        out[k * 2] = word >> 8;
+        out[k * 2 + 1] = word & 0xFF;
+      }
+    }
+    out += n * 2;
+    reg += n;
+    left -= n;
+  }
+  if (left > 0) return modbusException(req, MODBUS_EX_ADDRESS, resp);
+  resp[0] = req[0];
+  resp[1] = qty * 2;
+  return 2 + qty * 2;
+}
+
+size_t modbusHandlePdu(const ModbusMap *map, const uint8_t *req, size_t len, uint8_t *resp, size_t cap) {
+  if (len == 0 || cap < MODBUS_MAX_PDU) return 0;
+  switch (req[0]) {
+    case MODBUS_READ_COILS:
+      return modbusReadBits(map->coils, map->coilCount, req, len, resp);
+    case MODBUS_READ_DISCRETE:
+      return modbusReadBits(map->discretes, map->discreteCount, req, len, resp);
+    case MODBUS_READ_HOLDING:
+    case MODBUS_READ_INPUT:
+      return modbusReadRegisters(map, req, len, resp);
+
+    case MODBUS_WRITE_COIL: {
+      if (len != 5) return modbusException(req, MODBUS_EX_VALUE, resp);
+      uint16_t addr = modbusWord(req + 1), value = modbusWord(req + 3);
+      if (value != 0xFF00 && value != 0x0000) return modbusException(req, MODBUS_EX_VALUE, resp);
+      if (addr >= map->coilCount) return modbusException(req, MODBUS_EX_ADDRESS, resp);
+      if (!map->writeCoil(addr, value == 0xFF00)) return modbusException(req, MODBUS_EX_DEVICE, resp);
+      memcpy(resp, req, 5);  // The response echoes the request
+      return 5;
+    }
+
+    case MODBUS_WRITE_COILS: {
+      if (len < 6) return modbusException(req, MODBUS_EX_VALUE, resp);
+      uint16_t addr = modbusWord(req + 1), qty = modbusWord(req + 3);
+      uint8_t bytes = req[5];
+      if (qty == 0 || qty > 1968 || bytes != (qty + 7) / 8 || len != 6u + bytes) {
+        return modbusException(req, MODBUS_EX_VALUE, resp);
+      }
+      if ((uint32_t)addr + qty > map->coilCount) return modbusException(req, MODBUS_EX_ADDRESS, resp);
+      bool ok = true;  // Every coil is attempted - rooms before a refused one stay switched
+      for (uint16_t i = 0; i < qty; i++) {
+        if (!map->writeCoil(addr + i, (req[6 + i / 8] >> (i % 8)) & 1)) ok = false;
+      }
+      if (!ok) return modbusException(req, MODBUS_EX_DEVICE, resp);
+      memcpy(resp, req, 5);
+      return 5;
+    }
+
+    default:
+      return modbusException(req, MODBUS_EX_FUNCTION, resp);
+  }
+}
+
+size_t modbusTcpLength(const uint8_t *buf, size_t len) {
+  if (len < 6) return 0;
+  uint16_t follows = modbusWord(buf + 4);  // Unit id plus PDU
+  if (modbusWord(buf + 2) != 0 || follows < 2 || follows > 1 + MODBUS_MAX_PDU) return MODBUS_TCP_MAX_ADU + 1;
+  return 6 + follows;
+}
+
+size_t modbusHandleTcp(const ModbusMap *map, const uint8_t *adu, size_t len, uint8_t *resp, size_t cap) {
+  if (modbusTcpLength(adu, len) != len || cap < MODBUS_TCP_MAX_ADU) return 0;
+  size_t pdu = modbusHandlePdu(map, adu + MODBUS_MBAP_SIZE, len - MODBUS_MBAP_SIZE, resp + MODBUS_MBAP_SIZE,
+                               cap - MODBUS_MBAP_SIZE);
+  memcpy(resp, adu, 4);   // Transaction and protocol id
+  resp[4] = (pdu + 1) >> 8;
+  resp[5] = (pdu + 1) & 0xFF;
+  resp[6] = adu[6];       // Unit id
+  return MODBUS_MBAP_SIZE + pdu;
+}
+
+size_t modbusHandleRtu(const ModbusMap *map, uint8_t unit, const uint8_t *frame, size_t len, uint8_t *resp, size_t cap) {
+  if (len < 4 || cap < MODBUS_RTU_MAX_ADU) return 0;
+  if (frame[0] != unit && frame[0] != 0) return 0;
+  uint16_t crc = frame[len - 2] | (frame[len - 1] << 8);
+  if (modbusCrc16(frame, len - 2) != crc) return 0;
+  size_t pdu = modbusHandlePdu(map, frame + 1, len - 3, resp + 1, cap - 3);
+  if (frame[0] == 0) return 0;  // Broadcast - writes are applied, nothing is sent back
+  resp[0] = unit;
+  crc = modbusCrc16(resp, 1 + pdu);
+  resp[1 + pdu] = crc & 0xFF;
+  resp[2 + pdu] = crc >> 8;
+  return 3 + pdu;
+}
+
+#ifdef ARDUINO
+#include <WiFi.h>
+#include "room_state.h"
+#include "wifi_manager.h"
+#include "osdp.h"
+
+#if MODBUS_ENABLED && MODBUS_RTU && OSDP_ENABLED
+#error "Modbus RTU and the OSDP reader bus both need Serial1"
+#endif
+static_assert(2 * NUM_ROOMS <= 100, "room registers overlap the version registers");
+
+uint32_t modbusRequests = 0;
+uint32_t modbusExceptions = 0;
+uint32_t modbusMaxUs = 0;
+
+static bool (*modbusRoomCommand)(uint16_t room, bool on) = NULL;
+
+static bool modbusWriteCoil(uint16_t address, bool on) {
+  return modbusRoomCommand != NULL && modbusRoomCommand(address, on);
+}
+
+// The map over the room state table - see the address list in modbus_slave.h
+static const ModbusRegion modbusRegions[] = {
+  {0,   2 * NUM_ROOMS, MODBUS_BYTES, relayOwner},
+  {100, 2 * NUM_ROOMS, MODBUS_U32,   roomVersion},
+  {200, 2,             MODBUS_U32,   &roomStateSeq},
+};
+static const ModbusMap modbusMap = {
+  relayOn, NUM_ROOMS, relayHasOwner, NUM_ROOMS,
+  modbusRegions, sizeof(modbusRegions) / sizeof(modbusRegions[0]), modbusWriteCoil
+};
+
+static uint8_t modbusResponse[MODBUS_TCP_MAX_ADU];
+
+// Function to count an answered request - pdu points at the response PDU
+static void modbusCount(const uint8_t *pdu, uint32_t startUs) {
+  uint32_t elapsed = micros() - startUs;
+  modbusRequests++;
+  if (pdu[0] & 0x80) modbusExceptions++;
+  if (elapsed > modbusMaxUs) modbusMaxUs = elapsed;
+}
+
+#if MODBUS_TCP
+static WiFiServer modbusServer(MODBUS_TCP_PORT);
+static WiFiClient modbusClients[MODBUS_TCP_CLIENTS];
+static uint8_t modbusRx[MODBUS_TCP_CLIENTS][MODBUS_TCP_MAX_ADU];
+static size_t modbusRxLen[MODBUS_TCP_CLIENTS];
+
+// Function to take new connections - the oldest slot is reused only when its client has gone
+static void modbusAccept() {
+  if (!modbusServer.hasClient()) return;
+  for (uint8_t i = 0; i < MODBUS_TCP_CLIENTS; i++) {
+    if (modbusClients[i].connected()) continue;
+    modbusClients[i] = modbusServer.accept();
+    modbusClients[i].setNoDelay(true);  // Responses are single small segments - do not hold them back
+    modbusRxLen[i] = 0;
+    return;
+  }
+  modbusServer.accept().stop();  // Every slot busy
+}
+
+// Function to answer every complete request a client has sent
+static void modbusServeClient(uint8_t i) {
+  WiFiClient &client = modbusClients[i];
+  int avail = client.available();
+  if (avail > 0) {
+    size_t room = sizeof(modbusRx[i]) - modbusRxLen[i];
+    int n = client.read(modbusRx[i] + modbusRxLen[i], (size_t)avail < room ? avail : room);
+    if (n > 0) modbusRxLen[i] += n;
+  }
+  for (;;) {
+    size_t need = modbusTcpLength(modbusRx[i], modbusRxLen[i]);
+    if (need > MODBUS_TCP_MAX_ADU) {
+      client.stop();  // Not Modbus - drop the connection
+      modbusRxLen[i] = 0;
+      return;
+    }
+    if (need == 0 || modbusRxLen[i] < need) return;
+    uint32_t start = micros();
+    size_t len = modbusHandleTcp(&modbusMap, modbusRx[i], need, modbusResponse, sizeof(modbusResponse));
+    client.write(modbusResponse, len);
+    modbusCount(modbusResponse + MODBUS_MBAP_SIZE, start);
+    memmove(modbusRx[i], modbusRx[i] + need, modbusRxLen[i] - need);
+    modbusRxLen[i] -= need;
+  }
+}
+#endif
+
+#if MODBUS_RTU
+// A frame ends after 3.5 character times of silence - fixed at 1750 us above 19200 baud
+#define MODBUS_RTU_GAP_US (MODBUS_RTU_BAUD > 19200 ? 1750 : 38500000UL / MODBUS_RTU_BAUD)
+static uint8_t modbusRtuRx[MODBUS_RTU_MAX_ADU];
+static size_t modbusRtuLen = 0;
+static uint32_t modbusRtuLastByteUs = 0;
+
+// Function to collect RTU bytes and answer a frame once the line has gone quiet
+// The UART FIFO holds bytes between calls; the master waits for our answer before sending again
+static void modbusServeRtu() {
+  while (Serial1.available() > 0) {
+    int b = Serial1.read();
+    if (modbusRtuLen < sizeof(modbusRtuRx)) modbusRtuRx[modbusRtuLen++] = b;
+    modbusRtuLastByteUs = micros();
+  }
+  if (modbusRtuLen == 0 || micros() - modbusRtuLastByteUs < MODBUS_RTU_GAP_US) return;
+  uint32_t start = micros();
+  size_t len = modbusHandleRtu(&modbusMap, MODBUS_UNIT_ID, modbusRtuRx, modbusRtuLen, modbusResponse, sizeof(modbusResponse));
+  modbusRtuLen = 0;
+  if (len == 0) return;
+  Serial1.write(modbusResponse, len);
+  modbusCount(modbusResponse + 1, start);
+}
+#endif
+
+// Function to start the servers - roomCommand switches a room the way a card tap would
+void modbusBegin(bool (*roomCommand)(uint16_t room, bool on)) {
+  modbusRoomCommand = roomCommand;
+#if MODBUS_TCP
+  modbusServer.begin();
+  modbusServer.setNoDelay(true);
+#endif
+#if MODBUS_RTU
+  Serial1.begin(MODBUS_RTU_BAUD, SERIAL_8N1, MODBUS_RTU_RX_PIN, MODBUS_RTU_TX_PIN);
+#endif
+}
+
+// Function to serve pending requests - call while waiting
+void modbusPoll() {
+#if MODBUS_TCP
+  if (wifiManagerLinkUp()) {
+    modbusAccept();
+    for (uint8_t i = 0; i < MODBUS_TCP_CLIENTS; i++) {
+      if (modbusClients[i].connected()) modbusServeClient(i);
+    }
+  }
+#endif
+#if MODBUS_RTU
+  modbusServeRtu();
+#endif
+}
+#endif
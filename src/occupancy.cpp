@@ -0,0 +1,242 @@
+#include "occupancy.h"
+#include <string.h>
+
+// Function to set up a debouncer - initial is each input's level at start
+void occupancyInit(OccupancyDebouncer *d, uint8_t inputs, uint32_t debounceUs, uint32_t initial) {
+  memset((void *)d, 0, sizeof(*d));
+  d->inputs = inputs < OCC_MAX_INPUTS ? inputs : OCC_MAX_INPUTS;
+  d->debounceUs = debounceUs;
+  d->levelMask = initial;
+}
+
+// Function to note an edge on an input - only timestamps it; the level is read once it has settled
+// The edge and timer interrupts run at the same priority on one core, so they never interleave
+bool occupancyEdge(OccupancyDebouncer *d, uint8_t input, uint32_t nowUs) {
+  if (input >= d->inputs) return false;
+  uint32_t bit = 1UL << input;
+  d->edges++;
+  if (!(d->pendingMask & bit)) {
+    d->firstEdgeUs[input] = nowUs;  // Start of a burst - latency is measured from here
+    d->pendingMask |= bit;
+  }
+  d->lastEdgeUs[input] = nowUs;
+  if (d->timerArmed) return false;  // The timer will get to it - it re-arms for the latest deadline
+  d->timerArmed = true;
+  return true;
+}
+
+// Function to settle the inputs that have been quiet for the debounce time
+// Each input keeps its own deadline, so a chattering input never holds up the others
+uint32_t occupancySettle(OccupancyDebouncer *d, uint32_t nowUs, bool (*level)(uint8_t input)) {
+  d->timerFires++;
+  uint32_t next = 0;
+  uint32_t pending = d->pendingMask;
+  for (uint8_t i = 0; pending != 0; i++, pending >>= 1) {
+    if (!(pending & 1)) continue;
+    uint32_t bit = 1UL << i;
+    uint32_t quiet = nowUs - d->lastEdgeUs[i];
+    if (quiet < d->debounceUs) {
+      uint32_t wait = d->debounceUs - quiet;  // Still bouncing - come back when this one is due
+      if (next == 0 || wait < next) next = wait;
+      continue;
+    }
+    d->pendingMask &= ~bit;
+    bool active = level(i);
+    if (active == ((d->levelMask & bit) != 0)) {
+      d->glitches++;  // Bounced and came back - nothing changed
+      continue;
+    }
+    d->levelMask ^= bit;
+    uint8_t head = d->head;
+    if ((uint8_t)(head - d->tail) >= OCC_QUEUE_SIZE) {
+      d->dropped++;
+      continue;
+    }
+    OccupancyEvent &ev = d->queue[head % OCC_QUEUE_SIZE];
+    ev.input = i;
+    ev.active = active;
+    ev.edgeUs = d->firstEdgeUs[i];
+    ev.settledUs = nowUs;
+    d->head = head + 1;  // Publish after the event is written
+  }
+  d->timerArmed = next != 0;
+  return next;
+}
+
+// Function to take the oldest debounced event
+bool occupancyNextEvent(OccupancyDebouncer *d, OccupancyEvent *ev) {
+  uint8_t tail = d->tail;
+  if (tail == d->head) return false;
+  *ev = d->queue[tail % OCC_QUEUE_SIZE];
+  d->tail = tail + 1;
+  return true;
+}
+
+// Function to start a room's vacancy timing afresh - whoever switched it on counts as motion now
+void occupancyRoomOn(OccupancyRoom *room, uint32_t nowMs) {
+  room->latched = false;
+  room->lastMotionMs = nowMs;
+  room->closedMs = nowMs;
+}
+
+// Function to apply one debounced event to its room
+// Only the start of motion latches: a PIR holds its output for seconds after the last movement, so its
+// release just after the door closes behind someone leaving must not mark the room as occupied
+void occupancyApply(OccupancyRoom *room, uint8_t kind, bool active, uint32_t nowMs) {
+  if (kind == OCC_PIR) {
+    room->motion = active;
+    room->lastMotionMs = nowMs;  // Motion started, or was seen until now
+    if (active && room->doorFitted && !room->doorOpen) room->latched = true;  // Moving behind a closed door
+    return;
+  }
+  room->doorOpen = active;
+  room->latched = false;  // Opening lets people out; closing starts the grace period afresh
+  if (!active) room->closedMs = nowMs;
+}
+
+// Function to check whether an occupied room has been left
+bool occupancyVacant(const OccupancyRoom *room, uint32_t nowMs, uint32_t *nextCheckMs) {
+  *nextCheckMs = 0;
+  if (!room->pirFitted || room->motion) return false;  // Without a PIR there is no telling; with motion, someone is in
+  if (room->doorFitted && !room->doorOpen) {
+    if (room->latched) return false;  // Someone moved after the door closed and has not opened it since
+    uint32_t since = nowMs - room->closedMs;
+    if (since >= OCC_CLOSE_GRACE_MS) return true;
+    *nextCheckMs = OCC_CLOSE_GRACE_MS - since;
+    return false;
+  }
+  uint32_t idle = nowMs - room->lastMotionMs;
+  if (idle >= OCC_IDLE_MS) return true;
+  *nextCheckMs = OCC_IDLE_MS - idle;
+  return false;
+}
+
+#ifdef ARDUINO
+#include "room_state.h"
+
+static_assert(2 * NUM_ROOMS <= OCC_MAX_INPUTS, "two inputs per room must fit the debouncer masks");
+
+uint32_t occupancyEvents = 0;
+uint32_t occupancyVacated = 0;
+uint32_t occupancyLatencyMaxUs = 0;
+
+#if OCCUPANCY_ENABLED
+static const int8_t occPirPins[NUM_ROOMS] = OCC_PIR_PINS;
+static const int8_t occDoorPins[NUM_ROOMS] = OCC_DOOR_PINS;
+static int8_t occPins[2 * NUM_ROOMS];           // Input n: room n / 2, kind n % 2
+static OccupancyDebouncer occDebouncer;
+static OccupancyRoom occRooms[NUM_ROOMS];
+static hw_timer_t *occTimer = NULL;
+
+static bool occRoomWasOn[NUM_ROOMS];
+static uint32_t occSeenSeq = 0;                 // roomStateSeq when room on/off was last checked
+static bool occCheckDue = false;                // A vacancy timeout is running
+static uint32_t occCheckMs = 0;                 // When the earliest one runs out
+static uint32_t occLatencyTotalUs = 0;
+static uint32_t occReportMs = 0;
+static uint32_t occReportEdges = 0;
+
+// Function to read an input - both kinds are wired active high
+static bool occLevel(uint8_t input) {
+  return digitalRead(occPins[input]) == HIGH;
+}
+
+// Function to start the one-shot debounce timer - 1 us ticks
+static void IRAM_ATTR occArm(uint32_t us) {
+  timerWrite(occTimer, 0);
+  timerAlarmWrite(occTimer, us, false);
+  timerAlarmEnable(occTimer);
+}
+
+static void IRAM_ATTR occEdgeIsr(void *arg) {
+  if (occupancyEdge(&occDebouncer, (uint8_t)(uintptr_t)arg, micros())) occArm(occDebouncer.debounceUs);
+}
+
+static void IRAM_ATTR occTimerIsr() {
+  uint32_t next = occupancySettle(&occDebouncer, micros(), occLevel);
+  if (next != 0) occArm(next);
+}
+
+// Function to print the interrupt rate and input latency now and then
+static void occReport(uint32_t now) {
+  if (now - occReportMs < OCC_REPORT_MS) return;
+  uint32_t edges = occDebouncer.edges;
+  Serial.printf("Occupancy: %.1f edges/s, %u timer irqs, %u events, latency avg %u us max %u us, %u glitches, %u vacated\n",
+                (edges - occReportEdges) * 1000.0f / (now - occReportMs), (unsigned)occDebouncer.timerFires,
+                (unsigned)occupancyEvents, (unsigned)(occupancyEvents ? occLatencyTotalUs / occupancyEvents : 0),
+                (unsigned)occupancyLatencyMaxUs, (unsigned)occDebouncer.glitches, (unsigned)occupancyVacated);
+  occReportMs = now;
+  occReportEdges = edges;
+}
+#endif
+
+// Function to attach the input interrupts and the debounce timer
+void occupancyBegin() {
+#if OCCUPANCY_ENABLED
+  uint32_t initial = 0;
+  uint32_t now = millis();
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    occPins[2 * room + OCC_PIR] = occPirPins[room];
+    occPins[2 * room + OCC_DOOR] = occDoorPins[room];
+    occRooms[room].pirFitted = occPirPins[room] >= 0;
+    occRooms[room].doorFitted = occDoorPins[room] >= 0;
+    occupancyRoomOn(&occRooms[room], now);
+  }
+  for (uint8_t i = 0; i < 2 * NUM_ROOMS; i++) {
+    if (occPins[i] < 0) continue;
+    pinMode(occPins[i], i % 2 == OCC_DOOR ? INPUT_PULLUP : INPUT);
+    if (occLevel(i)) initial |= 1UL << i;
+    occupancyApply(&occRooms[i / 2], i % 2, occLevel(i), now);
+  }
+  occupancyInit(&occDebouncer, 2 * NUM_ROOMS, OCC_DEBOUNCE_US, initial);
+  occTimer = timerBegin(OCC_TIMER, 80, true);  // 80 MHz APB clock / 80 - microsecond ticks
+  timerAttachInterrupt(occTimer, occTimerIsr, false);
+  for (uint8_t i = 0; i < 2 * NUM_ROOMS; i++) {
+    if (occPins[i] >= 0) attachInterruptArg(digitalPinToInterrupt(occPins[i]), occEdgeIsr, (void *)(uintptr_t)i, CHANGE);
+  }
+  occReportMs = now;
+#endif
+}
+
+// Function to act on debounced events and vacancy timeouts
+void occupancyPoll(void (*vacate)(uint8_t room)) {
+#if OCCUPANCY_ENABLED
+  uint32_t now = millis();
+  bool changed = false;
+  OccupancyEvent ev;
+  while (occupancyNextEvent(&occDebouncer, &ev)) {
+    occupancyApply(&occRooms[ev.input / 2], ev.input % 2, ev.active, now);
+    uint32_t latency = micros() - ev.edgeUs;  // Includes the debounce time
+    occupancyEvents++;
+    occLatencyTotalUs += latency;
+    if (latency > occupancyLatencyMaxUs) occupancyLatencyMaxUs = latency;
+    changed = true;
+  }
+  if (roomStateSeq != occSeenSeq) {
+    // A room switched on by any path - tap, BMS, replication - starts its vacancy timing now
+    for (byte room = 0; room < NUM_ROOMS; room++) {
+      if (relayOn[room] && !occRoomWasOn[room]) occupancyRoomOn(&occRooms[room], now);
+      occRoomWasOn[room] = relayOn[room];
+    }
+    occSeenSeq = roomStateSeq;
+    changed = true;
+  }
+  occReport(now);
+  if (!changed && (!occCheckDue || (int32_t)(now - occCheckMs) < 0)) return;  // Nothing can have changed
+
+  occCheckDue = false;
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    if (!relayOn[room]) continue;
+    uint32_t waitMs;
+    if (occupancyVacant(&occRooms[room], now, &waitMs)) {
+      occupancyVacated++;
+      vacate(room);
+    }
+    else if (waitMs != 0 && (!occCheckDue || (int32_t)(now + waitMs - occCheckMs) < 0)) {
+      occCheckDue = true;
+      occCheckMs = now + waitMs;
+    }
+  }
+#endif
+}
+#endif
@@ -0,0 +1,326 @@
+#include "osdp.h"
+#include <string.h>
+
+uint16_t osdpCrc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0x1D0F;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+size_t osdpBuild(uint8_t *buf, size_t cap, uint8_t addr, bool reply, uint8_t seq, uint8_t code,
+                 const uint8_t *data, size_t len) {
+  size_t total = OSDP_HEADER_SIZE + len + 2;
+  if (len > OSDP_MAX_DATA || total > cap) return 0;
+  buf[0] = OSDP_SOM;
+  buf[1] = (addr & 0x7F) | (reply ? OSDP_REPLY_FLAG : 0);
+  buf[2] = total & 0xFF;
+  buf[3] = total >> 8;
+  buf[4] = (seq & 0x03) | OSDP_CTRL_CRC;
+  buf[5] = code;
+  if (len > 0) memcpy(buf + OSDP_HEADER_SIZE, data, len);
+  uint16_t crc = osdpCrc16(buf, total - 2);
+  buf[total - 2] = crc & 0xFF;
+  buf[total - 1] = crc >> 8;
+  return total;
+}
+
+int osdpParse(const uint8_t *buf, size_t len, OsdpFrame *frame) {
+  if (len == 0) return 0;
+  if (buf[0] != OSDP_SOM) {
+    // Skip to the next possible start of frame
+    size_t skip = 1;
+    while (skip < len && buf[skip] != OSDP_SOM) skip++;
+    return -(int)skip;
+  }
+  if (len < 5) return 0;
+  size_t total = buf[2] | (buf[3] << 8);
+  if (total < OSDP_HEADER_SIZE + 2 || total > OSDP_MAX_FRAME) return -1;  // Not a frame we could have sent or accept
+  if (len < total) return 0;
+
+  uint8_t ctrl = buf[4];
+  if (!(ctrl & OSDP_CTRL_CRC) || (ctrl & 0x08)) return -(int)total;  // Checksum-only or secure channel frames are not supported
+  uint16_t crc = buf[total - 2] | (buf[total - 1] << 8);
+  if (osdpCrc16(buf, total - 2) != crc) return -1;  // Damaged - resynchronize on the next SOM
+
+  frame->addr = buf[1] & 0x7F;
+  frame->reply = (buf[1] & OSDP_REPLY_FLAG) != 0;
+  frame->seq = ctrl & 0x03;
+  frame->code = buf[5];
+  frame->len = total - OSDP_HEADER_SIZE - 2;
+  memcpy(frame->data, buf + OSDP_HEADER_SIZE, frame->len);
+  return (int)total;
+}
+
+void osdpInit(OsdpBus *bus, const OsdpPort *port, uint32_t baud, uint8_t readerCount, uint32_t nowMs) {
+  memset(bus, 0, sizeof(*bus));
+  bus->port = port;
+  bus->baud = baud;
+  bus->adaptive = true;
+  bus->readerCount = readerCount > OSDP_MAX_READERS ? OSDP_MAX_READERS : readerCount;
+  bus->current = -1;
+  bus->startMs = nowMs;
+  for (uint8_t i = 0; i < bus->readerCount; i++) {
+    bus->readers[i].nextPollMs = nowMs;
+    bus->readers[i].lastPollMs = nowMs;
+    bus->readers[i].heatMs = nowMs;
+  }
+}
+
+// Function to add the wire time of a frame - 10 bits per byte with start and stop bits
+static void osdpCountWire(OsdpBus *bus, size_t bytes) {
+  bus->wireUs += (uint64_t)bytes * 10000000u / bus->baud;
+}
+
+// Function to set when a reader is next due - interpolates between the idle and fast interval by heat
+static void osdpSchedule(OsdpBus *bus, OsdpReader *r, uint32_t nowMs) {
+  for (uint8_t steps = 0; nowMs - r->heatMs >= OSDP_HEAT_STEP_MS; steps++) {
+    r->heatMs += OSDP_HEAT_STEP_MS;
+    if (steps < 32) r->heat -= r->heat / 8;
+  }
+  uint32_t interval = OSDP_POLL_IDLE_MS;
+  if (!r->online) interval = OSDP_OFFLINE_RETRY_MS;
+  else if (bus->adaptive) interval -= (uint32_t)(OSDP_POLL_IDLE_MS - OSDP_POLL_FAST_MS) * r->heat / OSDP_HEAT_MAX;
+  r->nextPollMs = nowMs + interval;
+}
+
+// Function to pick the reader that is most overdue - -1 if none is due yet
+static int osdpPickReader(OsdpBus *bus, uint32_t nowMs) {
+  int best = -1;
+  int32_t bestLate = -1;
+  for (uint8_t i = 0; i < bus->readerCount; i++) {
+    int32_t late = (int32_t)(nowMs - bus->readers[i].nextPollMs);
+    if (late > bestLate) {
+      bestLate = late;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Function to send a reader its next command - the head of its queue, or a poll
+// A resend after a missed reply keeps the sequence number so the reader repeats its last reply instead of acting twice
+static void osdpSend(OsdpBus *bus, uint8_t index, uint32_t nowMs) {
+  OsdpReader *r = &bus->readers[index];
+  if (!r->online) r->seq = 0;                    // Sequence 0 makes the reader start over
+  else if (!r->resend) r->seq = r->seq % 3 + 1;  // 1, 2, 3, 1, ...
+  r->resend = false;
+
+  uint8_t frame[OSDP_MAX_FRAME];
+  size_t len;
+  if (r->queueCount > 0 && r->online) {
+    const OsdpCommand *cmd = &r->queue[r->queueHead];
+    len = osdpBuild(frame, sizeof(frame), index, false, r->seq, cmd->code, cmd->data, cmd->len);
+    bus->currentCode = cmd->code;
+  }
+  else {
+    len = osdpBuild(frame, sizeof(frame), index, false, r->seq, OSDP_CMD_POLL, NULL, 0);
+    bus->currentCode = OSDP_CMD_POLL;
+  }
+
+  if (r->online) {
+    uint32_t gap = nowMs - r->lastPollMs;
+    if (gap > r->pollGapMax) r->pollGapMax = gap;
+  }
+  r->lastPollMs = nowMs;
+  bus->rxLen = 0;  // Anything still buffered is stale
+  bus->port->write(frame, len);
+  osdpCountWire(bus, len);
+  bus->current = index;
+  bus->sentMs = nowMs;
+}
+
+// Function to act on a card data reply - keeps the first four bytes of the card number, right-aligned if shorter
+static void osdpTakeCard(OsdpBus *bus, uint8_t index, const OsdpFrame *frame, uint32_t nowMs) {
+  if (frame->len < 4) return;
+  uint16_t bits = frame->data[2] | (frame->data[3] << 8);
+  size_t bytes = (bits + 7) / 8;
+  if (bytes == 0 || frame->len < 4 + bytes) return;
+
+  OsdpReader *r = &bus->readers[index];
+  r->cards++;
+  r->heat = OSDP_HEAT_MAX;  // Someone is at this door - more taps are likely soon
+  if (bus->cardCount == OSDP_CARD_QUEUE) {
+    bus->cardsDropped++;
+    return;
+  }
+  OsdpCardRead *read = &bus->cards[(bus->cardHead + bus->cardCount) % OSDP_CARD_QUEUE];
+  bus->cardCount++;
+  memset(read->uid, 0, OSDP_UID_SIZE);
+  if (bytes >= OSDP_UID_SIZE) memcpy(read->uid, frame->data + 4, OSDP_UID_SIZE);
+  else memcpy(read->uid + OSDP_UID_SIZE - bytes, frame->data + 4, bytes);
+  read->reader = index;
+  read->receivedMs = nowMs;
+}
+
+// Function to finish an exchange with the reply frame
+static void osdpHandleReply(OsdpBus *bus, const OsdpFrame *frame, uint32_t nowMs) {
+  uint8_t index = bus->current;
+  OsdpReader *r = &bus->readers[index];
+  bus->current = -1;
+  bus->heldMs += nowMs - bus->sentMs;
+  r->online = true;
+  r->misses = 0;
+  r->polls++;
+
+  if (frame->code == OSDP_REPLY_BUSY) {
+    r->nextPollMs = nowMs + OSDP_POLL_FAST_MS;  // Same command again shortly, same sequence number
+    r->resend = true;
+    return;
+  }
+  if (frame->code == OSDP_REPLY_NAK) r->online = false;  // Usually a sequence error - start over with sequence 0
+  if (frame->code == OSDP_REPLY_RAW) osdpTakeCard(bus, index, frame, nowMs);
+
+  // The queued command is done, answered or refused - a refused one would only be refused again
+  if (bus->currentCode != OSDP_CMD_POLL && r->queueCount > 0) {
+    r->queueHead = (r->queueHead + 1) % OSDP_QUEUE_DEPTH;
+    r->queueCount--;
+  }
+  osdpSchedule(bus, r, nowMs);
+  if (r->queueCount > 0) r->nextPollMs = nowMs;  // More commands waiting - keep going
+}
+
+void osdpService(OsdpBus *bus, uint32_t nowMs) {
+  // Collect reply bytes
+  if (bus->rxLen < sizeof(bus->rx)) bus->rxLen += bus->port->read(bus->rx + bus->rxLen, sizeof(bus->rx) - bus->rxLen);
+  while (bus->rxLen > 0) {
+    OsdpFrame frame;
+    int used = osdpParse(bus->rx, bus->rxLen, &frame);
+    if (used == 0) break;
+    size_t drop = used > 0 ? used : -used;
+    memmove(bus->rx, bus->rx + drop, bus->rxLen - drop);
+    bus->rxLen -= drop;
+    if (used < 0 || !frame.reply) continue;  // Noise, or our own command echoed by the transceiver
+    osdpCountWire(bus, drop);
+    // A late reply to an abandoned exchange is ignored
+    if (bus->current < 0 || frame.addr != bus->current) continue;
+    if (frame.seq != bus->readers[bus->current].seq) continue;
+    osdpHandleReply(bus, &frame, nowMs);
+  }
+
+  // Give up on a reply that is overdue - the next exchange with that reader resends the same command
+  if (bus->current >= 0) {
+    if (nowMs - bus->sentMs <= OSDP_REPLY_TIMEOUT_MS) return;
+    OsdpReader *r = &bus->readers[bus->current];
+    bus->heldMs += nowMs - bus->sentMs;
+    bus->current = -1;
+    r->timeouts++;
+    if (r->online && ++r->misses < OSDP_OFFLINE_RETRIES) {
+      r->nextPollMs = nowMs;
+      r->resend = true;
+    }
+    else {
+      r->online = false;
+      r->queueCount = 0;  // LED and buzzer feedback is stale by the time the reader is back
+      osdpSchedule(bus, r, nowMs);
+    }
+  }
+
+  int index = osdpPickReader(bus, nowMs);
+  if (index >= 0) osdpSend(bus, index, nowMs);
+}
+
+bool osdpQueueCommand(OsdpBus *bus, uint8_t reader, uint8_t code, const uint8_t *data, size_t len) {
+  if (reader >= bus->readerCount || len > sizeof(bus->readers[0].queue[0].data)) return false;
+  OsdpReader *r = &bus->readers[reader];
+  if (r->queueCount == OSDP_QUEUE_DEPTH) return false;
+  OsdpCommand *cmd = &r->queue[(r->queueHead + r->queueCount) % OSDP_QUEUE_DEPTH];
+  r->queueCount++;
+  cmd->code = code;
+  cmd->len = len;
+  if (len > 0) memcpy(cmd->data, data, len);
+  if (r->online && bus->current != reader) r->nextPollMs = r->lastPollMs;  // Due now, ahead of readers that are merely idle
+  return true;
+}
+
+bool osdpNextCard(OsdpBus *bus, OsdpCardRead *read) {
+  if (bus->cardCount == 0) return false;
+  *read = bus->cards[bus->cardHead];
+  bus->cardHead = (bus->cardHead + 1) % OSDP_CARD_QUEUE;
+  bus->cardCount--;
+  return true;
+}
+
+void osdpCardHandled(OsdpBus *bus, const OsdpCardRead *read, bool granted, uint32_t nowMs) {
+  OsdpReader *r = &bus->readers[read->reader];
+  uint32_t latency = nowMs - read->receivedMs;
+  r->latencyTotalMs += latency;
+  if (latency > r->latencyMaxMs) r->latencyMaxMs = latency;
+
+  // LED 0 green or red for one second, then back to its permanent state; a short beep on refusal
+  uint8_t led[14] = {0, 0, 2, 10, 0, (uint8_t)(granted ? 2 : 1), 0, 10, 0, 0, 0, 0, 0, 0};
+  osdpQueueCommand(bus, read->reader, OSDP_CMD_LED, led, sizeof(led));
+  if (!granted) {
+    uint8_t buzz[5] = {0, 2, 2, 1, 2};  // Default tone, 200 ms on, 100 ms off, twice
+    osdpQueueCommand(bus, read->reader, OSDP_CMD_BUZ, buzz, sizeof(buzz));
+  }
+}
+
+float osdpUtilization(const OsdpBus *bus, uint32_t nowMs) {
+  uint32_t elapsed = nowMs - bus->startMs;
+  return elapsed == 0 ? 0 : bus->wireUs / 10.0f / elapsed;
+}
+
+#ifdef ARDUINO
+#include "hot_standby.h"
+
+#if OSDP_ENABLED && HOT_STANDBY_ENABLED && OSDP_TX_PIN == HS_SUPERVISOR_PIN
+#error "OSDP_TX_PIN and HS_SUPERVISOR_PIN are the same GPIO - move one of them"
+#endif
+
+OsdpBus osdpBus;
+static uint32_t osdpLastReport = 0;
+
+static size_t osdpUartWrite(const uint8_t *buf, size_t len) {
+  return Serial1.write(buf, len);  // Frames fit the UART FIFO - returns without waiting for the line
+}
+
+static size_t osdpUartRead(uint8_t *buf, size_t cap) {
+  size_t n = 0;
+  while (n < cap && Serial1.available() > 0) buf[n++] = Serial1.read();
+  return n;
+}
+
+static const OsdpPort osdpUart = {osdpUartWrite, osdpUartRead};
+
+// Function to open the RS-485 UART and start polling
+void osdpBegin() {
+  Serial1.begin(OSDP_BAUD, SERIAL_8N1, OSDP_RX_PIN, OSDP_TX_PIN);
+#if OSDP_DE_PIN >= 0
+  Serial1.setPins(OSDP_RX_PIN, OSDP_TX_PIN, -1, OSDP_DE_PIN);  // The UART drives RTS as driver enable
+  Serial1.setMode(UART_MODE_RS485_HALF_DUPLEX);
+#endif
+  osdpInit(&osdpBus, &osdpUart, OSDP_BAUD, OSDP_READERS, millis());
+  osdpLastReport = millis();
+}
+
+// Function to print bus statistics - one line for the bus, one per door that read cards or missed replies
+static void osdpReport(uint32_t now) {
+  uint8_t online = 0;
+  for (uint8_t i = 0; i < osdpBus.readerCount; i++) online += osdpBus.readers[i].online;
+  uint32_t elapsed = now - osdpBus.startMs;
+  Serial.printf("OSDP %u/%u readers online, line %.1f%%, held %.1f%%, %lu cards dropped\n", online, osdpBus.readerCount,
+                osdpUtilization(&osdpBus, now), elapsed ? 100.0f * osdpBus.heldMs / elapsed : 0.0f,
+                (unsigned long)osdpBus.cardsDropped);
+  for (uint8_t i = 0; i < osdpBus.readerCount; i++) {
+    const OsdpReader *r = &osdpBus.readers[i];
+    if (r->cards == 0 && r->timeouts == 0) continue;
+    Serial.printf("Door %u: %lu polls, max gap %lu ms, %lu cards, decision avg %lu max %lu ms, %lu timeouts\n", i + 1,
+                  (unsigned long)r->polls, (unsigned long)r->pollGapMax, (unsigned long)r->cards,
+                  (unsigned long)(r->cards ? r->latencyTotalMs / r->cards : 0), (unsigned long)r->latencyMaxMs,
+                  (unsigned long)r->timeouts);
+  }
+}
+
+// Function to run the bus and print statistics now and then - call while waiting
+void osdpPoll() {
+  uint32_t now = millis();
+  osdpService(&osdpBus, now);
+  if (now - osdpLastReport >= OSDP_REPORT_MS) {
+    osdpLastReport = now;
+    osdpReport(now);
+  }
+}
+#endif
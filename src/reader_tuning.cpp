@@ -0,0 +1,235 @@
+#include "reader_tuning.h"
+
+// Receiver gain per index - RxGain_18dB_2 and RxGain_23dB_2 duplicate the first two settings and are skipped
+static const byte readerGains[READER_GAIN_COUNT] = {
+  MFRC522::RxGain_18dB, MFRC522::RxGain_23dB, MFRC522::RxGain_33dB,
+  MFRC522::RxGain_38dB, MFRC522::RxGain_43dB, MFRC522::RxGain_48dB
+};
+static const byte readerGainDb[READER_GAIN_COUNT] = {18, 23, 33, 38, 43, 48};
+
+#define READER_RATE_UNKNOWN 700   // Starting success estimate - optimistic so untried gains get a chance
+#define READER_RATE_SHIFT   3     // Weight of a new attempt is 1/8
+
+// Function to start tuning a reader - call after PCD_Init()
+void readerTuningBegin(ReaderTuning *t, MFRC522 *reader) {
+  memset(t, 0, sizeof(*t));
+  t->reader = reader;
+  t->gainIndex = READER_START_GAIN;
+  for (byte g = 0; g < READER_GAIN_COUNT; g++) t->successRate[g] = READER_RATE_UNKNOWN;
+  readerApplyGain(t);
+}
+
+// Function to re-apply the current gain - call after anything that re-initializes the reader
+void readerApplyGain(ReaderTuning *t) {
+  t->reader->PCD_SetAntennaGain(readerGains[t->gainIndex]);
+}
+
+// Function to record a first-attempt result at the current gain and pick the next gain once a window is full
+static void readerRecordAttempt(ReaderTuning *t, bool success) {
+  uint16_t &rate = t->successRate[t->gainIndex];
+  if (success) rate += (1000 - rate) >> READER_RATE_SHIFT;
+  else rate -= rate >> READER_RATE_SHIFT;
+  t->attempts[t->gainIndex]++;
+
+  if (++t->windowAttempts < READER_TUNE_WINDOW) return;
+  t->windowAttempts = 0;
+  t->windows++;
+
+  // Best gain so far - ties go to the lower gain, which is less sensitive to noise
+  byte best = 0;
+  for (byte g = 1; g < READER_GAIN_COUNT; g++) {
+    if (t->successRate[g] > t->successRate[best]) best = g;
+  }
+
+  // Periodically try a neighbour of the best gain so the estimate follows changes in the door frame
+  byte next = best;
+  if (t->windows % READER_EXPLORE_EVERY == 0) {
+    bool up = (t->windows / READER_EXPLORE_EVERY) % 2;
+    if (up && best + 1 < READER_GAIN_COUNT) next = best + 1;
+    else if (!up && best > 0) next = best - 1;
+  }
+
+  if (next != t->gainIndex) {
+    t->gainIndex = next;
+    readerApplyGain(t);
+  }
+}
+
+// Function to map an MFRC522 status code to an error class
+static ReaderErrorClass readerClassify(MFRC522::StatusCode status) {
+  switch (status) {
+    case MFRC522::STATUS_TIMEOUT:   return READER_ERR_TIMEOUT;
+    case MFRC522::STATUS_COLLISION: return READER_ERR_COLLISION;
+    case MFRC522::STATUS_CRC_WRONG: return READER_ERR_CRC;
+    case MFRC522::STATUS_NO_ROOM:
+    case MFRC522::STATUS_INTERNAL_ERROR: return READER_ERR_INTERNAL;
+    default:                        return READER_ERR_PROTOCOL;  // STATUS_ERROR, STATUS_INVALID, NACK
+  }
+}
+
+// Function to count a failed status and start the recovery clock
+static ReaderErrorClass readerRecordError(ReaderTuning *t, MFRC522::StatusCode status) {
+  ReaderErrorClass cls = readerClassify(status);
+  t->errors[cls]++;
+  if (t->errorSinceUs == 0) t->errorSinceUs = micros() | 1;  // Never 0 while an error is pending
+  return cls;
+}
+
+// Function to send REQA with the same register setup as PICC_IsNewCardPresent(), keeping the status code
+static MFRC522::StatusCode readerRequest(MFRC522 *reader) {
+  reader->PCD_WriteRegister(MFRC522::TxModeReg, 0x00);    // Reset baud rates
+  reader->PCD_WriteRegister(MFRC522::RxModeReg, 0x00);
+  reader->PCD_WriteRegister(MFRC522::ModWidthReg, 0x26);  // Reset modulation width
+  byte atqa[2];
+  byte size = sizeof(atqa);
+  return reader->PICC_RequestA(atqa, &size);
+}
+
+// Function to soft-reset the PCD after repeated timeouts - PCD_Init() issues the SoftReset command
+// and restores timer and antenna settings, then the tuned gain is put back
+static void readerSoftReset(ReaderTuning *t) {
+  t->reader->PCD_Init();
+  readerApplyGain(t);
+  t->softResets++;
+  t->timeoutStreak = 0;
+}
+
+// Function to re-select a card straight away after a collision or bit error - the card is still in the field
+// The last known UID is tried first with a direct SELECT, which skips anticollision entirely
+static bool readerRetrySelect(ReaderTuning *t) {
+  MFRC522 *reader = t->reader;
+  for (byte attempt = 0; attempt < READER_MAX_RETRIES; attempt++) {
+    byte atqa[2];
+    byte size = sizeof(atqa);
+    MFRC522::StatusCode status = reader->PICC_WakeupA(atqa, &size);  // Wakes the card from IDLE or HALT
+    if (status != MFRC522::STATUS_OK && status != MFRC522::STATUS_COLLISION) {
+      if (readerRecordError(t, status) == READER_ERR_TIMEOUT) return false;  // Card has left the field
+      continue;
+    }
+
+    if (t->haveLastUid) {
+      MFRC522::Uid known = t->lastUid;
+      if (reader->PICC_Select(&known, known.size * 8) == MFRC522::STATUS_OK) {
+        reader->uid = known;  // Same card as last time - no anticollision needed
+        return true;
+      }
+      size = sizeof(atqa);
+      status = reader->PICC_WakeupA(atqa, &size);  // A different card - wake it again for a full select
+      if (status != MFRC522::STATUS_OK && status != MFRC522::STATUS_COLLISION) continue;
+    }
+
+    status = reader->PICC_Select(&reader->uid, 0);
+    if (status == MFRC522::STATUS_OK) return true;
+    if (readerRecordError(t, status) == READER_ERR_TIMEOUT) return false;
+  }
+  return false;
+}
+
+// Function to detect and read a card, recovering from read errors - true when reader->uid is valid
+bool readerReadCard(ReaderTuning *t) {
+  MFRC522 *reader = t->reader;
+  unsigned long now = millis();
+  if (t->backoffMs > 0 && (long)(now - t->backoffUntil) < 0) return false;  // Noisy field - polling paused
+
+  MFRC522::StatusCode status = readerRequest(reader);
+  if (status == MFRC522::STATUS_TIMEOUT) {
+    t->errors[READER_ERR_NO_CARD]++;  // Empty field - the normal idle case
+    t->noiseStreak = 0;
+    t->backoffMs = 0;
+    return false;
+  }
+  if (status != MFRC522::STATUS_OK && status != MFRC522::STATUS_COLLISION) {
+    // Garbage on an otherwise empty field - back off exponentially while it persists
+    readerRecordError(t, status);
+    if (++t->noiseStreak >= READER_NOISE_STREAK) {
+      t->backoffMs = t->backoffMs == 0 ? READER_BACKOFF_MIN_MS : min(t->backoffMs * 2, READER_BACKOFF_MAX_MS);
+      t->backoffUntil = now + t->backoffMs;
+      t->backoffs++;
+      t->noiseStreak = 0;
+    }
+    return false;
+  }
+  t->noiseStreak = 0;
+  t->backoffMs = 0;
+
+  t->detections++;
+  if (t->pendingTaps == 0 || now - t->lastTapMs > READER_TAP_WINDOW_MS) {
+    t->pendingTaps = 0;  // A new user - start counting taps again
+    t->firstTapUs = micros();
+  }
+  t->lastTapMs = now;
+
+  status = reader->PICC_Select(&reader->uid, 0);
+  bool success = status == MFRC522::STATUS_OK;
+  readerRecordAttempt(t, success);  // Only first attempts count towards the gain's success rate
+  if (!success) {
+    // Collisions and bit errors are transient - re-select at once; a timeout means the card
+    // went quiet, so retrying would only add timer periods
+    if (readerRecordError(t, status) != READER_ERR_TIMEOUT) {
+      success = readerRetrySelect(t);
+      if (success) t->retriesRecovered++;
+    }
+  }
+
+  if (!success) {
+    if (status == MFRC522::STATUS_TIMEOUT && ++t->timeoutStreak >= READER_TIMEOUT_RESET) {
+      readerSoftReset(t);  // Repeated timeouts on detected cards usually mean a wedged PCD
+    }
+    t->failedTaps++;
+    t->pendingTaps++;  // The user will have to tap again
+    return false;
+  }
+
+  t->timeoutStreak = 0;
+  if (t->errorSinceUs != 0) {
+    // First good read after an error - record how long recovery took
+    uint32_t recoveryUs = micros() - t->errorSinceUs;
+    t->lastRecoveryUs = recoveryUs;
+    if (recoveryUs > t->maxRecoveryUs) t->maxRecoveryUs = recoveryUs;
+    t->recoveryUsTotal += recoveryUs;
+    t->recoveries++;
+    t->errorSinceUs = 0;
+  }
+
+  t->reads++;
+  t->lastUid = reader->uid;
+  t->haveLastUid = true;
+  return true;
+}
+
+// Function to record that the card just read has been decided on - closes the tap for the statistics
+void readerRecordDecision(ReaderTuning *t) {
+  t->decisions++;
+  t->tapsToSuccessTotal += t->pendingTaps + 1;  // Failed taps plus the one that worked
+  t->decisionUsTotal += micros() - t->firstTapUs;
+  t->pendingTaps = 0;
+
+  if (t->decisions % READER_REPORT_EVERY == 0) readerPrintStats(t);
+}
+
+// Function to print the tuning statistics on Serial
+void readerPrintStats(const ReaderTuning *t) {
+  Serial.printf("Reader: gain %u dB, %lu reads, %lu failed taps, %lu recovered by retry\n",
+                readerGainDb[t->gainIndex], (unsigned long)t->reads, (unsigned long)t->failedTaps,
+                (unsigned long)t->retriesRecovered);
+  if (t->decisions > 0) {
+    Serial.printf("Reader: %.2f taps to success, %lu us to decision (average)\n",
+                  (float)t->tapsToSuccessTotal / t->decisions, (unsigned long)(t->decisionUsTotal / t->decisions));
+  }
+  for (byte g = 0; g < READER_GAIN_COUNT; g++) {
+    if (t->attempts[g] == 0) continue;  // Only gains that have been tried
+    Serial.printf("Reader: %u dB success %u.%u%% over %u attempts\n", readerGainDb[g],
+                  t->successRate[g] / 10, t->successRate[g] % 10, t->attempts[g]);
+  }
+  Serial.printf("Reader errors: timeout %lu, collision %lu, crc %lu, protocol %lu, internal %lu\n",
+                (unsigned long)t->errors[READER_ERR_TIMEOUT], (unsigned long)t->errors[READER_ERR_COLLISION],
+                (unsigned long)t->errors[READER_ERR_CRC], (unsigned long)t->errors[READER_ERR_PROTOCOL],
+                (unsigned long)t->errors[READER_ERR_INTERNAL]);
+  Serial.printf("Reader recovery: %lu soft resets, %lu noise backoffs, %lu recoveries",
+                (unsigned long)t->softResets, (unsigned long)t->backoffs, (unsigned long)t->recoveries);
+  if (t->recoveries > 0) {
+    Serial.printf(", last %lu us, avg %lu us, max %lu us", (unsigned long)t->lastRecoveryUs,
+                  (unsigned long)(t->recoveryUsTotal / t->recoveries), (unsigned long)t->maxRecoveryUs);
+  }
+  Serial.println();
+}
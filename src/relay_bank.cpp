@@ -0,0 +1,73 @@
+#include "relay_bank.h"
+
+// Function to queue a level for one pin
+void relayBankWrite(RelayBank *bank, uint8_t pin, bool high) {
+  if (pin >= 32) return;  // Not in the output register - the ESP32-C3 has no such pin
+  uint32_t bit = 1UL << pin;
+  if (high) {
+    bank->high |= bit;
+    bank->low &= ~bit;
+  }
+  else {
+    bank->low |= bit;
+    bank->high &= ~bit;
+  }
+}
+
+// Function to queue the same level for several pins
+void relayBankWriteAll(RelayBank *bank, const uint8_t *pins, uint8_t count, bool high) {
+  for (uint8_t i = 0; i < count; i++) relayBankWrite(bank, pins[i], high);
+}
+
+#ifdef ARDUINO
+#include <soc/gpio_struct.h>
+
+// Function to apply the queued levels - one store per direction, skipped when nothing goes that way
+void relayBankCommit(RelayBank *bank) {
+  if (bank->high) GPIO.out_w1ts.val = bank->high;
+  if (bank->low) GPIO.out_w1tc.val = bank->low;
+  bank->high = bank->low = 0;
+}
+
+// Function to time both paths - the cycle counter is read after each pin's write, so the skew is the time
+// from the first pin changing to the last
+void relayBankPrintBenchmark(const uint8_t *pins, uint8_t count) {
+  const int rounds = 200;
+  if (count == 0 || count > 32) return;
+  uint32_t levels = 0;
+  for (uint8_t i = 0; i < count; i++) levels |= (uint32_t)digitalRead(pins[i]) << i;
+  uint32_t stamps[32];
+
+  uint32_t writeCycles = 0, writeSkew = 0;
+  for (int r = 0; r < rounds; r++) {
+    uint32_t start = ESP.getCycleCount();
+    for (uint8_t i = 0; i < count; i++) {
+      digitalWrite(pins[i], (levels >> i) & 1);
+      stamps[i] = ESP.getCycleCount();
+    }
+    writeCycles += stamps[count - 1] - start;
+    writeSkew += stamps[count - 1] - stamps[0];
+  }
+
+  uint32_t bankCycles = 0, bankSkew = 0;
+  for (int r = 0; r < rounds; r++) {
+    uint32_t start = ESP.getCycleCount();
+    RelayBank bank = {0, 0};
+    for (uint8_t i = 0; i < count; i++) relayBankWrite(&bank, pins[i], (levels >> i) & 1);
+    // The commit, stamped between its two stores - pins going the same way have no skew at all
+    uint32_t high = bank.high, low = bank.low;
+    if (high) GPIO.out_w1ts.val = high;
+    uint32_t first = ESP.getCycleCount();
+    if (low) GPIO.out_w1tc.val = low;
+    uint32_t last = ESP.getCycleCount();
+    bankCycles += last - start;
+    if (high && low) bankSkew += last - first;
+  }
+
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  Serial.printf("Relay bank: %u pins, digitalWrite %lu ns, skew %lu ns\n", count,
+                (unsigned long)(writeCycles / rounds * 1000 / mhz), (unsigned long)(writeSkew / rounds * 1000 / mhz));
+  Serial.printf("Relay bank: bank commit %lu ns, skew %lu ns\n", (unsigned long)(bankCycles / rounds * 1000 / mhz),
+                (unsigned long)(bankSkew / rounds * 1000 / mhz));
+}
+#endif
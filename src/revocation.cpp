@@ -0,0 +1,238 @@
+#include "revocation.h"
+#include "crypto_service.h"
+#include <string.h>
+
+#define REVOCATION_MAGIC 'R'
+
+// Function to compare versions across 16-bit wrap-around - positive when a is newer than b
+static int16_t versionDiff(uint16_t a, uint16_t b) {
+  return (int16_t)(a - b);
+}
+
+// Function to start an empty list
+void revocationInit(RevocationList *list) {
+  memset(list, 0, sizeof(*list));
+}
+
+// Function to find where a UID is, or would be inserted, in the sorted entries
+static int revocationFind(const RevocationList *list, const uint8_t *uid, bool *found) {
+  int lo = 0, hi = list->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = memcmp(list->entries[mid].uid, uid, REVOCATION_UID_SIZE);
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    }
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  *found = false;
+  return lo;
+}
+
+// Function to check whether a card is revoked - binary search over the sorted entries
+bool revocationContains(const RevocationList *list, const uint8_t *uid) {
+  bool found;
+  revocationFind(list, uid, &found);
+  return found;
+}
+
+// Function to drop the entry with the oldest version to make room
+static void revocationDropOldest(RevocationList *list) {
+  int oldest = 0;
+  for (int i = 1; i < list->count; i++) {
+    if (versionDiff(list->entries[i].version, list->entries[oldest].version) < 0) oldest = i;
+  }
+  memmove(&list->entries[oldest], &list->entries[oldest + 1], (list->count - oldest - 1) * sizeof(RevocationEntry));
+  list->count--;
+}
+
+// Function to add one revoked card at the given version - returns false if it was already listed
+bool revocationAdd(RevocationList *list, const uint8_t *uid, uint16_t version) {
+  bool found;
+  int pos = revocationFind(list, uid, &found);
+  if (found) return false;
+
+  if (list->count == REVOCATION_CAPACITY) {
+    revocationDropOldest(list);
+    pos = revocationFind(list, uid, &found);  // Position may have moved
+  }
+  memmove(&list->entries[pos + 1], &list->entries[pos], (list->count - pos) * sizeof(RevocationEntry));
+  memcpy(list->entries[pos].uid, uid, REVOCATION_UID_SIZE);
+  list->entries[pos].version = version;
+  list->count++;
+  if (versionDiff(version, list->version) > 0) list->version = version;  // Issuer adds advance the list directly
+  return true;
+}
+
+// Function to merge a verified card delta into the list
+RevocationMerge revocationMerge(RevocationList *list, const RevocationDelta *delta) {
+  if (versionDiff(delta->version, list->version) <= 0) return REVOCATION_STALE;
+
+  uint16_t before = list->version;
+  bool added = false;
+  for (uint8_t i = 0; i < delta->count; i++) {
+    added |= revocationAdd(list, delta->uids[i], delta->version);
+  }
+  list->version = before;  // Only a contiguous delta may advance the version
+
+  // Revocations are never undone, so extra entries are harmless - but if the door missed
+  // versions before the base it keeps its old version and waits for an older delta
+  // A gap delta the door already holds in full changes nothing - every later tap of that card would rewrite NVS
+  if (versionDiff(delta->baseVersion, before) > 0) return added ? REVOCATION_PARTIAL : REVOCATION_STALE;
+  list->version = delta->version;
+  return REVOCATION_MERGED;
+}
+
+// Function to build the newest delta a door can hand on - as many recent versions as fit on a card
+void revocationMakeDelta(const RevocationList *list, RevocationDelta *delta) {
+  // Raise the base version until the entries newer than it fit on one card
+  // Entries sharing a version stay together so the delta never claims a version it only half carries
+  uint16_t base = list->version - 0x7FFF;  // Oldest version still comparable with the current one
+  int count;
+  for (;;) {
+    count = 0;
+    uint16_t oldest = 0;
+    for (int i = 0; i < list->count; i++) {
+      if (versionDiff(list->entries[i].version, base) <= 0) continue;
+      if (count == 0 || versionDiff(list->entries[i].version, oldest) < 0) oldest = list->entries[i].version;
+      count++;
+    }
+    if (count <= REVOCATION_DELTA_MAX) break;
+    base = oldest;  // Drop the oldest version still included and try again
+  }
+
+  delta->baseVersion = base;
+  delta->version = list->version;
+  delta->count = 0;
+  for (int i = 0; i < list->count; i++) {
+    if (versionDiff(list->entries[i].version, base) <= 0) continue;
+    memcpy(delta->uids[delta->count++], list->entries[i].uid, REVOCATION_UID_SIZE);
+  }
+}
+
+// Function to sign and serialize a delta into a card block
+void revocationEncode(const RevocationDelta *delta, const uint8_t *key, size_t keyLen,
+                      uint8_t block[REVOCATION_BLOCK_SIZE]) {
+  memset(block, 0, REVOCATION_BLOCK_SIZE);
+  block[0] = REVOCATION_MAGIC;
+  block[1] = delta->count;
+  block[2] = delta->baseVersion;
+  block[3] = delta->baseVersion >> 8;
+  block[4] = delta->version;
+  block[5] = delta->version >> 8;
+  memcpy(block + 6, delta->uids, delta->count * REVOCATION_UID_SIZE);
+
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, block, REVOCATION_SIGNED_SIZE, mac);
+  memcpy(block + REVOCATION_SIGNED_SIZE, mac, REVOCATION_TAG_SIZE);
+}
+
+// Function to verify and parse a card block - returns false for blank, foreign or forged blocks
+bool revocationDecode(const uint8_t block[REVOCATION_BLOCK_SIZE], const uint8_t *key, size_t keyLen,
+                      RevocationDelta *delta) {
+  if (block[0] != REVOCATION_MAGIC || block[1] > REVOCATION_DELTA_MAX) return false;
+
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, block, REVOCATION_SIGNED_SIZE, mac);
+  if (!cryptoEqual(mac, block + REVOCATION_SIGNED_SIZE, REVOCATION_TAG_SIZE)) return false;
+
+  delta->count = block[1];
+  delta->baseVersion = block[2] | (block[3] << 8);
+  delta->version = block[4] | (block[5] << 8);
+  memcpy(delta->uids, block + 6, delta->count * REVOCATION_UID_SIZE);
+  return true;
+}
+
+#ifdef ARDUINO
+#include <Preferences.h>
+
+RevocationList revocationList;        // This door's revocation filter
+uint32_t revocationLastTapUs = 0;
+uint32_t revocationLastMergeUs = 0;
+uint32_t revocationMerges = 0;
+uint32_t revocationWriteBacks = 0;
+uint32_t revocationOverBudget = 0;
+
+static const uint8_t revocationSiteKey[] = REVOCATION_SITE_KEY;
+#define REVOCATION_KEY_LEN (sizeof(revocationSiteKey) - 1)  // Without the string terminator
+
+// Function to persist the filter so revocations survive a power cut
+static void revocationSave() {
+  Preferences prefs;
+  prefs.begin("revoke");
+  prefs.putUShort("ver", revocationList.version);
+  prefs.putBytes("list", revocationList.entries, revocationList.count * sizeof(RevocationEntry));
+  prefs.end();
+}
+
+// Function to load the revocation filter from NVS
+void revocationBegin() {
+  revocationInit(&revocationList);
+  Preferences prefs;
+  prefs.begin("revoke", true);  // Read-only
+  revocationList.version = prefs.getUShort("ver", 0);
+  size_t bytes = prefs.getBytes("list", revocationList.entries, sizeof(revocationList.entries));
+  revocationList.count = bytes / sizeof(RevocationEntry);
+  prefs.end();
+}
+
+// Function to exchange deltas with the card in the field - call after the card is selected
+void revocationProcessCard(MFRC522 &reader) {
+  MFRC522::PICC_Type type = MFRC522::PICC_GetType(reader.uid.sak);
+  if (type != MFRC522::PICC_TYPE_MIFARE_MINI && type != MFRC522::PICC_TYPE_MIFARE_1K &&
+      type != MFRC522::PICC_TYPE_MIFARE_4K) {
+    return;  // Only MIFARE Classic cards carry deltas
+  }
+
+  unsigned long start = micros();
+  MFRC522::MIFARE_Key key = {REVOCATION_CARD_KEY};
+  if (reader.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, REVOCATION_TRAILER_BLOCK, &key, &reader.uid) != MFRC522::STATUS_OK) {
+    return;  // Not a carrier card for this site
+  }
+
+  // Read the three data blocks - MIFARE_Read needs room for the 2 CRC bytes
+  uint8_t block[REVOCATION_BLOCK_SIZE];
+  for (byte i = 0; i < 3; i++) {
+    byte buf[18];
+    byte size = sizeof(buf);
+    if (reader.MIFARE_Read(REVOCATION_FIRST_BLOCK + i, buf, &size) != MFRC522::STATUS_OK) return;
+    memcpy(block + 16 * i, buf, 16);
+  }
+
+  RevocationDelta delta;
+  if (!revocationDecode(block, revocationSiteKey, REVOCATION_KEY_LEN, &delta)) {
+    return;  // Blank or forged - only site-provisioned carriers take part
+  }
+
+  unsigned long mergeStart = micros();
+  RevocationMerge result = revocationMerge(&revocationList, &delta);
+  if (result != REVOCATION_STALE) {  // Flash is only written when the list actually changed
+    revocationLastMergeUs = micros() - mergeStart;
+    revocationMerges++;
+    revocationSave();
+  }
+
+#if REVOCATION_WRITE_BACK
+  // Hand our newer list on so the card carries it to the next door
+  if (versionDiff(revocationList.version, delta.version) > 0) {
+    revocationMakeDelta(&revocationList, &delta);
+    revocationEncode(&delta, revocationSiteKey, REVOCATION_KEY_LEN, block);
+    bool written = true;
+    for (byte i = 0; i < 3 && written; i++) {
+      written = reader.MIFARE_Write(REVOCATION_FIRST_BLOCK + i, block + 16 * i, 16) == MFRC522::STATUS_OK;
+    }
+    if (written) revocationWriteBacks++;
+  }
+#endif
+
+  revocationLastTapUs = micros() - start;
+  if (revocationLastTapUs > REVOCATION_TAP_BUDGET_US) revocationOverBudget++;
+}
+
+// Function to check whether a card UID is revoked on this door
+bool revocationIsRevoked(const uint8_t *uid) {
+  return revocationContains(&revocationList, uid);
+}
+#endif
@@ -4,6 +4,27 @@
 #include <Wire.h>           // I2C communication library - enables I2C protocol for OLED communication
 #include <Adafruit_GFX.h>   // Graphics library - provides drawing primitives like text, lines, circles
 #include <Adafruit_SSD1306.h> // OLED display driver - specific for SSD1306 based 0.96" displays
+#include "room_state.h"       // Room state table - occupancy and ownership per room
+#include "hot_standby.h"      // Optional hot-standby controller pair
+#include "state_sync.h"       // Optional delta publishing of room state to a fleet collector
+#include "revocation.h"       // Optional offline revocation lists carried on site cards
+#include "reader_tuning.h"    // Adaptive antenna gain and read retries
+#include "event_journal.h"    // Optional persistent, encrypted journal of tap decisions
+#include "crypto_service.h"   // Hardware-accelerated HMAC and AES
+#include "wifi_manager.h"     // Non-blocking Wi-Fi link with reconnect backoff
+#include "site_config.h"      // Per-site settings from a binary blob in NVS
+#include "dwell_tracker.h"    // Optional staff dwell-time tracking for hospital wards
+#include "osdp.h"             // Optional OSDP card readers on an RS-485 bus
+#include "modbus_slave.h"     // Optional Modbus TCP/RTU access for building-management systems
+#include "web_ui.h"           // Optional status page served from flash
+#include "occupancy.h"        // Optional PIR and door-contact sensing per room
+#include "card_list.h"        // Optional card lists distributed from the host as signed deltas
+#include "emergency.h"        // Optional building-wide emergency lighting over multicast
+#include "anomaly.h"          // Optional detection of rooms left on and stuck relays
+#include "relay_bank.h"       // Relays switched together in one GPIO register write
+#include "block_pool.h"       // Fixed-size blocks for messages - kept off the heap
+#include "zero_cross.h"       // Optional relay switching on the mains zero crossing
+#include "display_compositor.h" // Alert overlay and partial display updates
 
 // OLED Display Configuration
 #define SCREEN_WIDTH 128     // OLED display width in pixels
@@ -14,6 +35,8 @@
 // Create display instance
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 
+// Pins, timings and room cards below are compiled defaults - a site config blob (site_config.h) overrides them
+
 // Define the pins for the RC522 on ESP32-C3
 #define RST_PIN 4           // RFID reset pin - controls the reset line of the RFID reader
 #define SS_PIN  5           // RFID SPI select pin (Slave Select) - selects the RFID reader on the SPI bus
@@ -35,32 +58,65 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 #define RELAY_1_POWER_PIN 0  // Pin to provide power to relay 1 common pin - constant HIGH output
 #define RELAY_2_POWER_PIN 3  // Pin to provide power to relay 2 common pin - constant HIGH output
 
+// Relay and relay power pin per room - index 0 drives room 1, index 1 drives room 2
+byte relayPins[NUM_ROOMS] = {RELAY_1_PIN, RELAY_2_PIN};
+byte relayPowerPins[NUM_ROOMS] = {RELAY_1_POWER_PIN, RELAY_2_POWER_PIN};
+
+// Wi-Fi is joined only when a network feature needs it
+#define NETWORK_ENABLED (HOT_STANDBY_ENABLED || STATE_SYNC_ENABLED || (MODBUS_ENABLED && MODBUS_TCP) || WEB_UI_ENABLED || \
+                         CARD_LIST_ENABLED || EMERGENCY_ENABLED)
+
 // Create MFRC522 instance - object-oriented approach to hardware abstraction
 MFRC522 mfrc522(SS_PIN, RST_PIN);  // RFID reader - creates instance with specified pins
+ReaderTuning readerTuning;         // Gain and retry state for the RFID reader
 
 // Store the UIDs of your specific RFID tags - security by allowing only specific cards
-// The byte arrays store the unique ID of each RFID tag in hexadecimal format
-byte rfid1UID[4] = {0x13, 0xA3, 0x50, 0x11};  // First authorized RFID card - 4-byte unique identifier
-byte rfid2UID[4] = {0x03, 0x32, 0xC0, 0x0D};  // Second authorized RFID card - 4-byte unique identifier
+// The byte arrays store the unique ID of each RFID tag in hexadecimal format, one card per room
+byte roomCardUID[NUM_ROOMS][UID_SIZE] = {
+  {0x13, 0xA3, 0x50, 0x11},  // Room 1 authorized RFID card - 4-byte unique identifier
+  {0x03, 0x32, 0xC0, 0x0D}   // Room 2 authorized RFID card - 4-byte unique identifier
+};
+
+// Staff badges - tracked for dwell time instead of being refused; the list comes from the site config
+#define MAX_STAFF_CARDS 32
+byte staffCardUID[MAX_STAFF_CARDS][UID_SIZE];
+byte staffCardCount = 0;
 
-// Variables to track the LED/Relay states - embedded systems need to track state
-bool relay1On = false;      // Status of relay 1 - tracks whether room 1 is occupied
-bool relay2On = false;      // Status of relay 2 - tracks whether room 2 is occupied
+// Room each OSDP door serves, or CONFIG_NO_ROOM for a corridor reader - guests are only let in at their own room's
+// door; the local reader at the desk serves every room
+byte doorRoom[OSDP_READERS];
 
-// Variables to track which tag turned on which relay - implements ownership concept
-byte relay1Owner[4] = {0, 0, 0, 0};  // UID of card that activated relay 1 - stores 4-byte ID
-byte relay2Owner[4] = {0, 0, 0, 0};  // UID of card that activated relay 2 - stores 4-byte ID
-bool relay1HasOwner = false;  // Flag for relay 1 ownership - indicates if relay 1 has an assigned user
-bool relay2HasOwner = false;  // Flag for relay 2 ownership - indicates if relay 2 has an assigned user
+// Room occupancy and ownership live in the room state table (room_state.h)
 
 // Buffer for storing display messages - manages what will be shown on the OLED
-String displayMessages[5];  // Circular buffer to hold last 5 messages - mimics serial monitor
+// Each message is a fixed-size block from the log line pool, so months of taps never fragment the heap
+#define LOG_LINE_SIZE  48   // Longest message kept, with its terminator - a 10-byte UID from an OSDP door fits
+#define LOG_POOL_LINES 8    // The display ring plus room for other holders of a line
+struct LogLine {
+  char text[LOG_LINE_SIZE];
+};
+static LogLine logLineBlocks[LOG_POOL_LINES];
+static std::atomic<uint16_t> logLineLinks[LOG_POOL_LINES];
+BlockPool logLinePool;      // Usage and exhaustion counts in logLinePool.used/peak/exhausted
+LogLine *displayMessages[5];  // Circular buffer to hold last 5 messages - mimics serial monitor
 int messageIndex = 0;       // Current position in circular buffer - tracks where to add new message
 
-// Display mode flags
-bool showingAlert = false;  // Flag to indicate if an alert message is currently displayed
-unsigned long alertStartTime = 0; // Timestamp when alert was shown - used for timing alert display duration
+// Card being handled - shown on alerts, whichever reader it came from
+byte tapUID[10];
+byte tapUIDSize = 0;
+#define LOCAL_DOOR -1                // Door number of the MFRC522 - OSDP readers are doors 0..OSDP_READERS-1
+unsigned long localTapTime = 0;      // Last card handled at the local reader - starts the debounce pause
+
+// Alert drawn over the title bar - the room rows stay live beneath it
+AlertOverlay alertOverlay;
+#define ALERT_OVERLAY_HEIGHT 16  // Title bar and separator rows - two text lines
 #define ALERT_DURATION 3000 // Duration to show alert messages in milliseconds (3 seconds)
+#define TAP_PAUSE 1000      // Pause after a tap before scanning again - debounce for a card held in the field
+#define FLASH_DURATION 100  // Relay flash half-period for denied taps in milliseconds
+#define RELAY_TEST_DURATION 500  // On-time per relay in the boot relay test in milliseconds
+
+// Timings in effect - the defaults above unless the site config replaces them
+SiteTimings timings = {ALERT_DURATION, TAP_PAUSE, FLASH_DURATION, RELAY_TEST_DURATION};
 
 // Function to check if two UIDs match - helper function for authentication
 // Takes two byte arrays and their size, returns true if all bytes match
@@ -71,74 +127,80 @@ bool compareUID(byte *uid1, byte *uid2, byte size) {
   return true;  // If all bytes match, return true
 }
 
-// Function to save the current UID as the owner of a relay - ownership assignment
-// Copies bytes from source array to destination array
-void saveOwner(byte *destination, byte *source, byte size) {
-  for (byte i = 0; i < size; i++) {
-    destination[i] = source[i];  // Copy each byte from source to destination
+// Function to find the room a card is authorized for - returns the room index or -1 for unknown cards
+int findCardRoom(byte *uid) {
+#if CARD_LIST_ENABLED
+  if (cardList.version != 0) return cardListRoom(uid);  // Once the host has sent a list, it replaces the compiled cards
+#endif
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    if (compareUID(roomCardUID[room], uid, UID_SIZE)) return room;
   }
+  return -1;  // Card is not authorized for any room
 }
 
 // Function to add a message to both Serial and OLED display - unified logging system
-// Takes a string message and adds it to the circular buffer and updates display
-void addMessage(String message) {
+// Takes a printf-style format, formats it into a pooled line and adds it to the circular buffer
+void addMessage(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void addMessage(const char *format, ...) {
+  blockPoolFree(&logLinePool, displayMessages[messageIndex]);  // The oldest line makes room for the new one
+  displayMessages[messageIndex] = (LogLine *)blockPoolAlloc(&logLinePool);
+  LogLine *line = displayMessages[messageIndex];
+  char spare[LOG_LINE_SIZE];  // Only used if the pool is exhausted - Serial still gets the message
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line != NULL ? line->text : spare, LOG_LINE_SIZE, format, args);
+  va_end(args);
+
   // Print to Serial for USB debugging
-  Serial.println(message);
-  
-  // Add to circular buffer for OLED display
-  displayMessages[messageIndex] = message;
+  Serial.println(line != NULL ? line->text : spare);
   messageIndex = (messageIndex + 1) % 5;  // Circular buffer implementation - wrap around after 5 messages
 }
 
-// Function to show an alert message on the OLED - displays important notifications prominently
-void showAlert(String message1, String message2 = "") {
-  display.clearDisplay();  // Clear the display buffer - prepares for new content
-  display.setTextSize(1);  // Set text size to smallest (1) - allows more content to fit
-  display.setTextColor(SSD1306_WHITE);  // Set text color to white - standard for monochrome OLED
-  
-  // Display the alert title with emphasis
-  display.setCursor(0, 0);  // Start at top-left
-  display.println("! ALERT !");  // Alert header
-  display.println("------------------");  // Visual separator
-  
-  // Display the alert message centered
-  display.setCursor(0, 24);  // Position for main message
-  display.println(message1);  // First line of alert
-  
-  if (message2 != "") {  // If there's a second message line
-    display.setCursor(0, 34);  // Position for second message line
-    display.println(message2);  // Second line of alert
+// Function to draw the alert overlay - title inverted with its repeat count, detail and card below
+void drawAlertOverlay() {
+  display.fillRect(0, 0, SCREEN_WIDTH, ALERT_OVERLAY_HEIGHT, SSD1306_BLACK);  // Hide the title bar under it
+  display.fillRect(0, 0, SCREEN_WIDTH, 8, SSD1306_WHITE);
+  display.setTextColor(SSD1306_BLACK, SSD1306_WHITE);
+  display.setCursor(1, 0);
+  display.print(alertOverlay.title);
+  if (alertOverlay.repeats > 1) {
+    char count[6];
+    int len = snprintf(count, sizeof(count), "x%u", alertOverlay.repeats);
+    display.setCursor(SCREEN_WIDTH - 6 * len, 0);  // Right-aligned - 6-pixel characters
+    display.print(count);
   }
-  
-  // Display UID information if available
-  if (mfrc522.uid.size > 0) {  // If we have a card UID
-    display.setCursor(0, 50);  // Position for UID information
-    display.print("UID:");  // Label for UID
-    for (byte i = 0; i < mfrc522.uid.size; i++) {
-      // Format UID bytes with leading zeros
-      display.print(mfrc522.uid.uidByte[i] < 0x10 ? " 0" : " ");
-      display.print(mfrc522.uid.uidByte[i], HEX);  // Display each byte in hexadecimal
-    }
+
+  // Detail, and the card's UID after it if the line has room
+  char line[ALERT_TEXT_SIZE];
+  int len = snprintf(line, sizeof(line), "%s", alertOverlay.detail);
+  if (len + 3 * alertOverlay.uidSize < (int)sizeof(line)) {
+    for (byte i = 0; i < alertOverlay.uidSize; i++) len += snprintf(line + len, sizeof(line) - len, " %02x", alertOverlay.uid[i]);
   }
-  
-  display.display();  // Update the display with the alert
-  
-  // Set alert display flags
-  showingAlert = true;  // Set flag that we're in alert mode
-  alertStartTime = millis();  // Record current time as alert start time
+  display.setTextColor(SSD1306_WHITE);
+  display.setCursor(0, 8);
+  display.print(line);
 }
 
-// Function to update the OLED display with current status and messages
-void updateDisplay() {
-  // Check if we should exit alert mode
-  if (showingAlert && (millis() - alertStartTime > ALERT_DURATION)) {
-    showingAlert = false;  // Exit alert mode after duration expires
+// Function to print how much an alert burst cost the display, against repainting the whole panel each time
+void reportAlertBurst() {
+  uint32_t full = (alertOverlay.burstAlerts + 1) * displayFullFrameBytes(SCREEN_WIDTH, SCREEN_HEIGHT / 8);
+  Serial.printf("Alert burst: %u alerts, %u frames, %lu bytes - %lu as full repaints\n", alertOverlay.burstAlerts,
+                alertOverlay.burstFrames, (unsigned long)alertOverlay.burstBytes, (unsigned long)full);
+  alertOverlay.burstAlerts = alertOverlay.burstFrames = 0;
+  alertOverlay.burstBytes = 0;
+}
+
+// Function to check whether a card is a staff badge
+bool isStaffCard(byte *uid) {
+  for (byte i = 0; i < staffCardCount; i++) {
+    if (compareUID(uid, staffCardUID[i], UID_SIZE)) return true;
   }
-  
-  // Skip updating if we're showing an alert and it's still active
-  if (showingAlert) return;
-  
-  // Normal display mode - shows system status and recent messages
+  return false;
+}
+
+// Function to update the OLED display with current status and messages - composed whole, sent where it changed
+void updateDisplay() {
+  // Status screen - always drawn, so a room switched during an alert shows at once
   display.clearDisplay();  // Clear the display buffer - prevents ghosting of previous content
   display.setTextSize(1);  // Set text size to smallest (1) - allows more content to fit on screen
   display.setTextColor(SSD1306_WHITE);  // Set text color to white - standard for monochrome OLED
@@ -147,32 +209,224 @@ void updateDisplay() {
   // Display title and status information - system state summary
   display.println("RFID Access System");
   display.println("------------------");
-  display.print("Room 1: ");
-  display.println(relay1On ? "Occupied" : "Free");  // Show status of room 1
-  display.print("Room 2: ");
-  display.println(relay2On ? "Occupied" : "Free");  // Show status of room 2
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    display.print("Room ");
+    display.print(room + 1);
+    display.print(": ");
+    display.println(relayOn[room] ? "Occupied" : "Free");  // Show status of each room
+  }
   display.println("------------------");
   
   // Display last few messages in reverse chronological order (newest at bottom)
   int count = 0;
   for (int i = 0; i < 3; i++) {  // Show up to 3 most recent messages - fits on screen
     int idx = (messageIndex - i - 1 + 5) % 5;  // Calculate index in circular buffer, accounting for wrap-around
-    if (displayMessages[idx] != "") {  // Only show non-empty message slots
-      display.println(displayMessages[idx]);  // Print the message on a new line
+    if (displayMessages[idx] != NULL) {  // Only show non-empty message slots
+      display.println(displayMessages[idx]->text);  // Print the message on a new line
       count++;
     }
   }
-  
-  display.display();  // Push the buffer to the display - makes changes visible on screen
+  if (alertOverlay.active) drawAlertOverlay();  // Over the title bar - the room rows stay visible
+
+  // Push only the changed columns of each page to the display
+  alertOverlayCountFrame(&alertOverlay, displayFlush(&display, &Wire, SCREEN_ADDRESS));
+}
+
+// Function to show an alert message on the OLED - drawn over the title bar by updateDisplay(); the same alert
+// again while it is showing only adds to its repeat count and keeps it up longer
+void showAlert(const char *message1, const char *message2 = "") {
+  alertOverlayPost(&alertOverlay, message1, message2, tapUID, tapUIDSize, millis());
+  updateDisplay();  // Sends the overlay rows - or just the counter for a repeat
+}
+
+// Function to check whether an emergency scene holds the outputs - nothing here may write a relay meanwhile,
+// or an edge queued for the next crossing could switch a light off after the listener forced it on
+static bool outputsHeld() {
+#if EMERGENCY_ENABLED
+  return emergencyActive();
+#else
+  return false;
+#endif
+}
+
+// Function to drive every relay to its room state at once - one register write per direction, on the next
+// zero crossing when a detector is fitted
+void applyRelayStates() {
+  if (outputsHeld()) return;  // Driven from the room state once the scene is cleared
+  RelayBank bank = {0, 0};
+  for (byte room = 0; room < NUM_ROOMS; room++) relayBankWrite(&bank, relayPins[room], relayOn[room]);
+  zeroCrossCommit(&bank);
+}
+
+// Function to switch one room's relay - on the next zero crossing when a detector is fitted
+void switchRelay(byte room, bool on) {
+  if (outputsHeld()) return;
+  RelayBank bank = {0, 0};
+  relayBankWrite(&bank, relayPins[room], on);
+  zeroCrossCommit(&bank);
+}
+
+#if HOT_STANDBY_ENABLED
+// Function to service the hot-standby link and react to role changes
+// On promotion the reader is re-initialized and the relays are driven from the replicated room state
+void serviceStandby() {
+  HotStandbyEvent event = hotStandbyPoll();
+  if (event == HS_EVENT_PROMOTED) {
+    mfrc522.PCD_Init();  // Reader was last driven by the partner - start from a clean state
+    readerApplyGain(&readerTuning);  // PCD_Init() resets the antenna gain
+    applyRelayStates();  // Continue where the partner stopped
+    addMessage("Standby took over");
+    addMessage("Failover %lums lag %lu", (unsigned long)hsNode.lastFailoverMs, (unsigned long)hsNode.failoverSeqLag);  // Takeover time and divergence
+    updateDisplay();
+  }
+  else if (event == HS_EVENT_DEMOTED) {
+    addMessage("Partner is active");
+    updateDisplay();
+  }
+}
+#endif
+
+#if EMERGENCY_ENABLED
+// Function to report emergency scene changes - the listener task has already switched the outputs
+void serviceEmergency() {
+  EmergencyEvent event = emergencyPoll();
+  if (event == EMERGENCY_EVENT_STARTED) {
+    addMessage("EMERGENCY lights on");
+    addMessage("Switched in %luus", (unsigned long)emergencySwitchUs);  // Datagram to last relay
+    updateDisplay();
+  }
+  else if (event == EMERGENCY_EVENT_CLEARED) {
+    applyRelayStates();  // Back to the room state
+    addMessage("Emergency cleared");
+    updateDisplay();
+  }
+}
+#endif
+
+// Function to read Serial - bytes of a config upload go to the site config, the rest are command lines
+void serviceSerial() {
+  while (Serial.available() > 0) {
+    uint8_t c = Serial.read();
+#if SITE_CONFIG_ENABLED
+    if (siteConfigUploadByte(c)) continue;  // Part of a signed config blob
+#endif
+#if JOURNAL_ENABLED
+    journalCommandByte(c);  // "audit ..." prints matching journal events
+#endif
+  }
+}
+
+// Function to run background work - journal housekeeping, replication and state publishing
+void serviceBackground() {
+  serviceSerial();  // Config uploads and audit commands
+#if NETWORK_ENABLED
+  wifiManagerPoll();  // Reconnects and flushes queued frames - never waits on the radio
+#endif
+#if CARD_LIST_ENABLED
+  cardListPoll();  // Card list updates - the standby controller takes them too
+#endif
+#if EMERGENCY_ENABLED
+  serviceEmergency();  // Both controllers of a standby pair hold the outputs on
+#endif
+#if DWELL_TRACKING_ENABLED
+  dwellMaintain();  // Close visits whose exit tap was missed
+#endif
+#if JOURNAL_ENABLED
+  journalMaintain();  // Erase ahead so journal writes on the tap path never wait for flash erase
+  journalAuditPoll();  // A few records of any audit in progress, one line of output at most
+#endif
+#if ZERO_CROSS_ENABLED
+  zeroCrossPoll();  // Mains frequency, switching accuracy and cost now and then
+#endif
+#if HOT_STANDBY_ENABLED
+  serviceStandby();
+  if (!hotStandbyIsActive()) return;  // Only the active controller publishes room state
+#endif
+#if OSDP_ENABLED
+  osdpPoll();  // Poll the remote readers - card reads wait in a queue for loop()
+#endif
+#if MODBUS_ENABLED
+  modbusPoll();  // Answer building-management requests straight from the room state table
+#endif
+#if WEB_UI_ENABLED
+  webUiPoll();  // Serve the status page and push room changes to open pages
+#endif
+#if STATE_SYNC_ENABLED
+  stateSyncPoll();
+#endif
+}
+
+// Function to switch a room on request from the building-management system - the same state, relay,
+// journal and display updates as a card tap, but without an owner card
+bool remoteSwitchRoom(uint16_t room, bool on) {
+  if (room >= NUM_ROOMS) return false;
+#if EMERGENCY_ENABLED
+  if (emergencyActive()) return false;  // Outputs are held on until the emergency is cleared
+#endif
+  if (relayOn[room] == on) return true;  // Already in the requested state - nothing to record
+  if (on) occupyRoom(room);
+  else checkOutRoom(room);
+  switchRelay(room, on);  // Drive the physical relay
+  journalRecord(on ? JOURNAL_REMOTE_ON : JOURNAL_REMOTE_OFF, room, NULL);  // Audit trail
+  addMessage("Relay %d %s by BMS", room + 1, on ? "ON" : "OFF");  // Log the action
+  updateDisplay();  // Update display with new status
+  return true;
+}
+
+// Function to switch off a room its occupancy sensors found empty - the owner's card checks in again on return
+void vacateRoom(uint8_t room) {
+  checkOutRoom(room);  // Update room state and clear ownership
+  switchRelay(room, false);  // Turn off the physical relay
+  journalRecord(JOURNAL_VACANT, room, NULL);  // Audit trail
+  addMessage("Relay %d OFF", room + 1);  // Log the action
+  addMessage("Room %d vacant", room + 1);
+  updateDisplay();  // Update display with new status
+}
+
+#if ANOMALY_ENABLED
+// Function to report a detector alert - nothing is switched, staff check the room or the relay
+void reportAnomaly(uint8_t room, uint8_t alerts) {
+  if (alerts & ANOMALY_LONG_STAY) addMessage("Room %d on long - vacant?", room + 1);
+  if (alerts & ANOMALY_STUCK_ON) addMessage("Relay %d stuck on", room + 1);
+  if (alerts & ANOMALY_STUCK_OFF) addMessage("Relay %d stuck off", room + 1);
+  updateDisplay();
+}
+#endif
+
+// Function to wait without starving background work - replaces delay() on the scan path
+// so heartbeats, deltas and reader polls keep flowing during relay flashes
+void idleDelay(unsigned long ms) {
+  unsigned long start = millis();
+  do {
+    serviceBackground();
+  } while (millis() - start < ms);
 }
 
 void setup() {
   // Initialize serial communication - crucial for debugging embedded systems
   Serial.begin(115200);  // Sets baud rate to 115200 bits per second
   delay(500);  // Short delay to ensure serial connection is established
+  blockPoolInit(&logLinePool, logLineBlocks, sizeof(LogLine), LOG_POOL_LINES, logLineLinks);  // Before the first message
+
+  // Load the site configuration - each section replaces its compiled defaults, checked on first use
+  SitePins pins = {SDA_PIN, SCL_PIN, SCK_PIN, MISO_PIN, MOSI_PIN};
+  SiteReader reader = {SS_PIN, RST_PIN, READER_START_GAIN};
+  for (byte door = 0; door < OSDP_READERS; door++) doorRoom[door] = door < NUM_ROOMS ? door : CONFIG_NO_ROOM;  // Reader n at room n+1
+#if SITE_CONFIG_ENABLED
+  siteConfigBegin();
+  siteConfigPins(&pins);
+  siteConfigReader(&reader);
+  siteConfigDoors(doorRoom, OSDP_READERS);
+  siteConfigRooms(relayPins, relayPowerPins);
+  siteConfigCards(roomCardUID);
+  siteConfigTimings(&timings);
+  staffCardCount = siteConfigStaff(staffCardUID, MAX_STAFF_CARDS);
+  Serial.printf("Config rev %u: load %u us, sections %u us\n", (unsigned)siteConfigRevision,
+                (unsigned)siteConfigLoadUs, (unsigned)siteConfigSectionUs);  // Boot cost of the blob
+#endif
   
   // Initialize I2C communication for OLED display - sets up the bus
-  Wire.begin(SDA_PIN, SCL_PIN);  // Start I2C with custom pins for ESP32
+  Wire.begin(pins.sda, pins.scl);  // Start I2C with custom pins for ESP32
   
   // Initialize OLED display - prepare the screen
   if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
@@ -188,39 +442,88 @@ void setup() {
   display.println("Building Lighting");
   display.println("Management System");
   display.println("Initializing...");
-  display.display();  // Show initial message
+  displayFlush(&display, &Wire, SCREEN_ADDRESS);  // Show initial message - the first flush sends the whole panel
   
   // Initialize the power pins for relays - these replace the 3.3V connection
-  pinMode(RELAY_1_POWER_PIN, OUTPUT);  // Set relay 1 power pin as output
-  pinMode(RELAY_2_POWER_PIN, OUTPUT);  // Set relay 2 power pin as output
-  
-  // Set the power pins to HIGH - continuously provide power to relay common pins
-  digitalWrite(RELAY_1_POWER_PIN, HIGH);  // Turn on power for relay 1
-  digitalWrite(RELAY_2_POWER_PIN, HIGH);  // Turn on power for relay 2
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    pinMode(relayPowerPins[room], OUTPUT);  // Set the relay power pin as output
+    digitalWrite(relayPowerPins[room], HIGH);  // Continuously provide power to the relay common pin
+  }
   
   // Initialize the SPI bus with custom pin mapping - configures SPI communication
-  SPI.begin(SCK_PIN, MISO_PIN, MOSI_PIN, SS_PIN);  // Start SPI with custom pins
+  SPI.begin(pins.sck, pins.miso, pins.mosi, reader.ssPin);  // Start SPI with custom pins
   
   // Initialize the MFRC522 RFID reader - prepares the RFID hardware
-  mfrc522.PCD_Init();  // Initializes the RFID reader in Proximity Coupling Device mode
-  
-  // Set up the relay pins as outputs - configure GPIO pin modes
-  pinMode(RELAY_1_PIN, OUTPUT);  // Sets relay 1 pin as output
-  pinMode(RELAY_2_PIN, OUTPUT);  // Sets relay 2 pin as output
+  mfrc522.PCD_Init(reader.ssPin, reader.rstPin);  // Initializes the reader on the configured pins - later PCD_Init() calls reuse them
+  readerTuningBegin(&readerTuning, &mfrc522);  // Start adapting the antenna gain
+  if (reader.startGain < READER_GAIN_COUNT && reader.startGain != readerTuning.gainIndex) {
+    readerTuning.gainIndex = reader.startGain;  // Site-tuned starting point, e.g. for a thick door panel
+    readerApplyGain(&readerTuning);
+  }
+
+#if CRYPTO_BENCHMARK_AT_BOOT
+  cryptoPrintBenchmark();  // Hardware vs software timings for card checks and journal records
+#endif
+#if JOURNAL_ENABLED
+  journalBegin();  // Find the journal head and log the boot
+#endif
+#if REVOCATION_ENABLED
+  revocationBegin();  // Load the revoked-card list saved before the last power cut
+#endif
   
-  // Initialize relays to off state - ensures system starts in known state
-  digitalWrite(RELAY_1_PIN, LOW);  // Sets relay 1 to LOW voltage (off)
-  digitalWrite(RELAY_2_PIN, LOW);  // Sets relay 2 to LOW voltage (off)
+  // Set up the relay pins as outputs, initialized to off - ensures system starts in known state
+  RelayBank bank = {0, 0};
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    pinMode(relayPins[room], OUTPUT);  // Sets the relay pin as output
+    relayBankWrite(&bank, relayPins[room], LOW);  // Sets the relay to LOW voltage (off)
+  }
+  relayBankCommit(&bank);
+#if RELAY_BANK_BENCHMARK_AT_BOOT
+  relayBankPrintBenchmark(relayPins, NUM_ROOMS);  // digitalWrite vs bank commit cost and skew
+#endif
+#if ZERO_CROSS_ENABLED
+  zeroCrossBegin();  // Detector locks within a few cycles - the relay test below switches at once until then
+#endif
   
-  // Test both relays quickly to confirm they're working - hardware validation
+  // Test each relay quickly to confirm it's working - hardware validation
   addMessage("Testing relays...");  // Indicate test is starting
-  digitalWrite(RELAY_1_PIN, HIGH);  // Turn on relay 1
-  delay(500);  // Wait 500ms
-  digitalWrite(RELAY_1_PIN, LOW);  // Turn off relay 1
-  digitalWrite(RELAY_2_PIN, HIGH);  // Turn on relay 2
-  delay(500);  // Wait 500ms
-  digitalWrite(RELAY_2_PIN, LOW);  // Turn off relay 2
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    switchRelay(room, true);  // Turn on the relay
+    delay(timings.relayTestMs);  // Wait
+    switchRelay(room, false);  // Turn off the relay
+  }
   
+#if OSDP_ENABLED
+  osdpBegin();  // Start polling the remote readers
+#endif
+#if OCCUPANCY_ENABLED
+  occupancyBegin();  // Room sensors - after the relay test, so its switching is not taken for occupancy
+#endif
+#if ANOMALY_ENABLED
+  anomalyBegin();  // Learned stay and current levels from before the restart
+#endif
+#if NETWORK_ENABLED
+  wifiManagerBegin();  // Connects in the background and reconnects with backoff - no waiting here
+#endif
+#if MODBUS_ENABLED
+  modbusBegin(remoteSwitchRoom);  // Coil writes switch rooms like a card tap would
+#endif
+#if WEB_UI_ENABLED
+  webUiBegin();  // Status page on port 80
+#endif
+#if HOT_STANDBY_ENABLED
+  hotStandbyBegin();  // Start in standby - takes over in loop() if the partner is silent
+#endif
+#if STATE_SYNC_ENABLED
+  stateSyncBegin();  // Publish room deltas to the fleet collector
+#endif
+#if CARD_LIST_ENABLED
+  cardListBegin();  // Load the last card list received and listen for updates
+#endif
+#if EMERGENCY_ENABLED
+  emergencyBegin(relayPins, NUM_ROOMS);  // Listener task - resumes a scene that was in force before a restart
+#endif
+
   addMessage("System ready!");  // Indicate system initialization complete
   addMessage("Scan your RFID tag");  // User instruction
   
@@ -228,152 +531,206 @@ void setup() {
   updateDisplay();  // Refresh the display with current information
 }
 
-void loop() {
-  // Check if we should exit alert mode and update display
-  if (showingAlert && (millis() - alertStartTime > ALERT_DURATION)) {
-    showingAlert = false;  // Exit alert mode
-    updateDisplay();  // Update with normal display
-  }
+// Function to decide on a card read at a door - the same rules for the local reader and every OSDP reader
+// Returns true if the tap was accepted (check-in, check-out or a staff visit)
+bool handleCard(byte *uid, byte uidSize, int door) {
+  tapUIDSize = uidSize < sizeof(tapUID) ? uidSize : sizeof(tapUID);
+  memcpy(tapUID, uid, tapUIDSize);
 
-  // Look for new cards - continuous polling for RFID tags
-  if (!mfrc522.PICC_IsNewCardPresent()) {
-    return;  // If no new card is present, exit this loop iteration
+  // Build UID string for display - format card ID for readability
+  char uidString[LOG_LINE_SIZE];
+  int len = door == LOCAL_DOOR ? snprintf(uidString, sizeof(uidString), "Card: ")
+                               : snprintf(uidString, sizeof(uidString), "Door %d card:", door + 1);
+  for (byte i = 0; i < uidSize && len < (int)sizeof(uidString); i++) {
+    len += snprintf(uidString + len, sizeof(uidString) - len, " %02x", uid[i]);  // Each byte in hexadecimal, leading zero
   }
+  addMessage("%s", uidString);  // Add card UID to message log
 
-  // Select one of the cards - attempt to read the detected card
-  if (!mfrc522.PICC_ReadCardSerial()) {
-    return;  // If card read fails, exit this loop iteration
-  }
+  // Check whether this card has been revoked (lost or stolen) - offline blacklist
+  bool cardRevoked = false;
+#if REVOCATION_ENABLED
+  cardRevoked = revocationIsRevoked(uid);
+#endif
 
-  // Build UID string for display - format card ID for readability
-  String uidString = "Card: ";
-  for (byte i = 0; i < mfrc522.uid.size; i++) {
-    // Format output for readability: add leading zero for values less than 0x10
-    uidString += (mfrc522.uid.uidByte[i] < 0x10 ? " 0" : " ");
-    uidString += String(mfrc522.uid.uidByte[i], HEX);  // Add each byte in hexadecimal
-  }
-  addMessage(uidString);  // Add card UID to message log
+  // Check which room this card owns, if any - ownership verification
+  int ownedRoom = findOwnedRoom(uid);
+
+  // Check which room this card is authorized for, if any - authentication check
+  int cardRoom = findCardRoom(uid);
+#if ANOMALY_ENABLED
+  anomalyRecordTap(ownedRoom >= 0 ? ownedRoom : cardRoom);  // Someone is at the door, whatever the decision
+#endif
 
-  // Check if this card is the owner of relay 1 - ownership verification
-  bool isRelay1Owner = relay1HasOwner && compareUID(relay1Owner, mfrc522.uid.uidByte, 4);
-  
-  // Check if this card is the owner of relay 2 - ownership verification
-  bool isRelay2Owner = relay2HasOwner && compareUID(relay2Owner, mfrc522.uid.uidByte, 4);
-  
-  // Check if this is one of the authorized cards - authentication check
-  bool isAuthorizedCard = compareUID(rfid1UID, mfrc522.uid.uidByte, 4) || 
-                          compareUID(rfid2UID, mfrc522.uid.uidByte, 4);
-  
   // Handle the card scan based on authorization and ownership - core business logic
-  if (isRelay1Owner) {
-    // This card owns relay 1, so it can turn it off - implements "check-out" functionality
-    relay1On = false;  // Update relay 1 state
-    relay1HasOwner = false;  // Clear ownership
-    digitalWrite(RELAY_1_PIN, LOW);  // Turn off the physical relay
-    addMessage("Relay 1 OFF");  // Log the action
-    addMessage("Left Room 1");  // User feedback
-    updateDisplay();  // Update display with new status
+  if (cardRevoked) {
+    // Revoked card - refuse both check-in and check-out
+    addMessage("Card revoked");
+    showAlert("ACCESS DENIED", "Card revoked");  // Show alert on display
+    journalRecord(JOURNAL_DENIED_REVOKED, -1, uid);  // Audit trail
+    return false;
+  }
+  int guestRoom = ownedRoom >= 0 ? ownedRoom : cardRoom;
+  if (guestRoom >= 0 && door != LOCAL_DOOR && doorRoom[door] != guestRoom) {
+    // Guest card at another room's door, or at a corridor reader - it may neither check in nor out here
+    addMessage("Room %d card, wrong door", guestRoom + 1);
+    showAlert("ACCESS DENIED", "Wrong door");  // Show alert on display
+    journalRecord(JOURNAL_DENIED_WRONG_DOOR, guestRoom, uid);  // Audit trail
+    return false;
   }
-  else if (isRelay2Owner) {
-    // This card owns relay 2, so it can turn it off - implements "check-out" functionality
-    relay2On = false;  // Update relay 2 state
-    relay2HasOwner = false;  // Clear ownership
-    digitalWrite(RELAY_2_PIN, LOW);  // Turn off the physical relay
-    addMessage("Relay 2 OFF");  // Log the action
-    addMessage("Left Room 2");  // User feedback
+  if (ownedRoom >= 0) {
+    // This card owns the room, so it can turn it off - implements "check-out" functionality
+    checkOutRoom(ownedRoom);  // Update room state and clear ownership
+    switchRelay(ownedRoom, false);  // Turn off the physical relay
+    journalRecord(JOURNAL_CHECK_OUT, ownedRoom, uid);  // Audit trail
+    addMessage("Relay %d OFF", ownedRoom + 1);  // Log the action
+    addMessage("Left Room %d", ownedRoom + 1);  // User feedback
     updateDisplay();  // Update display with new status
+    return true;
   }
-  else if (isAuthorizedCard) {
+  if (cardRoom >= 0) {
     // This is an authorized card but doesn't currently own any relay - handling "check-in"
-    if (compareUID(rfid1UID, mfrc522.uid.uidByte, 4)) {
-      // First RFID card - check if relay 1 is available
-      if (!relay1On) {
-        // relay 1 is available - assign it to this user
-        relay1On = true;  // Update relay 1 state
-        relay1HasOwner = true;  // Set ownership flag
-        saveOwner(relay1Owner, mfrc522.uid.uidByte, 4);  // Save user's UID as owner
-        digitalWrite(RELAY_1_PIN, HIGH);  // Turn on the physical relay
-        addMessage("Relay 1 ON");  // Log the action
-        addMessage("Room 1 assigned");  // User feedback
-        updateDisplay();  // Update display with new status
-      }
-      else {
-        // relay 1 is already taken - provide feedback
-        addMessage("Room 1 occupied");
-        showAlert("Room 1 is already", "occupied");  // Show alert on display
-        
-        // Flash relay 1 to indicate it's already taken - visual feedback
-        for (int i = 0; i < 2; i++) {
-          digitalWrite(RELAY_1_PIN, LOW);  // Turn off briefly
-          delay(100);  // Short delay
-          digitalWrite(RELAY_1_PIN, HIGH);  // Turn back on
-          delay(100);  // Short delay
-        }
-        // Return to proper state - ensure relay stays in the correct state
-        digitalWrite(RELAY_1_PIN, HIGH);
-      }
+    if (!relayOn[cardRoom]) {
+      // The card's room is available - assign it to this user
+      checkInRoom(cardRoom, uid);  // Update room state and save user's UID as owner
+      switchRelay(cardRoom, true);  // Turn on the physical relay
+      journalRecord(JOURNAL_CHECK_IN, cardRoom, uid);  // Audit trail
+      addMessage("Relay %d ON", cardRoom + 1);  // Log the action
+      addMessage("Room %d assigned", cardRoom + 1);  // User feedback
+      updateDisplay();  // Update display with new status
+      return true;
     }
-    else if (compareUID(rfid2UID, mfrc522.uid.uidByte, 4)) {
-      // Second RFID card - check if relay 2 is available
-      if (!relay2On) {
-        // relay 2 is available - assign it to this user
-        relay2On = true;  // Update relay 2 state
-        relay2HasOwner = true;  // Set ownership flag
-        saveOwner(relay2Owner, mfrc522.uid.uidByte, 4);  // Save user's UID as owner
-        digitalWrite(RELAY_2_PIN, HIGH);  // Turn on the physical relay
-        addMessage("Relay 2 ON");  // Log the action
-        addMessage("Room 2 assigned");  // User feedback
-        updateDisplay();  // Update display with new status
-      }
-      else {
-        // relay 2 is already taken - provide feedback
-        addMessage("Room 2 occupied");
-        showAlert("Room 2 is already", "occupied");  // Show alert on display
-        
-        // Flash relay 2 to indicate it's already taken - visual feedback
-        for (int i = 0; i < 2; i++) {
-          digitalWrite(RELAY_2_PIN, LOW);  // Turn off briefly
-          delay(100);  // Short delay
-          digitalWrite(RELAY_2_PIN, HIGH);  // Turn back on
-          delay(100);  // Short delay
-        }
-        // Return to proper state - ensure relay stays in the correct state
-        digitalWrite(RELAY_2_PIN, HIGH);
-      }
+
+    // The room is already taken - provide feedback
+    journalRecord(JOURNAL_DENIED_OCCUPIED, cardRoom, uid);  // Audit trail
+    addMessage("Room %d occupied", cardRoom + 1);
+    char alert[24];
+    snprintf(alert, sizeof(alert), "Room %d is already", cardRoom + 1);
+    showAlert(alert, "occupied");  // Show alert on display
+
+    // Flash the relay to indicate it's already taken - visual feedback
+    // Background work runs between the steps and may switch the room meanwhile (a BMS coil write), so the
+    // relay is always put back to the room state and the flash stops once the room is off. An emergency
+    // scene that starts meanwhile owns the outputs, so the flash is abandoned there and then
+    for (int i = 0; i < 2 && relayOn[cardRoom]; i++) {
+      switchRelay(cardRoom, false);  // Turn off briefly
+      idleDelay(timings.flashMs);  // Short delay
+      if (outputsHeld()) return false;
+      switchRelay(cardRoom, relayOn[cardRoom]);  // Turn back on - unless the room was switched off meanwhile
+      idleDelay(timings.flashMs);  // Short delay
+      if (outputsHeld()) return false;
     }
+    // Return to proper state - the room state as it is now, not as it was before the flash
+    switchRelay(cardRoom, relayOn[cardRoom]);
+    return false;
   }
-  else {
-    // Unauthorized RFID tag - security enforcement
-    addMessage("Access denied");
-    
-    // Check if all rooms are occupied - additional user feedback
-    if (relay1On && relay2On) {
-      addMessage("All rooms occupied");
-      showAlert("ACCESS DENIED", "All rooms occupied");  // Show alert on display
+#if DWELL_TRACKING_ENABLED
+  if (isStaffCard(uid)) {
+    // Staff badge - pair entry and exit taps to measure time spent in the room; relays are left alone
+    uint16_t staffRoom = door == LOCAL_DOOR ? DWELL_READER_ROOM : doorRoom[door];
+    if (staffRoom == CONFIG_NO_ROOM) {
+      // Corridor reader - a known badge, but there is no room to pair a visit with
+      addMessage("Staff at Door %d", door + 1);
+      updateDisplay();
+      return true;
     }
-    else {
-      showAlert("ACCESS DENIED", "Unauthorized card");  // Show alert on display
-      
-      // Flash both relays to indicate unauthorized access - visual alarm
-      for (int i = 0; i < 3; i++) {
-        digitalWrite(RELAY_1_PIN, HIGH);  // Turn on relay 1
-        digitalWrite(RELAY_2_PIN, HIGH);  // Turn on relay 2
-        delay(100);  // Short delay
-        digitalWrite(RELAY_1_PIN, LOW);  // Turn off relay 1
-        digitalWrite(RELAY_2_PIN, LOW);  // Turn off relay 2
-        delay(100);  // Short delay
-      }
-      
-      // Restore the relays to their correct states - recover from alarm
-      digitalWrite(RELAY_1_PIN, relay1On ? HIGH : LOW);  // Restore relay 1 to its correct state
-      digitalWrite(RELAY_2_PIN, relay2On ? HIGH : LOW);  // Restore relay 2 to its correct state
+    uint32_t dwellSeconds = 0;
+    DwellResult result = dwellRecordTap(uid, staffRoom, &dwellSeconds);
+#if ANOMALY_ENABLED
+    anomalyRecordTap(staffRoom);
+#endif
+    if (result == DWELL_ENTERED) {
+      journalRecord(JOURNAL_STAFF_IN, staffRoom, uid);  // Audit trail
+      addMessage("Staff in Room %d", staffRoom + 1);
     }
+    else if (result == DWELL_EXITED) {
+      journalRecord(JOURNAL_STAFF_OUT, staffRoom, uid);  // Audit trail
+      addMessage("Staff out %lum %lus", (unsigned long)(dwellSeconds / 60), (unsigned long)(dwellSeconds % 60));
+    }
+    updateDisplay();
+    return result != DWELL_REJECTED;
   }
+#endif
+
+  // Unauthorized RFID tag - security enforcement
+  addMessage("Access denied");
+  journalRecord(JOURNAL_DENIED_UNKNOWN, -1, uid);  // Audit trail
+
+  // Check if all rooms are occupied - additional user feedback
+  if (allRoomsOccupied()) {
+    addMessage("All rooms occupied");
+    showAlert("ACCESS DENIED", "All rooms occupied");  // Show alert on display
+    return false;
+  }
+  showAlert("ACCESS DENIED", "Unauthorized card");  // Show alert on display
+
+  // Flash all relays to indicate unauthorized access - visual alarm, every relay in step
+  // Stops without touching the relays if an emergency scene takes the outputs during a step
+  RelayBank bank = {0, 0};
+  for (int i = 0; i < 3; i++) {
+    if (outputsHeld()) return false;
+    relayBankWriteAll(&bank, relayPins, NUM_ROOMS, HIGH);  // Turn on every relay
+    zeroCrossCommit(&bank);
+    idleDelay(timings.flashMs);  // Short delay
+    if (outputsHeld()) return false;
+    relayBankWriteAll(&bank, relayPins, NUM_ROOMS, LOW);  // Turn off every relay
+    zeroCrossCommit(&bank);
+    idleDelay(timings.flashMs);  // Short delay
+  }
+
+  // Restore the relays to their correct states - recover from alarm
+  applyRelayStates();
+  return false;
+}
+
+void loop() {
+  // Take the alert overlay down once its time is up - only the title bar is sent again
+  if (alertOverlayExpire(&alertOverlay, millis(), timings.alertMs)) {
+    updateDisplay();
+    reportAlertBurst();
+  }
+
+  // Service network features and leave the shared reader alone while a standby partner is active
+  serviceBackground();
+#if HOT_STANDBY_ENABLED
+  if (!hotStandbyIsActive()) return;
+#endif
+#if EMERGENCY_ENABLED
+  if (emergencyActive()) return;  // Taps, remote doors and sensors wait - none of them may switch a light off now
+#endif
+
+#if OSDP_ENABLED
+  // Card reads from the remote readers, oldest first - the reader flashes green or red with the decision
+  OsdpCardRead read;
+  while (osdpNextCard(&osdpBus, &read)) {
+    bool granted = handleCard(read.uid, OSDP_UID_SIZE, read.reader);
+    osdpCardHandled(&osdpBus, &read, granted, millis());
+  }
+#endif
+#if OCCUPANCY_ENABLED
+  occupancyPoll(vacateRoom);  // Sensor events arrive by interrupt - this only looks at what they queued
+#endif
+#if ANOMALY_ENABLED
+  anomalyPoll(reportAnomaly);  // Relay changes, current readings and long stays - never while an emergency holds the relays
+#endif
+
+  // Small pause after each tap to prevent multiple reads of the same card - debounce mechanism
+  // Kept as a quiet period for the local reader only, so remote doors are served meanwhile
+  if (millis() - localTapTime < timings.tapPauseMs) return;
+
+  // Look for new cards and select one - a failed select is retried immediately while the card is in the field
+  if (!readerReadCard(&readerTuning)) {
+    return;  // If no card is present or it could not be read, exit this loop iteration
+  }
+
+#if REVOCATION_ENABLED
+  revocationProcessCard(mfrc522);  // Merge a newer revocation list carried by the card, or hand ours on
+#endif
+  handleCard(mfrc522.uid.uidByte, mfrc522.uid.size, LOCAL_DOOR);
+
+  readerRecordDecision(&readerTuning);  // Taps-to-success and time-to-decision statistics
 
   // Halt PICC and stop encryption - proper RFID card handling
   mfrc522.PICC_HaltA();  // Halts communication with the card
   mfrc522.PCD_StopCrypto1();  // Stops the encryption on the PCD
-
-  // Small delay to prevent multiple reads of the same card - debounce mechanism
-  delay(1000);  // Wait 1 second before scanning for a new card
-}
\ No newline at end of file
+  localTapTime = millis();  // Start the pause before scanning for a new card
+}
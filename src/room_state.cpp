@@ -0,0 +1,109 @@
+#include "room_state.h"
+#include "seqlock.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Room state arrays - all rooms start free with no owner
+bool relayOn[NUM_ROOMS] = {false};                  // Status of each relay
+byte relayOwner[NUM_ROOMS][UID_SIZE] = {{0}};       // Owner UID per relay
+bool relayHasOwner[NUM_ROOMS] = {false};            // Ownership flag per relay
+
+uint32_t roomStateSeq = 0;                // Incremented on every change so receivers can detect missed updates
+uint32_t roomVersion[NUM_ROOMS] = {0};    // Sequence number of each room's latest change
+
+// Copy of the table for other tasks - zeroed like the arrays, so it is right before the first change
+static SeqLock roomSnapshotLock;
+static_assert(sizeof(RoomSnapshot) <= SEQLOCK_MAX_WORDS * 4, "Room table too large for the seqlock");
+
+// Function to publish the table after a change - loop() is the only writer, so this never waits
+static void publishRoomState() {
+  RoomSnapshot s;
+  memset(&s, 0, sizeof(s));
+  s.seq = roomStateSeq;
+  memcpy(s.version, roomVersion, sizeof(s.version));
+  memcpy(s.on, relayOn, sizeof(s.on));
+  memcpy(s.hasOwner, relayHasOwner, sizeof(s.hasOwner));
+  memcpy(s.owner, relayOwner, sizeof(s.owner));
+  seqlockWrite(&roomSnapshotLock, &s, sizeof(s));
+}
+
+// Function to record that a room changed - bumps the sequence number and stamps the room with it
+static void markRoomChanged(byte room) {
+  roomStateSeq++;  // New state version
+  roomVersion[room] = roomStateSeq;  // Remember when this room changed
+  publishRoomState();
+}
+
+// Function to assign a room to a card - marks the relay on and records the owner
+void checkInRoom(byte room, const byte *uid) {
+  relayOn[room] = true;  // Update relay state
+  relayHasOwner[room] = true;  // Set ownership flag
+  memcpy(relayOwner[room], uid, UID_SIZE);  // Save user's UID as owner
+  markRoomChanged(room);
+}
+
+// Function to switch a room on without a card - remote command from a building-management system, no owner
+void occupyRoom(byte room) {
+  relayOn[room] = true;  // Update relay state
+  relayHasOwner[room] = false;  // No card owns it - only a remote command switches it off again
+  markRoomChanged(room);
+}
+
+// Function to release a room - marks the relay off and clears ownership
+void checkOutRoom(byte room) {
+  relayOn[room] = false;  // Update relay state
+  relayHasOwner[room] = false;  // Clear ownership
+  markRoomChanged(room);
+}
+
+// Function to overwrite one room with replicated state - used by a standby controller
+void applyRoomState(byte room, bool on, bool hasOwner, const byte *owner, uint32_t seq) {
+  if (room >= NUM_ROOMS) return;  // Ignore rooms this controller does not serve
+  relayOn[room] = on;
+  relayHasOwner[room] = hasOwner;
+  memcpy(relayOwner[room], owner, UID_SIZE);
+  roomVersion[room] = seq;  // Keep the sender's version for this room
+  if ((int32_t)(seq - roomStateSeq) > 0) roomStateSeq = seq;  // Follow the sender's sequence number
+  publishRoomState();
+}
+
+// Function to take the sender's sequence number after replicated rooms are applied - republishes the table
+void followRoomStateSeq(uint32_t seq) {
+  if (seq == roomStateSeq) return;  // Already published with it
+  roomStateSeq = seq;
+  publishRoomState();
+}
+
+// Function to find the room owned by a card - returns the room index or -1 if the card owns none
+int findOwnedRoom(const byte *uid) {
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    if (relayHasOwner[room] && memcmp(relayOwner[room], uid, UID_SIZE) == 0) return room;
+  }
+  return -1;  // Card does not own any room
+}
+
+// Function to check whether every room is occupied
+bool allRoomsOccupied() {
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    if (!relayOn[room]) return false;
+  }
+  return true;
+}
+
+// Function to build a bit mask of the rooms changed after a given sequence number
+uint32_t roomsChangedSince(uint32_t seq) {
+  uint32_t mask = 0;
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    if ((int32_t)(roomVersion[room] - seq) > 0) mask |= (1UL << room);  // Wrap-safe comparison
+  }
+  return mask;
+}
+
+// Function to copy every room as of one moment - a copy that raced a change is taken again. If loop() was
+// preempted in the middle of publishing, this task must let it run first; spinning at a higher priority
+// would never let the write finish on the single core
+void roomStateSnapshot(RoomSnapshot *out) {
+  while (!seqlockTryRead(&roomSnapshotLock, out, sizeof(*out))) {
+    if (seqlockWriting(&roomSnapshotLock)) vTaskDelay(1);
+  }
+}
@@ -0,0 +1,55 @@
+#include "seqlock.h"
+#include <string.h>
+
+// Function to start a seqlock with an all-zero payload
+void seqlockInit(SeqLock *lock) {
+  lock->seq.store(0, std::memory_order_relaxed);
+  for (size_t i = 0; i < SEQLOCK_MAX_WORDS; i++) lock->words[i].store(0, std::memory_order_relaxed);
+}
+
+// Function to publish a new payload - the release fence keeps the odd sequence ahead of the words, the
+// release store keeps the words ahead of the even one
+void seqlockWrite(SeqLock *lock, const void *data, size_t len) {
+  size_t words = (len + 3) / 4;
+  if (words > SEQLOCK_MAX_WORDS) return;
+  uint32_t seq = lock->seq.load(std::memory_order_relaxed);
+  lock->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len / 4; i++) {
+    uint32_t w;
+    memcpy(&w, p + 4 * i, 4);  // Fixed size - a single load, whatever the alignment
+    lock->words[i].store(w, std::memory_order_relaxed);
+  }
+  if (len % 4) {
+    uint32_t w = 0;
+    memcpy(&w, p + len / 4 * 4, len % 4);
+    lock->words[len / 4].store(w, std::memory_order_relaxed);
+  }
+  lock->seq.store(seq + 2, std::memory_order_release);
+}
+
+// Function to try one consistent copy of the payload - the acquire fence keeps the words ahead of the
+// second sequence read
+bool seqlockTryRead(const SeqLock *lock, void *out, size_t len) {
+  size_t words = (len + 3) / 4;
+  if (words > SEQLOCK_MAX_WORDS) return false;
+  uint32_t before = lock->seq.load(std::memory_order_acquire);
+  if (before & 1) return false;
+  uint8_t *p = (uint8_t *)out;
+  for (size_t i = 0; i < len / 4; i++) {
+    uint32_t w = lock->words[i].load(std::memory_order_relaxed);
+    memcpy(p + 4 * i, &w, 4);
+  }
+  if (len % 4) {
+    uint32_t w = lock->words[len / 4].load(std::memory_order_relaxed);
+    memcpy(p + len / 4 * 4, &w, len % 4);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return lock->seq.load(std::memory_order_relaxed) == before;
+}
+
+// Function to check whether a write is in progress
+bool seqlockWriting(const SeqLock *lock) {
+  return lock->seq.load(std::memory_order_relaxed) & 1;
+}
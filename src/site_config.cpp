@@ -0,0 +1,327 @@
+#include "site_config.h"
+#include "crypto_service.h"
+#include <string.h>
+
+static const uint8_t configMagic[4] = {'L', 'C', 'F', 'G'};
+
+static void configPut16(uint8_t *p, uint16_t v) {
+  p[0] = v; p[1] = v >> 8;
+}
+
+static void configPut32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint16_t configGet16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t configGet32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Function to compute the header CRC - the first 12 header bytes followed by the section table
+static uint32_t configHeaderCrc(const uint8_t *data, uint8_t sectionCount) {
+  uint8_t scratch[CONFIG_HEADER_SIZE - 4 + CONFIG_MAX_SECTIONS * CONFIG_ENTRY_SIZE];
+  size_t tableLen = (size_t)sectionCount * CONFIG_ENTRY_SIZE;
+  memcpy(scratch, data, CONFIG_HEADER_SIZE - 4);
+  memcpy(scratch + CONFIG_HEADER_SIZE - 4, data + CONFIG_HEADER_SIZE, tableLen);
+  return cryptoCrc32(scratch, CONFIG_HEADER_SIZE - 4 + tableLen);
+}
+
+// Function to open a blob - checks the header and table only, so its cost does not grow with section sizes
+bool configOpen(ConfigBlob *blob, const uint8_t *data, size_t size) {
+  memset(blob, 0, sizeof(*blob));
+  if (size < CONFIG_HEADER_SIZE || memcmp(data, configMagic, 4) != 0) return false;
+  if (data[4] != CONFIG_FORMAT_VERSION) return false;
+  uint8_t count = data[5];
+  uint16_t total = configGet16(data + 6);
+  size_t tableEnd = CONFIG_HEADER_SIZE + (size_t)count * CONFIG_ENTRY_SIZE;
+  if (count > CONFIG_MAX_SECTIONS || total > size || tableEnd > total) return false;
+  if (configHeaderCrc(data, count) != configGet32(data + 12)) return false;
+
+  // Every body must lie inside the blob - later lookups can then trust the table
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t *entry = data + CONFIG_HEADER_SIZE + i * CONFIG_ENTRY_SIZE;
+    uint32_t offset = configGet32(entry + 4);
+    if (offset < tableEnd || offset > total || configGet16(entry + 2) > total - offset) return false;
+  }
+
+  blob->data = data;
+  blob->size = total;
+  blob->sectionCount = count;
+  blob->revision = configGet32(data + 8);
+  return true;
+}
+
+// Function to check one section body against its table CRC, once
+static bool configCheckEntry(ConfigBlob *blob, uint8_t index) {
+  uint32_t bit = (uint32_t)1 << index;
+  if (!(blob->checkedMask & bit)) {
+    const uint8_t *entry = blob->data + CONFIG_HEADER_SIZE + index * CONFIG_ENTRY_SIZE;
+    if (cryptoCrc32(blob->data + configGet32(entry + 4), configGet16(entry + 2)) == configGet32(entry + 8)) {
+      blob->validMask |= bit;
+    }
+    blob->checkedMask |= bit;
+  }
+  return (blob->validMask & bit) != 0;
+}
+
+// Function to find a section of the given version - checks its CRC on first use, NULL if missing or damaged
+const uint8_t *configSection(ConfigBlob *blob, uint8_t id, uint8_t version, size_t *len) {
+  for (uint8_t i = 0; i < blob->sectionCount; i++) {
+    const uint8_t *entry = blob->data + CONFIG_HEADER_SIZE + i * CONFIG_ENTRY_SIZE;
+    if (entry[0] != id || entry[1] != version) continue;
+    if (!configCheckEntry(blob, i)) return NULL;
+    *len = configGet16(entry + 2);
+    return blob->data + configGet32(entry + 4);
+  }
+  return NULL;
+}
+
+// Function to check every section body - for accepting a new blob before it replaces the stored one
+bool configVerifyAll(ConfigBlob *blob) {
+  for (uint8_t i = 0; i < blob->sectionCount; i++) {
+    if (!configCheckEntry(blob, i)) return false;
+  }
+  return true;
+}
+
+// Function to compute the upload tag of a blob
+void configSign(const uint8_t *data, size_t size, const uint8_t *key, size_t keyLen, uint8_t tag[CONFIG_TAG_SIZE]) {
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, data, size, mac);
+  memcpy(tag, mac, CONFIG_TAG_SIZE);
+}
+
+// Function to check the upload tag of a blob - constant time
+bool configCheckTag(const uint8_t *data, size_t size, const uint8_t *key, size_t keyLen, const uint8_t *tag) {
+  uint8_t mac[CRYPTO_SHA256_SIZE];
+  cryptoHmacSha256(key, keyLen, data, size, mac);
+  return cryptoEqual(mac, tag, CONFIG_TAG_SIZE);
+}
+
+// Function to check an uploaded blob and its tag against the revision in force - the tag first, so an
+// unsigned blob is never parsed
+ConfigUpload configCheckUpload(ConfigBlob *blob, const uint8_t *data, size_t size, const uint8_t *tag,
+                               const uint8_t *key, size_t keyLen, uint32_t currentRevision) {
+  if (!configCheckTag(data, size, key, keyLen, tag)) return CONFIG_UPLOAD_BAD_TAG;
+  if (!configOpen(blob, data, size) || !configVerifyAll(blob)) return CONFIG_UPLOAD_DAMAGED;
+  if (blob->revision <= currentRevision) return CONFIG_UPLOAD_OLD;
+  return CONFIG_UPLOAD_OK;
+}
+
+// Function to start a blob - the header and table are filled in as sections are added
+void configBuildBegin(ConfigBuilder *b, uint8_t *buf, size_t capacity, uint8_t sectionCount, uint32_t revision) {
+  memset(b, 0, sizeof(*b));
+  b->buf = buf;
+  b->capacity = capacity;
+  b->sectionCount = sectionCount;
+  b->used = CONFIG_HEADER_SIZE + (size_t)sectionCount * CONFIG_ENTRY_SIZE;
+  if (sectionCount > CONFIG_MAX_SECTIONS || b->used > capacity) {
+    b->overflow = true;
+    return;
+  }
+  memset(buf, 0, b->used);
+  memcpy(buf, configMagic, 4);
+  buf[4] = CONFIG_FORMAT_VERSION;
+  buf[5] = sectionCount;
+  configPut32(buf + 8, revision);
+}
+
+// Function to append one section body and its table entry
+bool configBuildSection(ConfigBuilder *b, uint8_t id, uint8_t version, const uint8_t *data, size_t len) {
+  if (b->overflow || b->added == b->sectionCount || len > 0xFFFF ||
+      b->used + len > b->capacity || b->used + len > CONFIG_MAX_SIZE) {
+    b->overflow = true;
+    return false;
+  }
+  uint8_t *entry = b->buf + CONFIG_HEADER_SIZE + b->added * CONFIG_ENTRY_SIZE;
+  entry[0] = id;
+  entry[1] = version;
+  configPut16(entry + 2, len);
+  configPut32(entry + 4, b->used);
+  configPut32(entry + 8, cryptoCrc32(data, len));
+  memcpy(b->buf + b->used, data, len);
+  b->used += len;
+  b->added++;
+  return true;
+}
+
+// Function to finish a blob - returns its size, or 0 if a section was missing or did not fit
+size_t configBuildEnd(ConfigBuilder *b) {
+  if (b->overflow || b->added != b->sectionCount) return 0;
+  configPut16(b->buf + 6, b->used);
+  configPut32(b->buf + 12, configHeaderCrc(b->buf, b->sectionCount));
+  return b->used;
+}
+
+#ifdef ARDUINO
+#include <Preferences.h>
+
+uint32_t siteConfigRevision = 0;
+uint32_t siteConfigLoadUs = 0;
+uint32_t siteConfigSectionUs = 0;
+
+static uint8_t siteConfigData[CONFIG_MAX_SIZE];  // Blob as read from NVS - sections are used in place
+static ConfigBlob siteConfigBlob;                // Empty until a valid blob is loaded
+static bool siteConfigLoaded = false;
+
+// Function to look up a section for one of the accessors and time the first-use check
+static const uint8_t *siteConfigFind(uint8_t id, size_t minLen, size_t *len) {
+  if (!siteConfigLoaded) return NULL;
+  unsigned long start = micros();
+  const uint8_t *body = configSection(&siteConfigBlob, id, 1, len);
+  siteConfigSectionUs += micros() - start;
+  return body != NULL && *len >= minLen ? body : NULL;
+}
+
+// Function to load the blob from NVS - call first in setup(); compiled defaults stay in force without one
+void siteConfigBegin() {
+  unsigned long start = micros();
+  Preferences prefs;
+  prefs.begin(SITE_CONFIG_NAMESPACE, true);  // Read-only
+  size_t size = prefs.getBytes("blob", siteConfigData, sizeof(siteConfigData));
+  prefs.end();
+  siteConfigLoaded = size > 0 && configOpen(&siteConfigBlob, siteConfigData, size);
+  if (siteConfigLoaded) siteConfigRevision = siteConfigBlob.revision;
+  siteConfigLoadUs = micros() - start;
+  if (size > 0 && !siteConfigLoaded) Serial.println("Config: stored blob rejected, using defaults");
+}
+
+bool siteConfigPins(SitePins *pins) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_PINS, 5, &len);
+  if (p == NULL) return false;
+  pins->sda = p[0];
+  pins->scl = p[1];
+  pins->sck = p[2];
+  pins->miso = p[3];
+  pins->mosi = p[4];
+  return true;
+}
+
+bool siteConfigReader(SiteReader *reader) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_READER, 3, &len);
+  if (p == NULL) return false;
+  reader->ssPin = p[0];
+  reader->rstPin = p[1];
+  reader->startGain = p[2];
+  return true;
+}
+
+// The room count is a build-time capacity (NUM_ROOMS) - a blob for a different count is ignored
+bool siteConfigRooms(byte relayPins[NUM_ROOMS], byte powerPins[NUM_ROOMS]) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_ROOMS, 1, &len);
+  if (p == NULL || p[0] != NUM_ROOMS || len < 1 + 2 * NUM_ROOMS) return false;
+  for (byte room = 0; room < NUM_ROOMS; room++) {
+    relayPins[room] = p[1 + 2 * room];
+    powerPins[room] = p[2 + 2 * room];
+  }
+  return true;
+}
+
+// Cards for rooms outside the build's capacity are skipped
+bool siteConfigCards(byte cards[NUM_ROOMS][UID_SIZE]) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_CARDS, 1, &len);
+  if (p == NULL || len < 1 + (size_t)p[0] * (1 + UID_SIZE)) return false;
+  for (byte i = 0; i < p[0]; i++) {
+    const uint8_t *card = p + 1 + i * (1 + UID_SIZE);
+    if (card[0] < NUM_ROOMS) memcpy(cards[card[0]], card + 1, UID_SIZE);
+  }
+  return true;
+}
+
+bool siteConfigTimings(SiteTimings *timings) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_TIMINGS, 12, &len);
+  if (p == NULL) return false;
+  timings->alertMs = configGet32(p);
+  timings->tapPauseMs = configGet32(p + 4);
+  timings->flashMs = configGet16(p + 8);
+  timings->relayTestMs = configGet16(p + 10);
+  return true;
+}
+
+// Function to copy up to max staff badge UIDs - returns how many were copied, 0 without a staff section
+byte siteConfigStaff(byte staff[][UID_SIZE], byte max) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_STAFF, 1, &len);
+  if (p == NULL || len < 1 + (size_t)p[0] * UID_SIZE) return 0;
+  byte count = min(p[0], max);
+  memcpy(staff, p + 1, count * UID_SIZE);
+  return count;
+}
+
+// Function to set the room each OSDP door serves - a door left out serves no room rather than a guessed one
+bool siteConfigDoors(byte doorRooms[], byte count) {
+  size_t len;
+  const uint8_t *p = siteConfigFind(CONFIG_SECTION_DOORS, 1, &len);
+  if (p == NULL || len < 1 + (size_t)p[0]) return false;
+  for (byte door = 0; door < count; door++) {
+    byte room = door < p[0] ? p[1 + door] : CONFIG_NO_ROOM;
+    doorRooms[door] = room < NUM_ROOMS ? room : CONFIG_NO_ROOM;
+  }
+  return true;
+}
+
+#if SITE_CONFIG_UPLOAD
+static const uint8_t siteConfigKey[] = SITE_CONFIG_SITE_KEY;
+#define SITE_CONFIG_KEY_LEN (sizeof(siteConfigKey) - 1)  // Without the string terminator
+
+static uint8_t upload[CONFIG_MAX_SIZE + CONFIG_TAG_SIZE];
+static size_t uploadLen = 0;             // Bytes of the upload in progress, 0 when idle
+static size_t uploadSize = 0;            // Blob size from the upload's header
+static unsigned long uploadLastByte = 0;
+#endif
+
+// Function to take one Serial byte for a signed blob upload - restarts once a valid blob is stored
+// The blob is sent raw and followed by its tag. Bytes outside an upload are left to the caller, so the
+// Serial commands share the port; stray input cannot start an upload without the magic
+bool siteConfigUploadByte(uint8_t c) {
+#if SITE_CONFIG_UPLOAD
+  if (uploadLen > 0 && millis() - uploadLastByte > SITE_CONFIG_UPLOAD_GAP_MS) uploadLen = 0;
+  uploadLastByte = millis();
+  if (uploadLen < 4 && c != configMagic[uploadLen]) {
+    uploadLen = 0;
+    if (c != configMagic[0]) return false;
+  }
+  upload[uploadLen++] = c;
+  if (uploadLen == CONFIG_HEADER_SIZE) {
+    uploadSize = configGet16(upload + 6);
+    if (uploadSize < CONFIG_HEADER_SIZE || uploadSize > CONFIG_MAX_SIZE) {
+      uploadLen = 0;
+      return true;
+    }
+  }
+  if (uploadLen < CONFIG_HEADER_SIZE || uploadLen < uploadSize + CONFIG_TAG_SIZE) return true;
+
+  ConfigBlob blob;
+  ConfigUpload result = configCheckUpload(&blob, upload, uploadSize, upload + uploadSize, siteConfigKey,
+                                          SITE_CONFIG_KEY_LEN, siteConfigRevision);
+  if (result == CONFIG_UPLOAD_OK) {
+    Preferences prefs;
+    prefs.begin(SITE_CONFIG_NAMESPACE);
+    prefs.putBytes("blob", upload, uploadSize);
+    prefs.end();
+    Serial.printf("Config: revision %u stored, restarting\n", (unsigned)blob.revision);
+    Serial.flush();
+    ESP.restart();  // Pins and pin modes are only applied in setup()
+  }
+  if (result == CONFIG_UPLOAD_OLD) {
+    Serial.printf("Config: revision %u refused, revision %u is in force\n", (unsigned)blob.revision,
+                  (unsigned)siteConfigRevision);  // A rollback would bring back removed cards
+  }
+  else {
+    Serial.println(result == CONFIG_UPLOAD_BAD_TAG ? "Config: upload rejected, bad signature" : "Config: upload rejected, damaged");
+  }
+  uploadLen = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+#endif
@@ -0,0 +1,238 @@
+#include "state_sync.h"
+#include <string.h>
+#include <stdio.h>
+
+#define SYNC_MAGIC 'S'
+#define SYNC_OWNED 0x01   // Room record flag - owner UID follows
+
+// Function to store a 16-bit value little-endian
+static void syncPut16(uint8_t *p, uint16_t v) {
+  p[0] = v; p[1] = v >> 8;
+}
+
+// Function to store a 32-bit value little-endian
+static void syncPut32(uint8_t *p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// Function to load a 32-bit little-endian value
+static uint32_t syncGet32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Function to store the low bytes of a bitmap - only as many bytes as the room count needs
+static void syncPutBits(uint8_t *p, uint32_t bits, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) p[i] = bits >> (8 * i);
+}
+
+// Function to load a bitmap of the given width
+static uint32_t syncGetBits(const uint8_t *p, uint8_t bytes) {
+  uint32_t bits = 0;
+  for (uint8_t i = 0; i < bytes; i++) bits |= (uint32_t)p[i] << (8 * i);
+  return bits;
+}
+
+// Function to encode a message - returns the encoded length, or 0 if buf is too small
+size_t syncEncode(uint8_t *buf, size_t cap, uint8_t type, uint16_t controllerId,
+                  uint32_t seq, uint32_t prevSeq, uint32_t changedMask, const SyncRoomView &rooms) {
+  uint8_t maskBytes = (rooms.roomCount + 7) / 8;
+  size_t len = 13 + 2 * maskBytes;
+  if (cap < len) return 0;
+
+  uint32_t occupied = 0;
+  for (uint8_t room = 0; room < rooms.roomCount; room++) {
+    if (rooms.on[room]) occupied |= (1UL << room);
+  }
+
+  buf[0] = SYNC_MAGIC;
+  buf[1] = type;
+  syncPut16(buf + 2, controllerId);
+  syncPut32(buf + 4, seq);
+  syncPut32(buf + 8, prevSeq);
+  buf[12] = rooms.roomCount;
+  syncPutBits(buf + 13, occupied, maskBytes);
+  syncPutBits(buf + 13 + maskBytes, changedMask, maskBytes);
+
+  // One record per changed room - owner UID only when the room has an owner
+  for (uint8_t room = 0; room < rooms.roomCount; room++) {
+    if (!(changedMask & (1UL << room))) continue;
+    size_t need = rooms.hasOwner[room] ? 1 + SYNC_UID_SIZE : 1;
+    if (len + need > cap) return 0;
+    buf[len] = rooms.hasOwner[room] ? SYNC_OWNED : 0;
+    if (rooms.hasOwner[room]) memcpy(buf + len + 1, rooms.owner[room], SYNC_UID_SIZE);
+    len += need;
+  }
+  return len;
+}
+
+// Function to read the type and controller id of a message without decoding it - returns false if malformed
+bool syncPeek(const uint8_t *buf, size_t len, uint8_t *type, uint16_t *controllerId) {
+  if (len < 13 || buf[0] != SYNC_MAGIC) return false;
+  *type = buf[1];
+  *controllerId = buf[2] | (buf[3] << 8);
+  return true;
+}
+
+// Function to reset a receiver to follow one controller
+void syncReceiverInit(SyncReceiver *rx, uint16_t controllerId) {
+  memset(rx, 0, sizeof(*rx));
+  rx->controllerId = controllerId;
+}
+
+// Function to apply the room records of a delta or snapshot - returns false if the message is truncated
+static bool syncApplyRooms(SyncReceiver *rx, const uint8_t *buf, size_t len, size_t pos,
+                           uint32_t occupied, uint32_t mask) {
+  // Decode into a scratch copy so a truncated message leaves the receiver untouched
+  uint32_t owned = rx->owned;
+  uint8_t owner[SYNC_MAX_ROOMS][SYNC_UID_SIZE];
+  memcpy(owner, rx->owner, sizeof(owner));
+
+  for (uint8_t room = 0; room < SYNC_MAX_ROOMS; room++) {
+    if (!(mask & (1UL << room))) continue;
+    if (pos >= len) return false;
+    if (buf[pos] & SYNC_OWNED) {
+      if (pos + 1 + SYNC_UID_SIZE > len) return false;
+      memcpy(owner[room], buf + pos + 1, SYNC_UID_SIZE);
+      owned |= (1UL << room);
+      pos += 1 + SYNC_UID_SIZE;
+    }
+    else {
+      memset(owner[room], 0, SYNC_UID_SIZE);
+      owned &= ~(1UL << room);
+      pos += 1;
+    }
+  }
+
+  rx->occupied = occupied;
+  rx->owned = owned;
+  memcpy(rx->owner, owner, sizeof(owner));
+  rx->changedMask = mask;
+  return true;
+}
+
+// Function to apply one message to a receiver
+SyncResult syncReceive(SyncReceiver *rx, const uint8_t *buf, size_t len) {
+  uint8_t type;
+  uint16_t controllerId;
+  if (!syncPeek(buf, len, &type, &controllerId) || controllerId != rx->controllerId) return SYNC_INVALID;
+
+  uint32_t seq = syncGet32(buf + 4);
+  uint32_t prevSeq = syncGet32(buf + 8);
+  uint8_t roomCount = buf[12];
+  if (roomCount > SYNC_MAX_ROOMS) return SYNC_INVALID;
+  uint8_t maskBytes = (roomCount + 7) / 8;
+  if (len < 13u + 2 * maskBytes) return SYNC_INVALID;
+  uint32_t occupied = syncGetBits(buf + 13, maskBytes);
+  uint32_t mask = syncGetBits(buf + 13 + maskBytes, maskBytes);
+  size_t pos = 13 + 2 * maskBytes;
+
+  rx->changedMask = 0;
+  if (type == SYNC_MSG_SNAPSHOT) {
+    if (!syncApplyRooms(rx, buf, len, pos, occupied, mask)) return SYNC_INVALID;
+    rx->roomCount = roomCount;
+    rx->seq = seq;  // Snapshot replaces whatever we held
+    rx->synced = true;
+    return SYNC_APPLIED;
+  }
+  if (type == SYNC_MSG_DELTA) {
+    if (rx->synced && prevSeq == rx->seq) {
+      if (!syncApplyRooms(rx, buf, len, pos, occupied, mask)) return SYNC_INVALID;
+      rx->seq = seq;
+      return SYNC_APPLIED;
+    }
+    if (rx->synced && (int32_t)(seq - rx->seq) <= 0) return SYNC_CURRENT;  // Duplicate or reordered old delta
+    rx->gaps++;
+    return SYNC_GAP;
+  }
+  if (type == SYNC_MSG_HEARTBEAT) {
+    if (rx->synced && seq == rx->seq) return SYNC_CURRENT;
+    rx->gaps++;
+    return SYNC_GAP;  // Never synced, or the final delta before this heartbeat was lost
+  }
+  return SYNC_INVALID;
+}
+
+// Function to measure the size of the equivalent full-state JSON publish - used for bandwidth comparison
+// Matches {"id":1,"seq":42,"rooms":[{"on":true,"owner":"13a35011"},{"on":false,"owner":null}]}
+size_t syncJsonSize(uint16_t controllerId, uint32_t seq, const SyncRoomView &rooms) {
+  size_t len = snprintf(NULL, 0, "{\"id\":%u,\"seq\":%lu,\"rooms\":[", controllerId, (unsigned long)seq);
+  for (uint8_t room = 0; room < rooms.roomCount; room++) {
+    if (room > 0) len += 1;  // Comma between rooms
+    len += rooms.on[room] ? strlen("{\"on\":true,") : strlen("{\"on\":false,");
+    len += rooms.hasOwner[room] ? strlen("\"owner\":\"\"}") + 2 * SYNC_UID_SIZE : strlen("\"owner\":null}");
+  }
+  return len + 2;  // Closing "]}"
+}
+
+#ifdef ARDUINO
+#include "room_state.h"
+#include "wifi_manager.h"
+#include <WiFiUdp.h>
+
+static_assert(UID_SIZE == SYNC_UID_SIZE && NUM_ROOMS <= SYNC_MAX_ROOMS, "room table does not fit the sync format");
+
+WiFiUDP syncUdp;                  // Bound to SYNC_UDP_PORT - messages leave from it through the Wi-Fi queue, so
+                                  // the collector's snapshot requests come back to it
+IPAddress syncCollector;          // Fleet collector address
+uint32_t syncLastSentSeq = 0;     // Room sequence number covered by the last delta sent
+unsigned long syncLastHeartbeat = 0;  // When the last heartbeat went out
+
+uint32_t syncMessagesSent = 0;
+uint32_t syncBytesSent = 0;
+uint32_t syncJsonBytes = 0;
+uint32_t syncSnapshotsSent = 0;
+
+// Function to describe the room state arrays to the codec
+static SyncRoomView syncRoomView() {
+  SyncRoomView view = {NUM_ROOMS, relayOn, relayHasOwner, relayOwner};
+  return view;
+}
+
+// Function to encode one message and queue it for the collector - false if the Wi-Fi queue is full
+static bool syncSend(uint8_t type, uint32_t prevSeq, uint32_t mask) {
+  uint8_t buf[SYNC_MAX_MESSAGE];
+  size_t len = syncEncode(buf, sizeof(buf), type, SYNC_CONTROLLER_ID, roomStateSeq, prevSeq, mask, syncRoomView());
+  if (len == 0 || !wifiQueueSend(&syncUdp, syncCollector, SYNC_UDP_PORT, buf, len)) return false;
+  syncMessagesSent++;
+  syncBytesSent += len;
+  return true;
+}
+
+// Function to start publishing - opens the UDP port; the collector asks for a snapshot on first contact
+void stateSyncBegin() {
+  syncCollector.fromString(SYNC_COLLECTOR_ADDRESS);
+  syncUdp.begin(SYNC_UDP_PORT);
+  syncLastSentSeq = roomStateSeq;
+}
+
+// Function to service publishing - call on every loop() pass and while waiting
+void stateSyncPoll() {
+  bool linkUp = wifiManagerLinkUp();
+
+  // Answer snapshot requests - the collector only asks after it detects a gap
+  uint8_t buf[SYNC_MAX_MESSAGE];
+  while (linkUp && syncUdp.parsePacket() > 0) {
+    int len = syncUdp.read(buf, sizeof(buf));
+    uint8_t type;
+    uint16_t controllerId;
+    if (len > 0 && syncPeek(buf, len, &type, &controllerId) &&
+        type == SYNC_MSG_SNAPSHOT_REQ && controllerId == SYNC_CONTROLLER_ID) {
+      if (syncSend(SYNC_MSG_SNAPSHOT, 0, ALL_ROOMS_MASK)) syncSnapshotsSent++;
+    }
+  }
+
+  // Publish only the rooms changed since the last delta - queued while the link is down so the collector
+  // gets every change in order; once the queue is full, changes accumulate in roomVersion into one delta
+  uint32_t mask = roomsChangedSince(syncLastSentSeq);
+  if (mask && syncSend(SYNC_MSG_DELTA, syncLastSentSeq, mask)) {
+    syncJsonBytes += syncJsonSize(SYNC_CONTROLLER_ID, roomStateSeq, syncRoomView());
+    syncLastSentSeq = roomStateSeq;
+  }
+
+  // Heartbeats only matter live - queued like the rest while the link is up, skipped while it is down
+  if (linkUp && millis() - syncLastHeartbeat >= SYNC_HEARTBEAT_MS) {
+    syncSend(SYNC_MSG_HEARTBEAT, syncLastSentSeq, 0);
+    syncLastHeartbeat = millis();
+  }
+}
+#endif
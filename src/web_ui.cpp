@@ -0,0 +1,413 @@
+#include "web_ui.h"
+#include "crypto_service.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+// Function to match a header name at the start of a line, ignoring case - returns the value or NULL
+static const char *webHeaderValue(const char *line, const char *end, const char *name) {
+  size_t n = strlen(name);
+  if ((size_t)(end - line) < n || strncasecmp(line, name, n) != 0) return NULL;
+  line += n;
+  while (line < end && *line == ' ') line++;
+  return line;
+}
+
+// Function to copy a header value up to the end of its line - values that do not fit are left empty
+static void webCopyValue(const char *value, const char *end, char *out, size_t cap) {
+  size_t n = end - value;
+  if (n >= cap) n = 0;
+  memcpy(out, value, n);
+  out[n] = '\0';
+}
+
+// Function to parse a request header - returns the header length once the blank line is in, 0 until then
+int webParseRequest(const char *buf, size_t len, WebRequest *req) {
+  const char *end = NULL;
+  for (size_t i = 3; i < len; i++) {
+    if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+      end = buf + i + 1;
+      break;
+    }
+  }
+  if (end == NULL) return 0;
+  memset(req, 0, sizeof(*req));
+
+  // Request line: METHOD SP target SP HTTP/1.x
+  const char *line = buf;
+  const char *eol = (const char *)memchr(line, '\r', end - line);
+  const char *sp1 = (const char *)memchr(line, ' ', eol - line);
+  if (sp1 == NULL) return -1;
+  const char *sp2 = (const char *)memchr(sp1 + 1, ' ', eol - sp1 - 1);
+  if (sp2 == NULL || eol - sp2 != 9 || strncmp(sp2 + 1, "HTTP/1.", 7) != 0) return -1;
+  req->head = sp1 - line == 4 && memcmp(line, "HEAD", 4) == 0;
+  req->get = req->head || (sp1 - line == 3 && memcmp(line, "GET", 3) == 0);
+  req->keepAlive = sp2[8] == '1';  // HTTP/1.1 keeps the connection unless told otherwise
+  const char *target = sp1 + 1;
+  const char *query = (const char *)memchr(target, '?', sp2 - target);
+  webCopyValue(target, query != NULL ? query : sp2, req->path, sizeof(req->path));
+
+  for (line = eol + 2; line < end - 2; line = eol + 2) {
+    eol = (const char *)memchr(line, '\r', end - line);
+    const char *value;
+    if ((value = webHeaderValue(line, eol, "Connection:")) != NULL) {
+      if (strncasecmp(value, "close", 5) == 0) req->keepAlive = false;
+      else if (strncasecmp(value, "keep-alive", 10) == 0) req->keepAlive = true;
+    }
+    else if ((value = webHeaderValue(line, eol, "Upgrade:")) != NULL) {
+      req->upgrade = strncasecmp(value, "websocket", 9) == 0;
+    }
+    else if ((value = webHeaderValue(line, eol, "If-None-Match:")) != NULL) {
+      webCopyValue(value, eol, req->ifNoneMatch, sizeof(req->ifNoneMatch));
+    }
+    else if ((value = webHeaderValue(line, eol, "Sec-WebSocket-Key:")) != NULL) {
+      webCopyValue(value, eol, req->wsKey, sizeof(req->wsKey));
+    }
+  }
+  return end - buf;
+}
+
+// Function to find an asset by request path - "/" serves /index.html
+const WebAsset *webFindAsset(const WebAsset *assets, size_t count, const char *path) {
+  if (strcmp(path, "/") == 0) path = "/index.html";
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(assets[i].path, path) == 0) return &assets[i];
+  }
+  return NULL;
+}
+
+// Function to build the response header for an asset - a 304 if the request already holds its ETag
+// Every asset is stored gzipped and sent that way: every browser that can run the page accepts gzip
+size_t webAssetHeader(const WebAsset *asset, const WebRequest *req, bool *notModified, char *out, size_t cap) {
+  const char *cache = asset->immutable ? "public, max-age=31536000, immutable" : "no-cache";
+  const char *conn = req->keepAlive ? "keep-alive" : "close";
+  *notModified = req->ifNoneMatch[0] != '\0' && strstr(req->ifNoneMatch, asset->etag) != NULL;  // Also matches W/"..."
+  int n;
+  if (*notModified) {
+    n = snprintf(out, cap, "HTTP/1.1 304 Not Modified\r\nCache-Control: %s\r\nETag: %s\r\nConnection: %s\r\n\r\n",
+                 cache, asset->etag, conn);
+  }
+  else {
+    n = snprintf(out, cap, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Encoding: gzip\r\nContent-Length: %u\r\n"
+                 "Cache-Control: %s\r\nETag: %s\r\nVary: Accept-Encoding\r\nConnection: %s\r\n\r\n",
+                 asset->type, (unsigned)asset->len, cache, asset->etag, conn);
+  }
+  return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+// Function to build a header for a JSON body of the given length - never cached
+size_t webJsonHeader(size_t bodyLen, bool keepAlive, char *out, size_t cap) {
+  int n = snprintf(out, cap, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\n"
+                   "Cache-Control: no-store\r\nConnection: %s\r\n\r\n",
+                   (unsigned)bodyLen, keepAlive ? "keep-alive" : "close");
+  return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+// Function to build an empty response with a status code - the connection is closed after it
+size_t webStatusHeader(int code, char *out, size_t cap) {
+  const char *reason = code == 404 ? "Not Found" : code == 405 ? "Method Not Allowed" : "Bad Request";
+  int n = snprintf(out, cap, "HTTP/1.1 %d %s\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+                   code, reason, code == 405 ? "Allow: GET, HEAD\r\n" : "");
+  return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+// Function to build the room state JSON - formatted in place, no string objects
+size_t webStateJson(const WebStateView *view, char *out, size_t cap) {
+  size_t len = 0;
+  int n = snprintf(out, cap, "{\"seq\":%lu,\"uptime\":%lu,\"heap\":%lu,\"rooms\":[",
+                   (unsigned long)view->seq, (unsigned long)view->uptimeS, (unsigned long)view->freeHeap);
+  if (n < 0 || (size_t)n >= cap) return 0;
+  len = n;
+  for (uint8_t r = 0; r < view->rooms; r++) {
+    n = snprintf(out + len, cap - len, "%s{\"on\":%d,\"owned\":%d}", r ? "," : "", view->on[r], view->owned[r]);
+    if (n < 0 || (size_t)n >= cap - len) return 0;
+    len += n;
+  }
+  const WebStats *s = view->stats;
+  n = snprintf(out + len, cap - len, "],\"web\":{\"requests\":%lu,\"ttfbAvgUs\":%lu,\"ttfbMaxUs\":%lu,\"heapMax\":%lu}}",
+               (unsigned long)s->requests, (unsigned long)(s->requests ? s->ttfbTotalUs / s->requests : 0),
+               (unsigned long)s->ttfbMaxUs, (unsigned long)s->heapMax);
+  if (n < 0 || (size_t)n >= cap - len) return 0;
+  return len + n;
+}
+
+// Function to encode bytes as base64 - out needs 4 characters per 3 bytes, rounded up, plus the terminator
+static void webBase64(const uint8_t *in, size_t len, char *out) {
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = in[i] << 16;
+    if (i + 1 < len) v |= in[i + 1] << 8;
+    if (i + 2 < len) v |= in[i + 2];
+    *out++ = digits[v >> 18];
+    *out++ = digits[(v >> 12) & 63];
+    *out++ = i + 1 < len ? digits[(v >> 6) & 63] : '=';
+    *out++ = i + 2 < len ? digits[v & 63] : '=';
+  }
+  *out = '\0';
+}
+
+// Function to build the 101 response that accepts a WebSocket upgrade (RFC 6455 section 4.2.2)
+size_t webSocketAcceptHeader(const char *key, char *out, size_t cap) {
+  static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  uint8_t joined[WEB_WS_KEY_SIZE + sizeof(guid)];
+  size_t keyLen = strlen(key);
+  if (keyLen > WEB_WS_KEY_SIZE) return 0;
+  memcpy(joined, key, keyLen);
+  memcpy(joined + keyLen, guid, sizeof(guid) - 1);
+  uint8_t digest[CRYPTO_SHA1_SIZE];
+  cryptoSha1(joined, keyLen + sizeof(guid) - 1, digest);
+  char accept[WEB_WS_ACCEPT_SIZE + 1];
+  webBase64(digest, sizeof(digest), accept);
+  int n = snprintf(out, cap, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+  return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+// Function to build the header of an unmasked server-to-client text frame, FIN set
+size_t webSocketFrameHeader(size_t payloadLen, uint8_t out[4]) {
+  out[0] = 0x81;
+  if (payloadLen < 126) {
+    out[1] = payloadLen;
+    return 2;
+  }
+  out[1] = 126;
+  out[2] = payloadLen >> 8;
+  out[3] = payloadLen;
+  return 4;
+}
+
+#ifdef ARDUINO
+#include <WiFi.h>
+#include "room_state.h"
+#include "wifi_manager.h"
+
+WebStats webStats = {0, 0, 0, 0};
+
+#if WEB_UI_ENABLED
+#include "web_assets.h"  // Generated by tools/web_pack.py before every build
+
+#define WEB_RX_SIZE   768                          // Request header buffer - browsers send 400-600 bytes
+#define WEB_JSON_MAX  (160 + NUM_ROOMS * 22)       // State JSON for every room
+
+// Where each connection is in its exchange
+enum WebClientState : uint8_t {
+  WEB_FREE,       // Slot unused
+  WEB_READING,    // Collecting a request header
+  WEB_SENDING,    // Writing an asset body from flash
+  WEB_SOCKET      // Upgraded - pushed state, never asked
+};
+
+struct WebClient {
+  WiFiClient conn;
+  uint8_t state;
+  bool keepAlive;
+  char rx[WEB_RX_SIZE];
+  size_t rxLen;
+  const uint8_t *body;       // Next body byte to write - points into flash
+  size_t bodyLeft;
+  uint32_t startUs;          // Request's first byte
+  uint32_t heapStart;        // Free heap at the request's first byte
+  uint32_t lastMs;           // Last activity, for the keep-alive timeout
+  uint32_t wsSeq;            // roomStateSeq in the last push
+  uint32_t wsSentMs;
+};
+
+static WiFiServer webServer(WEB_UI_PORT);
+static WebClient webClients[WEB_UI_CLIENTS];
+static char webHeader[WEB_HEADER_MAX];
+static char webJson[WEB_JSON_MAX];
+
+// Function to note the heap a request holds - sampled after each write, since that is when lwIP allocates
+// The figure is the drop in free heap since the request's first byte, so other work in between counts too
+static void webSampleHeap(WebClient &c) {
+  uint32_t now = ESP.getFreeHeap();
+  if (c.heapStart > now && c.heapStart - now > webStats.heapMax) webStats.heapMax = c.heapStart - now;
+}
+
+// Function to write a response header and count the request
+static void webSendHeader(WebClient &c, const char *header, size_t len) {
+  c.conn.write((const uint8_t *)header, len);
+  uint32_t ttfb = micros() - c.startUs;
+  webStats.requests++;
+  webStats.ttfbTotalUs += ttfb;
+  if (ttfb > webStats.ttfbMaxUs) webStats.ttfbMaxUs = ttfb;
+  webSampleHeap(c);
+}
+
+// Function to finish a response - keep the connection for the next request or close it
+static void webDone(WebClient &c) {
+  if (c.keepAlive) {
+    c.state = WEB_READING;
+  }
+  else {
+    c.conn.stop();
+    c.state = WEB_FREE;
+  }
+}
+
+// Function to build the room state JSON into webJson - returns its length
+static size_t webBuildState() {
+  WebStateView view = {relayOn, relayHasOwner, NUM_ROOMS, roomStateSeq, (uint32_t)(millis() / 1000), ESP.getFreeHeap(), &webStats};
+  return webStateJson(&view, webJson, sizeof(webJson));
+}
+
+// Function to push the room state to an upgraded connection
+static void webPush(WebClient &c) {
+  size_t len = webBuildState();
+  uint8_t frame[4];
+  size_t hlen = webSocketFrameHeader(len, frame);
+  c.conn.write(frame, hlen);
+  c.conn.write((const uint8_t *)webJson, len);
+  c.wsSeq = roomStateSeq;
+  c.wsSentMs = millis();
+}
+
+// Function to answer one parsed request
+static void webRespond(WebClient &c, const WebRequest &req) {
+  c.keepAlive = req.keepAlive;
+  size_t len;
+  if (!req.get) {
+    c.keepAlive = false;
+    webSendHeader(c, webHeader, webStatusHeader(405, webHeader, sizeof(webHeader)));
+    webDone(c);
+    return;
+  }
+  if (strcmp(req.path, "/ws") == 0 && req.upgrade && req.wsKey[0] != '\0') {
+    webSendHeader(c, webHeader, webSocketAcceptHeader(req.wsKey, webHeader, sizeof(webHeader)));
+    c.state = WEB_SOCKET;
+    webPush(c);
+    return;
+  }
+  if (strcmp(req.path, "/api/state") == 0) {
+    size_t body = webBuildState();
+    webSendHeader(c, webHeader, webJsonHeader(body, req.keepAlive, webHeader, sizeof(webHeader)));
+    if (!req.head) c.conn.write((const uint8_t *)webJson, body);
+    webDone(c);
+    return;
+  }
+  const WebAsset *asset = webFindAsset(webAssets, WEB_ASSET_COUNT, req.path);
+  if (asset == NULL) {
+    c.keepAlive = false;
+    webSendHeader(c, webHeader, webStatusHeader(404, webHeader, sizeof(webHeader)));
+    webDone(c);
+    return;
+  }
+  bool notModified;
+  len = webAssetHeader(asset, &req, &notModified, webHeader, sizeof(webHeader));
+  webSendHeader(c, webHeader, len);
+  if (notModified || req.head) {
+    webDone(c);
+    return;
+  }
+  c.body = asset->data;
+  c.bodyLeft = asset->len;
+  c.state = WEB_SENDING;
+}
+
+// Function to collect request bytes and answer a request once its header is complete
+static void webRead(WebClient &c) {
+  int avail = c.conn.available();
+  if (avail > 0) {
+    if (c.rxLen == 0) {
+      c.startUs = micros();
+      c.heapStart = ESP.getFreeHeap();
+    }
+    size_t room = sizeof(c.rx) - c.rxLen;
+    int n = c.conn.read((uint8_t *)c.rx + c.rxLen, (size_t)avail < room ? avail : room);
+    if (n > 0) c.rxLen += n;
+    c.lastMs = millis();
+  }
+  else if (millis() - c.lastMs > WEB_IDLE_MS) {
+    c.conn.stop();
+    c.state = WEB_FREE;
+    return;
+  }
+  if (c.rxLen == 0) return;
+  WebRequest req;
+  int used = webParseRequest(c.rx, c.rxLen, &req);
+  if (used == 0 && c.rxLen < sizeof(c.rx)) return;  // Header not complete yet
+  if (used <= 0) {
+    c.keepAlive = false;
+    webSendHeader(c, webHeader, webStatusHeader(400, webHeader, sizeof(webHeader)));
+    webDone(c);
+    return;
+  }
+  memmove(c.rx, c.rx + used, c.rxLen - used);  // Keep a pipelined request, if any
+  c.rxLen -= used;
+  webRespond(c, req);
+}
+
+// Function to write the next slices of a body straight from flash - a full socket buffer just waits for the next poll
+static void webSend(WebClient &c) {
+  for (uint8_t i = 0; i < WEB_SLICES_PER_POLL && c.bodyLeft > 0; i++) {
+    size_t n = c.conn.write(c.body, c.bodyLeft < WEB_SEND_SLICE ? c.bodyLeft : WEB_SEND_SLICE);
+    if (n == 0) break;
+    c.body += n;
+    c.bodyLeft -= n;
+  }
+  webSampleHeap(c);
+  c.lastMs = millis();
+  if (c.bodyLeft == 0) webDone(c);
+}
+
+// Function to keep an upgraded connection - push on change, drop it when the browser sends a close frame
+static void webServeSocket(WebClient &c) {
+  int avail = c.conn.available();
+  if (avail > 0) {
+    uint8_t buf[64];
+    int n = c.conn.read(buf, (size_t)avail < sizeof(buf) ? avail : sizeof(buf));
+    if (n > 0 && (buf[0] & 0x0F) == 0x8) {  // Close - the page only ever sends that
+      c.conn.stop();
+      c.state = WEB_FREE;
+      return;
+    }
+  }
+  uint32_t since = millis() - c.wsSentMs;
+  if ((c.wsSeq != roomStateSeq && since >= WEB_WS_MIN_MS) || since >= WEB_WS_REFRESH_MS) webPush(c);
+}
+
+// Function to take new connections into a free slot
+static void webAccept() {
+  if (!webServer.hasClient()) return;
+  for (uint8_t i = 0; i < WEB_UI_CLIENTS; i++) {
+    WebClient &c = webClients[i];
+    if (c.state != WEB_FREE && c.conn.connected()) continue;
+    c.conn = webServer.accept();
+    c.conn.setNoDelay(true);  // The header and a short body are the whole response - send them now
+    c.state = WEB_READING;
+    c.rxLen = 0;
+    c.lastMs = millis();
+    return;
+  }
+  webServer.accept().stop();  // Every slot busy - the browser retries
+}
+#endif
+
+// Function to start the server - call after wifiManagerBegin()
+void webUiBegin() {
+#if WEB_UI_ENABLED
+  webServer.begin();
+  webServer.setNoDelay(true);
+#endif
+}
+
+// Function to serve pending requests and push state changes - call while waiting
+void webUiPoll() {
+#if WEB_UI_ENABLED
+  if (!wifiManagerLinkUp()) return;
+  webAccept();
+  for (uint8_t i = 0; i < WEB_UI_CLIENTS; i++) {
+    WebClient &c = webClients[i];
+    if (c.state == WEB_FREE) continue;
+    if (!c.conn.connected()) {
+      c.conn.stop();
+      c.state = WEB_FREE;
+      continue;
+    }
+    if (c.state == WEB_READING) webRead(c);
+    else if (c.state == WEB_SENDING) webSend(c);
+    else webServeSocket(c);
+  }
+#endif
+}
+#endif
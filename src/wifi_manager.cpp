@@ -0,0 +1,176 @@
+#include "wifi_manager.h"
+#include <string.h>
+
+// Function to start the state machine with its first attempt under way
+void wifiLinkInit(WifiLink *link, uint32_t nowMs) {
+  memset(link, 0, sizeof(*link));
+  link->state = WIFI_STATE_CONNECTING;
+  link->stateSince = nowMs;
+}
+
+// Function to drop the link and wait before the next attempt - doubles the delay up to the limit, with jitter
+static WifiAction wifiEnterBackoff(WifiLink *link, uint32_t nowMs, uint32_t noise) {
+  link->up = false;
+  link->disconnects++;
+  uint32_t backoff = link->backoffMs == 0 ? WIFI_BACKOFF_MIN_MS : link->backoffMs * 2;
+  if (backoff > WIFI_BACKOFF_MAX_MS) backoff = WIFI_BACKOFF_MAX_MS;
+  link->backoffMs = backoff + noise % (backoff / 4 + 1);  // Keeps a fleet from reconnecting in lockstep after an AP restart
+  link->state = WIFI_STATE_BACKOFF;
+  link->stateSince = nowMs;
+  return WIFI_ACTION_DISCONNECT;
+}
+
+// Function to run one step - a loss after the last IP event wins
+WifiAction wifiLinkStep(WifiLink *link, uint32_t nowMs, bool gotIp, bool lost, bool associated, uint32_t noise) {
+  switch (link->state) {
+    case WIFI_STATE_CONNECTING:
+      if (gotIp && associated) {
+        link->state = WIFI_STATE_CONNECTED;
+        link->up = true;
+        link->backoffMs = 0;
+        link->connects++;
+      }
+      else if (lost || nowMs - link->stateSince > WIFI_CONNECT_TIMEOUT_MS) {
+        return wifiEnterBackoff(link, nowMs, noise);
+      }
+      break;
+    case WIFI_STATE_CONNECTED:
+      if (lost) return wifiEnterBackoff(link, nowMs, noise);
+      break;
+    case WIFI_STATE_BACKOFF:
+      if (nowMs - link->stateSince >= link->backoffMs) {
+        link->state = WIFI_STATE_CONNECTING;
+        link->stateSince = nowMs;
+        return WIFI_ACTION_CONNECT;
+      }
+      break;
+  }
+  return WIFI_ACTION_NONE;
+}
+
+// Function to empty a queue
+void wifiQueueInit(WifiQueue *q) {
+  q->head = 0;
+  q->count = 0;
+  q->dropped = 0;
+}
+
+// Function to add a frame at the back - false if it is too long or the queue is full
+bool wifiQueuePush(WifiQueue *q, void *socket, uint32_t dest, uint16_t port, const uint8_t *data, size_t len) {
+  if (len > WIFI_FRAME_MAX || q->count == WIFI_QUEUE_SLOTS) {
+    q->dropped++;
+    return false;
+  }
+  WifiFrame &frame = q->frames[(q->head + q->count) % WIFI_QUEUE_SLOTS];
+  frame.socket = socket;
+  frame.dest = dest;
+  frame.port = port;
+  frame.len = len;
+  memcpy(frame.data, data, len);
+  q->count++;
+  return true;
+}
+
+// Function to take the frame at the front off the queue - its slot is only reused by a later push
+const WifiFrame *wifiQueuePop(WifiQueue *q) {
+  if (q->count == 0) return NULL;
+  const WifiFrame *frame = &q->frames[q->head];
+  q->head = (q->head + 1) % WIFI_QUEUE_SLOTS;
+  q->count--;
+  return frame;
+}
+
+#ifdef ARDUINO
+#include "hot_standby.h"
+#include "modbus_slave.h"
+#include "emergency.h"
+#include <WiFi.h>
+
+WifiLink wifiLink;
+uint32_t wifiPollMaxUs = 0;
+
+// Event counters - written by the Wi-Fi task, read by loop(); counters cannot lose an event the way a cleared flag can
+static volatile uint32_t wifiGotIpEvents = 0;
+static volatile uint32_t wifiLostEvents = 0;
+static uint32_t wifiGotIpSeen = 0;
+static uint32_t wifiLostSeen = 0;
+
+static WifiQueue wifiQueue;            // Frames held while the link is down
+static bool wifiNtpStarted = false;    // SNTP is started on the first connection
+
+// Function to count driver events - runs in the Wi-Fi task, so it only touches the counters
+static void wifiOnEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) wifiGotIpEvents++;
+  else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP) wifiLostEvents++;
+}
+
+// Function to start the station and register for driver events - returns immediately
+void wifiManagerBegin() {
+  WiFi.mode(WIFI_STA);  // Station mode - join the site network
+  WiFi.setAutoReconnect(false);  // Reconnects are ours, with backoff
+  WiFi.setSleep(WIFI_MODEM_SLEEP ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);  // Sleep between DTIM beacons when allowed
+  WiFi.onEvent(wifiOnEvent);
+  wifiQueueInit(&wifiQueue);
+  wifiLinkInit(&wifiLink, millis());
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);  // Returns at once - the result arrives as an event
+}
+
+// Function to send queued frames while the link is up - a few per call so one pass of loop() stays short
+static void wifiFlushQueue() {
+  for (byte sent = 0; sent < WIFI_FLUSH_PER_POLL; sent++) {
+    const WifiFrame *frame = wifiQueuePop(&wifiQueue);
+    if (frame == NULL) break;
+    WiFiUDP *socket = (WiFiUDP *)frame->socket;
+    socket->beginPacket(IPAddress(frame->dest), frame->port);  // Leaves from the socket's own port
+    socket->write(frame->data, frame->len);
+    socket->endPacket();
+  }
+}
+
+// Function to run the connection state machine and flush queued frames - call on every loop() pass
+void wifiManagerPoll() {
+  unsigned long start = micros();
+
+  // Apply driver events since the last poll
+  bool gotIp = wifiGotIpEvents != wifiGotIpSeen;
+  bool lost = wifiLostEvents != wifiLostSeen;
+  wifiGotIpSeen = wifiGotIpEvents;
+  wifiLostSeen = wifiLostEvents;
+
+  bool associated = gotIp && WiFi.status() == WL_CONNECTED;
+  switch (wifiLinkStep(&wifiLink, millis(), gotIp, lost, associated, (uint32_t)random(0x7fffffff))) {
+    case WIFI_ACTION_CONNECT:
+      WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+      break;
+    case WIFI_ACTION_DISCONNECT:
+      WiFi.disconnect();
+      break;
+    case WIFI_ACTION_NONE:
+      break;
+  }
+  if (wifiLink.up && !wifiNtpStarted) {
+    configTime(0, 0, WIFI_NTP_SERVER);  // SNTP keeps the clock in the background from here on
+    wifiNtpStarted = true;
+  }
+
+  if (wifiLink.up) wifiFlushQueue();
+
+  uint32_t elapsed = micros() - start;
+  if (elapsed > wifiPollMaxUs) wifiPollMaxUs = elapsed;
+}
+
+// Function to check whether the link is up - a cached flag, cheap enough for every packet
+bool wifiManagerLinkUp() {
+  return wifiLink.up;
+}
+
+// Function to queue a UDP frame for sending from socket - held while the link is down, false if the queue is full
+bool wifiQueueSend(WiFiUDP *socket, const IPAddress &dest, uint16_t port, const uint8_t *data, size_t len) {
+  return wifiQueuePush(&wifiQueue, socket, (uint32_t)dest, port, data, len);
+}
+
+// Function to report queue drops
+uint32_t wifiQueueDropped() {
+  return wifiQueue.dropped;
+}
+#endif
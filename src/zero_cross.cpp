@@ -0,0 +1,279 @@
+#include "zero_cross.h"
+
+// Function to start a tracker with no lock
+void zeroCrossInit(ZeroCross *zc, int32_t offsetUs) {
+  zc->offsetUs = offsetUs;
+  zc->crossUs = 0;
+  zc->half16 = 0;
+  zc->good = 0;
+  zc->edges = zc->glitches = zc->missed = zc->unlocks = 0;
+}
+
+// Function to note a detector edge - an alpha-beta filter on the crossing time and half-period, so detector
+// jitter is smoothed out of both. Only an edge within ZC_WINDOW of where a crossing is due - the next one, or
+// the one after if the detector missed one - is taken; anything else before then is noise. An edge later
+// than that means the crossings were lost, and the lock starts again from it
+void zeroCrossEdge(ZeroCross *zc, uint32_t nowUs) {
+  uint32_t interval = nowUs - zc->crossUs;
+  if (zc->good == 0) {
+    zc->crossUs = nowUs;
+    if (interval >= ZC_MIN_HALF_US && interval <= ZC_MAX_HALF_US) {
+      zc->half16 = interval * 16;
+      zc->good = 1;
+    }
+    return;
+  }
+  uint32_t half = zc->half16 / 16;
+  uint32_t window = half / ZC_WINDOW;
+  uint32_t halves;
+  if ((int32_t)interval < 0) {
+    zc->glitches++;  // Just after an early edge - the filtered crossing time is still ahead of it
+    return;
+  }
+  if (interval + window >= half && interval <= half + window) halves = 1;
+  else if (interval + window >= 2 * half && interval <= 2 * half + window) {
+    halves = 2;
+    zc->missed++;
+  }
+  else if (interval > 2 * half + window) {
+    if (zc->good >= ZC_LOCK_EDGES) zc->unlocks++;
+    zc->good = 0;
+    zc->crossUs = nowUs;
+    return;
+  }
+  else {
+    zc->glitches++;
+    return;
+  }
+  uint32_t predicted = zc->crossUs + (halves * zc->half16 + 8) / 16;
+  int32_t err = (int32_t)(nowUs - predicted);
+  zc->crossUs = predicted + err / 4;
+  uint32_t half16 = zc->half16 + err / (2 * (int32_t)halves);
+  if (half16 >= ZC_MIN_HALF_US * 16 && half16 <= ZC_MAX_HALF_US * 16) zc->half16 = half16;
+  if (zc->good < 255) zc->good++;
+  zc->edges++;
+}
+
+// Function to check whether the tracker is locked - up to two missed crossings are bridged
+bool zeroCrossLocked(const ZeroCross *zc, uint32_t nowUs) {
+  return zc->good >= ZC_LOCK_EDGES && nowUs - zc->crossUs < 3 * (zc->half16 / 16);
+}
+
+// Function to find the fire time - the first crossing that leaves room for the lead and the compensation
+bool zeroCrossFireTime(const ZeroCross *zc, uint32_t nowUs, uint32_t compensationUs, uint32_t *fireUs) {
+  if (!zeroCrossLocked(zc, nowUs)) return false;
+  uint32_t half16 = zc->half16;
+  uint32_t zero = zc->crossUs + zc->offsetUs;
+  int32_t ahead = (int32_t)(nowUs + ZC_LEAD_US + compensationUs - zero);
+  if (ahead > 0) {
+    uint32_t k = ((uint64_t)ahead * 16 + half16 - 1) / half16;
+    zero += ((uint64_t)k * half16 + 8) / 16;
+  }
+  *fireUs = zero - compensationUs;
+  return true;
+}
+
+// Function to add pins to the edge at fireUs, or a new edge - capacity is checked by the caller
+static void zcSchedulePut(ZcSchedule *s, uint32_t fireUs, uint32_t high, uint32_t low) {
+  if ((high | low) == 0) return;
+  for (uint8_t i = 0; i < s->count; i++) {
+    if (s->pending[i].fireUs == fireUs) {
+      s->pending[i].high |= high;
+      s->pending[i].low |= low;
+      return;
+    }
+  }
+  s->pending[s->count++] = {fireUs, high, low};
+}
+
+// Function to queue a bank's edges - all or nothing
+bool zcScheduleAdd(ZcSchedule *s, const RelayBank *bank, uint32_t highUs, uint32_t lowUs) {
+  uint32_t pins = bank->high | bank->low;
+  uint8_t kept = 0;
+  bool joinHigh = bank->high == 0, joinLow = bank->low == 0;
+  for (uint8_t i = 0; i < s->count; i++) {
+    if (((s->pending[i].high | s->pending[i].low) & ~pins) == 0) continue;  // Emptied by the cancel below
+    kept++;
+    if (s->pending[i].fireUs == highUs) joinHigh = true;
+    if (s->pending[i].fireUs == lowUs) joinLow = true;
+  }
+  uint8_t added = !joinHigh + !joinLow;
+  if (added == 2 && highUs == lowUs) added = 1;
+  if (kept + added > ZC_MAX_PENDING) return false;
+  zcScheduleCancel(s, pins);
+  zcSchedulePut(s, highUs, bank->high, 0);
+  zcSchedulePut(s, lowUs, 0, bank->low);
+  return true;
+}
+
+// Function to drop pins from the pending edges - edges left with no pins go
+void zcScheduleCancel(ZcSchedule *s, uint32_t pins) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < s->count; i++) {
+    ZcEdge e = s->pending[i];
+    e.high &= ~pins;
+    e.low &= ~pins;
+    if (e.high | e.low) s->pending[kept++] = e;
+  }
+  s->count = kept;
+}
+
+// Function to take the due edges - a pin is in at most one edge, so the order they are merged in is irrelevant
+bool zcScheduleDue(ZcSchedule *s, uint32_t nowUs, RelayBank *due, uint32_t *nextUs) {
+  uint8_t kept = 0;
+  uint32_t next = 0;
+  for (uint8_t i = 0; i < s->count; i++) {
+    ZcEdge e = s->pending[i];
+    if ((int32_t)(e.fireUs - nowUs) <= ZC_SLACK_US) {
+      due->high |= e.high;
+      due->low |= e.low;
+      continue;
+    }
+    if (kept == 0 || (int32_t)(e.fireUs - next) < 0) next = e.fireUs;
+    s->pending[kept++] = e;
+  }
+  s->count = kept;
+  if (kept) *nextUs = next;
+  return kept != 0;
+}
+
+#ifdef ARDUINO
+#include <soc/gpio_struct.h>
+
+uint32_t zeroCrossSwitches = 0;
+uint32_t zeroCrossUnsynced = 0;
+uint32_t zeroCrossLateMaxUs = 0;
+
+#if ZERO_CROSS_ENABLED
+static ZeroCross zcTracker;
+static ZcSchedule zcSchedule;
+static hw_timer_t *zcTimer = NULL;
+static portMUX_TYPE zcLock = portMUX_INITIALIZER_UNLOCKED;  // Tracker and schedule - shared by loop() and both irqs
+static bool zcArmed = false;
+static uint32_t zcArmedUs = 0;                              // Fire time the timer is armed for
+
+// CPU cost, in cycles, since the last report
+static volatile uint32_t zcCommitCycles = 0, zcCommits = 0;  // Scheduling, in the caller
+static volatile uint32_t zcFireCycles = 0, zcFires = 0;      // Timer irq
+static volatile uint32_t zcEdgeCycles = 0, zcEdges = 0;      // Detector irq - paid 100 or 120 times a second
+static uint32_t zcReportMs = 0;
+
+// Function to start the one-shot edge timer for fireUs - 1 us ticks; inside zcLock
+static void IRAM_ATTR zcArm(uint32_t fireUs, uint32_t nowUs) {
+  int32_t wait = (int32_t)(fireUs - nowUs);
+  timerWrite(zcTimer, 0);
+  timerAlarmWrite(zcTimer, wait > 1 ? wait : 1, false);
+  timerAlarmEnable(zcTimer);
+  zcArmed = true;
+  zcArmedUs = fireUs;
+}
+
+static void IRAM_ATTR zcEdgeIsr() {
+  uint32_t start = ESP.getCycleCount();
+  portENTER_CRITICAL_ISR(&zcLock);
+  zeroCrossEdge(&zcTracker, micros());
+  portEXIT_CRITICAL_ISR(&zcLock);
+  zcEdgeCycles += ESP.getCycleCount() - start;
+  zcEdges++;
+}
+
+// Timer irq - writes the due pins straight to the set and clear registers, then arms for the next edge
+static void IRAM_ATTR zcTimerIsr() {
+  uint32_t start = ESP.getCycleCount();
+  RelayBank due = {0, 0};
+  uint32_t next;
+  portENTER_CRITICAL_ISR(&zcLock);
+  uint32_t now = micros();
+  int32_t late = (int32_t)(now - zcArmedUs);
+  zcArmed = false;
+  bool more = zcScheduleDue(&zcSchedule, now, &due, &next);
+  if (due.high) GPIO.out_w1ts.val = due.high;
+  if (due.low) GPIO.out_w1tc.val = due.low;
+  if (more) zcArm(next, now);
+  portEXIT_CRITICAL_ISR(&zcLock);
+  if (late > 0 && (uint32_t)late > zeroCrossLateMaxUs) zeroCrossLateMaxUs = late;
+  zeroCrossSwitches += __builtin_popcount(due.high | due.low);
+  zcFireCycles += ESP.getCycleCount() - start;
+  zcFires++;
+}
+#endif
+
+// Function to attach the detector interrupt and the edge timer
+void zeroCrossBegin() {
+#if ZERO_CROSS_ENABLED
+  if (ZC_PIN < 0) return;  // No detector - every commit switches at once
+  zeroCrossInit(&zcTracker, ZC_DETECT_OFFSET_US);
+  zcSchedule.count = 0;
+  pinMode(ZC_PIN, INPUT);
+  zcTimer = timerBegin(ZC_TIMER, 80, true);  // 80 MHz APB clock / 80 - microsecond ticks
+  timerAttachInterrupt(zcTimer, zcTimerIsr, false);
+  attachInterrupt(digitalPinToInterrupt(ZC_PIN), zcEdgeIsr, RISING);
+  zcReportMs = millis();
+#endif
+}
+
+// Function to apply a bank's levels on the next zero crossing - without a lock the pins' pending edges are
+// dropped first, or they would undo the change when they fire
+void zeroCrossCommit(RelayBank *bank) {
+#if ZERO_CROSS_ENABLED
+  if (zcTimer != NULL && (bank->high | bank->low)) {
+    uint32_t start = ESP.getCycleCount();
+    uint32_t highUs, lowUs;
+    portENTER_CRITICAL(&zcLock);
+    uint32_t now = micros();
+    bool synced = zeroCrossFireTime(&zcTracker, now, ZC_OPERATE_US, &highUs) &&
+                  zeroCrossFireTime(&zcTracker, now, ZC_RELEASE_US, &lowUs) &&
+                  zcScheduleAdd(&zcSchedule, bank, highUs, lowUs);
+    if (synced) {
+      uint32_t first = !bank->low || (bank->high && (int32_t)(highUs - lowUs) < 0) ? highUs : lowUs;
+      if (!zcArmed || (int32_t)(first - zcArmedUs) < 0) zcArm(first, now);
+    }
+    else zcScheduleCancel(&zcSchedule, bank->high | bank->low);
+    portEXIT_CRITICAL(&zcLock);
+    zcCommitCycles += ESP.getCycleCount() - start;
+    zcCommits++;
+    if (synced) {
+      bank->high = bank->low = 0;
+      return;
+    }
+    zeroCrossUnsynced++;
+  }
+#endif
+  relayBankCommit(bank);
+}
+
+// Function to apply a bank's levels at once - without the cancel, an edge queued just before would undo them
+void zeroCrossCommitNow(RelayBank *bank) {
+#if ZERO_CROSS_ENABLED
+  if (zcTimer != NULL) {
+    portENTER_CRITICAL(&zcLock);
+    zcScheduleCancel(&zcSchedule, bank->high | bank->low);
+    portEXIT_CRITICAL(&zcLock);
+  }
+#endif
+  relayBankCommit(bank);
+}
+
+// Function to print switching statistics - mains frequency, edges fired, lateness and CPU cost
+void zeroCrossPoll() {
+#if ZERO_CROSS_ENABLED
+  uint32_t now = millis();
+  if (zcTimer == NULL || now - zcReportMs < ZC_REPORT_MS) return;
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  portENTER_CRITICAL(&zcLock);
+  bool locked = zeroCrossLocked(&zcTracker, micros());
+  uint32_t half16 = zcTracker.half16;
+  uint32_t commit = zcCommits ? zcCommitCycles / zcCommits : 0, fire = zcFires ? zcFireCycles / zcFires : 0;
+  uint32_t edge = zcEdges ? zcEdgeCycles / zcEdges : 0;
+  zcCommitCycles = zcCommits = zcFireCycles = zcFires = zcEdgeCycles = zcEdges = 0;
+  portEXIT_CRITICAL(&zcLock);
+  Serial.printf("Zero cross: %s %.2f Hz, %u relay edges on a crossing, %u changes at once, late max %u us, %u glitches, "
+                "%u missed, %u unlocks\n", locked ? "locked" : "no lock", half16 ? 8e6f / half16 : 0.0f,
+                (unsigned)zeroCrossSwitches, (unsigned)zeroCrossUnsynced, (unsigned)zeroCrossLateMaxUs,
+                (unsigned)zcTracker.glitches, (unsigned)zcTracker.missed, (unsigned)zcTracker.unlocks);
+  Serial.printf("Zero cross: cost %u ns to schedule, %u ns per timer irq, %u ns per detector edge\n",
+                (unsigned)(commit * 1000 / mhz), (unsigned)(fire * 1000 / mhz), (unsigned)(edge * 1000 / mhz));
+  zcReportMs = now;
+#endif
+}
+#endif
@@ -0,0 +1,233 @@
+// Anomaly detector replay - generates months of labelled room traces and replays them through the detector
+// Hotel rooms, long-stay apartments, meeting rooms and offices each have their own stay lengths and tap
+// habits. Into these the generator injects the faults the detector is for - guests who left without
+// tapping out, relays welded on, lamps or relays that stopped passing current - and scores every alert
+// against those labels. The traces keep no more than one room in memory, as the firmware keeps no history.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/anomaly_replay.cpp src/anomaly.cpp -o anomaly_replay
+//                add -DANOMALY_K=3 to see the precision/recall trade of a more eager detector
+// Run:           ./anomaly_replay [rooms] [days]
+#include "anomaly.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#define SAMPLE_S        60     // Current reading interval - the firmware reads every second; slower here keeps
+                               // the replay short and stretches the mismatch time constant to minutes
+#define LEARN_STAYS     10     // Stays a room sees before any fault is injected - the detector learns each room first
+#define ABANDON_PCT     3      // Stays whose guest leaves without tapping out
+#define FAULT_PCT       10     // Rooms that get a welded relay, and rooms that lose current, once each
+#define GLITCH_PER_MIL  2      // Readings replaced by noise
+#define STUCK_GRACE_S   900    // A stuck alert this soon after the repair still counts - the evidence decays
+
+static const uint64_t HOUR_MS = 3600 * 1000ULL;
+
+// One kind of room - stay and gap lengths are lognormal
+struct RoomKind {
+  const char *name;
+  double stayMedianH, staySigma;
+  double gapMedianH, gapSigma;
+  double extraTapsPerDay;    // Taps during a stay - housekeeping, a second card, staff
+};
+
+static const RoomKind kinds[] = {
+  {"hotel",      16, 0.5,  8, 0.8, 1.0},
+  {"long-stay", 120, 0.4, 24, 0.8, 1.0},
+  {"meeting",   1.5, 0.5,  3, 1.0, 0.0},
+  {"office",      9, 0.15, 15, 0.3, 2.0},
+};
+#define KIND_COUNT (int)(sizeof(kinds) / sizeof(kinds[0]))
+
+// One time the relay was on - left is when the guest really went, off when the relay did
+struct Stay {
+  uint64_t on, left, off;
+  bool abandoned;
+};
+
+struct Fault {
+  uint64_t start, end;
+  uint8_t alert;             // ANOMALY_STUCK_ON or ANOMALY_STUCK_OFF
+  bool detectable;           // The relay spent long enough in the state that shows it
+  bool caught;
+};
+
+enum EventKind { EV_TAP, EV_SWITCH, EV_SAMPLE };
+
+struct Event {
+  uint64_t ms;
+  uint8_t kind;
+  bool on;
+  uint16_t reading;
+};
+
+struct Score {
+  uint32_t alerts = 0, correct = 0, labelled = 0, caught = 0;
+  std::vector<double> delays;   // Hours from the fault starting to its alert
+};
+
+static double median(std::vector<double> v) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+// Function to generate one room's stays and faults and replay its events - returns the events replayed
+static size_t replayRoom(int index, uint64_t endMs, std::mt19937_64 &rng, Score score[3], double &detectorNs) {
+  const RoomKind &kind = kinds[index % KIND_COUNT];
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> normal(0, 1);
+  auto lognormal = [&](double medianH, double sigma) { return (uint64_t)(medianH * exp(sigma * normal(rng)) * HOUR_MS); };
+
+  // Stays
+  std::vector<Stay> stays;
+  uint64_t t = (uint64_t)(uniform(rng) * kind.gapMedianH * HOUR_MS);
+  while (true) {
+    Stay s;
+    s.on = t;
+    s.left = t + std::max<uint64_t>(lognormal(kind.stayMedianH, kind.staySigma), 60000);
+    s.abandoned = stays.size() >= LEARN_STAYS && uniform(rng) * 100 < ABANDON_PCT;
+    s.off = s.abandoned ? s.left + (uint64_t)((s.left - s.on) * (2 + 6 * uniform(rng))) + 4 * HOUR_MS : s.left;
+    if (s.off >= endMs) break;
+    stays.push_back(s);
+    t = s.off + std::max<uint64_t>(lognormal(kind.gapMedianH, kind.gapSigma), 60000);
+  }
+  if (stays.size() <= LEARN_STAYS) return 0;
+
+  // Faults - after the learning stays, one to three days each
+  std::vector<Fault> faults;
+  for (uint8_t alert : {ANOMALY_STUCK_ON, ANOMALY_STUCK_OFF}) {
+    if (uniform(rng) * 100 >= FAULT_PCT) continue;
+    uint64_t from = stays[LEARN_STAYS].on;
+    Fault f;
+    f.start = from + (uint64_t)(uniform(rng) * (endMs - from) * 0.8);
+    f.end = std::min(endMs, f.start + (uint64_t)((24 + 48 * uniform(rng)) * HOUR_MS));
+    f.alert = alert;
+    f.caught = false;
+    faults.push_back(f);
+  }
+
+  // Events
+  std::vector<Event> events;
+  for (const Stay &s : stays) {
+    events.push_back({s.on, EV_TAP, true, 0});
+    events.push_back({s.on, EV_SWITCH, true, 0});
+    double perMs = kind.extraTapsPerDay / (24 * HOUR_MS);
+    for (uint64_t tap = s.on; perMs > 0;) {
+      tap += (uint64_t)(-log(1 - uniform(rng)) / perMs);
+      if (tap >= s.left) break;
+      events.push_back({tap, EV_TAP, true, 0});
+    }
+    events.push_back({s.off, EV_TAP, false, 0});  // The guest, or staff finding the room empty
+    events.push_back({s.off, EV_SWITCH, false, 0});
+  }
+  double level = 600 + 1900 * uniform(rng), offLevel = 5 + 35 * uniform(rng);
+  size_t stay = 0;
+  std::vector<uint64_t> relevantMs(faults.size(), 0);
+  for (uint64_t ms = SAMPLE_S * 1000; ms < endMs; ms += SAMPLE_S * 1000) {
+    while (stay < stays.size() && stays[stay].off <= ms) stay++;
+    bool on = stay < stays.size() && stays[stay].on <= ms;
+    bool flowing = on;
+    for (size_t i = 0; i < faults.size(); i++) {
+      const Fault &f = faults[i];
+      if (ms < f.start || ms >= f.end) continue;
+      if (f.alert == ANOMALY_STUCK_ON && !on) flowing = true, relevantMs[i] += SAMPLE_S * 1000;
+      if (f.alert == ANOMALY_STUCK_OFF && on) flowing = false, relevantMs[i] += SAMPLE_S * 1000;
+    }
+    double drift = 1 + 0.1 * sin(ms / (24.0 * 30 * HOUR_MS));  // Lamps age, supply voltage wanders
+    double reading = flowing ? level * drift * (1 + 0.02 * normal(rng)) : offLevel + fabs(5 * normal(rng));
+    if (uniform(rng) * 1000 < GLITCH_PER_MIL) reading = uniform(rng) * 4095;
+    events.push_back({ms, EV_SAMPLE, on, (uint16_t)std::min(4095.0, std::max(0.0, reading))});
+  }
+  for (size_t i = 0; i < faults.size(); i++) faults[i].detectable = relevantMs[i] >= HOUR_MS / 2;
+  std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.ms < b.ms; });
+
+  // Replay - times go in as 32-bit milliseconds, wrapping every 49 days as millis() does
+  AnomalyRoom room;
+  anomalyRoomInit(&room, false, 0);
+  std::vector<std::pair<uint64_t, uint8_t>> raised;
+  auto start = std::chrono::steady_clock::now();
+  for (const Event &e : events) {
+    uint32_t now = (uint32_t)e.ms;
+    if (e.kind == EV_TAP) anomalyTap(&room, now);
+    else if (e.kind == EV_SWITCH) anomalySwitched(&room, e.on, now);
+    else {
+      uint8_t alerts = anomalyCheckStay(&room, now) | anomalyCurrent(&room, e.reading, now);
+      if (alerts) raised.push_back({e.ms, alerts});
+    }
+  }
+  detectorNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  // Score each alert against the labels
+  for (const Stay &s : stays) {
+    if (s.abandoned) score[0].labelled++;
+  }
+  for (const Fault &f : faults) {
+    if (f.detectable) score[f.alert == ANOMALY_STUCK_ON ? 1 : 2].labelled++;
+  }
+  std::vector<bool> stayCaught(stays.size(), false);
+  for (const auto &a : raised) {
+    if (a.second & ANOMALY_LONG_STAY) {
+      score[0].alerts++;
+      for (size_t i = 0; i < stays.size(); i++) {
+        if (stays[i].abandoned && a.first >= stays[i].left && a.first <= stays[i].off && !stayCaught[i]) {
+          stayCaught[i] = true;
+          score[0].correct++;
+          score[0].caught++;
+          score[0].delays.push_back((a.first - stays[i].left) / (double)HOUR_MS);
+        }
+      }
+    }
+    for (int k = 1; k <= 2; k++) {
+      uint8_t bit = k == 1 ? ANOMALY_STUCK_ON : ANOMALY_STUCK_OFF;
+      if (!(a.second & bit)) continue;
+      score[k].alerts++;
+      for (Fault &f : faults) {
+        if (f.alert != bit || a.first < f.start || a.first > f.end + STUCK_GRACE_S * 1000) continue;
+        score[k].correct++;
+        if (!f.caught && f.detectable) {
+          f.caught = true;
+          score[k].caught++;
+          score[k].delays.push_back((a.first - f.start) / (double)HOUR_MS);
+        }
+        break;
+      }
+    }
+  }
+  return events.size();
+}
+
+int main(int argc, char **argv) {
+  int rooms = argc > 1 ? atoi(argv[1]) : 200;
+  int days = argc > 2 ? atoi(argv[2]) : 120;
+  if (rooms < 1 || days < 7) {
+    fprintf(stderr, "Usage: anomaly_replay [rooms] [days]\n");
+    return 2;
+  }
+  std::mt19937_64 rng(1);
+  Score score[3];
+  double detectorNs = 0;
+  size_t events = 0;
+  for (int room = 0; room < rooms; room++) events += replayRoom(room, days * 24 * HOUR_MS, rng, score, detectorNs);
+
+  printf("%d rooms (%d kinds), %d days, current read every %d s - %zu events\n", rooms, KIND_COUNT, days, SAMPLE_S, events);
+  printf("Detector:   %.1f ns per event on this host, %zu bytes of state per room\n", detectorNs / events, sizeof(AnomalyRoom));
+  const char *names[3] = {"Long stay:", "Stuck on:", "Stuck off:"};
+  const char *delayUnit[3] = {"h after the guest left", "h after the fault", "h after the fault"};
+  bool ok = true;
+  for (int k = 0; k < 3; k++) {
+    const Score &s = score[k];
+    double precision = s.alerts ? (double)s.correct / s.alerts : 1, recall = s.labelled ? (double)s.caught / s.labelled : 1;
+    printf("%-11s precision %.3f (%u/%u alerts), recall %.3f (%u/%u), median %.2f %s\n", names[k], precision, s.correct,
+           s.alerts, recall, s.caught, s.labelled, median(s.delays), delayUnit[k]);
+    // An abandoned stay looks like a genuine one until it outlasts the room's longest stays, so its recall
+    // is traded against precision by ANOMALY_K and only reported; a stuck relay must always be caught
+    ok = ok && precision >= 0.9 && (k == 0 || recall >= 0.8);
+  }
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,605 @@
+// Card list distribution - keeps the master card/room assignments and sends each controller only what
+// changed since the list version it last acknowledged (see card_list.h)
+// The state directory holds the master list and, per controller, the version and cards it acknowledged.
+// A controller's delta is a merge of two UID-sorted lists - its acknowledged cards and its cards in the
+// master - so the cost grows with the cards involved, never with the number of versions in between.
+//
+// State directory:
+//   master.csv       "# version N" then uid,controller,room     room numbered from 1 as on the display
+//   controllers.csv  controller,version,known,address           known is 0 when its list is not on record
+//   acked.csv        controller,uid,room                        each controller's list at its acked version
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/card_dist.cpp src/card_list.cpp src/crypto_service.cpp -o card_dist
+// Run:           ./card_dist publish dir assignments.csv   make the file the new master version if it differs
+//                ./card_dist deltas dir outdir              write each out-of-date controller's blobs to outdir/<id>.cld
+//                ./card_dist push dir [broadcast-address]   send them over UDP and record the acknowledgements
+//                ./card_dist ack dir controller version     record a delivery made some other way
+//                ./card_dist --bench [cards] [controllers]  diff and sign timings; every delta is applied and checked
+// The site key comes from CARD_LIST_KEY in the environment and must match the firmware's CARD_LIST_SITE_KEY.
+#include "card_list.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#define PUSH_ROUNDS     4      // Sends per out-of-date controller before giving up until the next push
+#define PUSH_WAIT_MS    1000   // Time to collect acknowledgements after each round
+
+// One card/room assignment
+struct Card {
+  uint16_t controller;
+  uint8_t uid[CARD_LIST_UID_SIZE];
+  uint8_t room;                      // Room index on the controller
+};
+
+// What the host knows about one controller
+struct Controller {
+  uint32_t version = 0;              // Version last acknowledged
+  bool known = true;                 // False when it reported a version whose list is not on record
+  std::string address;               // Where its last acknowledgement came from
+};
+
+struct State {
+  std::string dir;
+  uint32_t version = 0;              // Master version
+  std::vector<Card> master;          // Sorted by controller, then UID
+  std::vector<Card> acked;           // Same order - each controller's list at its acked version
+  std::map<uint16_t, Controller> controllers;
+};
+
+// A controller's update, ready to send
+struct Update {
+  uint16_t controller;
+  uint32_t baseVersion;
+  size_t removes, adds;
+  std::vector<std::vector<uint8_t>> parts;
+};
+
+static bool cardLess(const Card &a, const Card &b) {
+  if (a.controller != b.controller) return a.controller < b.controller;
+  return memcmp(a.uid, b.uid, CARD_LIST_UID_SIZE) < 0;
+}
+
+static std::string siteKey() {
+  const char *key = getenv("CARD_LIST_KEY");
+  return key != NULL ? key : "change-this-card-key";
+}
+
+// Function to parse an 8-digit hex UID
+static bool parseUid(const char *s, uint8_t uid[CARD_LIST_UID_SIZE]) {
+  for (int i = 0; i < CARD_LIST_UID_SIZE; i++) {
+    unsigned v;
+    if (sscanf(s + 2 * i, "%2x", &v) != 1) return false;
+    uid[i] = v;
+  }
+  return true;
+}
+
+// Function to read uid,controller,room lines - false with a message on the first bad line
+static bool readCards(const std::string &path, std::vector<Card> &cards, bool withController, uint32_t *version) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) return false;
+  char line[128];
+  int lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    unsigned v;
+    if (version != NULL && sscanf(line, "# version %u", &v) == 1) *version = v;
+    if (line[0] == '#' || line[0] == '\n' || !strncmp(line, "uid,", 4)) continue;
+    Card c;
+    char uidText[32];
+    unsigned controller, room;
+    bool ok = withController ? sscanf(line, "%u,%31[0-9a-fA-F],%u", &controller, uidText, &room) == 3
+                             : sscanf(line, "%31[0-9a-fA-F],%u,%u", uidText, &controller, &room) == 3;
+    if (!ok || strlen(uidText) != 2 * CARD_LIST_UID_SIZE || !parseUid(uidText, c.uid) || controller < 1 || controller > 0xFFFF ||
+        room < 1 || room > 255) {
+      fprintf(stderr, "%s:%d: expected %s\n", path.c_str(), lineNo, withController ? "controller,uid,room" : "uid,controller,room");
+      fclose(f);
+      return false;
+    }
+    c.controller = controller;
+    c.room = room - 1;
+    cards.push_back(c);
+  }
+  fclose(f);
+  std::sort(cards.begin(), cards.end(), cardLess);
+  return true;
+}
+
+// Function to write a file through a temporary, so a crash never leaves half a state file
+static bool writeFile(const std::string &path, const std::string &text) {
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (f == NULL) return false;
+  bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+  ok = fclose(f) == 0 && ok;
+  return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+static std::string cardLine(const Card &c, bool controllerFirst) {
+  char line[64];
+  if (controllerFirst) snprintf(line, sizeof(line), "%u,%02x%02x%02x%02x,%u\n", c.controller, c.uid[0], c.uid[1], c.uid[2], c.uid[3], c.room + 1);
+  else snprintf(line, sizeof(line), "%02x%02x%02x%02x,%u,%u\n", c.uid[0], c.uid[1], c.uid[2], c.uid[3], c.controller, c.room + 1);
+  return line;
+}
+
+static bool loadState(State &s, const std::string &dir) {
+  s.dir = dir;
+  mkdir(dir.c_str(), 0755);
+  struct stat st;
+  if (stat((dir + "/master.csv").c_str(), &st) == 0 && !readCards(dir + "/master.csv", s.master, false, &s.version)) return false;
+  if (stat((dir + "/acked.csv").c_str(), &st) == 0 && !readCards(dir + "/acked.csv", s.acked, true, NULL)) return false;
+  FILE *f = fopen((dir + "/controllers.csv").c_str(), "r");
+  if (f != NULL) {
+    char line[128], address[64];
+    unsigned id, version, known;
+    while (fgets(line, sizeof(line), f)) {
+      address[0] = '\0';
+      if (sscanf(line, "%u,%u,%u,%63s", &id, &version, &known, address) < 3) continue;
+      Controller &c = s.controllers[id];
+      c.version = version;
+      c.known = known != 0;
+      c.address = address;
+    }
+    fclose(f);
+  }
+  return true;
+}
+
+static bool saveControllers(const State &s) {
+  std::string text = "# controller,version,known,address\n", acked;
+  for (const auto &c : s.controllers) {
+    text += std::to_string(c.first) + "," + std::to_string(c.second.version) + "," + (c.second.known ? "1" : "0") + "," +
+            c.second.address + "\n";
+  }
+  for (const Card &c : s.acked) acked += cardLine(c, true);
+  return writeFile(s.dir + "/acked.csv", acked) && writeFile(s.dir + "/controllers.csv", text);
+}
+
+// Function to find one controller's cards in a sorted list
+static std::pair<const Card *, const Card *> slice(const std::vector<Card> &cards, uint16_t controller) {
+  Card key = {controller, {0}, 0};
+  auto lo = std::lower_bound(cards.begin(), cards.end(), key, cardLess);
+  auto hi = lo;
+  while (hi != cards.end() && hi->controller == controller) hi++;
+  return {cards.data() + (lo - cards.begin()), cards.data() + (hi - cards.begin())};
+}
+
+// Function to diff two UID-sorted lists of one controller - removes get the UID, adds the UID and room;
+// a card whose room changed is only an add, which the firmware applies as a move
+static void diffCards(const Card *old, const Card *oldEnd, const Card *cur, const Card *curEnd,
+                      std::vector<uint8_t> &removes, std::vector<uint8_t> &adds) {
+  while (old < oldEnd || cur < curEnd) {
+    int cmp = old == oldEnd ? 1 : cur == curEnd ? -1 : memcmp(old->uid, cur->uid, CARD_LIST_UID_SIZE);
+    if (cmp < 0) {
+      removes.insert(removes.end(), old->uid, old->uid + CARD_LIST_UID_SIZE);
+      old++;
+      continue;
+    }
+    if (cmp > 0 || old->room != cur->room) {
+      adds.insert(adds.end(), cur->uid, cur->uid + CARD_LIST_UID_SIZE);
+      adds.push_back(cur->room);
+    }
+    if (cmp == 0) old++;
+    cur++;
+  }
+}
+
+// Function to cut a delta into signed blobs - removes first, so a part never needs room the list lacks
+static void makeParts(Update &u, uint32_t version, bool reset, const std::vector<uint8_t> &removes,
+                      const std::vector<uint8_t> &adds, const std::string &key) {
+  const size_t space = CARD_LIST_BLOB_MAX - CARD_LIST_HEADER_SIZE - CARD_LIST_TAG_SIZE;
+  size_t r = 0, a = 0, nr = removes.size() / CARD_LIST_UID_SIZE, na = adds.size() / CARD_LIST_ADD_SIZE;
+  u.removes = nr;
+  u.adds = na;
+  do {
+    CardDelta d;
+    d.controller = u.controller;
+    d.baseVersion = u.baseVersion;
+    d.version = version;
+    d.flags = reset && u.parts.empty() ? CARD_FLAG_RESET : 0;
+    d.removeCount = std::min(nr - r, space / CARD_LIST_UID_SIZE);
+    d.addCount = std::min(na - a, (space - d.removeCount * CARD_LIST_UID_SIZE) / CARD_LIST_ADD_SIZE);
+    d.removes = removes.data() + r * CARD_LIST_UID_SIZE;
+    d.adds = adds.data() + a * CARD_LIST_ADD_SIZE;
+    r += d.removeCount;
+    a += d.addCount;
+    if (r == nr && a == na) d.flags |= CARD_FLAG_FINAL;
+    std::vector<uint8_t> blob(CARD_LIST_BLOB_MAX);
+    blob.resize(cardDeltaEncode(blob.data(), blob.size(), &d, (const uint8_t *)key.data(), key.size()));
+    u.parts.push_back(blob);
+  } while (r < nr || a < na);
+}
+
+// Function to work out every out-of-date controller's update
+static std::vector<Update> makeUpdates(const State &s, const std::string &key) {
+  std::vector<uint16_t> ids;
+  for (const Card &c : s.master) {
+    if (ids.empty() || ids.back() != c.controller) ids.push_back(c.controller);
+  }
+  for (const auto &c : s.controllers) ids.push_back(c.first);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  std::vector<Update> updates;
+  for (uint16_t id : ids) {
+    auto found = s.controllers.find(id);
+    Controller c = found != s.controllers.end() ? found->second : Controller();
+    if (c.known && c.version == s.version) continue;
+    auto cur = slice(s.master, id);
+    auto old = c.known ? slice(s.acked, id) : std::make_pair(cur.first, cur.first);  // Unknown list - send it all
+    std::vector<uint8_t> removes, adds;
+    diffCards(old.first, old.second, cur.first, cur.second, removes, adds);
+    Update u;
+    u.controller = id;
+    u.baseVersion = c.version;
+    makeParts(u, s.version, !c.known || c.version == 0, removes, adds, key);
+    updates.push_back(u);
+  }
+  return updates;
+}
+
+// Function to record an acknowledgement - only an applied final part moves the controller's list on
+// A controller holding parts of an earlier update no longer matches any version on record, so it gets the full list
+static void recordAck(State &s, uint16_t id, uint32_t version, uint8_t result, const std::string &address) {
+  Controller &c = s.controllers[id];
+  if (!address.empty()) c.address = address;
+  if (version == c.version && c.known && result != CARD_MIXED) return;
+  auto old = slice(s.acked, id);
+  std::vector<Card> rest(s.acked.begin(), s.acked.begin() + (old.first - s.acked.data()));
+  rest.insert(rest.end(), s.acked.begin() + (old.second - s.acked.data()), s.acked.end());
+  c.version = version;
+  c.known = result == CARD_APPLIED && version == s.version;
+  if (c.known) {
+    auto cur = slice(s.master, id);
+    rest.insert(rest.end(), cur.first, cur.second);
+    std::sort(rest.begin(), rest.end(), cardLess);
+  }
+  else if (version == 0) c.known = true;  // Wiped - its list is empty
+  s.acked.swap(rest);
+}
+
+static int runPublish(const std::string &dir, const std::string &file) {
+  State s;
+  std::vector<Card> cards;
+  if (!loadState(s, dir) || !readCards(file, cards, false, NULL)) return 1;
+  for (size_t i = 0; i < cards.size(); i++) {
+    if (i > 0 && !cardLess(cards[i - 1], cards[i])) {
+      fprintf(stderr, "%s%s", cardLine(cards[i], false).c_str(), "is listed twice\n");
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < cards.size();) {
+    size_t j = i;
+    while (j < cards.size() && cards[j].controller == cards[i].controller) j++;
+    if (j - i > CARD_LIST_CAPACITY) {
+      fprintf(stderr, "Controller %u has %zu cards - more than the %d it can hold\n", cards[i].controller, j - i, CARD_LIST_CAPACITY);
+      return 1;
+    }
+    i = j;
+  }
+  bool same = cards.size() == s.master.size();
+  for (size_t i = 0; same && i < cards.size(); i++) same = !cardLess(cards[i], s.master[i]) && !cardLess(s.master[i], cards[i]) &&
+                                                           cards[i].room == s.master[i].room;
+  if (same) {
+    printf("Unchanged at version %u\n", s.version);
+    return 0;
+  }
+  std::string text = "# version " + std::to_string(s.version + 1) + "\nuid,controller,room\n";
+  for (const Card &c : cards) text += cardLine(c, false);
+  if (!writeFile(dir + "/master.csv", text)) {
+    fprintf(stderr, "Cannot write %s/master.csv\n", dir.c_str());
+    return 1;
+  }
+  printf("Version %u: %zu cards\n", s.version + 1, cards.size());
+  return 0;
+}
+
+static int runDeltas(const std::string &dir, const std::string &out) {
+  State s;
+  if (!loadState(s, dir)) return 1;
+  mkdir(out.c_str(), 0755);
+  size_t bytes = 0;
+  std::vector<Update> updates = makeUpdates(s, siteKey());
+  for (const Update &u : updates) {
+    std::string path = out + "/" + std::to_string(u.controller) + ".cld";
+    std::string data;
+    for (const auto &p : u.parts) data.append((const char *)p.data(), p.size());
+    if (!writeFile(path, data)) {
+      fprintf(stderr, "Cannot write %s\n", path.c_str());
+      return 1;
+    }
+    bytes += data.size();
+    printf("controller %u: version %u -> %u, %zu removed, %zu added, %zu parts, %zu bytes\n", u.controller, u.baseVersion,
+           s.version, u.removes, u.adds, u.parts.size(), data.size());
+  }
+  printf("%zu controllers out of date, %zu bytes\n", updates.size(), bytes);
+  return 0;
+}
+
+static int runPush(const std::string &dir, const char *broadcast) {
+  State s;
+  if (!loadState(s, dir)) return 1;
+  std::string key = siteKey();
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  int yes = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+  struct timeval tv = {0, 100000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  std::vector<Update> updates;
+  for (int round = 0; round < PUSH_ROUNDS; round++) {
+    updates = makeUpdates(s, key);  // Again each round - a stale answer changes the base
+    if (updates.empty()) break;
+    for (const Update &u : updates) {
+      const std::string &known = s.controllers[u.controller].address;
+      sockaddr_in to = {};
+      to.sin_family = AF_INET;
+      to.sin_port = htons(CARD_LIST_UDP_PORT);
+      inet_pton(AF_INET, known.empty() ? broadcast : known.c_str(), &to.sin_addr);
+      for (const auto &p : u.parts) sendto(sock, p.data(), p.size(), 0, (sockaddr *)&to, sizeof(to));
+      usleep(1000);  // Pace the parts - a controller's UDP queue is short
+    }
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(PUSH_WAIT_MS)) {
+      uint8_t buf[64];
+      sockaddr_in from;
+      socklen_t fromLen = sizeof(from);
+      ssize_t n = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr *)&from, &fromLen);
+      uint16_t id;
+      uint32_t version;
+      uint8_t result;
+      if (n <= 0 || !cardAckDecode(buf, n, (const uint8_t *)key.data(), key.size(), &id, &version, &result)) continue;
+      char address[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+      recordAck(s, id, version, result, address);
+    }
+  }
+  close(sock);
+  if (!saveControllers(s)) {
+    fprintf(stderr, "Cannot write the controller state\n");
+    return 1;
+  }
+  updates = makeUpdates(s, key);
+  printf("Version %u: %zu controllers still out of date\n", s.version, updates.size());
+  return updates.empty() ? 0 : 3;
+}
+
+static int runAck(const std::string &dir, unsigned id, unsigned version) {
+  State s;
+  if (!loadState(s, dir)) return 1;
+  if (version != s.version) {
+    fprintf(stderr, "Only the current version %u can be acknowledged\n", s.version);
+    return 1;
+  }
+  recordAck(s, id, version, CARD_APPLIED, "");
+  return saveControllers(s) ? 0 : 1;
+}
+
+// ---- Benchmark ----
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Function to load a controller's acked cards into a list, as it would hold them
+static void loadList(CardList &list, const State &s, uint16_t id) {
+  cardListInit(&list);
+  list.version = s.controllers.at(id).version;
+  auto old = slice(s.acked, id);
+  for (const Card *c = old.first; c < old.second; c++) {
+    memcpy(list.entries[list.count].uid, c->uid, CARD_LIST_UID_SIZE);
+    list.entries[list.count++].room = c->room;
+  }
+}
+
+// Function to apply an update's parts from first to last - the result of the last one applied or refused
+static CardApply applyParts(CardList &list, const Update &u, size_t parts, const std::string &key) {
+  CardApply result = CARD_INVALID;
+  for (size_t i = 0; i < parts && i < u.parts.size(); i++) {
+    CardDelta d;
+    if (!cardDeltaDecode(u.parts[i].data(), u.parts[i].size(), (const uint8_t *)key.data(), key.size(), &d)) return CARD_INVALID;
+    result = cardListApply(&list, u.controller, &d);
+    if (result != CARD_APPLIED) break;
+  }
+  return result;
+}
+
+// Function to lose the final part of a two-part update and publish again before it is resent - the
+// controller must refuse the newer delta on top of its half-applied list and end up with the master list
+// from a full resend
+static bool checkLostFinalPart(const std::string &key) {
+  const uint16_t id = 7;
+  auto cards = [](uint32_t first) {  // 250 cards on the controller, none shared between batches
+    std::vector<Card> v;
+    for (uint32_t i = 0; i < 250; i++) {
+      Card c;
+      c.controller = id;
+      uint32_t uid = first + i;
+      c.uid[0] = uid >> 24, c.uid[1] = uid >> 16, c.uid[2] = uid >> 8, c.uid[3] = uid;
+      c.room = i % 4;
+      v.push_back(c);
+    }
+    return v;
+  };
+  State s;
+  s.version = 1;
+  s.acked = cards(0x20000000);
+  s.controllers[id].version = 1;
+  static CardList list;
+  loadList(list, s, id);
+
+  s.master = cards(0x30000000);  // Version 2 replaces every card - 250 removes and 250 adds, two parts
+  s.version = 2;
+  std::vector<Update> updates = makeUpdates(s, key);
+  if (updates.size() != 1 || updates[0].parts.size() < 2) return false;
+  if (applyParts(list, updates[0], updates[0].parts.size() - 1, key) != CARD_APPLIED) return false;
+  recordAck(s, id, list.version, CARD_APPLIED, "");  // Still at version 1 as far as the host can tell
+
+  s.master = cards(0x40000000);  // Version 3 published before the final part is resent
+  s.version = 3;
+  updates = makeUpdates(s, key);
+  CardApply result = applyParts(list, updates[0], updates[0].parts.size(), key);
+  if (result != CARD_MIXED) return false;
+  recordAck(s, id, list.version, result, "");
+
+  updates = makeUpdates(s, key);  // Full list now
+  if (updates.size() != 1 || applyParts(list, updates[0], updates[0].parts.size(), key) != CARD_APPLIED) return false;
+  recordAck(s, id, list.version, CARD_APPLIED, "");
+  std::vector<Card> want = cards(0x40000000);
+  bool same = list.version == 3 && list.partial == 0 && list.count == want.size();
+  for (int i = 0; same && i < list.count; i++) {
+    same = memcmp(list.entries[i].uid, want[i].uid, CARD_LIST_UID_SIZE) == 0 && list.entries[i].room == want[i].room;
+  }
+  return same && makeUpdates(s, key).empty();
+}
+
+static int runBench(int cardCount, int controllerCount) {
+  const int versions = 10, churn = cardCount / 100;  // Ten publishes, each replacing 1% of the cards
+  std::mt19937 rng(1);
+  std::string key = siteKey();
+  uint32_t nextUid = 0x10000000;
+  auto newCard = [&](Card &c) {
+    uint32_t uid = nextUid + rng() % 4096;  // Issued in batches - ascending with gaps, as card stock is
+    nextUid = uid + 1;
+    c.uid[0] = uid >> 24, c.uid[1] = uid >> 16, c.uid[2] = uid >> 8, c.uid[3] = uid;
+    c.controller = 1 + rng() % controllerCount;
+    c.room = rng() % 4;
+  };
+
+  // Master history - version v at history[v - 1]
+  std::vector<std::vector<Card>> history(1);
+  for (int i = 0; i < cardCount; i++) {
+    Card c;
+    newCard(c);
+    history[0].push_back(c);
+  }
+  for (int v = 1; v < versions; v++) {
+    std::vector<Card> next = history.back();
+    std::shuffle(next.begin(), next.end(), rng);
+    for (int i = 0; i < churn; i++) newCard(next[i]);               // Cards retired and new ones issued
+    for (int i = churn; i < churn + churn / 5; i++) next[i].room = (next[i].room + 1) % 4;  // Moves
+    history.push_back(next);
+  }
+  for (auto &h : history) std::sort(h.begin(), h.end(), cardLess);
+
+  // Each controller last acknowledged one of the versions - most are current or one behind
+  State s;
+  s.version = versions;
+  s.master = history.back();
+  for (int id = 1; id <= controllerCount; id++) {
+    int r = rng() % 100;
+    uint32_t v = r < 60 ? versions - 1 : r < 90 ? versions - 2 - rng() % 3 : 1 + rng() % (versions - 1);
+    if (r < 2) v = 0;  // New or wiped
+    s.controllers[id].version = v;
+    if (v == 0) continue;
+    auto part = slice(history[v - 1], id);
+    s.acked.insert(s.acked.end(), part.first, part.second);
+  }
+  std::sort(s.acked.begin(), s.acked.end(), cardLess);
+
+  // Diff alone, then diff plus signing - best of three
+  double diffMs = 1e9, signMs = 1e9;
+  size_t removes = 0, adds = 0;
+  for (int run = 0; run < 3; run++) {
+    auto start = std::chrono::steady_clock::now();
+    removes = adds = 0;
+    for (int id = 1; id <= controllerCount; id++) {
+      auto cur = slice(s.master, id), old = slice(s.acked, id);
+      std::vector<uint8_t> r, a;
+      diffCards(old.first, old.second, cur.first, cur.second, r, a);
+      removes += r.size() / CARD_LIST_UID_SIZE;
+      adds += a.size() / CARD_LIST_ADD_SIZE;
+    }
+    diffMs = std::min(diffMs, msSince(start));
+  }
+  std::vector<Update> updates;
+  for (int run = 0; run < 3; run++) {
+    auto start = std::chrono::steady_clock::now();
+    updates = makeUpdates(s, key);
+    signMs = std::min(signMs, msSince(start));
+  }
+
+  size_t deltaBytes = 0, parts = 0, fullBytes = 0;
+  for (const Update &u : updates) {
+    for (const auto &p : u.parts) deltaBytes += p.size();
+    parts += u.parts.size();
+    auto cur = slice(s.master, u.controller);
+    fullBytes += CARD_LIST_HEADER_SIZE + (cur.second - cur.first) * CARD_LIST_ADD_SIZE + CARD_LIST_TAG_SIZE;
+  }
+
+  // Every update applied to a controller holding its acked list must give exactly its master list
+  bool ok = true;
+  static CardList list;
+  double applyMs = 0;
+  int stale = 0;
+  for (const Update &u : updates) {
+    loadList(list, s, u.controller);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &p : u.parts) {
+      CardDelta d;
+      ok = ok && cardDeltaDecode(p.data(), p.size(), (const uint8_t *)key.data(), key.size(), &d) &&
+           cardListApply(&list, u.controller, &d) == CARD_APPLIED;
+    }
+    applyMs += msSince(start);
+    auto cur = slice(s.master, u.controller);
+    ok = ok && list.version == s.version && list.count == cur.second - cur.first;
+    for (int i = 0; ok && i < list.count; i++) {
+      ok = memcmp(list.entries[i].uid, cur.first[i].uid, CARD_LIST_UID_SIZE) == 0 && list.entries[i].room == cur.first[i].room;
+    }
+    // A replayed blob must do nothing now the list has moved on
+    CardDelta d;
+    if (cardDeltaDecode(u.parts[0].data(), u.parts[0].size(), (const uint8_t *)key.data(), key.size(), &d) &&
+        cardListApply(&list, u.controller, &d) == CARD_STALE) stale++;
+  }
+  // Forged blob - one flipped bit
+  std::vector<uint8_t> forged = updates[0].parts[0];
+  forged[CARD_LIST_HEADER_SIZE] ^= 1;
+  CardDelta d;
+  bool forgedRefused = !cardDeltaDecode(forged.data(), forged.size(), (const uint8_t *)key.data(), key.size(), &d);
+  bool lostFinal = checkLostFinalPart(key);
+  ok = ok && stale == (int)updates.size() && forgedRefused && lostFinal;
+
+  printf("%d cards on %d controllers, version %u; controllers acked 0..%d versions back\n", cardCount, controllerCount,
+         s.version, versions);
+  printf("Diff:          %8.2f ms for all controllers (%.2f us each) - %zu removes, %zu adds\n", diffMs, diffMs * 1000 / controllerCount,
+         removes, adds);
+  printf("Diff and sign: %8.2f ms - %zu controllers out of date, %zu blobs\n", signMs, updates.size(), parts);
+  printf("Bytes sent:    %8zu as deltas, %zu as full lists to the same controllers (%.1fx)\n", deltaBytes, fullBytes,
+         (double)fullBytes / deltaBytes);
+  printf("Apply:         %8.2f ms for all blobs on the host, verify included\n", applyMs);
+  printf("Replays refused %d/%zu, forged blob %s\n", stale, updates.size(), forgedRefused ? "refused" : "ACCEPTED");
+  printf("Final part lost, then a newer version: %s\n", lostFinal ? "refused, full list resent" : "LIST WRONG");
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+    int cards = argc > 2 ? atoi(argv[2]) : 100000;
+    int controllers = argc > 3 ? atoi(argv[3]) : 1000;
+    if (cards < 100 || controllers < 1 || controllers > 0xFFFF || cards / controllers > CARD_LIST_CAPACITY / 2) {
+      fprintf(stderr, "Bad bench size\n");
+      return 2;
+    }
+    return runBench(cards, controllers);
+  }
+  if (argc == 4 && !strcmp(argv[1], "publish")) return runPublish(argv[2], argv[3]);
+  if (argc == 4 && !strcmp(argv[1], "deltas")) return runDeltas(argv[2], argv[3]);
+  if ((argc == 3 || argc == 4) && !strcmp(argv[1], "push")) return runPush(argv[2], argc == 4 ? argv[3] : "255.255.255.255");
+  if (argc == 5 && !strcmp(argv[1], "ack")) return runAck(argv[2], atoi(argv[3]), atoi(argv[4]));
+  fprintf(stderr, "Usage: card_dist publish|deltas|push|ack ... or card_dist --bench [cards] [controllers]\n");
+  return 2;
+}
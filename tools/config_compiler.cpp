@@ -0,0 +1,426 @@
+// Site config compiler - turns a JSON site description into the binary blob the controller loads from NVS
+// See tools/site_config.json for the accepted keys; anything left out keeps the firmware's compiled default.
+// The output is the blob followed by its upload tag. The key comes from SITE_CONFIG_KEY in the environment and
+// must match the firmware's SITE_CONFIG_SITE_KEY; the controller must be built with -DSITE_CONFIG_UPLOAD=1.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/config_compiler.cpp src/site_config.cpp src/crypto_service.cpp -o config_compiler
+// Run:           ./config_compiler site.json site.bin   compile; send with: stty -F /dev/ttyUSB0 115200 raw && cat site.bin > /dev/ttyUSB0
+//                ./config_compiler --bench site.json     compare parsing the JSON against opening the blob
+//                ./config_compiler --selftest site.json  run the controller's upload checks on the compiled blob
+#include "site_config.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define UID_BYTES 4  // Card UID size the firmware stores per room
+
+static std::string siteKey() {
+  const char *key = getenv("SITE_CONFIG_KEY");
+  return key != NULL ? key : "change-this-config-key";
+}
+
+// Parsed JSON value - just enough JSON for site files
+struct Json {
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+  double number = 0;
+  std::string text;
+  std::vector<Json> items;
+  std::vector<std::pair<std::string, Json>> members;
+
+  const Json *get(const char *key) const {
+    for (const auto &m : members) {
+      if (m.first == key) return &m.second;
+    }
+    return NULL;
+  }
+};
+
+// Recursive-descent JSON parser - reports the byte offset of the first error
+struct JsonParser {
+  const char *s;
+  size_t pos = 0;
+  std::string error;
+
+  explicit JsonParser(const char *text) : s(text) {}
+
+  void skipSpace() {
+    while (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r') pos++;
+  }
+
+  bool fail(const char *what) {
+    if (error.empty()) error = std::string(what) + " at offset " + std::to_string(pos);
+    return false;
+  }
+
+  bool parseString(std::string *out) {
+    if (s[pos] != '"') return fail("expected string");
+    pos++;
+    while (s[pos] != '"') {
+      if (s[pos] == '\0') return fail("unterminated string");
+      if (s[pos] == '\\') {
+        pos++;
+        char c = s[pos];
+        if (c == 'n') c = '\n';
+        else if (c == 't') c = '\t';
+        else if (c != '"' && c != '\\' && c != '/') return fail("unsupported escape");
+        out->push_back(c);
+      }
+      else {
+        out->push_back(s[pos]);
+      }
+      pos++;
+    }
+    pos++;
+    return true;
+  }
+
+  bool parseValue(Json *v) {
+    skipSpace();
+    char c = s[pos];
+    if (c == '{') {
+      v->type = Json::OBJECT;
+      pos++;
+      skipSpace();
+      if (s[pos] == '}') { pos++; return true; }
+      for (;;) {
+        skipSpace();
+        std::pair<std::string, Json> member;
+        if (!parseString(&member.first)) return false;
+        skipSpace();
+        if (s[pos++] != ':') return fail("expected ':'");
+        if (!parseValue(&member.second)) return false;
+        v->members.push_back(std::move(member));
+        skipSpace();
+        if (s[pos] == ',') { pos++; continue; }
+        if (s[pos] == '}') { pos++; return true; }
+        return fail("expected ',' or '}'");
+      }
+    }
+    if (c == '[') {
+      v->type = Json::ARRAY;
+      pos++;
+      skipSpace();
+      if (s[pos] == ']') { pos++; return true; }
+      for (;;) {
+        Json item;
+        if (!parseValue(&item)) return false;
+        v->items.push_back(std::move(item));
+        skipSpace();
+        if (s[pos] == ',') { pos++; continue; }
+        if (s[pos] == ']') { pos++; return true; }
+        return fail("expected ',' or ']'");
+      }
+    }
+    if (c == '"') {
+      v->type = Json::STRING;
+      return parseString(&v->text);
+    }
+    if (strncmp(s + pos, "true", 4) == 0 || strncmp(s + pos, "false", 5) == 0) {
+      v->type = Json::BOOL;
+      v->number = s[pos] == 't';
+      pos += s[pos] == 't' ? 4 : 5;
+      return true;
+    }
+    if (strncmp(s + pos, "null", 4) == 0) {
+      pos += 4;
+      return true;
+    }
+    char *end;
+    v->number = strtod(s + pos, &end);
+    if (end == s + pos) return fail("unexpected character");
+    v->type = Json::NUMBER;
+    pos = end - s;
+    return true;
+  }
+
+  bool parse(Json *root) {
+    if (!parseValue(root)) return false;
+    skipSpace();
+    return s[pos] == '\0' || fail("trailing data");
+  }
+};
+
+static void put16(std::vector<uint8_t> &out, unsigned v) {
+  out.push_back(v & 0xFF);
+  out.push_back((v >> 8) & 0xFF);
+}
+
+static void put32(std::vector<uint8_t> &out, unsigned long v) {
+  put16(out, v & 0xFFFF);
+  put16(out, (v >> 16) & 0xFFFF);
+}
+
+// Function to read an integer member within range - prints the problem and returns false otherwise
+static bool getInt(const Json *obj, const char *key, long lo, long hi, long *out) {
+  const Json *v = obj->get(key);
+  if (v == NULL || v->type != Json::NUMBER || v->number < lo || v->number > hi || v->number != (long)v->number) {
+    fprintf(stderr, "'%s' must be an integer from %ld to %ld\n", key, lo, hi);
+    return false;
+  }
+  *out = (long)v->number;
+  return true;
+}
+
+// Function to parse a card UID written as hex, with optional spaces or colons ("13 A3 50 11")
+static bool parseUid(const std::string &text, uint8_t uid[UID_BYTES]) {
+  std::string hex;
+  for (char c : text) {
+    if (isxdigit((unsigned char)c)) hex.push_back(c);
+    else if (c != ' ' && c != ':') return false;
+  }
+  if (hex.size() != UID_BYTES * 2) return false;
+  for (int i = 0; i < UID_BYTES; i++) uid[i] = (uint8_t)strtoul(hex.substr(i * 2, 2).c_str(), NULL, 16);
+  return true;
+}
+
+// One encoded section
+struct Section {
+  uint8_t id;
+  std::vector<uint8_t> body;
+};
+
+// Function to encode every section present in the site file
+static bool buildSections(const Json &site, std::vector<Section> *sections) {
+  long v;
+  if (const Json *pins = site.get("pins")) {
+    Section sec = {CONFIG_SECTION_PINS, {}};
+    for (const char *key : {"sda", "scl", "sck", "miso", "mosi"}) {
+      if (!getInt(pins, key, 0, 21, &v)) return false;
+      sec.body.push_back(v);
+    }
+    sections->push_back(sec);
+  }
+  if (const Json *reader = site.get("reader")) {
+    Section sec = {CONFIG_SECTION_READER, {}};
+    if (!getInt(reader, "ss", 0, 21, &v)) return false;
+    sec.body.push_back(v);
+    if (!getInt(reader, "rst", 0, 21, &v)) return false;
+    sec.body.push_back(v);
+    if (!getInt(reader, "startGain", 0, 5, &v)) return false;
+    sec.body.push_back(v);
+    sections->push_back(sec);
+  }
+  if (const Json *rooms = site.get("rooms")) {
+    if (rooms->type != Json::ARRAY || rooms->items.empty() || rooms->items.size() > 255) {
+      fprintf(stderr, "'rooms' must be a non-empty array\n");
+      return false;
+    }
+    Section roomSec = {CONFIG_SECTION_ROOMS, {(uint8_t)rooms->items.size()}};
+    Section cardSec = {CONFIG_SECTION_CARDS, {0}};
+    for (size_t i = 0; i < rooms->items.size(); i++) {
+      const Json &room = rooms->items[i];
+      if (!getInt(&room, "relay", 0, 21, &v)) return false;
+      roomSec.body.push_back(v);
+      if (!getInt(&room, "power", 0, 21, &v)) return false;
+      roomSec.body.push_back(v);
+      const Json *card = room.get("card");
+      if (card == NULL) continue;
+      uint8_t uid[UID_BYTES];
+      if (card->type != Json::STRING || !parseUid(card->text, uid)) {
+        fprintf(stderr, "room %zu: 'card' must be %d hex bytes\n", i + 1, UID_BYTES);
+        return false;
+      }
+      cardSec.body.push_back(i);
+      cardSec.body.insert(cardSec.body.end(), uid, uid + UID_BYTES);
+      cardSec.body[0]++;
+    }
+    sections->push_back(roomSec);
+    if (cardSec.body[0] > 0) sections->push_back(cardSec);
+  }
+  if (const Json *staff = site.get("staff")) {
+    if (staff->type != Json::ARRAY || staff->items.size() > 255) {
+      fprintf(stderr, "'staff' must be an array of badge UIDs\n");
+      return false;
+    }
+    Section sec = {CONFIG_SECTION_STAFF, {(uint8_t)staff->items.size()}};
+    for (const Json &badge : staff->items) {
+      uint8_t uid[UID_BYTES];
+      if (badge.type != Json::STRING || !parseUid(badge.text, uid)) {
+        fprintf(stderr, "staff badge '%s' must be %d hex bytes\n", badge.text.c_str(), UID_BYTES);
+        return false;
+      }
+      sec.body.insert(sec.body.end(), uid, uid + UID_BYTES);
+    }
+    sections->push_back(sec);
+  }
+  if (const Json *doors = site.get("doors")) {
+    if (doors->type != Json::ARRAY || doors->items.size() > 255) {
+      fprintf(stderr, "'doors' must be an array of room numbers\n");
+      return false;
+    }
+    Section sec = {CONFIG_SECTION_DOORS, {(uint8_t)doors->items.size()}};
+    for (size_t i = 0; i < doors->items.size(); i++) {
+      const Json &room = doors->items[i];  // Numbered from 1 as on the display, 0 for a door without a room
+      if (room.type != Json::NUMBER || room.number < 0 || room.number >= CONFIG_NO_ROOM || room.number != (long)room.number) {
+        fprintf(stderr, "door %zu: room must be a number from 0 (none) to %d\n", i + 1, CONFIG_NO_ROOM - 1);
+        return false;
+      }
+      sec.body.push_back(room.number == 0 ? CONFIG_NO_ROOM : (uint8_t)(room.number - 1));
+    }
+    sections->push_back(sec);
+  }
+  if (const Json *t = site.get("timings")) {
+    Section sec = {CONFIG_SECTION_TIMINGS, {}};
+    if (!getInt(t, "alertMs", 0, 600000, &v)) return false;
+    put32(sec.body, v);
+    if (!getInt(t, "tapPauseMs", 0, 60000, &v)) return false;
+    put32(sec.body, v);
+    if (!getInt(t, "flashMs", 0, 65535, &v)) return false;
+    put16(sec.body, v);
+    if (!getInt(t, "relayTestMs", 0, 65535, &v)) return false;
+    put16(sec.body, v);
+    sections->push_back(sec);
+  }
+  return true;
+}
+
+// Function to compile site JSON text into a blob - returns its size, 0 on error
+static size_t compileSite(const std::string &text, uint8_t *blob, size_t capacity) {
+  Json site;
+  JsonParser parser(text.c_str());
+  if (!parser.parse(&site) || site.type != Json::OBJECT) {
+    fprintf(stderr, "JSON error: %s\n", parser.error.empty() ? "top level must be an object" : parser.error.c_str());
+    return 0;
+  }
+  long revision = 1;
+  if (site.get("revision") && !getInt(&site, "revision", 1, 0x7FFFFFFF, &revision)) return 0;
+
+  std::vector<Section> sections;
+  if (!buildSections(site, &sections)) return 0;
+
+  ConfigBuilder b;
+  configBuildBegin(&b, blob, capacity, sections.size(), revision);
+  for (const Section &sec : sections) configBuildSection(&b, sec.id, 1, sec.body.data(), sec.body.size());
+  size_t size = configBuildEnd(&b);
+  if (size == 0) fprintf(stderr, "config does not fit in %d bytes\n", CONFIG_MAX_SIZE);
+  return size;
+}
+
+static bool readFile(const char *path, std::string *out) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return false;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->append(buf, n);
+  fclose(f);
+  return true;
+}
+
+// Function to time what boot would cost either way - parsing the JSON vs opening the blob and reading every section
+static int runBench(const std::string &text) {
+  uint8_t blob[CONFIG_MAX_SIZE];
+  size_t size = compileSite(text, blob, sizeof(blob));
+  if (size == 0) return 1;
+
+  const int rounds = 20000;
+  auto t0 = std::chrono::steady_clock::now();
+  size_t sink = 0;
+  for (int i = 0; i < rounds; i++) {
+    Json site;
+    JsonParser parser(text.c_str());
+    parser.parse(&site);
+    sink += site.members.size();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    ConfigBlob cfg;
+    configOpen(&cfg, blob, size);
+    for (uint8_t id = CONFIG_SECTION_PINS; id <= CONFIG_SECTION_DOORS; id++) {
+      size_t len;
+      if (configSection(&cfg, id, 1, &len) != NULL) sink += len;
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  double jsonUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+  double blobUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / rounds;
+  printf("JSON   %5zu bytes  parse             %7.2f us (plus heap allocations)\n", text.size(), jsonUs);
+  printf("blob   %5zu bytes  open + all sections %5.2f us (no allocations)\n", size, blobUs);
+  printf("(checksum %zu)\n", sink);
+  return 0;
+}
+
+// Function to run the controller's upload checks on a compiled blob - what it stores and what it refuses
+static int runSelfTest(const std::string &text) {
+  uint8_t blob[CONFIG_MAX_SIZE + CONFIG_TAG_SIZE];
+  size_t size = compileSite(text, blob, CONFIG_MAX_SIZE);
+  if (size == 0) return 1;
+  std::string key = siteKey();
+  const uint8_t *k = (const uint8_t *)key.data();
+  configSign(blob, size, k, key.size(), blob + size);
+  ConfigBlob opened;
+  configOpen(&opened, blob, size);
+  uint32_t revision = opened.revision;
+
+  struct Case {
+    const char *name;
+    size_t flip;              // Byte flipped before the check, or SIZE_MAX for none
+    bool wrongKey;
+    uint32_t inForce;         // Revision the controller runs
+    ConfigUpload expect;
+  };
+  const Case cases[] = {
+    {"newer than the revision in force", SIZE_MAX, false, revision - 1, CONFIG_UPLOAD_OK},
+    {"on a controller without a blob", SIZE_MAX, false, 0, revision > 0 ? CONFIG_UPLOAD_OK : CONFIG_UPLOAD_OLD},
+    {"same revision sent again", SIZE_MAX, false, revision, CONFIG_UPLOAD_OLD},
+    {"rollback below the revision in force", SIZE_MAX, false, revision + 1, CONFIG_UPLOAD_OLD},
+    {"signed with another key", SIZE_MAX, true, 0, CONFIG_UPLOAD_BAD_TAG},
+    {"body changed after signing", size - 1, false, 0, CONFIG_UPLOAD_BAD_TAG},
+    {"tag changed", size, false, 0, CONFIG_UPLOAD_BAD_TAG},
+  };
+  static const char *names[] = {"stored", "bad tag", "damaged", "refused (old)"};
+  static const uint8_t otherKey[] = "another-site-key";
+  bool ok = true;
+  for (const Case &c : cases) {
+    uint8_t copy[sizeof(blob)];
+    memcpy(copy, blob, size + CONFIG_TAG_SIZE);
+    if (c.flip != SIZE_MAX) copy[c.flip] ^= 0x01;
+    ConfigBlob check;
+    ConfigUpload got = configCheckUpload(&check, copy, size, copy + size, c.wrongKey ? otherKey : k,
+                                         c.wrongKey ? sizeof(otherKey) - 1 : key.size(), c.inForce);
+    printf("revision %u %-38s %-14s %s\n", (unsigned)revision, c.name, names[got], got == c.expect ? "ok" : "WRONG");
+    ok = ok && got == c.expect;
+  }
+  printf(ok ? "All checks passed\n" : "CHECKS FAILED\n");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc == 3 && strcmp(argv[1], "--bench") == 0) {
+    std::string text;
+    if (!readFile(argv[2], &text)) { perror(argv[2]); return 1; }
+    return runBench(text);
+  }
+  if (argc == 3 && strcmp(argv[1], "--selftest") == 0) {
+    std::string text;
+    if (!readFile(argv[2], &text)) { perror(argv[2]); return 1; }
+    return runSelfTest(text);
+  }
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s site.json site.bin | --bench site.json | --selftest site.json\n", argv[0]);
+    return 2;
+  }
+
+  std::string text;
+  if (!readFile(argv[1], &text)) { perror(argv[1]); return 1; }
+  uint8_t blob[CONFIG_MAX_SIZE + CONFIG_TAG_SIZE];
+  size_t size = compileSite(text, blob, CONFIG_MAX_SIZE);
+  if (size == 0) return 1;
+  std::string key = siteKey();
+  configSign(blob, size, (const uint8_t *)key.data(), key.size(), blob + size);
+
+  FILE *out = fopen(argv[2], "wb");
+  if (out == NULL || fwrite(blob, 1, size + CONFIG_TAG_SIZE, out) != size + CONFIG_TAG_SIZE) { perror(argv[2]); return 1; }
+  fclose(out);
+  ConfigBlob check;
+  configOpen(&check, blob, size);
+  printf("%s: revision %u, %u sections, %zu bytes + %d byte tag\n", argv[2], (unsigned)check.revision,
+         check.sectionCount, size, CONFIG_TAG_SIZE);
+  return 0;
+}
@@ -0,0 +1,316 @@
+// Display simulator - replays a day of taps at the door against the 128x32 status panel, once the way alerts
+// used to be shown and once through the compositor (display_compositor.h), and counts what each puts on the bus
+// Frames are drawn into an SSD1306 page buffer with a stand-in font: 6 columns per character, 5 of glyph and
+// one blank, the glyph bytes hashed from the character. The layout is the firmware's - title, separator and
+// the two room rows - with alerts drawn by the same rules as drawAlertOverlay().
+//
+// Denial bursts come a few minutes apart: one card tapped 1 to 6 times about a second apart, now and then a
+// second card denied in the middle of it, and rooms switched at random, some while an alert is up. The old
+// way repainted the whole panel for every alert and again when it went, and left room changes off the panel
+// until then. The compositor sends the changed columns of each page. A burst runs from its first alert to
+// the frame taking the overlay down, as reportAlertBurst() counts it. I2C time is 9 bit times per byte at
+// 400 kHz.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/display_sim.cpp src/display_compositor.cpp -o display_sim
+// Run:           ./display_sim [hours] [seed]
+#include "display_compositor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define WIDTH          128
+#define PAGES          4            // 32 rows
+#define ALERT_MS       3000         // timings.alertMs in site_config.json
+#define TICK_MS        10           // loop() checks the alert time this often
+#define BURST_GAP_S    240          // Mean time between denial bursts
+#define ROOM_GAP_S     90           // Mean time between room changes
+#define I2C_US_PER_BYTE 22.5        // 9 bits at 400 kHz
+
+static uint8_t frame[WIDTH * PAGES];
+
+// Function to fill whole pages of a column range - every row this panel draws is page-aligned
+static void fillRect(int x, int y, int w, int h, bool on) {
+  for (int p = y / 8; p < (y + h) / 8 && p < PAGES; p++) {
+    for (int c = x; c < x + w && c < WIDTH; c++) frame[p * WIDTH + c] = on ? 0xff : 0x00;
+  }
+}
+
+// Function to draw text in the stand-in font - inverted draws dark glyphs on a lit background
+static int drawText(int x, int y, const char *text, bool inverted) {
+  uint8_t *row = frame + (y / 8) * WIDTH;
+  for (; *text && x + 6 <= WIDTH; text++, x += 6) {
+    for (int c = 0; c < 6; c++) {
+      uint8_t glyph = 0;
+      if (c < 5 && *text != ' ') glyph = ((uint8_t)*text * 2654435761u >> (c * 5 + 3)) & 0x7f;
+      row[x + c] = inverted ? (uint8_t)~glyph : glyph;
+    }
+  }
+  return x;
+}
+
+// Function to draw the status screen - as updateDisplay() does
+static void drawStatus(const bool *roomOn) {
+  memset(frame, 0, sizeof(frame));
+  drawText(0, 0, "RFID Access System", false);
+  drawText(0, 8, "------------------", false);
+  for (int room = 0; room < 2; room++) {
+    char line[24];
+    snprintf(line, sizeof(line), "Room %d: %s", room + 1, roomOn[room] ? "Occupied" : "Free");
+    drawText(0, 16 + 8 * room, line, false);
+  }
+}
+
+// Function to draw the overlay - as drawAlertOverlay() does
+static void drawOverlay(const AlertOverlay *a) {
+  fillRect(0, 0, WIDTH, 16, false);
+  fillRect(0, 0, WIDTH, 8, true);
+  drawText(1, 0, a->title, true);
+  if (a->repeats > 1) {
+    char count[6];
+    int len = snprintf(count, sizeof(count), "x%u", a->repeats);
+    drawText(WIDTH - 6 * len, 0, count, true);
+  }
+  char line[ALERT_TEXT_SIZE];
+  int len = snprintf(line, sizeof(line), "%s", a->detail);
+  if (len + 3 * a->uidSize < (int)sizeof(line)) {
+    for (int i = 0; i < a->uidSize; i++) len += snprintf(line + len, sizeof(line) - len, " %02x", a->uid[i]);
+  }
+  drawText(0, 8, line, false);
+}
+
+enum EventType { EV_ALERT, EV_ROOM };
+
+struct Event {
+  uint64_t ms;
+  EventType type;
+  int reason;                       // Alert text
+  uint8_t uid[4];                   // Card denied
+  int room;
+};
+
+static const char *const reasons[][2] = {
+  {"ACCESS DENIED", "Unauthorized card"},
+  {"ACCESS DENIED", "All rooms occupied"},
+  {"ACCESS DENIED", "Card revoked"},
+  {"Room 1", "occupied"},
+};
+
+// Per burst size - 1 to 6 alerts, 7 for more
+struct SizeStats {
+  uint32_t bursts;
+  uint64_t oldFrames, oldBytes;
+  uint64_t newFrames, newBytes;
+};
+
+int main(int argc, char **argv) {
+  int hours = argc > 1 ? atoi(argv[1]) : 24;
+  uint32_t seed = argc > 2 ? (uint32_t)atoi(argv[2]) : 1;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  uint64_t endMs = (uint64_t)hours * 3600 * 1000;
+
+  // Traffic - bursts and room changes, in time order once sorted
+  std::vector<Event> events;
+  for (double t = 0;;) {
+    t += -log(1.0 - unit(rng)) * BURST_GAP_S * 1000;
+    if (t >= endMs) break;
+    Event e{};
+    e.ms = (uint64_t)t;
+    e.type = EV_ALERT;
+    e.reason = rng() % 4;
+    for (auto &b : e.uid) b = rng();
+    int taps = 1 + rng() % 6;
+    for (int i = 0; i < taps; i++) {
+      events.push_back(e);
+      if (unit(rng) < 0.15) {       // Another card denied in the middle of the burst
+        Event other = e;
+        other.ms += 300 + rng() % 400;
+        other.reason = rng() % 4;
+        for (auto &b : other.uid) b = rng();
+        events.push_back(other);
+      }
+      if (unit(rng) < 0.2) {        // A room switched while the alert is up
+        Event room{};
+        room.ms = e.ms + 100 + rng() % 800;
+        room.type = EV_ROOM;
+        room.room = rng() % 2;
+        events.push_back(room);
+      }
+      e.ms += 700 + rng() % 800;    // The next tap, after the reader's pause
+    }
+  }
+  for (double t = 0;;) {
+    t += -log(1.0 - unit(rng)) * ROOM_GAP_S * 1000;
+    if (t >= endMs) break;
+    Event room{};
+    room.ms = (uint64_t)t;
+    room.type = EV_ROOM;
+    room.room = rng() % 2;
+    events.push_back(room);
+  }
+  std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.ms < b.ms; });
+
+  const uint32_t full = displayFullFrameBytes(WIDTH, PAGES);
+  bool roomOn[2] = {false, false};
+
+  // Old way - a full frame per alert and per expiry, room changes held back while an alert is up
+  bool oldShowing = false;
+  uint64_t oldStartMs = 0, oldFrames = 0, oldBytes = 0;
+  uint64_t hidden = 0, hiddenMs = 0;
+  std::vector<uint64_t> pendingRooms;   // When each held-back room change happened
+
+  // Compositor
+  AlertOverlay overlay{};
+  uint8_t shadow[WIDTH * PAGES];
+  DisplaySpan spans[DISPLAY_MAX_PAGES];
+  bool shadowValid = false;
+  uint64_t newFrames = 0, newBytes = 0;
+  uint64_t repeatFrames = 0, repeatBytes = 0;
+  uint64_t roomFrames = 0, roomMissed = 0;
+  uint64_t expiries = 0, expiryOutside = 0, appearOutside = 0;
+  uint64_t diffNs = 0, diffs = 0;
+  SizeStats sizes[8] = {};
+  uint64_t burstOldFrames = 0, burstOldBytes = 0;
+
+  // Function to compose and flush one frame - the bytes it put on the bus
+  auto flush = [&]() -> uint32_t {
+    drawStatus(roomOn);
+    if (overlay.active) drawOverlay(&overlay);
+    auto t0 = std::chrono::steady_clock::now();
+    displayDiff(frame, shadow, WIDTH, PAGES, spans, !shadowValid);
+    diffNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    diffs++;
+    shadowValid = true;
+    uint32_t bytes = displayBusBytes(spans, PAGES);
+    if (bytes) {
+      newFrames++;
+      newBytes += bytes;
+    }
+    alertOverlayCountFrame(&overlay, bytes);
+    return bytes;
+  };
+  auto lowerPagesTouched = [&]() {
+    for (int p = 2; p < PAGES; p++) if (spans[p].first <= spans[p].last) return true;
+    return false;
+  };
+
+  flush();                          // Boot frame, sent whole
+  size_t next = 0;
+  for (uint64_t now = 0; now < endMs; now += TICK_MS) {
+    for (; next < events.size() && events[next].ms <= now; next++) {
+      const Event &e = events[next];
+      if (e.type == EV_ROOM) {
+        roomOn[e.room] = !roomOn[e.room];
+        if (oldShowing) {
+          hidden++;
+          pendingRooms.push_back(now);
+        }
+        else {
+          oldFrames++;
+          oldBytes += full;
+        }
+        flush();
+        bool touched = spans[2 + e.room].first <= spans[2 + e.room].last;
+        if (touched) roomFrames++;
+        else roomMissed++;
+        continue;
+      }
+
+      oldShowing = true;
+      oldStartMs = now;
+      oldFrames++;
+      oldBytes += full;
+      burstOldFrames++;
+      burstOldBytes += full;
+
+      bool wasActive = overlay.active;
+      bool repeat = alertOverlayPost(&overlay, reasons[e.reason][0], reasons[e.reason][1], e.uid, 4, now);
+      uint32_t bytes = flush();
+      if (repeat) {
+        repeatFrames++;
+        repeatBytes += bytes;
+      }
+      if (!wasActive && lowerPagesTouched()) appearOutside++;
+    }
+
+    if (oldShowing && now - oldStartMs > ALERT_MS) {
+      oldShowing = false;
+      oldFrames++;
+      oldBytes += full;
+      burstOldFrames++;
+      burstOldBytes += full;
+      for (uint64_t at : pendingRooms) hiddenMs += now - at;
+      pendingRooms.clear();
+    }
+    if (alertOverlayExpire(&overlay, now, ALERT_MS)) {
+      flush();
+      expiries++;
+      if (lowerPagesTouched()) expiryOutside++;
+      SizeStats &s = sizes[overlay.burstAlerts < 7 ? overlay.burstAlerts : 7];
+      s.bursts++;
+      s.oldFrames += burstOldFrames;
+      s.oldBytes += burstOldBytes;
+      s.newFrames += overlay.burstFrames;
+      s.newBytes += overlay.burstBytes;
+      overlay.burstAlerts = overlay.burstFrames = 0;  // As reportAlertBurst() clears them
+      overlay.burstBytes = 0;
+      burstOldFrames = burstOldBytes = 0;
+    }
+  }
+
+  printf("%d h, seed %u: %zu events, full frame %u bytes (%.1f ms on the bus)\n\n", hours, seed, events.size(),
+         full, full * I2C_US_PER_BYTE / 1000);
+  printf("alerts   bursts   old frames   old bytes   old ms   new frames   new bytes   new ms\n");
+  SizeStats total = {};
+  for (int n = 1; n < 8; n++) {
+    const SizeStats &s = sizes[n];
+    if (!s.bursts) continue;
+    double b = s.bursts;
+    printf("%5d%s %8u %12.1f %11.0f %8.1f %12.1f %11.0f %8.1f\n", n, n == 7 ? "+" : " ", s.bursts,
+           s.oldFrames / b, s.oldBytes / b, s.oldBytes / b * I2C_US_PER_BYTE / 1000, s.newFrames / b,
+           s.newBytes / b, s.newBytes / b * I2C_US_PER_BYTE / 1000);
+    total.bursts += s.bursts;
+    total.oldFrames += s.oldFrames;
+    total.oldBytes += s.oldBytes;
+    total.newFrames += s.newFrames;
+    total.newBytes += s.newBytes;
+  }
+  double b = total.bursts ? total.bursts : 1;
+  printf("  all %8u %12.1f %11.0f %8.1f %12.1f %11.0f %8.1f\n\n", total.bursts, total.oldFrames / b,
+         total.oldBytes / b, total.oldBytes / b * I2C_US_PER_BYTE / 1000, total.newFrames / b, total.newBytes / b,
+         total.newBytes / b * I2C_US_PER_BYTE / 1000);
+
+  printf("Whole run:       old %llu frames, %llu bytes - new %llu frames, %llu bytes (%.1f%%)\n",
+         (unsigned long long)oldFrames, (unsigned long long)oldBytes, (unsigned long long)newFrames,
+         (unsigned long long)newBytes, 100.0 * newBytes / (oldBytes ? oldBytes : 1));
+  printf("Repeat frames:   %llu, %.1f bytes each\n", (unsigned long long)repeatFrames,
+         repeatFrames ? (double)repeatBytes / repeatFrames : 0.0);
+  printf("Room changes:    old %llu held back under an alert, %.0f ms on average - new %llu shown at once, "
+         "%llu missed\n", (unsigned long long)hidden, hidden ? (double)hiddenMs / hidden : 0.0,
+         (unsigned long long)roomFrames, (unsigned long long)roomMissed);
+  printf("Overlay frames:  %llu expiries, %llu touched the room rows; %llu appearances touched them\n",
+         (unsigned long long)expiries, (unsigned long long)expiryOutside, (unsigned long long)appearOutside);
+  printf("Host diff cost:  %.0f ns per frame\n\n", diffs ? (double)diffNs / diffs : 0.0);
+
+  bool ok = true;
+  if (total.bursts == 0 || total.newBytes >= total.oldBytes) {
+    printf("FAIL: bursts do not cost fewer bytes than full repaints\n");
+    ok = false;
+  }
+  if (roomMissed) {
+    printf("FAIL: %llu room changes did not reach the panel\n", (unsigned long long)roomMissed);
+    ok = false;
+  }
+  if (expiryOutside || appearOutside) {
+    printf("FAIL: the overlay appearing or expiring sent rows outside it\n");
+    ok = false;
+  }
+  printf(ok ? "All checks passed\n" : "CHECKS FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+// Ward shift simulator for the dwell tracker - 200 beds, a day shift of nurses, doctors, aides and cleaners
+// Generates entry/exit taps with missed exits and double reads, feeds them through dwellTap() in time
+// order, checks every credited second against the simulation's own record and times the pairing.
+//
+// Build (host):  g++ -O2 -std=c++17 -DDWELL_TABLE_SIZE=128 -Iinclude tools/dwell_sim.cpp src/dwell_tracker.cpp -o dwell_sim
+// Run:           ./dwell_sim [beds] [shifts]
+#include "dwell_tracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define SHIFT_S          (12 * 3600)  // Day shift
+#define MISSED_EXIT_PCT  5            // Exit taps forgotten
+#define DOUBLE_READ_PCT  3            // Entry taps read twice
+
+// One staff role - how many badges and what their visits look like
+struct Role {
+  const char *name;
+  int badges;
+  int minVisitS, maxVisitS;
+  int minGapS, maxGapS;
+};
+
+static const Role roles[] = {
+  {"nurse",   45, 120,  900,  60,  600},
+  {"doctor",  12, 180,  600, 120, 1200},
+  {"aide",    10, 120,  600,  60,  900},
+  {"cleaner",  8, 600, 1200, 120,  600},
+};
+
+struct Tap {
+  uint32_t time;
+  uint8_t uid[DWELL_UID_SIZE];
+  uint16_t room;
+};
+
+// Expected results, kept by the simulation while it generates taps
+struct Truth {
+  std::vector<uint64_t> roomSeconds;
+  std::vector<uint32_t> roomVisits;
+  std::vector<uint32_t> roomMissed;
+};
+
+// Function to make a badge UID - scrambled, since real UIDs are not issued in sequence
+static void makeUid(uint32_t id, uint8_t uid[DWELL_UID_SIZE]) {
+  uint32_t x = (id + 1) * 2654435761u;
+  x ^= x >> 15;
+  uid[0] = x >> 24;
+  uid[1] = x >> 16;
+  uid[2] = x >> 8;
+  uid[3] = x;
+}
+
+// Function to generate one shift of taps for every badge - rooms never repeat back to back, so a missed
+// exit is always followed by a tap in another room or by the timeout, as on a real ward round
+static void generateShift(int beds, uint32_t start, std::mt19937 &rng, std::vector<Tap> *taps, Truth *truth) {
+  uint32_t badge = 0;
+  for (const Role &role : roles) {
+    for (int n = 0; n < role.badges; n++, badge++) {
+      uint8_t uid[DWELL_UID_SIZE];
+      makeUid(badge, uid);
+      uint32_t t = start + rng() % 600;
+      int lastRoom = -1;
+      while (t < start + SHIFT_S) {
+        int room;
+        do room = rng() % beds; while (room == lastRoom);
+        lastRoom = room;
+        uint32_t visit = role.minVisitS + rng() % (role.maxVisitS - role.minVisitS + 1);
+
+        taps->push_back({t, {uid[0], uid[1], uid[2], uid[3]}, (uint16_t)room});
+        if ((int)(rng() % 100) < DOUBLE_READ_PCT) taps->push_back({t + 1 + (uint32_t)(rng() % 3), {uid[0], uid[1], uid[2], uid[3]}, (uint16_t)room});
+        if ((int)(rng() % 100) < MISSED_EXIT_PCT) {
+          truth->roomMissed[room]++;
+        }
+        else {
+          taps->push_back({t + visit, {uid[0], uid[1], uid[2], uid[3]}, (uint16_t)room});
+          truth->roomSeconds[room] += visit;
+          truth->roomVisits[room]++;
+        }
+        t += visit + role.minGapS + rng() % (role.maxGapS - role.minGapS + 1);
+      }
+    }
+  }
+}
+
+// Function to feed taps through a fresh tracker the way the firmware does - a short timeout sweep after each tap
+static void replay(DwellTracker *t, std::vector<DwellTotals> &rooms, const std::vector<Tap> &taps) {
+  std::fill(rooms.begin(), rooms.end(), DwellTotals());
+  dwellInit(t, rooms.data(), rooms.size());
+  for (const Tap &tap : taps) {
+    uint32_t duration;
+    dwellTap(t, tap.uid, tap.room, tap.time, &duration);
+    dwellExpire(t, tap.time, 4);
+  }
+  uint32_t end = taps.back().time + DWELL_TIMEOUT_S + 1;
+  dwellExpire(t, end, DWELL_TABLE_SIZE);  // Close whatever is still open after the shift
+}
+
+int main(int argc, char **argv) {
+  int beds = argc > 1 ? atoi(argv[1]) : 200;
+  int shifts = argc > 2 ? atoi(argv[2]) : 1;
+  if (beds < 2 || beds >= DWELL_NO_ROOM) beds = 200;
+  if (shifts < 1) shifts = 1;
+
+  std::mt19937 rng(7);
+  std::vector<Tap> taps;
+  Truth truth = {std::vector<uint64_t>(beds), std::vector<uint32_t>(beds), std::vector<uint32_t>(beds)};
+  for (int s = 0; s < shifts; s++) generateShift(beds, 1767258000u + s * 86400, rng, &taps, &truth);
+  std::stable_sort(taps.begin(), taps.end(), [](const Tap &a, const Tap &b) { return a.time < b.time; });
+
+  static DwellTracker tracker;
+  std::vector<DwellTotals> rooms(beds);
+  replay(&tracker, rooms, taps);
+
+  // Every credited second and every missed exit must match the simulation
+  int wrong = 0;
+  uint64_t seconds = 0, visits = 0, missed = 0;
+  for (int r = 0; r < beds; r++) {
+    if (rooms[r].seconds != truth.roomSeconds[r] || rooms[r].visits != truth.roomVisits[r] ||
+        rooms[r].missedExits != truth.roomMissed[r]) wrong++;
+    seconds += rooms[r].seconds;
+    visits += rooms[r].visits;
+    missed += rooms[r].missedExits;
+  }
+
+  // Throughput - replay the same taps repeatedly
+  const int rounds = 200;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) replay(&tracker, rooms, taps);
+  auto t1 = std::chrono::steady_clock::now();
+  double nsPerTap = std::chrono::duration<double, std::nano>(t1 - t0).count() / rounds / taps.size();
+
+  // Busiest rooms over the rolling window at the end of the last shift
+  uint32_t now = taps.back().time;
+  std::vector<int> order(beds);
+  for (int r = 0; r < beds; r++) order[r] = r;
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return dwellWindowSeconds(&rooms[a].window, now) > dwellWindowSeconds(&rooms[b].window, now);
+  });
+
+  int badges = 0;
+  for (const Role &role : roles) badges += role.badges;
+  printf("%d beds, %d badges, %d shift(s), %zu taps\n", beds, badges, shifts, taps.size());
+  printf("paired visits %llu, dwell %.1f h, missed exits %llu, rooms not matching the simulation: %d\n",
+         (unsigned long long)visits, seconds / 3600.0, (unsigned long long)missed, wrong);
+  printf("pairing %.0f ns per tap (%.1f M taps/s), longest probe %u slots, table %u/%d used\n",
+         nsPerTap, 1000.0 / nsPerTap, (unsigned)tracker.maxProbe, tracker.badgeCount, DWELL_TABLE_SIZE);
+  printf("memory: %zu bytes tracker + %zu bytes room totals\n", sizeof(DwellTracker), sizeof(DwellTotals) * beds);
+  printf("busiest rooms, last %d h:", DWELL_WINDOW_BUCKETS * DWELL_BUCKET_S / 3600);
+  for (int i = 0; i < 5; i++) {
+    printf(" %d:%um/%uv", order[i] + 1, (unsigned)dwellWindowSeconds(&rooms[order[i]].window, now) / 60,
+           (unsigned)dwellWindowVisits(&rooms[order[i]].window, now));
+  }
+  printf("\n");
+  return wrong == 0 ? 0 : 1;
+}
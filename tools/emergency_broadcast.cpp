@@ -0,0 +1,316 @@
+// Emergency broadcaster - sends one signed scene command to every controller at once over multicast
+// (see emergency.h). Wi-Fi never acknowledges or retries multicast frames, so each command is sent again
+// on a backoff schedule: a controller that missed a copy catches the next one a few milliseconds later,
+// and one that was reconnecting catches the once-a-second repeats.
+//
+// Build (host):  g++ -O2 -std=c++17 -pthread -Iinclude tools/emergency_broadcast.cpp src/emergency.cpp src/crypto_service.cpp -o emergency_broadcast
+// Run:           ./emergency_broadcast on [seconds] [interface]      every output on; repeats for seconds (default 30)
+//                ./emergency_broadcast clear [seconds] [interface]   back to normal
+//                ./emergency_broadcast --bench [controllers] [loss%] loopback harness - command-to-relay latency
+// EMERGENCY_KEY and EMERGENCY_SITE in the environment must match the firmware's EMERGENCY_SITE_KEY and
+// EMERGENCY_SITE_ID. The last seq sent is kept in emergency.seq in the current directory.
+#include "emergency.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define REPEAT_MS       1000   // Interval between repeats once the fast schedule is over
+#define BENCH_WINDOW_MS 1000   // A simulated controller not switched by then counts as missed
+#define ACK_TIMEOUT_MS  200    // Per-device baseline - wait for an answer before resending, as a TCP retransmit would
+
+// Send times of the first copies, in milliseconds after the command - dense at first, where it matters
+static const int fastSchedule[] = {0, 5, 10, 20, 40, 80, 160, 320, 640};
+#define FAST_SENDS (int)(sizeof(fastSchedule) / sizeof(fastSchedule[0]))
+
+typedef std::chrono::steady_clock Clock;
+
+static std::string siteKey() {
+  const char *key = getenv("EMERGENCY_KEY");
+  return key != NULL ? key : "change-this-emergency-key";
+}
+
+static uint16_t siteId() {
+  const char *site = getenv("EMERGENCY_SITE");
+  return site != NULL ? atoi(site) : 1;
+}
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Function to pick the next seq - above the last one sent and never below the clock, so a lost seq file
+// cannot make the controllers ignore us
+static uint32_t nextSeq() {
+  uint32_t last = 0;
+  FILE *f = fopen("emergency.seq", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%u", &last) != 1) last = 0;
+    fclose(f);
+  }
+  uint32_t seq = std::max<uint32_t>(last + 1, (uint32_t)time(NULL));
+  f = fopen("emergency.seq", "w");
+  if (f != NULL) {
+    fprintf(f, "%u\n", seq);
+    fclose(f);
+  }
+  return seq;
+}
+
+// Function to open the sending socket on the given interface address, or the default route's
+static int openSender(const char *interface) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  unsigned char ttl = 1, loop = 1;  // Controllers share the building's subnet - never route the command further
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  if (interface != NULL) {
+    in_addr addr;
+    inet_pton(AF_INET, interface, &addr);
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr));
+  }
+  return sock;
+}
+
+static sockaddr_in groupAddress() {
+  sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_port = htons(EMERGENCY_UDP_PORT);
+  inet_pton(AF_INET, EMERGENCY_GROUP, &to.sin_addr);
+  return to;
+}
+
+static int runSend(uint8_t scene, int seconds, const char *interface) {
+  std::string key = siteKey();
+  uint8_t buf[EMERGENCY_SIZE];
+  uint32_t seq = nextSeq();
+  emergencyEncode(buf, siteId(), seq, scene, (const uint8_t *)key.data(), key.size());
+  int sock = openSender(interface);
+  sockaddr_in to = groupAddress();
+
+  Clock::time_point start = Clock::now();
+  int sent = 0;
+  for (int ms = 0; ms <= seconds * 1000; ms = sent < FAST_SENDS ? fastSchedule[sent] : ms + REPEAT_MS) {
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(ms));
+    if (sendto(sock, buf, sizeof(buf), 0, (sockaddr *)&to, sizeof(to)) < 0) perror("sendto");
+    sent++;
+  }
+  close(sock);
+  printf("Scene %s seq %u: %d copies to %s:%d\n", scene == EMERGENCY_SCENE_ALL_ON ? "on" : "clear", seq, sent,
+         EMERGENCY_GROUP, EMERGENCY_UDP_PORT);
+  return 0;
+}
+
+// ---- Loopback harness ----
+
+// One simulated controller - the firmware's receive path on a group socket, and a unicast socket for the
+// per-device baseline
+struct SimController {
+  int group = -1, direct = -1;
+  uint16_t port = 0;
+  EmergencyReceiver rx;
+  std::atomic<int64_t> switchedNs{0};     // When the last command acted on switched the "relays"
+};
+
+static std::atomic<bool> simStop{false};
+
+static void simRun(SimController *sim, double loss, unsigned seed, const std::string &key) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> chance(0, 1);
+  pollfd fds[2] = {{sim->group, POLLIN, 0}, {sim->direct, POLLIN, 0}};
+  uint8_t buf[EMERGENCY_SIZE + 1];
+  while (!simStop) {
+    if (poll(fds, 2, 50) <= 0) continue;
+    for (int i = 0; i < 2; i++) {
+      if (!(fds[i].revents & POLLIN)) continue;
+      sockaddr_in from;
+      socklen_t fromLen = sizeof(from);
+      ssize_t len = recvfrom(fds[i].fd, buf, sizeof(buf), 0, (sockaddr *)&from, &fromLen);
+      if (len <= 0 || chance(rng) < loss) continue;  // Lost on the radio
+      EmergencyResult result = emergencyReceive(&sim->rx, buf, len, (const uint8_t *)key.data(), key.size());
+      if (result == EMERGENCY_ACT) sim->switchedNs = nowNs();
+      if (i == 1 && result != EMERGENCY_INVALID) sendto(fds[i].fd, "ok", 2, 0, (sockaddr *)&from, fromLen);
+    }
+  }
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t i = (size_t)(p * v.size());
+  return v[std::min(i, v.size() - 1)];
+}
+
+// Function to check the codec against the cases the firmware relies on
+static bool codecChecks(const std::string &key) {
+  const uint8_t *k = (const uint8_t *)key.data();
+  EmergencyReceiver rx;
+  emergencyReceiverInit(&rx, 7);
+  uint8_t on[EMERGENCY_SIZE], forged[EMERGENCY_SIZE], foreign[EMERGENCY_SIZE], old[EMERGENCY_SIZE];
+  emergencyEncode(old, 7, 100, EMERGENCY_SCENE_CLEAR, k, key.size());
+  emergencyEncode(on, 7, 101, EMERGENCY_SCENE_ALL_ON, k, key.size());
+  emergencyEncode(forged, 7, 102, EMERGENCY_SCENE_CLEAR, k, key.size());
+  forged[EMERGENCY_SIZE - 1] ^= 1;
+  emergencyEncode(foreign, 8, 103, EMERGENCY_SCENE_CLEAR, k, key.size());
+  bool ok = emergencyReceive(&rx, on, sizeof(on), k, key.size()) == EMERGENCY_ACT && rx.scene == EMERGENCY_SCENE_ALL_ON;
+  ok = ok && emergencyReceive(&rx, on, sizeof(on), k, key.size()) == EMERGENCY_REPEAT;           // Retransmission
+  ok = ok && emergencyReceive(&rx, old, sizeof(old), k, key.size()) == EMERGENCY_REPEAT;         // Replay of an older command
+  ok = ok && emergencyReceive(&rx, forged, sizeof(forged), k, key.size()) == EMERGENCY_INVALID;  // Bad tag
+  ok = ok && emergencyReceive(&rx, foreign, sizeof(foreign), k, key.size()) == EMERGENCY_INVALID;  // Another building
+  ok = ok && emergencyReceive(&rx, on, sizeof(on) - 1, k, key.size()) == EMERGENCY_INVALID;      // Truncated
+  return ok && rx.seq == 101 && rx.scene == EMERGENCY_SCENE_ALL_ON;
+}
+
+// Function to print latency statistics and return the number of controllers never switched
+static int report(const char *name, const std::vector<double> &ms, int commands, int controllers, int datagrams) {
+  int missed = commands * controllers - (int)ms.size();
+  printf("%-12s p50 %8.2f ms  p99 %8.2f ms  max %8.2f ms  %d missed, %d datagrams for %d commands\n", name,
+         percentile(ms, 0.5), percentile(ms, 0.99), percentile(ms, 1.0), missed, datagrams, commands);
+  return missed;
+}
+
+static int runBench(int count, double loss) {
+  std::string key = siteKey();
+  const uint8_t *k = (const uint8_t *)key.data();
+  bool ok = codecChecks(key);
+
+  // Every simulated controller joins the group on the loopback interface, as the real ones do on Wi-Fi
+  std::vector<SimController> sims(count);
+  sockaddr_in group = groupAddress();
+  for (int i = 0; i < count; i++) {
+    SimController &sim = sims[i];
+    emergencyReceiverInit(&sim.rx, siteId());
+    sim.group = socket(AF_INET, SOCK_DGRAM, 0);
+    int yes = 1, rcvbuf = 1 << 16;
+    setsockopt(sim.group, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    setsockopt(sim.group, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = group.sin_port;
+    addr.sin_addr = group.sin_addr;
+    ip_mreq mreq = {};
+    mreq.imr_multiaddr = group.sin_addr;
+    inet_pton(AF_INET, "127.0.0.1", &mreq.imr_interface);
+    sim.direct = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in direct = {};
+    direct.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &direct.sin_addr);
+    socklen_t directLen = sizeof(direct);
+    if (sim.group < 0 || sim.direct < 0 || bind(sim.group, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(sim.group, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ||
+        bind(sim.direct, (sockaddr *)&direct, sizeof(direct)) < 0 || getsockname(sim.direct, (sockaddr *)&direct, &directLen) < 0) {
+      perror("simulated controller socket");
+      return 1;
+    }
+    sim.port = direct.sin_port;
+  }
+  std::vector<std::thread> threads;
+  for (int i = 0; i < count; i++) threads.emplace_back(simRun, &sims[i], loss, 1000 + i, std::cref(key));
+
+  int sock = openSender("127.0.0.1");
+  uint32_t seq = 1;
+  auto allSwitched = [&](int64_t since) {
+    for (const SimController &sim : sims) {
+      if (sim.switchedNs < since) return false;
+    }
+    return true;
+  };
+  auto collect = [&](int64_t since, std::vector<double> &ms) {
+    for (const SimController &sim : sims) {
+      if (sim.switchedNs >= since) ms.push_back((sim.switchedNs - since) / 1e6);
+    }
+  };
+
+  // Multicast - one datagram reaches every controller, repeated on the fast schedule
+  const int commands = 20;
+  std::vector<double> multicastMs;
+  int multicastSent = 0;
+  for (int c = 0; c < commands; c++) {
+    uint8_t buf[EMERGENCY_SIZE];
+    emergencyEncode(buf, siteId(), seq++, c % 2 == 0 ? EMERGENCY_SCENE_ALL_ON : EMERGENCY_SCENE_CLEAR, k, key.size());
+    Clock::time_point start = Clock::now();
+    int64_t startNs = nowNs();
+    for (int sent = 0; !allSwitched(startNs) && Clock::now() - start < std::chrono::milliseconds(BENCH_WINDOW_MS);) {
+      if (sent < FAST_SENDS && Clock::now() >= start + std::chrono::milliseconds(fastSchedule[sent])) {
+        sendto(sock, buf, sizeof(buf), 0, (sockaddr *)&group, sizeof(group));
+        multicastSent++;
+        sent++;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    collect(startNs, multicastMs);
+  }
+
+  // Baseline - the same command to each controller in turn, waiting for its answer as an HTTP or MQTT
+  // request would, and resending after a timeout
+  const int serialCommands = 3;
+  std::vector<double> serialMs;
+  int serialSent = 0;
+  timeval wait = {0, ACK_TIMEOUT_MS * 1000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+  for (int c = 0; c < serialCommands; c++) {
+    uint8_t buf[EMERGENCY_SIZE];
+    emergencyEncode(buf, siteId(), seq++, c % 2 == 0 ? EMERGENCY_SCENE_ALL_ON : EMERGENCY_SCENE_CLEAR, k, key.size());
+    int64_t startNs = nowNs();
+    for (SimController &sim : sims) {
+      sockaddr_in to = {};
+      to.sin_family = AF_INET;
+      to.sin_port = sim.port;
+      inet_pton(AF_INET, "127.0.0.1", &to.sin_addr);
+      for (int attempt = 0; attempt < 10; attempt++) {
+        sendto(sock, buf, sizeof(buf), 0, (sockaddr *)&to, sizeof(to));
+        serialSent++;
+        char ack[4];
+        if (recv(sock, ack, sizeof(ack), 0) > 0) break;
+      }
+    }
+    collect(startNs, serialMs);
+  }
+
+  simStop = true;
+  for (std::thread &t : threads) t.join();
+  for (SimController &sim : sims) {
+    close(sim.group);
+    close(sim.direct);
+  }
+  close(sock);
+
+  printf("%d simulated controllers on loopback, %.0f%% of datagrams lost per controller\n", count, loss * 100);
+  int missed = report("Multicast:", multicastMs, commands, count, multicastSent);
+  report("Per-device:", serialMs, serialCommands, count, serialSent);
+  printf("Codec checks (repeat, replay, forged, foreign site, truncated) %s\n", ok ? "passed" : "FAILED");
+  ok = ok && missed == 0;
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+    int count = argc > 2 ? atoi(argv[2]) : 500;
+    double loss = argc > 3 ? atof(argv[3]) / 100 : 0.05;
+    if (count < 1 || count > 5000 || loss < 0 || loss >= 1) {
+      fprintf(stderr, "Bad bench size\n");
+      return 2;
+    }
+    return runBench(count, loss);
+  }
+  if (argc >= 2 && argc <= 4 && (!strcmp(argv[1], "on") || !strcmp(argv[1], "clear"))) {
+    int seconds = argc > 2 ? atoi(argv[2]) : 30;
+    return runSend(!strcmp(argv[1], "on") ? EMERGENCY_SCENE_ALL_ON : EMERGENCY_SCENE_CLEAR, seconds, argc > 3 ? argv[3] : NULL);
+  }
+  fprintf(stderr, "Usage: emergency_broadcast on|clear [seconds] [interface] or emergency_broadcast --bench [controllers] [loss%%]\n");
+  return 2;
+}
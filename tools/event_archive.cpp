@@ -0,0 +1,523 @@
+#include "event_archive.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARCHIVE_HEADER_SIZE 8       // "EVAR" + version
+#define ARCHIVE_FOOTER_SIZE 16      // Index offset, block count, "EVIX"
+#define ARCHIVE_ENTRY_SIZE  (44 + ARCHIVE_BLOOM_BYTES)  // One serialized ArchiveBlockInfo
+
+// ---- Encoding helpers ----
+
+static void putU16(std::vector<uint8_t> &out, uint16_t v) {
+  out.push_back(v);
+  out.push_back(v >> 8);
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back(v >> (8 * i));
+}
+
+static void putU64(std::vector<uint8_t> &out, uint64_t v) {
+  for (int i = 0; i < 8; i++) out.push_back(v >> (8 * i));
+}
+
+static uint16_t getU16(const uint8_t *p) {
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t getU64(const uint8_t *p) {
+  return getU32(p) | (uint64_t)getU32(p + 4) << 32;
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back((uint8_t)v | 0x80);
+    v >>= 7;
+  }
+  out.push_back((uint8_t)v);
+}
+
+// Function to read a varint - false if it runs past end
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t *v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (p >= end) return false;
+    uint8_t b = *p++;
+    result |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Function to get the bits needed for values 0..max
+static uint8_t bitsFor(uint32_t max) {
+  uint8_t bits = 0;
+  while (bits < 32 && (max >> bits) != 0) bits++;
+  return bits;
+}
+
+// Function to append count values of the given width, least significant bit first
+static void packBits(std::vector<uint8_t> &out, const std::vector<uint32_t> &values, uint8_t bits) {
+  if (bits == 0) return;
+  uint64_t acc = 0;
+  int used = 0;
+  for (uint32_t v : values) {
+    acc |= (uint64_t)v << used;
+    used += bits;
+    while (used >= 8) {
+      out.push_back((uint8_t)acc);
+      acc >>= 8;
+      used -= 8;
+    }
+  }
+  if (used > 0) out.push_back((uint8_t)acc);
+}
+
+static size_t packedSize(uint32_t count, uint8_t bits) {
+  return ((uint64_t)count * bits + 7) / 8;
+}
+
+// Function to unpack count values - reads a 64-bit window per value, byte by byte only near the end
+static void unpackBits(const uint8_t *p, size_t len, uint32_t count, uint8_t bits, std::vector<uint32_t> &values) {
+  values.resize(count);
+  if (bits == 0) {
+    std::fill(values.begin(), values.end(), 0);
+    return;
+  }
+  uint32_t mask = bits == 32 ? 0xFFFFFFFF : (1UL << bits) - 1;
+  uint64_t bit = 0;
+  for (uint32_t i = 0; i < count; i++, bit += bits) {
+    size_t at = bit >> 3;
+    uint64_t window = 0;
+    if (at + 8 <= len) memcpy(&window, p + at, 8);  // Little-endian host
+    else for (size_t k = 0; at + k < len; k++) window |= (uint64_t)p[at + k] << (8 * k);
+    values[i] = (uint32_t)(window >> (bit & 7)) & mask;
+  }
+}
+
+// Function to compute a CRC-32 (IEEE, as cryptoCrc32) a byte at a time - the firmware's nibble table is
+// small but runs at a third of the speed, and a full scan checks every block
+static uint32_t crc32(const uint8_t *data, size_t len) {
+  static const std::vector<uint32_t> table = [] {  // Built once, safely when several threads get here first
+    std::vector<uint32_t> t(256);
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+// Function to pick the three Bloom filter bits for a UID - FNV-1a, one byte of the hash per bit
+static void bloomBits(const uint8_t *uid, uint8_t len, uint8_t bits[3]) {
+  uint32_t h = 2166136261u;
+  for (uint8_t i = 0; i < len; i++) h = (h ^ uid[i]) * 16777619u;
+  bits[0] = h;
+  bits[1] = h >> 8;
+  bits[2] = h >> 16;
+}
+
+static bool uidEqual(const uint8_t *a, uint8_t aLen, const uint8_t *b, uint8_t bLen) {
+  return aLen == bLen && memcmp(a, b, aLen) == 0;
+}
+
+// ---- Writer ----
+
+// Function to create an archive file
+bool archiveCreate(ArchiveWriter *w, const char *path) {
+  w->file = fopen(path, "wb");
+  if (w->file == NULL) return false;
+  std::vector<uint8_t> header = {'E', 'V', 'A', 'R'};
+  putU32(header, ARCHIVE_VERSION);
+  w->bytes = fwrite(header.data(), 1, header.size(), w->file);
+  return w->bytes == ARCHIVE_HEADER_SIZE;
+}
+
+// Function to look up or add a controller name
+uint16_t archiveController(ArchiveWriter *w, const std::string &name) {
+  auto found = w->controllers.emplace(name, w->names.size());
+  if (!found.second) return found.first->second;
+  w->names.push_back(name);
+  w->pending.emplace_back();
+  w->lastTime.push_back(0);
+  return w->names.size() - 1;
+}
+
+// Function to encode and write one controller's pending events as a block
+static bool flushBlock(ArchiveWriter *w, uint16_t controller) {
+  std::vector<ArchiveEvent> &events = w->pending[controller];
+  if (events.empty()) return true;
+  uint32_t count = events.size();
+
+  ArchiveBlockInfo info = {};
+  info.offset = w->bytes;
+  info.count = count;
+  info.controller = controller;
+  info.minTime = events.front().timeMs;
+  info.maxTime = events.back().timeMs;
+  info.minRoom = 0xFFFF;
+  uint8_t minType = 0xFF, maxType = 0;
+
+  // UID dictionary - cards in order of first appearance, so a guest's taps share one entry
+  std::vector<const ArchiveEvent *> dict;
+  std::unordered_map<std::string, uint32_t> dictIndex;
+  std::vector<uint32_t> uids(count), rooms(count), types(count);
+  for (uint32_t i = 0; i < count; i++) {
+    const ArchiveEvent &e = events[i];
+    auto found = dictIndex.emplace(std::string((const char *)e.uid, e.uidLen), dict.size());
+    if (found.second) {
+      dict.push_back(&e);
+      uint8_t bits[3];
+      bloomBits(e.uid, e.uidLen, bits);
+      for (int k = 0; k < 3; k++) info.uidBloom[bits[k] / 8] |= 1 << (bits[k] % 8);
+    }
+    uids[i] = found.first->second;
+    uint16_t room = e.room == ARCHIVE_NO_ROOM ? 0 : e.room + 1;
+    rooms[i] = room;
+    if (room < info.minRoom) info.minRoom = room;
+    if (room > info.maxRoom) info.maxRoom = room;
+    types[i] = e.type;
+    if (e.type < minType) minType = e.type;
+    if (e.type > maxType) maxType = e.type;
+    info.typeMask |= 1U << (e.type & 15);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    rooms[i] -= info.minRoom;   // Frame of reference - a block of rooms 1-16 needs 4 bits a room
+    types[i] -= minType;
+  }
+  uint8_t uidBits = bitsFor(dict.size() - 1);
+  uint8_t roomBits = bitsFor(info.maxRoom - info.minRoom);
+  uint8_t typeBits = bitsFor(maxType - minType);
+
+  std::vector<uint8_t> block;
+  putVarint(block, count);
+  putVarint(block, dict.size());
+  block.push_back(uidBits);
+  block.push_back(roomBits);
+  block.push_back(typeBits);
+  block.push_back(minType);
+  for (const ArchiveEvent *e : dict) {
+    block.push_back(e->uidLen);
+    block.insert(block.end(), e->uid, e->uid + e->uidLen);
+  }
+
+  // Time column - first time, then each delta's change from the one before
+  std::vector<uint8_t> timeCol;
+  putVarint(timeCol, info.minTime);
+  uint64_t prevDelta = 0;
+  for (uint32_t i = 1; i < count; i++) {
+    uint64_t delta = events[i].timeMs - events[i - 1].timeMs;
+    putVarint(timeCol, zigzag((int64_t)(delta - prevDelta)));
+    prevDelta = delta;
+  }
+  putVarint(block, timeCol.size());
+  block.insert(block.end(), timeCol.begin(), timeCol.end());
+  packBits(block, uids, uidBits);
+  packBits(block, rooms, roomBits);
+  packBits(block, types, typeBits);
+
+  info.size = block.size();
+  info.crc = crc32(block.data(), block.size());
+  if (fwrite(block.data(), 1, block.size(), w->file) != block.size()) return false;
+  w->bytes += block.size();
+  w->index.push_back(info);
+  events.clear();
+  return true;
+}
+
+// Function to add one event
+bool archiveAppend(ArchiveWriter *w, const ArchiveEvent &event) {
+  if (w->file == NULL || event.controller >= w->names.size() || event.uidLen > ARCHIVE_UID_MAX) return false;
+  if (event.timeMs < w->lastTime[event.controller]) return false;
+  std::vector<ArchiveEvent> &events = w->pending[event.controller];
+  if (!events.empty() && event.timeMs - events.front().timeMs >= ARCHIVE_BLOCK_SPAN_MS && !flushBlock(w, event.controller)) return false;
+  if (events.capacity() == 0) events.reserve(ARCHIVE_BLOCK_EVENTS);
+  events.push_back(event);
+  w->lastTime[event.controller] = event.timeMs;
+  w->events++;
+  if (events.size() >= ARCHIVE_BLOCK_EVENTS) return flushBlock(w, event.controller);
+  return true;
+}
+
+// Function to write the blocks still being filled and the index
+bool archiveFinish(ArchiveWriter *w) {
+  if (w->file == NULL) return false;
+  bool ok = true;
+  for (size_t c = 0; c < w->pending.size() && ok; c++) {
+    ok = flushBlock(w, c);
+    std::vector<ArchiveEvent>().swap(w->pending[c]);
+  }
+  std::vector<uint8_t> tail;
+  for (const ArchiveBlockInfo &b : w->index) {
+    putU64(tail, b.offset);
+    putU32(tail, b.size);
+    putU32(tail, b.count);
+    putU64(tail, b.minTime);
+    putU64(tail, b.maxTime);
+    putU16(tail, b.controller);
+    putU16(tail, b.minRoom);
+    putU16(tail, b.maxRoom);
+    putU16(tail, b.typeMask);
+    putU32(tail, b.crc);
+    tail.insert(tail.end(), b.uidBloom, b.uidBloom + ARCHIVE_BLOOM_BYTES);
+  }
+  putU16(tail, w->names.size());
+  for (const std::string &name : w->names) {
+    putU16(tail, name.size());
+    tail.insert(tail.end(), name.begin(), name.end());
+  }
+  putU64(tail, w->bytes);
+  putU32(tail, w->index.size());
+  tail.insert(tail.end(), {'E', 'V', 'I', 'X'});
+  ok = ok && fwrite(tail.data(), 1, tail.size(), w->file) == tail.size();
+  w->bytes += tail.size();
+  ok = fclose(w->file) == 0 && ok;
+  w->file = NULL;
+  return ok;
+}
+
+// ---- Reader ----
+
+// Function to open an archive for queries
+bool archiveOpen(ArchiveReader *r, const char *path) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < ARCHIVE_HEADER_SIZE + ARCHIVE_FOOTER_SIZE) {
+    ::close(fd);
+    return false;
+  }
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m == MAP_FAILED) return false;
+  r->map = (const uint8_t *)m;
+  r->mapSize = st.st_size;
+
+  const uint8_t *foot = r->map + r->mapSize - ARCHIVE_FOOTER_SIZE;
+  uint64_t indexOffset = getU64(foot);
+  uint32_t blocks = getU32(foot + 8);
+  bool ok = memcmp(r->map, "EVAR", 4) == 0 && getU32(r->map + 4) == ARCHIVE_VERSION && memcmp(foot + 12, "EVIX", 4) == 0 &&
+            indexOffset >= ARCHIVE_HEADER_SIZE && indexOffset + (uint64_t)blocks * ARCHIVE_ENTRY_SIZE + 2 <= r->mapSize - ARCHIVE_FOOTER_SIZE;
+  if (!ok) {
+    archiveClose(r);
+    return false;
+  }
+  const uint8_t *p = r->map + indexOffset;
+  r->index.resize(blocks);
+  r->events = 0;
+  for (ArchiveBlockInfo &b : r->index) {
+    b.offset = getU64(p);
+    b.size = getU32(p + 8);
+    b.count = getU32(p + 12);
+    b.minTime = getU64(p + 16);
+    b.maxTime = getU64(p + 24);
+    b.controller = getU16(p + 32);
+    b.minRoom = getU16(p + 34);
+    b.maxRoom = getU16(p + 36);
+    b.typeMask = getU16(p + 38);
+    b.crc = getU32(p + 40);
+    memcpy(b.uidBloom, p + 44, ARCHIVE_BLOOM_BYTES);
+    p += ARCHIVE_ENTRY_SIZE;
+    r->events += b.count;
+    if (b.offset < ARCHIVE_HEADER_SIZE || b.offset + b.size > indexOffset) ok = false;
+  }
+  const uint8_t *end = foot;
+  uint16_t names = getU16(p);
+  p += 2;
+  r->names.clear();
+  for (uint16_t i = 0; i < names && ok; i++) {
+    if (p + 2 > end || p + 2 + getU16(p) > end) ok = false;
+    else {
+      r->names.emplace_back((const char *)p + 2, getU16(p));
+      p += 2 + getU16(p);
+    }
+  }
+  if (!ok) archiveClose(r);
+  return ok;
+}
+
+// Function to unmap an archive
+void archiveClose(ArchiveReader *r) {
+  if (r->map != NULL) munmap((void *)r->map, r->mapSize);
+  r->map = NULL;
+  r->mapSize = 0;
+  r->index.clear();
+  r->names.clear();
+  r->events = 0;
+}
+
+// Function to check a block's index entry against a query - true if the block may hold a match
+static bool blockMayMatch(const ArchiveBlockInfo &b, const ArchiveQuery &q) {
+  if (q.controller != ARCHIVE_ANY && b.controller != q.controller) return false;
+  if (b.maxTime < q.fromMs || b.minTime > q.toMs) return false;
+  if (!(b.typeMask & q.typeMask)) return false;
+  if (q.room != ARCHIVE_ANY) {
+    uint16_t room = q.room == ARCHIVE_NO_ROOM ? 0 : q.room + 1;
+    if (room < b.minRoom || room > b.maxRoom) return false;
+  }
+  if (q.uidLen) {
+    uint8_t bits[3];
+    bloomBits(q.uid, q.uidLen, bits);
+    for (int k = 0; k < 3; k++) {
+      if (!(b.uidBloom[bits[k] / 8] & (1 << (bits[k] % 8)))) return false;
+    }
+  }
+  return true;
+}
+
+// Function to decode one block and visit its matching events - sets *stop when the visitor asks to stop
+static bool decodeBlock(const ArchiveReader *r, const ArchiveBlockInfo &b, const ArchiveQuery &q, ArchiveVisitor visit,
+                        void *ctx, ArchiveQueryStats *stats, ArchiveScratch *s, bool *stop) {
+  const uint8_t *p = r->map + b.offset;
+  const uint8_t *end = p + b.size;
+  stats->bytesRead += b.size;
+  if (crc32(p, b.size) != b.crc) return false;
+
+  uint64_t count, dictSize;
+  if (!getVarint(p, end, &count) || !getVarint(p, end, &dictSize) || count != b.count || p + 4 > end) return false;
+  uint8_t uidBits = p[0], roomBits = p[1], typeBits = p[2], minType = p[3];
+  p += 4;
+  if (uidBits > 32 || roomBits > 32 || typeBits > 32) return false;
+
+  // Dictionary - a UID query stops here when the card never tapped in this block
+  std::vector<const uint8_t *> dict(dictSize);
+  int64_t wanted = -1;
+  for (uint64_t d = 0; d < dictSize; d++) {
+    if (p >= end || p + 1 + *p > end || *p > ARCHIVE_UID_MAX) return false;
+    dict[d] = p;
+    if (q.uidLen && uidEqual(p + 1, *p, q.uid, q.uidLen)) wanted = d;
+    p += 1 + *p;
+  }
+  if (q.uidLen && wanted < 0) {
+    stats->blocksNoUid++;
+    return true;
+  }
+
+  uint64_t timeLen;
+  if (!getVarint(p, end, &timeLen) || p + timeLen > end) return false;
+  const uint8_t *timeEnd = p + timeLen;
+  s->times.resize(count);
+  uint64_t t, prevDelta = 0;
+  if (count > 0 && !getVarint(p, timeEnd, &t)) return false;
+  if (count > 0) s->times[0] = t;
+  for (uint64_t i = 1; i < count; i++) {
+    uint64_t dod;
+    if (!getVarint(p, timeEnd, &dod)) return false;
+    prevDelta += unzigzag(dod);
+    t += prevDelta;
+    s->times[i] = t;
+  }
+  p = timeEnd;
+
+  size_t uidLen = packedSize(count, uidBits), roomLen = packedSize(count, roomBits), typeLen = packedSize(count, typeBits);
+  if (p + uidLen + roomLen + typeLen > end) return false;
+  unpackBits(p, uidLen, count, uidBits, s->uids);
+  unpackBits(p + uidLen, roomLen, count, roomBits, s->rooms);
+  unpackBits(p + uidLen + roomLen, typeLen, count, typeBits, s->types);
+  stats->blocksDecoded++;
+  stats->eventsDecoded += count;
+
+  uint32_t roomValue = 0;
+  if (q.room != ARCHIVE_ANY) roomValue = (q.room == ARCHIVE_NO_ROOM ? 0 : q.room + 1) - b.minRoom;
+  ArchiveEvent e;
+  e.controller = b.controller;
+  for (uint64_t i = 0; i < count; i++) {
+    if (s->times[i] < q.fromMs) continue;
+    if (s->times[i] > q.toMs) break;  // Times only grow within a block
+    if (q.room != ARCHIVE_ANY && s->rooms[i] != roomValue) continue;
+    uint8_t type = s->types[i] + minType;
+    if (!(q.typeMask & (1U << (type & 15)))) continue;
+    uint32_t d = s->uids[i];
+    if (d >= dictSize) return false;
+    if (wanted >= 0 && d != wanted) continue;
+    e.timeMs = s->times[i];
+    e.type = type;
+    uint32_t room = s->rooms[i] + b.minRoom;
+    e.room = room == 0 ? ARCHIVE_NO_ROOM : room - 1;
+    e.uidLen = dict[d][0];
+    memcpy(e.uid, dict[d] + 1, e.uidLen);
+    if (!visit(&e, ctx)) {
+      *stop = true;
+      break;
+    }
+  }
+  return true;
+}
+
+// Function to run a query - blocks are pruned on their index entry before any of their bytes are read
+bool archiveQuery(ArchiveReader *r, const ArchiveQuery &q, ArchiveVisitor visit, void *ctx, ArchiveQueryStats *stats) {
+  ArchiveQueryStats local;
+  if (stats == NULL) stats = &local;
+  bool stop = false;
+  for (const ArchiveBlockInfo &b : r->index) {
+    if (!blockMayMatch(b, q)) {
+      stats->blocksSkipped++;
+      continue;
+    }
+    if (!decodeBlock(r, b, q, visit, ctx, stats, &r->scratch, &stop)) return false;
+    if (stop) break;
+  }
+  return true;
+}
+
+// Function to run a query over one block of the index
+bool archiveQueryBlock(const ArchiveReader *r, size_t block, const ArchiveQuery &q, ArchiveVisitor visit, void *ctx,
+                       ArchiveQueryStats *stats, ArchiveScratch *scratch) {
+  ArchiveQueryStats local;
+  if (stats == NULL) stats = &local;
+  const ArchiveBlockInfo &b = r->index[block];
+  if (!blockMayMatch(b, q)) {
+    stats->blocksSkipped++;
+    return true;
+  }
+  bool stop = false;
+  return decodeBlock(r, b, q, visit, ctx, stats, scratch, &stop);
+}
+
+// Function to parse "13 a3 50 11" or "13A35011" into a UID
+uint8_t archiveParseUid(const char *s, uint8_t uid[ARCHIVE_UID_MAX]) {
+  uint8_t len = 0;
+  int high = -1;
+  for (; *s != '\0' && *s != '\n'; s++) {
+    char c = *s;
+    if (c == ' ' || c == ':') {
+      if (high >= 0) return 0;  // Half a byte
+      continue;
+    }
+    int v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (v < 0) break;
+    if (high < 0) high = v;
+    else {
+      if (len == ARCHIVE_UID_MAX) return 0;
+      uid[len++] = high << 4 | v;
+      high = -1;
+    }
+  }
+  return high < 0 ? len : 0;
+}
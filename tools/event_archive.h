@@ -0,0 +1,141 @@
+// Event archive - years of controller tap history in a compact file that stays quick to query, for
+// billing and audits on the host. Raw text logs run to ~100 bytes per tap and JSON to more; here a
+// tap costs a few bytes.
+//
+// Events are kept in blocks of up to ARCHIVE_BLOCK_EVENTS, one controller per block, each stored as
+// columns:
+//   time        delta-of-delta, zigzag varints - taps at a steady rhythm cost a byte each
+//   uid         dictionary of the block's distinct cards, then one bit-packed index per event
+//   room        bit-packed, room + 1 so 0 means no room
+//   type        bit-packed JOURNAL_ event type - the decision the controller took
+// Every block has an index entry at the end of the file with its controller, time range, room range and
+// a mask of the event types and a Bloom filter of the cards in it. A query reads the index first and only
+// touches blocks that can hold a match; a block that gets past the Bloom filter without holding the card is
+// still ruled out by its dictionary before any column is decoded. Blocks are cut at ARCHIVE_BLOCK_SPAN_MS
+// as well as at ARCHIVE_BLOCK_EVENTS, so a quiet controller's blocks still cover a short time range.
+//
+// Layout: "EVAR" version | block ... | index entries | controller names | index offset, block count, "EVIX"
+// Integers are little endian; each block carries a CRC-32 of its bytes.
+#ifndef EVENT_ARCHIVE_H
+#define EVENT_ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define ARCHIVE_VERSION      1
+#define ARCHIVE_BLOCK_EVENTS 8192       // Most events per block
+#define ARCHIVE_BLOCK_SPAN_MS (7 * 86400000ULL)  // Longest time per block - a query for a day or a month decodes little else
+#define ARCHIVE_BLOOM_BYTES  32         // UID Bloom filter per block - 256 bits
+#define ARCHIVE_UID_MAX      10         // Longest card UID - triple-size ISO 14443
+#define ARCHIVE_NO_ROOM      0xFFFF     // Room value for events without a room
+#define ARCHIVE_ANY          0xFFFF     // Query value matching any controller or room
+
+// One archived event
+struct ArchiveEvent {
+  uint64_t timeMs;                    // Unix time in milliseconds
+  uint16_t controller;                // Index into the archive's controller names
+  uint16_t room;                      // Room index or ARCHIVE_NO_ROOM
+  uint8_t type;                       // JOURNAL_ event type
+  uint8_t uidLen;                     // 0 for events without a card
+  uint8_t uid[ARCHIVE_UID_MAX];
+};
+
+// Index entry of one block - all of them are loaded when the archive is opened
+struct ArchiveBlockInfo {
+  uint64_t offset;                    // Block start in the file
+  uint32_t size;                      // Block bytes
+  uint32_t count;                     // Events in the block
+  uint64_t minTime, maxTime;
+  uint16_t controller;
+  uint16_t minRoom, maxRoom;          // Stored as room + 1 - 0 is no room
+  uint16_t typeMask;                  // Bit n set when an event of type n is in the block
+  uint32_t crc;
+  uint8_t uidBloom[ARCHIVE_BLOOM_BYTES];  // Three bits per card seen
+};
+
+// Query - every condition must match
+struct ArchiveQuery {
+  uint64_t fromMs = 0;                // Earliest event time, inclusive
+  uint64_t toMs = UINT64_MAX;         // Latest event time, inclusive
+  uint16_t controller = ARCHIVE_ANY;
+  uint16_t room = ARCHIVE_ANY;        // ARCHIVE_NO_ROOM matches events without a room
+  uint16_t typeMask = 0xFFFF;         // Bit n to include events of type n
+  uint8_t uidLen = 0;                 // Non-zero to only return events for this card
+  uint8_t uid[ARCHIVE_UID_MAX] = {0};
+};
+
+// Work done by a query - shows how much of the archive the index ruled out
+struct ArchiveQueryStats {
+  uint32_t blocksSkipped = 0;         // Ruled out by their index entry
+  uint32_t blocksNoUid = 0;           // Passed the Bloom filter, then ruled out by their UID dictionary
+  uint32_t blocksDecoded = 0;         // Columns decoded
+  uint64_t eventsDecoded = 0;
+  uint64_t bytesRead = 0;             // Block bytes touched
+};
+
+// Called for each matching event, block by block, in time order within a block - return false to stop
+typedef bool (*ArchiveVisitor)(const ArchiveEvent *event, void *ctx);
+
+// Archive being written - events must arrive in time order per controller
+struct ArchiveWriter {
+  FILE *file = NULL;
+  std::vector<std::string> names;                  // Controller names by index
+  std::unordered_map<std::string, uint16_t> controllers;
+  std::vector<std::vector<ArchiveEvent>> pending;  // Block being filled, per controller
+  std::vector<uint64_t> lastTime;                  // Newest event per controller
+  std::vector<ArchiveBlockInfo> index;
+  uint64_t events = 0;
+  uint64_t bytes = 0;                              // File size so far
+};
+
+// Columns of the block being decoded, reused across blocks - one per thread scanning an archive
+struct ArchiveScratch {
+  std::vector<uint64_t> times;
+  std::vector<uint32_t> uids, rooms, types;
+};
+
+// Archive open for queries - the file is mapped, so a block costs nothing until a query touches it
+struct ArchiveReader {
+  const uint8_t *map = NULL;
+  size_t mapSize = 0;
+  std::vector<std::string> names;
+  std::vector<ArchiveBlockInfo> index;
+  uint64_t events = 0;
+  ArchiveScratch scratch;                          // For archiveQuery
+};
+
+// Function to create an archive file
+bool archiveCreate(ArchiveWriter *w, const char *path);
+
+// Function to look up or add a controller name - returns its index
+uint16_t archiveController(ArchiveWriter *w, const std::string &name);
+
+// Function to add one event - false if it is older than its controller's previous event, or on a write error
+bool archiveAppend(ArchiveWriter *w, const ArchiveEvent &event);
+
+// Function to write the blocks still being filled and the index - the file is unreadable until this succeeds
+bool archiveFinish(ArchiveWriter *w);
+
+// Function to open an archive for queries - false if it is missing, truncated or not an archive
+bool archiveOpen(ArchiveReader *r, const char *path);
+
+// Function to unmap an archive
+void archiveClose(ArchiveReader *r);
+
+// Function to run a query - false if a block it read is corrupt
+bool archiveQuery(ArchiveReader *r, const ArchiveQuery &q, ArchiveVisitor visit, void *ctx, ArchiveQueryStats *stats);
+
+// Function to run a query over one block of the index - false if the block is corrupt. Touches nothing in
+// the reader, so threads may each take blocks of one archive with their own scratch and stats
+bool archiveQueryBlock(const ArchiveReader *r, size_t block, const ArchiveQuery &q, ArchiveVisitor visit, void *ctx,
+                       ArchiveQueryStats *stats, ArchiveScratch *scratch);
+
+// Function to parse "13 a3 50 11" or "13A35011" into a UID - returns its length, 0 if it is not one
+uint8_t archiveParseUid(const char *s, uint8_t uid[ARCHIVE_UID_MAX]);
+
+#endif
@@ -0,0 +1,410 @@
+// Hot-standby simulator - runs the firmware's replication and role logic (hot_standby.h) for two controllers
+// exchanging real UDP packets over loopback, on a virtual millisecond clock
+// The active controller checks rooms in and out every few hundred milliseconds. Then, over and over, one of:
+//   crash            the active controller dies; the standby must take over within the failover window,
+//                    holding the room table the dead one had. The dead one reboots empty and must catch up
+//   isolate standby  the standby loses its network for 3 s - it must not take over the lines
+//   isolate active   the active controller loses its network for 3 s
+// Each runs with the supervisor outputs cross-wired (HS_PEER_CLAIM_PIN) and without, with and without packet
+// loss. Any millisecond with both controllers driving the lines is counted as split brain. Without the wire an
+// isolated active controller cannot know its partner took over; that split is reported, and must end as soon
+// as the network is back.
+//
+// Forged packets arrive throughout - from a third socket on the LAN, and with the partner's address but no
+// key - claiming to be active with a higher term. They must not demote anyone or reach the room table.
+// In half of the crashes the active controller's recorded traffic is replayed to the standby with the dead
+// controller's address, from the crash until the reboot: it must neither delay the takeover nor demote anyone.
+// Once the standby takes over, the tape holds its own packets too, so they are reflected back to it.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/hot_standby_sim.cpp src/hot_standby.cpp src/state_sync.cpp src/crypto_service.cpp -o hot_standby_sim
+// Run:           ./hot_standby_sim [cycles] [seed]
+#include "hot_standby.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define ROOMS          8
+#define TAP_GAP_MS     300          // Mean time between room changes on the active controller
+#define ISOLATE_MS     3000
+#define REBOOT_MS      2000         // A crashed controller is back this long after it died
+#define FORGE_GAP_MS   5000         // Mean time between forged packets
+#define FORGED_TERM    1000000      // Added to the target's term - no run takes over that often
+#define TAPE_PACKETS   64           // Recent packets of the active controller kept for replay
+#define REPLAY_GAP_MS  20           // One replayed packet this often
+
+static const uint8_t siteKey[] = "change-this-standby-key";
+static const uint8_t wrongKey[] = "guessed-key";
+
+// UDP socket bound to a loopback port the kernel picks
+struct HostSocket {
+  int fd;
+  uint16_t port;
+};
+
+// Function to open a non-blocking loopback socket
+static bool socketOpen(HostSocket *s) {
+  s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (s->fd < 0 || bind(s->fd, (sockaddr *)&addr, sizeof(addr)) < 0 || getsockname(s->fd, (sockaddr *)&addr, &len) < 0) {
+    perror("socket");
+    return false;
+  }
+  fcntl(s->fd, F_SETFL, O_NONBLOCK);
+  s->port = ntohs(addr.sin_port);
+  return true;
+}
+
+// Function to send a datagram to a loopback port
+static void socketSend(const HostSocket *s, uint16_t port, const uint8_t *data, size_t len) {
+  sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  to.sin_port = htons(port);
+  sendto(s->fd, data, len, 0, (sockaddr *)&to, sizeof(to));
+}
+
+// One controller - its replication state, room table and network
+struct Controller {
+  HsNode node;
+  HsPort port;
+  HostSocket sock;
+  uint16_t peerPort;
+  bool preferred;
+  bool alive;
+  bool linkUp;
+  double loss;
+  std::mt19937 *rng;
+  std::vector<std::vector<uint8_t>> *tape;  // Packets seen on the network from the active controller
+  bool on[ROOMS], hasOwner[ROOMS];
+  uint8_t owner[ROOMS][SYNC_UID_SIZE];
+  uint32_t version[ROOMS];
+  uint32_t seq;
+};
+
+// Function to put a packet on the network - dropped with the sender's link down, or at random
+static void controllerSend(void *ctx, const uint8_t *pkt, size_t len) {
+  Controller *c = (Controller *)ctx;
+  if (!c->alive || !c->linkUp) return;
+  if (std::uniform_real_distribution<double>(0, 1)(*c->rng) < c->loss) return;
+  if (c->node.active) {                        // Recorded by an attacker on the LAN
+    if (c->tape->size() == TAPE_PACKETS) c->tape->erase(c->tape->begin());
+    c->tape->push_back(std::vector<uint8_t>(pkt, pkt + len));
+  }
+  socketSend(&c->sock, c->peerPort, pkt, len);
+}
+
+// Function to boot a controller - empty room table, in standby
+static void controllerBoot(Controller *c, uint32_t now) {
+  memset(c->on, 0, sizeof(c->on));
+  memset(c->hasOwner, 0, sizeof(c->hasOwner));
+  memset(c->owner, 0, sizeof(c->owner));
+  memset(c->version, 0, sizeof(c->version));
+  c->seq = 0;
+  c->alive = true;
+  hsInit(&c->node, c->preferred, now);
+  c->port = {controllerSend, c, siteKey, sizeof(siteKey) - 1, {ROOMS, c->on, c->hasOwner, c->owner}, &c->seq};
+}
+
+// Function to count rooms that differ between two tables
+static int tableDiff(const Controller &a, const Controller &b) {
+  int diff = 0;
+  for (int r = 0; r < ROOMS; r++) {
+    if (a.on[r] != b.on[r] || a.hasOwner[r] != b.hasOwner[r] ||
+        (a.hasOwner[r] && memcmp(a.owner[r], b.owner[r], SYNC_UID_SIZE) != 0)) diff++;
+  }
+  return diff;
+}
+
+// Results of one configuration
+struct Stats {
+  std::vector<uint32_t> failoverMs, resyncMs;
+  uint32_t crashes = 0, diverged = 0, lagged = 0, failed = 0;
+  uint32_t isolatedPromotions = 0, splitMs = 0, splitUnresolved = 0, unwiredSplitMs = 0;
+  uint32_t forged = 0, forgedHeard = 0, rejected = 0;
+  uint32_t replays = 0, replaysHeard = 0;
+};
+
+// A pair of controllers on one clock
+struct Pair {
+  Controller c[2];
+  HostSocket attacker;
+  bool wired;
+  uint32_t now = 1000;
+  uint32_t nextTap = 0, nextForge = 0;
+  std::mt19937 rng;
+  Stats *stats;
+  bool isolatedActive = false;      // Split brain is expected while the active controller is cut off without the wire
+  std::vector<std::vector<uint8_t>> tape;
+  int replayTarget = -1;            // Controller the tape is replayed to, -1 for none
+  size_t replayNext = 0;
+
+  bool claims(int i) const { return c[i].alive && c[i].node.active; }
+  int active() const { return claims(0) ? 0 : claims(1) ? 1 : -1; }
+
+  // Function to deliver packets waiting for controller i and run its poll - as hotStandbyPoll() does
+  void poll(int i) {
+    Controller &me = c[i];
+    uint8_t buf[HS_MAX_PACKET + 16];
+    for (;;) {
+      sockaddr_in from = {};
+      socklen_t fromLen = sizeof(from);
+      ssize_t len = recvfrom(me.sock.fd, buf, sizeof(buf), 0, (sockaddr *)&from, &fromLen);
+      if (len <= 0) break;
+      if (!me.alive || !me.linkUp) continue;
+      if (ntohs(from.sin_port) != me.peerPort) continue;  // hsUdp.remoteIP() == hsPeer
+      hsReceive(&me.node, &me.port, buf, len, now);
+      if (me.node.applied) {                              // hsApplyReceived()
+        for (int r = 0; r < ROOMS; r++) {
+          if (!(me.node.rx.changedMask & (1u << r))) continue;
+          me.on[r] = me.node.rx.occupied & (1u << r);
+          me.hasOwner[r] = me.node.rx.owned & (1u << r);
+          memcpy(me.owner[r], me.node.rx.owner[r], SYNC_UID_SIZE);
+          me.version[r] = me.node.rx.seq;
+        }
+        me.seq = me.node.rx.seq;
+      }
+    }
+    if (!me.alive) return;
+    uint32_t mask = 0;
+    for (int r = 0; r < ROOMS; r++) if ((int32_t)(me.version[r] - me.node.lastSentSeq) > 0) mask |= 1u << r;
+    const Controller &peer = c[1 - i];
+    HsPeerClaim claim = !wired ? HS_CLAIM_UNWIRED : (peer.alive && peer.node.active) ? HS_CLAIM_HELD : HS_CLAIM_RELEASED;
+    hsTick(&me.node, &me.port, mask, now, me.linkUp, claim);
+  }
+
+  // Function to send a forged takeover - from a stranger, or as the partner without the key
+  void forge() {
+    int target = active() >= 0 ? active() : 0;
+    Controller &t = c[target];
+    HsNode fake;
+    hsInit(&fake, true, now);
+    fake.active = true;
+    fake.term = t.node.term + FORGED_TERM;
+    bool on[ROOMS] = {true, true, true, true, true, true, true, true}, has[ROOMS] = {};
+    uint8_t own[ROOMS][SYNC_UID_SIZE] = {};
+    uint32_t seq = t.seq + 1000;
+    uint8_t pkt[HS_MAX_PACKET];
+    size_t pktLen = 0;
+    struct Capture { uint8_t *buf; size_t *len; } cap = {pkt, &pktLen};
+    bool stranger = rng() % 2;
+    HsPort port = {[](void *ctx, const uint8_t *p, size_t len) {
+                     Capture *cp = (Capture *)ctx;
+                     memcpy(cp->buf, p, len);
+                     *cp->len = len;
+                   },
+                   &cap, stranger ? siteKey : wrongKey, stranger ? sizeof(siteKey) - 1 : sizeof(wrongKey) - 1,
+                   {ROOMS, on, has, own}, &seq};
+    hsTick(&fake, &port, 0xff, now, true, HS_CLAIM_UNWIRED);  // Active - sends a delta for every room
+    stats->forged++;
+    if (stranger) {
+      socketSend(&attacker, t.sock.port, pkt, pktLen);      // Right key, wrong address - only the source check stops it
+    }
+    else {
+      uint32_t before = t.node.rejected;
+      hsReceive(&t.node, &t.port, pkt, pktLen, now);        // Spoofed address - the tag must stop it
+      if (t.node.rejected == before) stats->forgedHeard++;
+      else stats->rejected++;
+    }
+  }
+
+  // Function to replay the next recorded packet as the partner - tagged with the right key, so only freshness stops it
+  void replay() {
+    if (tape.empty()) return;
+    Controller &t = c[replayTarget];
+    const std::vector<uint8_t> &pkt = tape[replayNext++ % tape.size()];
+    uint32_t before = t.node.replayed;
+    hsReceive(&t.node, &t.port, pkt.data(), pkt.size(), now);
+    stats->replays++;
+    if (t.node.replayed == before) stats->replaysHeard++;
+  }
+
+  // Function to run the pair for ms milliseconds - taps on the active controller, forgeries, split-brain count
+  void run(uint32_t ms) {
+    for (uint32_t end = now + ms; now != end; now++) {
+      int a = active();
+      if (a >= 0 && now >= nextTap) {
+        Controller &act = c[a];
+        int r = rng() % ROOMS;
+        act.on[r] = act.hasOwner[r] = !act.on[r];
+        for (auto &b : act.owner[r]) b = rng();
+        act.version[r] = ++act.seq;
+        nextTap = now + 1 + rng() % (2 * TAP_GAP_MS);
+      }
+      if (replayTarget >= 0 && now % REPLAY_GAP_MS == 0) replay();
+      if (now >= nextForge) {
+        forge();
+        nextForge = now + 1 + rng() % (2 * FORGE_GAP_MS);
+      }
+      poll(0);
+      poll(1);
+      if (claims(0) && claims(1)) {
+        if (isolatedActive && !wired) stats->unwiredSplitMs++;
+        else stats->splitMs++;
+      }
+    }
+  }
+
+  // Function to run until a condition holds or ms pass - the time it took, or UINT32_MAX
+  template <typename F> uint32_t runUntil(uint32_t ms, F done) {
+    for (uint32_t t = 0; t < ms; t++) {
+      if (done()) return t;
+      run(1);
+    }
+    return done() ? ms : UINT32_MAX;
+  }
+};
+
+// Function to run one configuration - cycles of crash and isolation
+static Stats runConfig(bool wired, double loss, int cycles, uint32_t seed) {
+  Stats stats;
+  Pair p;
+  p.wired = wired;
+  p.rng.seed(seed);
+  p.stats = &stats;
+  for (int i = 0; i < 2; i++) {
+    if (!socketOpen(&p.c[i].sock)) exit(1);
+    p.c[i].preferred = i == 0;
+    p.c[i].linkUp = true;
+    p.c[i].loss = loss;
+    p.c[i].rng = &p.rng;
+    p.c[i].tape = &p.tape;
+  }
+  if (!socketOpen(&p.attacker)) exit(1);
+  p.c[0].peerPort = p.c[1].sock.port;
+  p.c[1].peerPort = p.c[0].sock.port;
+  controllerBoot(&p.c[0], p.now);
+  controllerBoot(&p.c[1], p.now);
+  p.run(2000);
+
+  for (int cycle = 0; cycle < cycles; cycle++) {
+    p.run(1000 + p.rng() % 4000);
+    int a = p.active();
+    if (a < 0) {
+      stats.failed++;
+      continue;
+    }
+    int s = 1 - a;
+    int kind = p.rng() % 5;
+    if (kind < 3) {                 // Crash
+      stats.crashes++;
+      Controller dead = p.c[a];     // Its room table as it died
+      p.c[a].alive = false;
+      if (p.rng() % 2) {
+        p.replayTarget = s;         // Replay the dead controller's last packets until it is back
+        p.replayNext = 0;
+      }
+      uint32_t took = p.runUntil(2000, [&]() { return p.claims(s); });
+      if (took == UINT32_MAX) {
+        stats.failed++;
+        p.replayTarget = -1;
+        continue;
+      }
+      stats.failoverMs.push_back(took);
+      int diff = tableDiff(p.c[s], dead);
+      if (diff) stats.diverged++;
+      if (p.c[s].node.failoverSeqLag) stats.lagged++;
+      p.run(REBOOT_MS - std::min(took, (uint32_t)REBOOT_MS));
+      p.replayTarget = -1;
+      controllerBoot(&p.c[a], p.now);
+      uint32_t synced = p.runUntil(3000, [&]() {
+        return p.c[a].node.rx.synced && !p.c[a].node.active && tableDiff(p.c[a], p.c[s]) == 0;
+      });
+      if (synced == UINT32_MAX) stats.failed++;
+      else stats.resyncMs.push_back(synced);
+    }
+    else if (kind == 3) {           // Isolate the standby
+      p.c[s].linkUp = false;
+      p.run(ISOLATE_MS);
+      if (p.claims(s)) stats.isolatedPromotions++;
+      p.c[s].linkUp = true;
+      p.run(1000);
+    }
+    else {                          // Isolate the active controller
+      p.c[a].linkUp = false;
+      p.isolatedActive = true;
+      p.run(ISOLATE_MS);
+      p.c[a].linkUp = true;
+      uint32_t settled = p.runUntil(1000, [&]() { return !(p.claims(0) && p.claims(1)); });
+      p.isolatedActive = false;
+      if (settled == UINT32_MAX || settled > 2 * HS_HEARTBEAT_MS) stats.splitUnresolved++;
+      p.run(1000);
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    if (p.c[i].node.term >= FORGED_TERM) stats.forgedHeard++;  // A stranger's packet got past the address check
+  }
+  for (int i = 0; i < 2; i++) close(p.c[i].sock.fd);
+  close(p.attacker.fd);
+  return stats;
+}
+
+// Function to take a quantile of a sample
+static uint32_t quantile(std::vector<uint32_t> v, double q) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(q * (v.size() - 1))];
+}
+
+int main(int argc, char **argv) {
+  int cycles = argc > 1 ? atoi(argv[1]) : 300;
+  uint32_t seed = argc > 2 ? (uint32_t)atoi(argv[2]) : 1;
+  bool ok = true;
+
+  printf("%d cycles per configuration, seed %u\n\n", cycles, seed);
+  printf("wire  loss  crashes  failover ms (p50/max)  diverged  lag shown  resync ms (max)  isolated promotions"
+         "  split ms  unwired split ms  forged (bad tag)  replayed\n");
+  for (int wired = 1; wired >= 0; wired--) {
+    for (double loss : {0.0, 0.01}) {
+      Stats s = runConfig(wired, loss, cycles, seed);
+      printf("%-4s  %3.0f%%  %7u  %10u / %-9u  %8u  %9u  %15u  %19u  %8u  %16u  %6u (%u)  %8u\n", wired ? "yes" : "no",
+             loss * 100, s.crashes, quantile(s.failoverMs, 0.5), quantile(s.failoverMs, 1.0), s.diverged, s.lagged,
+             quantile(s.resyncMs, 1.0), s.isolatedPromotions, s.splitMs, s.unwiredSplitMs, s.forged, s.rejected,
+             s.replays);
+
+      uint32_t bound = HS_FAILOVER_MS + HS_STANDBY_GRACE_MS + 1;
+      if (s.failed) {
+        printf("FAIL: %u cycles without a takeover or resync\n", s.failed);
+        ok = false;
+      }
+      if (quantile(s.failoverMs, 1.0) > bound) {
+        printf("FAIL: a takeover took longer than %u ms\n", bound);
+        ok = false;
+      }
+      if (loss == 0 && s.diverged) {
+        printf("FAIL: %u takeovers without packet loss held a different room table\n", s.diverged);
+        ok = false;
+      }
+      if (s.isolatedPromotions || s.splitMs) {
+        printf("FAIL: an isolated standby took over, or both controllers drove the lines\n");
+        ok = false;
+      }
+      if (s.splitUnresolved) {
+        printf("FAIL: %u splits outlasted the isolation by more than two heartbeats\n", s.splitUnresolved);
+        ok = false;
+      }
+      if (s.forgedHeard) {
+        printf("FAIL: %u forged packets were acted on\n", s.forgedHeard);
+        ok = false;
+      }
+      if (s.replaysHeard) {
+        printf("FAIL: %u replayed packets were taken as fresh\n", s.replaysHeard);
+        ok = false;
+      }
+    }
+  }
+  printf(ok ? "All checks passed\n" : "CHECKS FAILED\n");
+  return ok ? 0 : 1;
+}
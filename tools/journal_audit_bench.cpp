@@ -0,0 +1,309 @@
+// Audit query benchmark - fills a RAM-backed journal with simulated hotel traffic and times indexed
+// queries against a full scan, checking that both return the same events.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/journal_audit_bench.cpp src/event_journal.cpp src/crypto_service.cpp -o journal_audit_bench
+// Run:           ./journal_audit_bench [events] [rooms]
+#include "event_journal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#define JOURNAL_SECTORS 1024          // 4 MB of RAM "flash" - room for 129k events
+#define STAFF_CARDS     15            // Housekeeping and maintenance cards
+#define START_TIME      1767225600u   // 2026-01-01 00:00 UTC
+
+static std::vector<uint8_t> flash(JOURNAL_SECTORS * JOURNAL_SECTOR_SIZE, 0xFF);
+static uint64_t bytesRead = 0;        // Storage bytes read - stands in for flash reads on the controller
+
+static bool ramRead(uint32_t offset, void *buf, size_t len) {
+  memcpy(buf, &flash[offset], len);
+  bytesRead += len;
+  return true;
+}
+
+static bool ramWrite(uint32_t offset, const void *buf, size_t len) {
+  const uint8_t *src = (const uint8_t *)buf;
+  for (size_t i = 0; i < len; i++) flash[offset + i] &= src[i];  // Writes can only clear bits, like NOR flash
+  return true;
+}
+
+static bool ramErase(uint32_t offset) {
+  memset(&flash[offset], 0xFF, JOURNAL_SECTOR_SIZE);
+  return true;
+}
+
+static const JournalStorage ramStorage = {JOURNAL_SECTORS * JOURNAL_SECTOR_SIZE, ramRead, ramWrite, ramErase};
+static const uint8_t key[16] = {'b', 'e', 'n', 'c', 'h', '-', 'j', 'o', 'u', 'r', 'n', 'a', 'l', 'k', 'e', 'y'};
+
+static void makeUid(uint32_t id, uint8_t uid[JOURNAL_UID_SIZE]) {
+  uid[0] = id >> 24 | 0x80;  // Never all zero
+  uid[1] = id >> 16;
+  uid[2] = id >> 8;
+  uid[3] = id;
+}
+
+// Function to fill the journal - guests tap their own room, staff tap any room, strangers get denied
+static void simulate(Journal *j, uint32_t events, int rooms, std::mt19937 &rng) {
+  std::vector<uint32_t> guest(rooms);
+  for (int r = 0; r < rooms; r++) guest[r] = 1000 + r;
+  uint32_t nextGuest = 1000 + rooms;
+  uint32_t now = START_TIME;
+  std::uniform_int_distribution<int> roomPick(0, rooms - 1);
+
+  for (uint32_t i = 0; i < events; i++) {
+    now += 5 + rng() % 120;
+    JournalEvent e;
+    e.time = now;
+    int kind = rng() % 100;
+    int room = roomPick(rng);
+    if (kind < 3) {  // New guest for the room
+      guest[room] = nextGuest++;
+    }
+    if (kind < 75) {
+      e.type = (rng() & 1) ? JOURNAL_CHECK_IN : JOURNAL_CHECK_OUT;
+      e.room = room;
+      makeUid(guest[room], e.uid);
+    }
+    else if (kind < 95) {
+      e.type = JOURNAL_CHECK_IN;
+      e.room = room;
+      makeUid(1 + rng() % STAFF_CARDS, e.uid);
+    }
+    else {
+      e.type = JOURNAL_DENIED_UNKNOWN;
+      e.room = JOURNAL_NO_ROOM;
+      makeUid(500000 + rng() % 100000, e.uid);
+    }
+    journalAppend(j, &e);
+    if (i % 7 == 0) journalPrepare(j);  // Idle time between taps
+  }
+}
+
+// Function to answer a query by decoding every record - the baseline the summaries are measured against
+static uint32_t fullScan(const Journal *j, const JournalQuery *q, std::vector<uint32_t> *seqs) {
+  uint32_t matches = 0;
+  for (uint32_t slot = 0; slot < journalSlots(j); slot++) {
+    JournalEvent e;
+    if (!journalRead(j, slot, &e)) continue;
+    if (e.time < q->fromTime || e.time > q->toTime) continue;
+    if (q->room != JOURNAL_NO_ROOM && e.room != q->room) continue;
+    if (q->matchUid && memcmp(e.uid, q->uid, JOURNAL_UID_SIZE) != 0) continue;
+    seqs->push_back(e.seq);
+    matches++;
+  }
+  return matches;
+}
+
+static bool collect(const JournalEvent *event, void *ctx) {
+  ((std::vector<uint32_t> *)ctx)->push_back(event->seq);
+  return true;
+}
+
+// Function to run one kind of query many times and print averages for both methods
+static bool benchQueries(const Journal *j, const char *name, std::vector<JournalQuery> &queries) {
+  double indexedUs = 0, scanUs = 0, sectors = 0, skipped = 0, records = 0, matches = 0;
+  uint64_t indexedBytes = 0, scanBytes = 0;
+  for (const JournalQuery &q : queries) {
+    std::vector<uint32_t> got, want;
+    JournalQueryStats stats;
+
+    bytesRead = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    journalQuery(j, &q, collect, &got, &stats);
+    auto t1 = std::chrono::steady_clock::now();
+    indexedBytes += bytesRead;
+
+    bytesRead = 0;
+    fullScan(j, &q, &want);
+    auto t2 = std::chrono::steady_clock::now();
+    scanBytes += bytesRead;
+
+    std::sort(want.begin(), want.end());
+    std::sort(got.begin(), got.end());
+    if (got != want) {
+      printf("%s: indexed query returned %zu events, full scan %zu\n", name, got.size(), want.size());
+      return false;
+    }
+    indexedUs += std::chrono::duration<double, std::micro>(t1 - t0).count();
+    scanUs += std::chrono::duration<double, std::micro>(t2 - t1).count();
+    sectors += stats.sectorsScanned;
+    skipped += stats.sectorsSkipped;
+    records += stats.recordsRead;
+    matches += got.size();
+  }
+  double n = queries.size();
+  printf("%-28s %7.1f  %6.1f/%-6.1f %8.0f %9.1f %9.1f %8.0f %8.0f\n", name, matches / n, sectors / n, skipped / n,
+         records / n, indexedUs / n, scanUs / n, indexedBytes / n / 1024, scanBytes / n / 1024);
+  return true;
+}
+
+static bool collectOne(const JournalEvent *event, void *ctx) {
+  ((std::vector<uint32_t> *)ctx)->push_back(event->seq);
+  return false;  // As the controller does - one printed line per step
+}
+
+// Function to run queries a few records at a time with taps appended between steps, as the controller's
+// background audit does - the steps must return the events the one-shot query saw, in order, once each.
+// With lap set, a whole ring of taps is appended halfway so the cursor must start over; then only the
+// events that survived have to be there.
+static bool checkStepped(Journal *j, const char *name, std::vector<JournalQuery> &queries, int rooms, bool lap,
+                         std::mt19937 &rng) {
+  uint32_t steps = 0, appended = 0;
+  for (const JournalQuery &q : queries) {
+    std::vector<uint32_t> want, got;
+    journalQuery(j, &q, collect, &want, NULL);
+
+    JournalCursor c;
+    journalQueryStart(j, &c);
+    bool lapped = false;
+    while (!journalQueryStep(j, &q, &c, 16, collectOne, &got)) {
+      steps++;
+      if (rng() % 4 == 0) {
+        simulate(j, 1, rooms, rng);
+        appended++;
+      }
+      if (lap && !lapped && got.size() >= want.size() / 2) {  // Run the head just past the cursor's sector
+        uint32_t sectors = (c.slot / JOURNAL_SLOTS_PER_SECTOR + j->sectorCount - j->head / JOURNAL_SLOTS_PER_SECTOR) %
+                           j->sectorCount + 1;
+        uint32_t taps = sectors * JOURNAL_EVENTS_PER_SECTOR;
+        simulate(j, taps, rooms, rng);
+        appended += taps;
+        lapped = true;
+      }
+    }
+    if (c.matches != got.size() || !std::is_sorted(got.begin(), got.end()) ||
+        std::adjacent_find(got.begin(), got.end()) != got.end()) {
+      printf("%s: stepped query visited events out of order or twice\n", name);
+      return false;
+    }
+    if (lap) {  // Whatever of the original answer is still in the journal
+      std::vector<uint32_t> left;
+      fullScan(j, &q, &left);
+      std::sort(left.begin(), left.end());
+      want.erase(std::remove_if(want.begin(), want.end(),
+                                [&](uint32_t seq) { return !std::binary_search(left.begin(), left.end(), seq); }),
+                 want.end());
+      if (want.size() == got.size()) {
+        printf("%s: the head did not lap the cursor\n", name);
+        return false;
+      }
+      std::vector<uint32_t> missing;
+      std::set_difference(want.begin(), want.end(), got.begin(), got.end(), std::back_inserter(missing));
+      if (!missing.empty() || (!got.empty() && got.back() >= c.endSeq)) {
+        printf("%s: stepped query missed %zu surviving events or ran past its start\n", name, missing.size());
+        return false;
+      }
+    }
+    else if (got != want) {
+      printf("%s: stepped query returned %zu events, one-shot query %zu\n", name, got.size(), want.size());
+      return false;
+    }
+  }
+  printf("stepped audits, %-20s %zu queries, %u steps, %u taps appended between steps\n", name, queries.size(), steps,
+         appended);
+  return true;
+}
+
+// Function to type each query as the Serial audit command and check it parses back to the same query
+static bool checkCommands(const std::vector<std::vector<JournalQuery> *> &sets) {
+  int parsed = 0;
+  for (const auto *set : sets) {
+    for (const JournalQuery &q : *set) {
+      char line[JOURNAL_COMMAND_MAX + 1];  // As long as the controller keeps
+      int len = snprintf(line, sizeof(line), "audit from %u to %u", (unsigned)q.fromTime, (unsigned)q.toTime);
+      if (q.room != JOURNAL_NO_ROOM) len += snprintf(line + len, sizeof(line) - len, " room %d", q.room + 1);
+      if (q.matchUid) {
+        snprintf(line + len, sizeof(line) - len, " uid %02X%02X%02X%02X", q.uid[0], q.uid[1], q.uid[2], q.uid[3]);
+      }
+      JournalQuery back;
+      if (!journalParseQuery(line, &back) || back.fromTime != q.fromTime || back.toTime != q.toTime ||
+          back.room != q.room || back.matchUid != q.matchUid ||
+          (q.matchUid && memcmp(back.uid, q.uid, JOURNAL_UID_SIZE) != 0)) {
+        printf("command \"%s\" does not parse back to its query\n", line);
+        return false;
+      }
+      parsed++;
+    }
+  }
+  const char *bad[] = {"", "audits", "audit room", "audit room 0", "audit room 256", "audit uid 1234567",
+                       "audit uid 12345G78", "audit from -1", "audit from 5 to 4", "audit floor 3"};
+  for (const char *line : bad) {
+    JournalQuery q;
+    if (journalParseQuery(line, &q)) {
+      printf("command \"%s\" should be refused\n", line);
+      return false;
+    }
+  }
+  printf("audit commands: %d parsed back to their queries, %zu malformed lines refused\n\n", parsed,
+         sizeof(bad) / sizeof(bad[0]));
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t events = argc > 1 ? atoi(argv[1]) : 100000;
+  int rooms = argc > 2 ? atoi(argv[2]) : 40;
+  if (rooms < 1 || rooms >= JOURNAL_NO_ROOM) rooms = 40;
+
+  Journal j;
+  journalOpen(&j, &ramStorage, key);
+  std::mt19937 rng(42);
+  simulate(&j, events, rooms, rng);
+
+  // Reopen to check the unsealed sector's summary is rebuilt from flash
+  Journal reopened;
+  journalOpen(&reopened, &ramStorage, key);
+  if (reopened.head != j.head || memcmp(&reopened.open, &j.open, sizeof(j.open)) != 0) {
+    printf("reopen: head or open-sector summary differs\n");
+    return 1;
+  }
+
+  uint32_t endTime = START_TIME;
+  for (uint32_t slot = 0; slot < journalSlots(&j); slot++) {
+    JournalEvent e;
+    if (journalRead(&j, slot, &e) && e.time > endTime) endTime = e.time;
+  }
+  printf("%u events, %d rooms, %u sectors, %.1f days of traffic, AES-CTR records\n\n", events, rooms,
+         JOURNAL_SECTORS, (endTime - START_TIME) / 86400.0);
+
+  const int rounds = 50;
+  std::vector<JournalQuery> roomNight, uidAll, hourAny, roomAll;
+  for (int i = 0; i < rounds; i++) {
+    uint32_t day = START_TIME + (rng() % ((endTime - START_TIME) / 86400)) * 86400;
+    JournalQuery q = {day + 2 * 3600, day + 4 * 3600, (uint8_t)(rng() % rooms), false, {0}};
+    roomNight.push_back(q);
+
+    q = {0, 0xFFFFFFFF, JOURNAL_NO_ROOM, true, {0}};
+    makeUid(1000 + rng() % (rooms + events / 100), q.uid);  // A guest card from anywhere in the history
+    uidAll.push_back(q);
+
+    uint32_t from = START_TIME + rng() % (endTime - START_TIME);
+    q = {from, from + 3600, JOURNAL_NO_ROOM, false, {0}};
+    hourAny.push_back(q);
+
+    q = {0, 0xFFFFFFFF, (uint8_t)(rng() % rooms), false, {0}};
+    roomAll.push_back(q);
+  }
+  if (!checkCommands({&roomNight, &uidAll, &hourAny, &roomAll})) return 1;
+  printf("%-28s %7s  %13s %8s %9s %9s %8s %8s\n", "query", "matches", "read/skipped", "records", "index us",
+         "scan us", "index KB", "scan KB");
+  if (!benchQueries(&j, "room, 02:00-04:00", roomNight)) return 1;
+  if (!benchQueries(&j, "one guest card, all time", uidAll)) return 1;
+  if (!benchQueries(&j, "any room, one hour", hourAny)) return 1;
+  if (!benchQueries(&j, "one room, all time", roomAll)) return 1;
+
+  // Last - these append to the journal
+  printf("\n");
+  std::vector<JournalQuery> few(uidAll.begin(), uidAll.begin() + 5);
+  if (!checkStepped(&j, "one guest card", few, rooms, false, rng)) return 1;
+  few.assign(roomAll.begin(), roomAll.begin() + 3);
+  if (!checkStepped(&j, "one room", few, rooms, false, rng)) return 1;
+  few.assign(roomAll.begin() + 3, roomAll.begin() + 5);
+  if (!checkStepped(&j, "one room, head laps", few, rooms, true, rng)) return 1;
+  return 0;
+}
@@ -0,0 +1,645 @@
+// Log ingest daemon - follows the Serial output of many controllers on USB at once and writes one merged,
+// time-ordered event stream, instead of a Serial monitor per board during commissioning
+// Worker threads each own an epoll set of serial devices. A device is read straight into a 16 KB batch
+// buffer and split into lines in place: an event is a receive timestamp, a kind and an offset into the
+// batch, so the text is never copied until the merged line is written out. Finished batches go to a merger
+// thread that interleaves the devices by timestamp. Each worker publishes a watermark - the time up to
+// which it has read everything - and the merger only writes events older than every worker's watermark,
+// so the output is in order even though devices are read by different threads. Devices matching the
+// patterns are attached as they appear and dropped when unplugged.
+//
+// Output, one line per log line:  2026-10-18T09:14:03.512204Z ttyACM3 relay Relay 1 ON
+//
+// Build (host):  g++ -O2 -std=c++17 -pthread tools/log_ingest.cpp -o log_ingest
+// Run:           ./log_ingest [-o file] [pattern...]      default pattern /dev/ttyACM*
+//                ./log_ingest --bench [controllers] [seconds] [baud]
+//                    simulated controllers on pseudo-terminals, flat out or paced at a baud rate;
+//                    every line is checked, throughput and merge delay are reported
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <glob.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define BATCH_SIZE     16384   // Bytes read per batch - a partial line at the end moves to the next one
+#define MAX_WORKERS    4
+#define WATERMARK_MS   20      // Idle workers still advance their watermark this often
+#define RESCAN_MS      2000    // New devices are looked for this often
+#define OUT_BUFFER     (1 << 20)
+#define READS_PER_PASS 4       // Reads per device per pass - a busy device cannot hold back the others' watermark
+
+// ---- Line kinds, from the firmware's addMessage() and Serial.printf() texts ----
+
+enum Kind : uint8_t { K_CARD, K_RELAY, K_ROOM, K_DENIED, K_STAFF, K_DIAG, K_JOURNAL, K_INFO, K_COUNT };
+static const char *kindNames[K_COUNT] = {"card", "relay", "room", "denied", "staff", "diag", "journal", "info"};
+
+static bool startsWith(const char *s, size_t len, const char *prefix) {
+  size_t n = strlen(prefix);
+  return len >= n && memcmp(s, prefix, n) == 0;
+}
+
+// Function to classify one line - first match wins
+static Kind classify(const char *s, size_t len) {
+  if (startsWith(s, len, "Card: ")) return K_CARD;
+  if (startsWith(s, len, "Door ") && memmem(s, len, " card:", 6) != NULL) return K_CARD;
+  if (startsWith(s, len, "Relay ")) return K_RELAY;
+  if (startsWith(s, len, "Room ") || startsWith(s, len, "Left Room ")) return K_ROOM;
+  if (startsWith(s, len, "Access denied") || startsWith(s, len, "Card revoked") ||
+      startsWith(s, len, "All rooms occupied")) return K_DENIED;
+  if (startsWith(s, len, "Staff ")) return K_STAFF;
+  if (startsWith(s, len, "#")) return K_JOURNAL;  // Journal dump: #seq t= type= room= uid=
+  if (startsWith(s, len, "OSDP ")) return K_DIAG;
+  // Statistics lines read "Name: ..." or "Name 3: ..." - a short label of words and numbers, then a colon
+  for (size_t i = 0; i < len && i < 24; i++) {
+    char c = s[i];
+    if (c == ':') return i > 0 ? K_DIAG : K_INFO;
+    if (!isalnum((unsigned char)c) && c != ' ' && c != '/' && c != '-') break;
+  }
+  return K_INFO;
+}
+
+// ---- Devices and batches ----
+
+struct Device;
+
+struct Event {
+  uint64_t ns;        // Receive time, monotonic
+  uint32_t off;       // Line start in the batch
+  uint16_t len;
+  uint8_t kind;
+};
+
+struct Batch {
+  Device *dev;
+  size_t used;        // Bytes read into data
+  size_t lineStart;   // Start of the line still being read
+  size_t next;        // Next event the merger writes
+  std::vector<Event> events;
+  char data[BATCH_SIZE];
+};
+
+struct Device {
+  std::string path;
+  std::string name;           // Path without /dev/
+  std::atomic<int> fd;        // -1 once unplugged - closed by its worker, reopened by the rescan
+  int worker;
+  Batch *cur;                 // Batch being read into - worker-owned
+  bool discarding;            // Inside an overlong line - skip to its end
+  std::deque<Batch *> queue;  // Batches waiting to be merged - merger-owned
+  uint64_t lines, bytes, overlong;
+};
+
+// Batches are recycled - steady-state ingest allocates nothing
+static std::mutex poolLock;
+static std::vector<Batch *> pool;
+
+static Batch *takeBatch(Device *dev) {
+  Batch *b = NULL;
+  {
+    std::lock_guard<std::mutex> g(poolLock);
+    if (!pool.empty()) {
+      b = pool.back();
+      pool.pop_back();
+    }
+  }
+  if (b == NULL) {
+    b = new Batch;
+    b->events.reserve(256);
+  }
+  b->dev = dev;
+  b->used = b->lineStart = b->next = 0;
+  b->events.clear();
+  return b;
+}
+
+static void releaseBatch(Batch *b) {
+  std::lock_guard<std::mutex> g(poolLock);
+  pool.push_back(b);
+}
+
+static uint64_t monoNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ---- Workers ----
+
+struct Worker {
+  int ep;
+  std::thread thread;
+  std::mutex outLock;
+  std::vector<Batch *> outbox;            // Finished batches for the merger
+  std::atomic<uint64_t> watermark{0};     // Everything received before this has been published
+  std::atomic<uint32_t> devices{0};
+};
+
+static Worker workers[MAX_WORKERS];
+static int workerCount = 1;
+static std::atomic<bool> running(true);
+static std::mutex mergeWake;
+static std::condition_variable mergeCv;
+static std::atomic<uint64_t> overlongTotal(0);
+
+// Function to split the bytes just read into lines - events point into the batch, nothing is copied
+static void splitLines(Device *dev, Batch *b, size_t from, uint64_t ns) {
+  const char *data = b->data;
+  const char *p;
+  while ((p = (const char *)memchr(data + from, '\n', b->used - from)) != NULL) {
+    size_t end = p - data;
+    size_t start = b->lineStart;
+    b->lineStart = end + 1;
+    from = end + 1;
+    if (dev->discarding) {
+      dev->discarding = false;  // End of an overlong line - the next one is whole
+      continue;
+    }
+    if (end > start && data[end - 1] == '\r') end--;
+    if (end == start) continue;
+    b->events.push_back({ns, (uint32_t)start, (uint16_t)(end - start), (uint8_t)classify(data + start, end - start)});
+    dev->lines++;
+  }
+}
+
+// Function to hand a device's batch to the merger and start a new one with the partial line carried over
+static void publish(Worker &w, Device *dev) {
+  Batch *b = dev->cur;
+  if (b->events.empty() && b->lineStart == 0) return;  // Nothing finished yet - keep filling
+  Batch *fresh = takeBatch(dev);
+  size_t tail = b->used - b->lineStart;
+  memcpy(fresh->data, b->data + b->lineStart, tail);  // Only the unfinished line, if any
+  fresh->used = tail;
+  dev->cur = fresh;
+  if (b->events.empty()) {
+    releaseBatch(b);
+    return;
+  }
+  std::lock_guard<std::mutex> g(w.outLock);
+  w.outbox.push_back(b);
+}
+
+// Function to read what a device has, up to READS_PER_PASS reads - returns false once it has gone away
+// Anything left is reported again by the next epoll_wait, which is level-triggered
+static bool drainDevice(Worker &w, Device *dev, uint64_t ns) {
+  for (int reads = 0; reads < READS_PER_PASS;) {
+    Batch *b = dev->cur;
+    if (b->used == BATCH_SIZE) {
+      if (b->lineStart == 0) {
+        // A whole batch without a newline - boot ROM noise at the wrong baud, or a binary upload
+        dev->discarding = true;
+        dev->overlong++;
+        overlongTotal++;
+        b->used = 0;
+      }
+      else {
+        publish(w, dev);
+        continue;
+      }
+    }
+    ssize_t n = read(dev->fd, b->data + b->used, BATCH_SIZE - b->used);
+    reads++;
+    if (n > 0) {
+      size_t from = b->used;
+      b->used += n;
+      dev->bytes += n;
+      splitLines(dev, b, from, ns);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+    return false;  // EOF or EIO - unplugged
+  }
+  return true;
+}
+
+static void detach(Worker &w, Device *dev) {
+  epoll_ctl(w.ep, EPOLL_CTL_DEL, dev->fd, NULL);
+  close(dev->fd);
+  dev->fd = -1;
+  w.devices--;
+  fprintf(stderr, "log_ingest: %s detached\n", dev->name.c_str());
+}
+
+static void runWorker(int index) {
+  Worker &w = workers[index];
+  epoll_event ready[64];
+  std::vector<Device *> touched;
+  while (running) {
+    int n = epoll_wait(w.ep, ready, 64, WATERMARK_MS);
+    uint64_t ns = monoNs();  // Every line read in this pass gets this time - all of it arrived before now
+    touched.clear();
+    for (int i = 0; i < n; i++) {
+      Device *dev = (Device *)ready[i].data.ptr;
+      if (dev->fd < 0) continue;
+      bool alive = drainDevice(w, dev, ns);
+      touched.push_back(dev);
+      if (!alive) detach(w, dev);
+    }
+    for (Device *dev : touched) publish(w, dev);
+    w.watermark = ns;
+    if (!touched.empty()) mergeCv.notify_one();
+  }
+}
+
+// ---- Merger ----
+
+struct Output {
+  FILE *out;
+  char buf[OUT_BUFFER];
+  size_t len;
+  int64_t realOffsetNs;       // Realtime minus monotonic, fixed at start
+  int64_t second;             // Second of the cached date text
+  char date[32];
+};
+
+static Output output;
+static std::atomic<uint64_t> merged(0);
+static uint64_t kindCounts[K_COUNT];
+static uint64_t mergeDelayMaxNs = 0, mergeDelayTotalNs = 0;
+
+// Hook for the benchmark to check every merged line
+static void (*checkLine)(const Device *dev, const char *text, size_t len, uint64_t ns) = NULL;
+
+static void flushOutput() {
+  if (output.out != NULL && output.len > 0) {
+    fwrite(output.buf, 1, output.len, output.out);
+    fflush(output.out);
+  }
+  output.len = 0;
+}
+
+// Function to write one merged line - the date text is formatted once per second
+static void emit(const Device *dev, const Batch *b, const Event &e) {
+  merged++;
+  kindCounts[e.kind]++;
+  if (checkLine != NULL) checkLine(dev, b->data + e.off, e.len, e.ns);
+  if (output.out == NULL) return;
+  if (output.len + 96 + dev->name.size() + e.len > OUT_BUFFER) flushOutput();
+  int64_t real = (int64_t)e.ns + output.realOffsetNs;
+  int64_t sec = real / 1000000000;
+  if (sec != output.second) {
+    time_t t = sec;
+    tm parts;
+    gmtime_r(&t, &parts);
+    strftime(output.date, sizeof(output.date), "%Y-%m-%dT%H:%M:%S.", &parts);
+    output.second = sec;
+  }
+  char *p = output.buf + output.len;
+  size_t dl = strlen(output.date);
+  memcpy(p, output.date, dl);
+  p += dl;
+  uint32_t us = (real % 1000000000) / 1000;
+  for (int i = 5; i >= 0; i--, us /= 10) p[i] = '0' + us % 10;
+  p += 6;
+  *p++ = 'Z';
+  *p++ = ' ';
+  memcpy(p, dev->name.data(), dev->name.size());
+  p += dev->name.size();
+  *p++ = ' ';
+  size_t kl = strlen(kindNames[e.kind]);
+  memcpy(p, kindNames[e.kind], kl);
+  p += kl;
+  *p++ = ' ';
+  memcpy(p, b->data + e.off, e.len);
+  p += e.len;
+  *p++ = '\n';
+  output.len = p - output.buf;
+}
+
+// Function to take the published batches and write every event older than all the watermarks
+// Devices are interleaved by a heap on their oldest waiting event; equal times are broken by device
+static void mergeRound(std::vector<Device *> &active) {
+  uint64_t wm = UINT64_MAX;
+  for (int i = 0; i < workerCount; i++) wm = std::min(wm, workers[i].watermark.load());  // Read before the outboxes
+  for (int i = 0; i < workerCount; i++) {
+    std::vector<Batch *> got;
+    {
+      std::lock_guard<std::mutex> g(workers[i].outLock);
+      got.swap(workers[i].outbox);
+    }
+    for (Batch *b : got) {
+      if (b->dev->queue.empty()) active.push_back(b->dev);
+      b->dev->queue.push_back(b);
+    }
+  }
+  auto head = [](const Device *d) { return d->queue.front()->events[d->queue.front()->next].ns; };
+  auto later = [&](const Device *a, const Device *b) {
+    uint64_t ha = head(a), hb = head(b);
+    return ha != hb ? ha > hb : a > b;
+  };
+  std::make_heap(active.begin(), active.end(), later);
+  uint64_t now = monoNs();
+  while (!active.empty() && head(active.front()) <= wm) {
+    std::pop_heap(active.begin(), active.end(), later);
+    Device *dev = active.back();
+    Batch *b = dev->queue.front();
+    const Event &e = b->events[b->next++];
+    emit(dev, b, e);
+    uint64_t delay = now - e.ns;
+    mergeDelayTotalNs += delay;
+    mergeDelayMaxNs = std::max(mergeDelayMaxNs, delay);
+    if (b->next == b->events.size()) {
+      dev->queue.pop_front();
+      releaseBatch(b);
+    }
+    if (dev->queue.empty()) active.pop_back();
+    else std::push_heap(active.begin(), active.end(), later);
+  }
+  flushOutput();
+}
+
+static void runMerger() {
+  std::vector<Device *> active;
+  while (running) {
+    {
+      std::unique_lock<std::mutex> g(mergeWake);
+      mergeCv.wait_for(g, std::chrono::milliseconds(WATERMARK_MS));
+    }
+    mergeRound(active);
+  }
+  mergeRound(active);  // Everything read before the workers stopped
+}
+
+// ---- Attaching devices ----
+
+static std::map<std::string, Device *> devices;  // Main thread only - a device keeps its entry across replugs
+
+// Function to open a serial device raw and non-blocking and give it to the least loaded worker
+static bool attach(const std::string &path) {
+  Device *&dev = devices[path];
+  if (dev != NULL && dev->fd >= 0) return true;
+  int fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) return false;
+  termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);  // No echo, no line editing, no CR/LF translation
+    cfsetispeed(&tio, B115200);  // Ignored by USB CDC, needed by USB-UART bridges
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  if (dev == NULL) {
+    dev = new Device();
+    dev->fd = -1;
+    dev->path = path;
+    dev->name = path.compare(0, 5, "/dev/") == 0 ? path.substr(5) : path;
+  }
+  int best = 0;
+  for (int i = 1; i < workerCount; i++) {
+    if (workers[i].devices < workers[best].devices) best = i;
+  }
+  dev->fd = fd;
+  dev->worker = best;
+  dev->discarding = false;
+  if (dev->cur == NULL) dev->cur = takeBatch(dev);
+  workers[best].devices++;
+  epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.ptr = dev;
+  epoll_ctl(workers[best].ep, EPOLL_CTL_ADD, fd, &ev);  // Safe while the worker waits on the set
+  fprintf(stderr, "log_ingest: %s attached to worker %d\n", dev->name.c_str(), best);
+  return true;
+}
+
+static void rescan(const std::vector<std::string> &patterns) {
+  for (const std::string &pattern : patterns) {
+    glob_t g;
+    if (glob(pattern.c_str(), 0, NULL, &g) == 0) {
+      for (size_t i = 0; i < g.gl_pathc; i++) attach(g.gl_pathv[i]);
+    }
+    globfree(&g);
+  }
+}
+
+static void startThreads(std::thread &merger) {
+  unsigned hw = std::thread::hardware_concurrency();
+  workerCount = std::max(1, std::min(MAX_WORKERS, (int)(hw > 1 ? hw / 2 : 1)));
+  timespec rt;
+  clock_gettime(CLOCK_REALTIME, &rt);
+  output.realOffsetNs = (int64_t)(rt.tv_sec * 1000000000LL + rt.tv_nsec) - (int64_t)monoNs();
+  output.second = -1;
+  for (int i = 0; i < workerCount; i++) {
+    workers[i].ep = epoll_create1(0);
+    workers[i].watermark = monoNs();
+  }
+  for (int i = 0; i < workerCount; i++) workers[i].thread = std::thread(runWorker, i);
+  merger = std::thread(runMerger);
+}
+
+static void stopThreads(std::thread &merger) {
+  running = false;
+  for (int i = 0; i < workerCount; i++) workers[i].thread.join();
+  merger.join();
+}
+
+static void printSummary(double seconds) {
+  uint64_t bytes = 0;
+  for (auto &d : devices) bytes += d.second->bytes;
+  fprintf(stderr, "log_ingest: %zu devices, %d workers, %llu lines, %.1f MB in %.1f s; merge delay avg %.2f ms, max %.2f ms;"
+          " %llu overlong\n ", devices.size(), workerCount, (unsigned long long)merged.load(), bytes / 1e6, seconds,
+          merged ? mergeDelayTotalNs / 1e6 / merged : 0, mergeDelayMaxNs / 1e6, (unsigned long long)overlongTotal.load());
+  for (int k = 0; k < K_COUNT; k++) fprintf(stderr, " %s %llu", kindNames[k], (unsigned long long)kindCounts[k]);
+  fprintf(stderr, "\n");
+}
+
+// ---- Benchmark: simulated controllers on pseudo-terminals ----
+
+// Function to make line i of controller c - deterministic, so the checker can regenerate it
+static int makeLine(uint32_t c, uint64_t i, char *out) {
+  uint64_t h = (c + 1) * 0x9E3779B97F4A7C15ULL ^ (i * 0xBF58476D1CE4E5B9ULL);
+  h ^= h >> 31;
+  h *= 0x94D049BB133111EBULL;
+  h ^= h >> 29;
+  unsigned a = h >> 8 & 0xFF, b = h >> 16 & 0xFF, d = h >> 24 & 0xFF, e = h >> 32 & 0xFF;
+  switch (h % 12) {
+    case 0: case 1: case 2: return sprintf(out, "Card:  %02x %02x %02x %02x\r\n", a, b, d, e);
+    case 3: return sprintf(out, "Door %u card: %02x %02x %02x %02x\r\n", a % 16 + 1, a, b, d, e);
+    case 4: case 5: return sprintf(out, "Relay %u %s\r\n", a % 2 + 1, b & 1 ? "ON" : "OFF");
+    case 6: return sprintf(out, "Room %u assigned\r\n", a % 2 + 1);
+    case 7: return sprintf(out, "Access denied\r\n");
+    case 8: return sprintf(out, "Staff in Room %u\r\n", a % 16 + 1);
+    case 9: return sprintf(out, "Reader: gain %u dB, %llu reads, %u failed taps, %u recovered by retry\r\n",
+                           18 + a % 30, (unsigned long long)i, b, d);
+    case 10: return sprintf(out, "Occupancy: %u.%u edges/s, %u timer irqs, %u events, latency avg %u us max %u us,"
+                            " %u glitches, %u vacated\r\n", a % 10, b % 10, d * 7, e * 3, 21000 + a, 24000 + b, d % 5, e % 3);
+    default: return sprintf(out, "Scan your RFID tag\r\n");
+  }
+}
+
+struct SimController {
+  uint32_t index;
+  int master;
+  Device *dev;
+  std::atomic<uint64_t> written{0};   // Lines
+  uint64_t checked;                   // Lines seen by the checker, in order
+  uint64_t mismatches;
+};
+
+static std::vector<SimController *> sims;
+static std::map<const Device *, SimController *> simByDevice;
+static std::atomic<uint64_t> orderErrors(0);
+static uint64_t lastMergedNs = 0;
+
+static void benchCheck(const Device *dev, const char *text, size_t len, uint64_t ns) {
+  SimController *s = simByDevice[dev];
+  char expect[256];
+  int n = makeLine(s->index, s->checked++, expect);
+  if ((size_t)n - 2 != len || memcmp(expect, text, len) != 0) s->mismatches++;
+  if (ns < lastMergedNs) orderErrors++;
+  lastMergedNs = ns;
+}
+
+// Function to write one controller's log in writes that split lines anywhere - at the given baud rate
+// (10 bits per byte, as on the UART), or as fast as the pty takes it with baud 0
+static void runSimController(uint32_t c, SimController *s, double seconds, uint32_t baud) {
+  char buf[4096];
+  size_t len = 0;
+  uint64_t i = 0, sent = 0;
+  uint32_t seed = c * 7919 + 1;
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    if (baud != 0) std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 10000000 / baud));
+    while (len < sizeof(buf) - 256) len += makeLine(c, i++, buf + len);
+    seed = seed * 1103515245 + 12345;
+    size_t chunk = std::min(len, (size_t)(64 + (seed >> 16) % 2048));
+    size_t done = 0;
+    while (done < chunk) {
+      ssize_t n = write(s->master, buf + done, chunk - done);
+      if (n <= 0) return;
+      done += n;
+    }
+    memmove(buf, buf + chunk, len - chunk);
+    len -= chunk;
+    sent += chunk;
+    // Count whole lines handed over - a partial tail line is completed by a later write
+    s->written = i - std::count(buf, buf + len, '\n');
+  }
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(s->master, buf + done, len - done);
+    if (n <= 0) return;
+    done += n;
+  }
+  s->written = i;
+}
+
+static int runBench(int controllers, double seconds, uint32_t baud) {
+  std::vector<std::string> paths;
+  std::vector<int> holders;  // Slave fds held open so the raw settings stay until the daemon attaches
+  for (int c = 0; c < controllers; c++) {
+    int m = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m < 0 || grantpt(m) != 0 || unlockpt(m) != 0) {
+      fprintf(stderr, "could not open pseudo-terminal %d\n", c);
+      return 1;
+    }
+    paths.push_back(ptsname(m));
+    int slave = open(paths.back().c_str(), O_RDWR | O_NOCTTY);
+    termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    holders.push_back(slave);
+    SimController *s = new SimController();
+    s->index = c;
+    s->master = m;
+    sims.push_back(s);
+  }
+
+  checkLine = benchCheck;
+  std::thread merger;
+  startThreads(merger);
+  for (int c = 0; c < controllers; c++) {
+    attach(paths[c]);
+    sims[c]->dev = devices[paths[c]];
+    simByDevice[sims[c]->dev] = sims[c];
+  }
+  for (int fd : holders) close(fd);
+
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::thread> writers;
+  for (int c = 0; c < controllers; c++) writers.emplace_back(runSimController, c, sims[c], seconds, baud);
+  for (std::thread &t : writers) t.join();
+  uint64_t total = 0;
+  for (SimController *s : sims) total += s->written;
+  // Wait for the daemon to catch up - the masters stay open, since closing one hangs up its terminal
+  for (int i = 0; i < 500 && merged < total; i++) usleep(10000);
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  stopThreads(merger);
+
+  uint64_t bytes = 0, mismatches = 0, missing = 0;
+  for (SimController *s : sims) {
+    bytes += s->dev->bytes;
+    mismatches += s->mismatches;
+    missing += s->written - s->checked;
+  }
+  printf("%d controllers on pseudo-terminals, %s, %d workers, %.1f s:\n", controllers,
+         baud ? (std::to_string(baud) + " baud each").c_str() : "flat out", workerCount, elapsed);
+  printf("  %llu lines, %.1f MB ingested: %.2f M lines/s, %.1f MB/s\n", (unsigned long long)merged.load(), bytes / 1e6,
+         merged / elapsed / 1e6, bytes / elapsed / 1e6);
+  if (baud == 0) printf("  %d controllers at 115200 baud produce at most %.2f MB/s - %.0fx headroom\n", controllers,
+         controllers * 11520 / 1e6, bytes / elapsed / (controllers * 11520.0));
+  printf("  merge delay avg %.2f ms, max %.2f ms (watermark period %d ms)\n",
+         merged ? mergeDelayTotalNs / 1e6 / merged : 0, mergeDelayMaxNs / 1e6, WATERMARK_MS);
+  printf("  check: %llu lines missing, %llu altered, %llu out of time order\n", (unsigned long long)missing,
+         (unsigned long long)mismatches, (unsigned long long)orderErrors.load());
+  for (SimController *s : sims) close(s->master);
+  return missing || mismatches || orderErrors ? 1 : 0;
+}
+
+// ---- Daemon ----
+
+static void onSignal(int) {
+  running = false;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    int controllers = argc > 2 ? atoi(argv[2]) : 64;
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+    uint32_t baud = argc > 4 ? atoi(argv[4]) : 0;
+    if (controllers < 1 || controllers > 1000) controllers = 64;
+    if (seconds <= 0) seconds = 5;
+    return runBench(controllers, seconds, baud);
+  }
+
+  std::vector<std::string> patterns;
+  output.out = stdout;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output.out = fopen(argv[++i], "a");
+      if (output.out == NULL) {
+        perror(argv[i]);
+        return 1;
+      }
+    }
+    else patterns.push_back(argv[i]);
+  }
+  if (patterns.empty()) patterns.push_back("/dev/ttyACM*");
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  std::thread merger;
+  auto t0 = std::chrono::steady_clock::now();
+  startThreads(merger);
+  while (running) {
+    rescan(patterns);
+    for (int i = 0; i < RESCAN_MS / 100 && running; i++) usleep(100000);
+  }
+  stopThreads(merger);
+  printSummary(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+  return 0;
+}
@@ -0,0 +1,254 @@
+// Modbus slave benchmark - serves a 32-room table with the firmware's request handler on a loopback TCP
+// port and drives it from local Modbus clients, as a building-management head end would poll it.
+// Clients mix coil reads, owner/version register reads, sequence reads and coil writes, check every
+// response against the table and report sustained requests per second and round-trip latency.
+// The handler on its own is timed too, so the server and network overhead can be told apart.
+//
+// Build (host):  g++ -O2 -std=c++17 -pthread -Iinclude tools/modbus_bench.cpp src/modbus_slave.cpp -o modbus_bench
+// Run:           ./modbus_bench [seconds]
+#include "modbus_slave.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <random>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define ROOMS       32
+#define MAX_CLIENTS 8
+
+typedef std::chrono::steady_clock Clock;
+
+// The room table, laid out as room_state.cpp lays it out
+static bool relayOn[ROOMS];
+static bool relayHasOwner[ROOMS];
+static uint8_t relayOwner[ROOMS][4];
+static uint32_t roomVersion[ROOMS];
+static uint32_t roomStateSeq;
+
+// Function to switch a room - stands in for remoteSwitchRoom() in the firmware
+static bool switchRoom(uint16_t room, bool on) {
+  if (room >= ROOMS) return false;
+  if (relayOn[room] == on) return true;
+  relayOn[room] = on;
+  relayHasOwner[room] = false;
+  roomVersion[room] = ++roomStateSeq;
+  return true;
+}
+
+static const ModbusRegion regions[] = {
+  {0,   2 * ROOMS, MODBUS_BYTES, relayOwner},
+  {100, 2 * ROOMS, MODBUS_U32,   roomVersion},
+  {200, 2,         MODBUS_U32,   &roomStateSeq},
+};
+static const ModbusMap map = {relayOn, ROOMS, relayHasOwner, ROOMS, regions, 3, switchRoom};
+
+// ---- Server - one thread, the same stream cutting as modbusServeClient() ----
+
+static std::atomic<bool> stopServer(false);
+
+static void serve(int listener) {
+  struct Conn {
+    int fd;
+    uint8_t rx[MODBUS_TCP_MAX_ADU];
+    size_t len;
+  };
+  std::vector<Conn> conns;
+  uint8_t resp[MODBUS_TCP_MAX_ADU];
+  while (!stopServer) {
+    std::vector<pollfd> fds = {{listener, POLLIN, 0}};
+    for (Conn &c : conns) fds.push_back({c.fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), 50) <= 0) continue;
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listener, NULL, NULL);
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      conns.push_back({fd, {0}, 0});
+    }
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP))) continue;
+      Conn &c = conns[i - 1];
+      ssize_t n = read(c.fd, c.rx + c.len, sizeof(c.rx) - c.len);
+      if (n <= 0) {
+        close(c.fd);
+        c.fd = -1;
+        continue;
+      }
+      c.len += n;
+      for (;;) {
+        size_t need = modbusTcpLength(c.rx, c.len);
+        if (need == 0 || need > MODBUS_TCP_MAX_ADU || c.len < need) break;
+        size_t out = modbusHandleTcp(&map, c.rx, need, resp, sizeof(resp));
+        if (write(c.fd, resp, out) < 0) break;
+        memmove(c.rx, c.rx + need, c.len - need);
+        c.len -= need;
+      }
+    }
+    conns.erase(std::remove_if(conns.begin(), conns.end(), [](const Conn &c) { return c.fd < 0; }), conns.end());
+  }
+  for (Conn &c : conns) close(c.fd);
+}
+
+// ---- Clients ----
+
+struct ClientResult {
+  std::vector<double> latencyUs;
+  uint32_t bad;
+};
+
+// Function to build one request ADU - a BMS poll cycle's mix of reads with the odd write
+static size_t makeRequest(uint8_t *buf, uint16_t tid, std::mt19937 &rng) {
+  uint8_t pdu[6];
+  size_t len = 5;
+  int pick = rng() % 10;
+  uint16_t addr, qty;
+  if (pick < 4) { pdu[0] = MODBUS_READ_COILS; addr = 0; qty = ROOMS; }
+  else if (pick < 7) { pdu[0] = MODBUS_READ_HOLDING; addr = 0; qty = 2 * ROOMS; }
+  else if (pick < 8) { pdu[0] = MODBUS_READ_INPUT; addr = 100; qty = 2 * ROOMS; }
+  else if (pick < 9) { pdu[0] = MODBUS_READ_INPUT; addr = 200; qty = 2; }
+  else { pdu[0] = MODBUS_WRITE_COIL; addr = rng() % ROOMS; qty = (rng() & 1) ? 0xFF00 : 0x0000; }
+  pdu[1] = addr >> 8; pdu[2] = addr; pdu[3] = qty >> 8; pdu[4] = qty;
+  buf[0] = tid >> 8; buf[1] = tid; buf[2] = 0; buf[3] = 0;
+  buf[4] = 0; buf[5] = len + 1; buf[6] = 1;
+  memcpy(buf + MODBUS_MBAP_SIZE, pdu, len);
+  return MODBUS_MBAP_SIZE + len;
+}
+
+// Function to check a response - same transaction, same function, no exception, expected length
+static bool checkResponse(const uint8_t *req, const uint8_t *resp, size_t len) {
+  if (len < MODBUS_MBAP_SIZE + 2 || memcmp(req, resp, 2) != 0 || resp[7] != req[7]) return false;
+  uint16_t qty = (req[10] << 8) | req[11];
+  switch (req[7]) {
+    case MODBUS_READ_COILS:   return resp[8] == (qty + 7) / 8;
+    case MODBUS_READ_HOLDING:
+    case MODBUS_READ_INPUT:   return resp[8] == qty * 2;
+    default:                  return memcmp(req + 7, resp + 7, 5) == 0;
+  }
+}
+
+static void runClient(uint16_t port, double seconds, int seed, ClientResult *result) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+    result->bad++;
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  std::mt19937 rng(seed);
+  uint8_t req[32], resp[MODBUS_TCP_MAX_ADU];
+  auto end = Clock::now() + std::chrono::duration<double>(seconds);
+  for (uint16_t tid = 1; Clock::now() < end; tid++) {
+    size_t len = makeRequest(req, tid, rng);
+    auto t0 = Clock::now();
+    if (write(fd, req, len) != (ssize_t)len) break;
+    size_t got = 0, need = 0;
+    while (need == 0 || got < need) {
+      ssize_t n = read(fd, resp + got, sizeof(resp) - got);
+      if (n <= 0) break;
+      got += n;
+      need = modbusTcpLength(resp, got);
+    }
+    auto t1 = Clock::now();
+    if (!checkResponse(req, resp, got)) result->bad++;
+    result->latencyUs.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+  }
+  close(fd);
+}
+
+// Function to run a number of clients at once and print throughput and latency
+static void runLoad(uint16_t port, int clients, double seconds) {
+  std::vector<ClientResult> results(clients);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; i++) threads.emplace_back(runClient, port, seconds, 100 + i, &results[i]);
+  for (std::thread &t : threads) t.join();
+
+  std::vector<double> all;
+  uint32_t bad = 0;
+  for (const ClientResult &r : results) {
+    all.insert(all.end(), r.latencyUs.begin(), r.latencyUs.end());
+    bad += r.bad;
+  }
+  std::sort(all.begin(), all.end());
+  if (all.empty()) {
+    printf("%d client(s): no requests completed\n", clients);
+    return;
+  }
+  printf("%d client(s): %8.0f requests/s, round trip p50 %5.1f us, p99 %6.1f us, max %7.1f us, %u bad responses\n",
+         clients, all.size() / seconds, all[all.size() / 2], all[all.size() * 99 / 100], all.back(), bad);
+}
+
+// Function to time the request handler alone, per function code
+static void timeHandler() {
+  struct Case {
+    const char *name;
+    uint8_t pdu[5];
+  };
+  const Case cases[] = {
+    {"read 32 coils",         {MODBUS_READ_COILS, 0, 0, 0, ROOMS}},
+    {"read 64 owner regs",    {MODBUS_READ_HOLDING, 0, 0, 0, 2 * ROOMS}},
+    {"read 64 version regs",  {MODBUS_READ_INPUT, 0, 100, 0, 2 * ROOMS}},
+    {"write coil",            {MODBUS_WRITE_COIL, 0, 5, 0xFF, 0x00}},
+  };
+  uint8_t resp[MODBUS_MAX_PDU];
+  for (const Case &c : cases) {
+    const int rounds = 2000000;
+    size_t sink = 0;
+    auto t0 = Clock::now();
+    for (int i = 0; i < rounds; i++) {
+      sink += modbusHandlePdu(&map, c.pdu, sizeof(c.pdu), resp, sizeof(resp));
+      __asm__ __volatile__("" : : "r"(resp) : "memory");
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+    printf("  handler, %-22s %6.1f ns (%zu-byte response)\n", c.name, ns, sink / rounds);
+  }
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 3;
+  if (seconds <= 0) seconds = 3;
+  for (int r = 0; r < ROOMS; r++) {
+    relayOn[r] = r % 3 == 0;
+    relayHasOwner[r] = relayOn[r];
+    for (int b = 0; b < 4; b++) relayOwner[r][b] = r * 4 + b;
+    roomVersion[r] = r;
+  }
+  roomStateSeq = ROOMS;
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t alen = sizeof(addr);
+  if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, MAX_CLIENTS) != 0 ||
+      getsockname(listener, (sockaddr *)&addr, &alen) != 0) {
+    perror("listen");
+    return 1;
+  }
+  uint16_t port = ntohs(addr.sin_port);
+  std::thread server(serve, listener);
+
+  printf("Modbus TCP slave on 127.0.0.1:%u, %d rooms\n", port, ROOMS);
+  timeHandler();
+  runLoad(port, 1, seconds);
+  runLoad(port, 4, seconds);
+
+  stopServer = true;
+  server.join();
+  close(listener);
+  return 0;
+}
@@ -0,0 +1,261 @@
+// Occupancy sensor simulator - feeds simulated input edges through the firmware's debouncer and vacancy
+// rules on a virtual clock, one room per scenario, all rooms sharing one debouncer as on the controller.
+// Door contacts bounce on every transition, PIRs give multi-second pulses with the odd EMI spike, and the
+// debounce timer fires exactly when the firmware would arm it. Each scenario states when its room should
+// be switched off (or that it never should) and is checked against what the rules decided; the exit code
+// is non-zero if any check fails. Microsecond timestamps wrap many times over the run, as micros() does.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/occupancy_sim.cpp src/occupancy.cpp -o occupancy_sim
+// Run:           ./occupancy_sim [seed]
+#include "occupancy.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#define HOUR_MS        3600000ULL
+#define RUN_MS         (14 * HOUR_MS)
+#define LOOP_MS        1              // Main loop period - events are picked up at the next pass
+#define POLL_SAMPLE_MS 10             // Sampling period of the polled debounce it replaces, for comparison
+#define NEVER          UINT64_MAX
+
+// One raw edge on an input
+struct Edge {
+  uint64_t us;
+  uint8_t input;
+  bool level;
+};
+
+// One scenario - a room, its sensors and what should happen to it
+struct Scenario {
+  const char *name;
+  bool pir, door;
+  uint64_t expectVacantMs;            // NEVER if the room must stay on
+  uint64_t vacatedMs;
+  uint32_t events;
+  uint32_t latencyMaxUs;
+  uint64_t latencyTotalUs;
+};
+
+static std::mt19937 rng;
+static std::vector<Edge> edges;
+
+static uint64_t minutes(double m) {
+  return (uint64_t)(m * 60000);
+}
+
+// Function to add a clean transition plus contact bounce - a few extra toggles over the next 3 ms that end
+// at the new level
+static void transition(uint8_t input, uint64_t ms, bool level, bool bounce) {
+  uint64_t us = ms * 1000;
+  edges.push_back({us, input, level});
+  if (!bounce) return;
+  int toggles = 2 * (1 + rng() % 4);
+  for (int i = 0; i < toggles; i++) {
+    us += 50 + rng() % 700;
+    edges.push_back({us, input, (i % 2 == 0) ? !level : level});
+  }
+}
+
+// Function to add one PIR pulse - the output holds for a few seconds after the last movement
+static void motion(uint8_t room, uint64_t ms) {
+  transition(2 * room + OCC_PIR, ms, true, false);
+  transition(2 * room + OCC_PIR, ms + 2000 + rng() % 3000, false, false);
+}
+
+// Function to add motion pulses over a span - someone up and about trips the PIR every 10-90 s, well inside
+// the grace period, which is what lets a door closing behind them be told from one closing as they leave
+static void activity(uint8_t room, uint64_t fromMs, uint64_t toMs) {
+  for (uint64_t t = fromMs; t < toMs; t += 10000 + rng() % 80000) motion(room, t);
+}
+
+// Function to add an EMI spike on a PIR line - shorter than any debounce
+static void spike(uint8_t room, uint64_t ms) {
+  uint64_t us = ms * 1000;
+  edges.push_back({us, (uint8_t)(2 * room + OCC_PIR), true});
+  edges.push_back({us + 40, (uint8_t)(2 * room + OCC_PIR), false});
+}
+
+// Function to open a door, then close it a few seconds later
+static void passDoor(uint8_t room, uint64_t ms) {
+  transition(2 * room + OCC_DOOR, ms, true, true);
+  transition(2 * room + OCC_DOOR, ms + 3000 + rng() % 5000, false, true);
+}
+
+// ---- The controller side, as occupancyBegin() and occupancyPoll() wire it ----
+
+static OccupancyDebouncer deb;
+static OccupancyRoom rooms[OCC_MAX_INPUTS / 2];
+static bool levels[OCC_MAX_INPUTS];
+static bool roomOn[OCC_MAX_INPUTS / 2];
+
+static bool readLevel(uint8_t input) {
+  return levels[input];
+}
+
+int main(int argc, char **argv) {
+  rng.seed(argc > 1 ? atoi(argv[1]) : 1);
+
+  std::vector<Scenario> sc = {
+    {"overnight guest, leaves", true, true, 0, NEVER, 0, 0, 0},
+    {"leaves without tap-out", true, true, 0, NEVER, 0, 0, 0},
+    {"still reader, door shut", true, true, NEVER, NEVER, 0, 0, 0},
+    {"door left open, idle", true, true, 0, NEVER, 0, 0, 0},
+    {"PIR only", true, false, 0, NEVER, 0, 0, 0},
+    {"door contact only", false, true, NEVER, NEVER, 0, 0, 0},
+    {"chattering contact", true, true, NEVER, NEVER, 0, 0, 0},
+  };
+  uint8_t n = sc.size();
+
+  // Overnight: busy evening, asleep and still for 8 hours, up, out at 9 h - off one grace period later
+  passDoor(0, 2000);
+  activity(0, 10000, minutes(120));
+  spike(0, minutes(300));
+  activity(0, 9 * HOUR_MS - minutes(30), 9 * HOUR_MS - 20000);
+  passDoor(0, 9 * HOUR_MS - 10000);
+
+  // Checks in, drops a bag, leaves at 25 min for the rest of the day
+  passDoor(1, 1500);
+  activity(1, 5000, minutes(20));
+  passDoor(1, minutes(25));
+
+  // Reads in a chair for the whole run - moves now and then, then not at all for hours
+  passDoor(2, 2500);
+  activity(2, 8000, minutes(40));
+  for (int i = 0; i < 50; i++) spike(2, minutes(60) + i * minutes(13));
+
+  // Door propped open, nobody moving after 15 min
+  transition(2 * 3 + OCC_DOOR, 3000, true, true);
+  activity(3, 5000, minutes(15));
+
+  // No door contact - motion for two hours
+  activity(4, 1000, 2 * HOUR_MS);
+
+  // Door only - opened and closed all day, never enough to call the room empty
+  for (uint64_t t = 1000; t < RUN_MS - HOUR_MS; t += HOUR_MS) passDoor(5, t);
+
+  // A worn contact that chatters for half a second each time, with someone inside throughout
+  for (uint64_t t = 1000; t < RUN_MS - HOUR_MS; t += 2 * HOUR_MS) {
+    uint8_t input = 2 * 6 + OCC_DOOR;
+    for (int i = 0; i < 201; i++) edges.push_back({t * 1000 + i * 2500, input, i % 2 == 0});  // Ends open
+    edges.push_back({t * 1000 + 201 * 2500 + 4000000, input, false});
+    motion(6, t + 10000);
+  }
+  activity(6, 20000, RUN_MS);
+
+  std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.us < b.us; });
+
+  // Expected vacancy: the last door close plus the grace period, or the end of the last motion plus the
+  // idle time - each counted from the input's final edge plus the debounce time
+  for (uint8_t r = 0; r < n; r++) {
+    if (sc[r].expectVacantMs == NEVER) continue;
+    uint64_t lastClose = 0, lastMotion = 0;
+    bool open = false;
+    for (const Edge &e : edges) {
+      if (e.input / 2 != r) continue;
+      if (e.input % 2 == OCC_DOOR) {
+        open = e.level;
+        if (!e.level) lastClose = e.us / 1000;
+      }
+      else if (!e.level) lastMotion = e.us / 1000;
+    }
+    sc[r].expectVacantMs = OCC_DEBOUNCE_US / 1000 +
+                           ((sc[r].door && !open) ? lastClose + OCC_CLOSE_GRACE_MS : lastMotion + OCC_IDLE_MS);
+  }
+
+  occupancyInit(&deb, 2 * n, OCC_DEBOUNCE_US, 0);
+  for (uint8_t r = 0; r < n; r++) {
+    rooms[r].pirFitted = sc[r].pir;
+    rooms[r].doorFitted = sc[r].door;
+    occupancyRoomOn(&rooms[r], 0);  // Every room was just checked in
+    roomOn[r] = true;
+  }
+
+  uint64_t timerDueUs = 0;  // 0 while the one-shot timer is idle
+  size_t next = 0;
+  uint32_t checks = 0, loopWakeups = 0;
+  bool checkDue = false;
+  uint64_t checkMs = 0;
+  for (uint64_t ms = 0; ms < RUN_MS; ms += LOOP_MS) {
+    uint64_t endUs = (ms + LOOP_MS) * 1000;
+    // Interrupts in time order up to this loop pass
+    for (;;) {
+      uint64_t edgeUs = next < edges.size() ? edges[next].us : UINT64_MAX;
+      uint64_t fireUs = timerDueUs ? timerDueUs : UINT64_MAX;
+      if (std::min(edgeUs, fireUs) >= endUs) break;
+      if (edgeUs <= fireUs) {
+        const Edge &e = edges[next++];
+        if (levels[e.input] == e.level) continue;  // No edge - the line was already there
+        levels[e.input] = e.level;
+        if (occupancyEdge(&deb, e.input, (uint32_t)e.us)) timerDueUs = e.us + deb.debounceUs;
+      }
+      else {
+        uint32_t wait = occupancySettle(&deb, (uint32_t)fireUs, readLevel);
+        timerDueUs = wait ? fireUs + wait : 0;
+      }
+    }
+
+    // The loop side - events, then vacancy only when something changed or a timeout ran out
+    uint32_t nowMs = (uint32_t)(ms + LOOP_MS);
+    bool changed = false;
+    OccupancyEvent ev;
+    while (occupancyNextEvent(&deb, &ev)) {
+      Scenario &s = sc[ev.input / 2];
+      occupancyApply(&rooms[ev.input / 2], ev.input % 2, ev.active, nowMs);
+      uint32_t latency = (uint32_t)endUs - ev.edgeUs;
+      s.events++;
+      s.latencyTotalUs += latency;
+      s.latencyMaxUs = std::max(s.latencyMaxUs, latency);
+      changed = true;
+    }
+    if (!changed && (!checkDue || ms + LOOP_MS < checkMs)) continue;
+    loopWakeups++;
+    checkDue = false;
+    for (uint8_t r = 0; r < n; r++) {
+      if (!roomOn[r]) continue;
+      uint32_t waitMs;
+      checks++;
+      if (occupancyVacant(&rooms[r], nowMs, &waitMs)) {
+        roomOn[r] = false;
+        sc[r].vacatedMs = ms + LOOP_MS;
+      }
+      else if (waitMs != 0 && (!checkDue || ms + LOOP_MS + waitMs < checkMs)) {
+        checkDue = true;
+        checkMs = ms + LOOP_MS + waitMs;
+      }
+    }
+  }
+
+  int failures = 0;
+  printf("%zu raw edges over %llu h, debounce %u ms, grace %u s, idle %u min\n", edges.size(),
+         (unsigned long long)(RUN_MS / HOUR_MS), OCC_DEBOUNCE_US / 1000, OCC_CLOSE_GRACE_MS / 1000, OCC_IDLE_MS / 60000);
+  printf("  %-26s %12s %12s %7s %22s\n", "scenario", "expected off", "switched off", "events", "edge-to-decision avg/max");
+  for (uint8_t r = 0; r < n; r++) {
+    const Scenario &s = sc[r];
+    char expect[16], got[16];
+    if (s.expectVacantMs == NEVER) snprintf(expect, sizeof(expect), "never");
+    else snprintf(expect, sizeof(expect), "%.1f min", s.expectVacantMs / 60000.0);
+    if (s.vacatedMs == NEVER) snprintf(got, sizeof(got), "never");
+    else snprintf(got, sizeof(got), "%.1f min", s.vacatedMs / 60000.0);
+    bool ok = s.expectVacantMs == NEVER ? s.vacatedMs == NEVER
+                                        : s.vacatedMs != NEVER && s.vacatedMs >= s.expectVacantMs &&
+                                          s.vacatedMs <= s.expectVacantMs + 2 * LOOP_MS;
+    failures += !ok;
+    printf("  %-26s %12s %12s %7u %10.1f / %6.1f ms  %s\n", s.name, expect, got, s.events,
+           s.events ? s.latencyTotalUs / 1000.0 / s.events : 0, s.latencyMaxUs / 1000.0, ok ? "ok" : "FAIL");
+  }
+
+  double hours = RUN_MS / (double)HOUR_MS;
+  uint32_t inputs = 0;
+  for (uint8_t r = 0; r < n; r++) inputs += sc[r].pir + sc[r].door;
+  printf("interrupts: %u edge + %u timer = %.0f per hour; %u glitches absorbed, %u events dropped\n", deb.edges,
+         deb.timerFires, (deb.edges + deb.timerFires) / hours, deb.glitches, deb.dropped);
+  printf("polled debounce at %u ms for the same %u inputs: %.0f pin reads per hour\n", POLL_SAMPLE_MS, inputs,
+         inputs * 3600000.0 / POLL_SAMPLE_MS);
+  printf("vacancy checks: %u in %u loop passes that had anything to do, of %llu\n", checks, loopWakeups,
+         (unsigned long long)(RUN_MS / LOOP_MS));
+  if (failures) printf("%d scenario(s) FAILED\n", failures);
+  return failures ? 1 : 0;
+}
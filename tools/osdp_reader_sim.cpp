@@ -0,0 +1,259 @@
+// OSDP reader-bus simulator - runs the controller's bus code against simulated readers over a pseudo-terminal
+// A child process plays every reader on the pty master: it answers polls after the wire time the frames would
+// take at the chosen baud rate, presents cards at a few busy doors and many quiet ones, drops a small share
+// of replies and repeats its last reply when the controller retries with the same sequence number.
+// The parent runs osdpService() on the pty slave exactly as osdpPoll() does on the UART, decides each card
+// at once, and reports bus utilization and per-door latency from card presented to decision made -
+// first with the adaptive poll schedule, then with every reader polled at the idle interval for comparison.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/osdp_reader_sim.cpp src/osdp.cpp -o osdp_reader_sim
+// Run:           ./osdp_reader_sim [readers] [baud] [seconds]
+#include "osdp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <random>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#define BUSY_DOORS        4       // Ward entrances and the like - the first doors on the bus
+#define BUSY_GAP_MS       2000    // Mean time between cards at a busy door
+#define QUIET_GAP_MS      20000   // Mean time between cards at any other door
+#define TURNAROUND_US     1000    // Reader processing time before it starts replying
+#define DROP_PER_MILLE    2       // Replies lost on the line
+#define GRANTED_PCT       90      // Share of cards the simulated controller accepts
+
+typedef std::chrono::steady_clock Clock;
+static Clock::time_point epoch;
+
+static double nowMs() {
+  return std::chrono::duration<double, std::milli>(Clock::now() - epoch).count();
+}
+
+// One card presentation - the card number is the index, so the controller side can find the time it was presented
+struct Presentation {
+  double atMs;
+  uint8_t door;
+};
+
+// Function to generate card presentations for every door over the run, in time order per door
+static std::vector<Presentation> generateCards(int readers, int seconds, std::mt19937 &rng) {
+  std::vector<Presentation> cards;
+  for (int door = 0; door < readers; door++) {
+    std::exponential_distribution<double> gap(1.0 / (door < BUSY_DOORS ? BUSY_GAP_MS : QUIET_GAP_MS));
+    for (double t = 500 + gap(rng); t < seconds * 1000.0 - 500; t += gap(rng) + 500) cards.push_back({t, (uint8_t)door});
+  }
+  return cards;
+}
+
+// ---- Reader side (child process, pty master) ----
+
+struct SimReader {
+  std::vector<uint32_t> pending;  // Card numbers in presentation order
+  size_t next;
+  uint8_t lastSeq;
+  uint8_t lastReply[OSDP_MAX_FRAME];
+  size_t lastReplyLen;
+  uint32_t leds, buzzes;
+};
+
+static void sleepUs(double us) {
+  if (us > 0) usleep((useconds_t)us);
+}
+
+static void runReaders(int fd, int readers, uint32_t baud, const std::vector<Presentation> &cards) {
+  std::vector<SimReader> sim(readers);
+  for (uint32_t id = 0; id < cards.size(); id++) sim[cards[id].door].pending.push_back(id);
+  for (SimReader &r : sim) r.lastSeq = 0xFF;
+  std::mt19937 rng(11);
+  uint32_t dropped = 0, repeated = 0;
+  double usPerByte = 10e6 / baud;
+
+  uint8_t rx[256];
+  size_t rxLen = 0;
+  for (;;) {
+    ssize_t n = read(fd, rx + rxLen, sizeof(rx) - rxLen);
+    if (n <= 0) break;  // Controller closed its end
+    rxLen += n;
+    for (;;) {
+      OsdpFrame cmd;
+      int used = osdpParse(rx, rxLen, &cmd);
+      if (used == 0) break;
+      size_t drop = used > 0 ? used : -used;
+      memmove(rx, rx + drop, rxLen - drop);
+      rxLen -= drop;
+      if (used < 0 || cmd.reply || cmd.addr >= readers) continue;
+
+      SimReader &r = sim[cmd.addr];
+      sleepUs(used * usPerByte + TURNAROUND_US);  // The command's own wire time, then the reader's turnaround
+
+      if (cmd.seq != 0 && cmd.seq == r.lastSeq) {
+        repeated++;  // Retry of a command whose reply was lost - answer the same again, act on nothing
+      }
+      else {
+        uint8_t data[8];
+        size_t len = 0;
+        uint8_t code = OSDP_REPLY_ACK;
+        if (cmd.code == OSDP_CMD_POLL && r.next < r.pending.size() && cards[r.pending[r.next]].atMs <= nowMs()) {
+          uint32_t id = r.pending[r.next++];
+          uint8_t raw[8] = {0, 0, 32, 0, (uint8_t)(id >> 24), (uint8_t)(id >> 16), (uint8_t)(id >> 8), (uint8_t)id};
+          memcpy(data, raw, sizeof(raw));
+          len = sizeof(raw);
+          code = OSDP_REPLY_RAW;
+        }
+        else if (cmd.code == OSDP_CMD_LED) r.leds++;
+        else if (cmd.code == OSDP_CMD_BUZ) r.buzzes++;
+        else if (cmd.code != OSDP_CMD_POLL) code = OSDP_REPLY_NAK;
+        r.lastReplyLen = osdpBuild(r.lastReply, sizeof(r.lastReply), cmd.addr, true, cmd.seq, code, data, len);
+        r.lastSeq = cmd.seq;
+      }
+
+      if ((int)(rng() % 1000) < DROP_PER_MILLE) {
+        dropped++;
+        continue;
+      }
+      sleepUs(r.lastReplyLen * usPerByte);
+      if (write(fd, r.lastReply, r.lastReplyLen) < 0) break;
+    }
+  }
+
+  uint32_t leds = 0, buzzes = 0, left = 0;
+  for (const SimReader &r : sim) {
+    leds += r.leds;
+    buzzes += r.buzzes;
+    left += r.pending.size() - r.next;
+  }
+  printf("  readers: %u LED and %u buzzer commands, %u replies dropped, %u repeated on retry, %u cards never polled\n",
+         leds, buzzes, dropped, repeated, left);
+  fflush(stdout);
+}
+
+// ---- Controller side (parent, pty slave) ----
+
+static int busFd = -1;
+
+static size_t ptyWrite(const uint8_t *buf, size_t len) {
+  ssize_t n = write(busFd, buf, len);
+  return n > 0 ? n : 0;
+}
+
+static size_t ptyRead(uint8_t *buf, size_t cap) {
+  ssize_t n = read(busFd, buf, cap);
+  return n > 0 ? n : 0;
+}
+
+static const OsdpPort ptyPort = {ptyWrite, ptyRead};
+
+// Function to print one latency summary - mean, 95th percentile and worst, in ms
+static void printLatency(const char *label, std::vector<double> v) {
+  if (v.empty()) {
+    printf("  %-22s no cards\n", label);
+    return;
+  }
+  std::sort(v.begin(), v.end());
+  double sum = 0;
+  for (double x : v) sum += x;
+  printf("  %-22s %5zu cards, mean %6.1f ms, p95 %6.1f ms, max %6.1f ms\n", label, v.size(), sum / v.size(),
+         v[v.size() * 95 / 100], v.back());
+}
+
+// Function to run one simulation - returns false if the pty could not be set up
+static bool runBus(int readers, uint32_t baud, int seconds, bool adaptive) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return false;
+  busFd = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (busFd < 0) return false;
+  termios tio;
+  tcgetattr(busFd, &tio);
+  cfmakeraw(&tio);  // Binary frames - no echo, no line editing
+  tcsetattr(busFd, TCSANOW, &tio);
+
+  std::mt19937 rng(5);
+  std::vector<Presentation> cards = generateCards(readers, seconds, rng);
+  epoch = Clock::now();
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    close(busFd);
+    runReaders(master, readers, baud, cards);
+    _exit(0);
+  }
+
+  static OsdpBus bus;
+  osdpInit(&bus, &ptyPort, baud, readers, 0);
+  bus.adaptive = adaptive;
+  std::vector<std::vector<double>> latency(readers);
+  std::mt19937 decide(9);
+  double endMs = seconds * 1000.0;
+  while (nowMs() < endMs) {
+    osdpService(&bus, (uint32_t)nowMs());
+    OsdpCardRead read;
+    while (osdpNextCard(&bus, &read)) {
+      uint32_t id = ((uint32_t)read.uid[0] << 24) | (read.uid[1] << 16) | (read.uid[2] << 8) | read.uid[3];
+      if (id < cards.size()) latency[read.reader].push_back(nowMs() - cards[id].atMs);
+      osdpCardHandled(&bus, &read, (int)(decide() % 100) < GRANTED_PCT, (uint32_t)nowMs());
+    }
+    usleep(100);  // The firmware loop does other work between bus calls too
+  }
+  uint32_t end = (uint32_t)nowMs();
+
+  printf("%s schedule, %d readers at %u baud, %d s:\n", adaptive ? "adaptive" : "fixed", readers, baud, seconds);
+  fflush(stdout);
+  close(busFd);
+  waitpid(child, NULL, 0);
+  close(master);
+
+  uint32_t polls = 0, timeouts = 0, online = 0, gapMax = 0;
+  for (int i = 0; i < readers; i++) {
+    polls += bus.readers[i].polls;
+    timeouts += bus.readers[i].timeouts;
+    online += bus.readers[i].online;
+    gapMax = std::max(gapMax, bus.readers[i].pollGapMax);
+  }
+  printf("  bus: line %.1f%%, held %.1f%%, %.0f exchanges/s, %u timeouts, %u/%d online, longest poll gap %u ms, %u cards dropped\n",
+         osdpUtilization(&bus, end), 100.0 * bus.heldMs / end, polls * 1000.0 / end, timeouts, online, readers,
+         gapMax, bus.cardsDropped);
+
+  std::vector<double> busy, quiet;
+  for (int i = 0; i < readers; i++) (i < BUSY_DOORS ? busy : quiet).insert((i < BUSY_DOORS ? busy : quiet).end(),
+                                                                          latency[i].begin(), latency[i].end());
+  printLatency("busy doors:", busy);
+  printLatency("quiet doors:", quiet);
+  printf("  door  polls  max gap  cards  presented-to-decision mean/max\n");
+  for (int i = 0; i < readers; i++) {
+    const OsdpReader &r = bus.readers[i];
+    double sum = 0, worst = 0;
+    for (double x : latency[i]) {
+      sum += x;
+      worst = std::max(worst, x);
+    }
+    if (i >= BUSY_DOORS + 4 && i < readers - 2) continue;  // Quiet doors look alike - show a few
+    printf("  %4d %6u %6u ms %6zu  %6.1f / %6.1f ms\n", i + 1, r.polls, r.pollGapMax, latency[i].size(),
+           latency[i].empty() ? 0 : sum / latency[i].size(), worst);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int readers = argc > 1 ? atoi(argv[1]) : 32;
+  uint32_t baud = argc > 2 ? atoi(argv[2]) : 115200;
+  int seconds = argc > 3 ? atoi(argv[3]) : 20;
+  if (readers < 1 || readers > OSDP_MAX_READERS) readers = 32;
+  if (baud < 1200) baud = 115200;
+  if (seconds < 2) seconds = 20;
+  signal(SIGPIPE, SIG_IGN);
+
+  if (!runBus(readers, baud, seconds, true) || !runBus(readers, baud, seconds, false)) {
+    fprintf(stderr, "could not open a pseudo-terminal\n");
+    return 1;
+  }
+  return 0;
+}
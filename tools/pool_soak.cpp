@@ -0,0 +1,416 @@
+// Pool soak test - months of controller traffic against a model of the ESP32 heap, once with every message,
+// event record and frame allocated from the heap and once with them in block pools (block_pool.h)
+// The heap model is first-fit with coalescing over a fixed arena, as multi_heap is. Each simulated minute
+// brings taps - three messages each, built by String concatenation with its temporaries and the reallocs
+// as they grow, kept in a five-line display ring - and an event record per tap and a telemetry frame,
+// both queued until sent. Wi-Fi drops a few times a day, so queues fill and drain and the Wi-Fi stack's
+// own long-lived buffers are freed and taken again wherever they fit. HTTP sessions hold buffers for
+// a few minutes. Every hour the soak asks for a 4 KB buffer, as an OTA chunk or a large page would,
+// and samples fragmentation, 1 - largest free block / free bytes; a day reports its worst hour.
+// With pools the same traffic takes blocks from three fixed arrays carved out of the arena once at boot,
+// and the heap is left with the Wi-Fi buffers and the sessions.
+//
+// The pool is also hammered from several threads, checking that no block is ever handed out twice.
+//
+// Build (host):  g++ -O2 -std=c++17 -pthread -Iinclude tools/pool_soak.cpp src/block_pool.cpp -o pool_soak
+// Run:           ./pool_soak [days]
+#include "block_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define ARENA_BYTES      (40 * 1024)  // Heap left to the application once Wi-Fi is up
+#define HEADER_BYTES     8            // Per allocation, as multi_heap
+#define TAPS_PER_DAY     400          // A busy controller with OSDP doors
+#define FRAME_EVERY_MIN  1            // Telemetry frame each minute
+#define OUTAGES_PER_DAY  3
+#define EVENT_QUEUE_MAX  32           // Events held while the link is down - the oldest are dropped beyond this
+#define FRAME_QUEUE_MAX  16           // WIFI_QUEUE_SLOTS
+#define WIFI_BUFFERS     4            // Long-lived Wi-Fi stack buffers, taken again at each reconnect
+#define WIFI_BUFFER_BYTES 1600
+#define BIG_REQUEST      4096         // The hourly large allocation
+#define SESSIONS_PER_DAY 48           // HTTP requests, each holding a few buffers a while
+
+#define LOG_LINE_BYTES   48           // As LOG_LINE_SIZE in the firmware
+#define EVENT_BYTES      32           // JOURNAL_RECORD_SIZE
+#define FRAME_BYTES      192          // WIFI_FRAME_MAX
+
+// First-fit heap with coalescing over a fixed arena
+struct Heap {
+  std::map<uint32_t, uint32_t> freeBlocks;          // Offset -> bytes, in address order
+  std::unordered_map<uint32_t, uint32_t> used;      // Offset -> bytes
+  uint32_t failures = 0;
+  uint64_t calls = 0;                               // Allocations served, failed or not
+
+  Heap() { freeBlocks[0] = ARENA_BYTES; }
+
+  int64_t alloc(uint32_t bytes) {
+    uint32_t need = (bytes + HEADER_BYTES + 7) & ~7U;
+    calls++;
+    for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+      if (it->second < need) continue;
+      uint32_t at = it->first, rest = it->second - need;
+      freeBlocks.erase(it);
+      if (rest >= 16) freeBlocks[at + need] = rest;
+      else need += rest;
+      used[at] = need;
+      return at;
+    }
+    failures++;
+    return -1;
+  }
+
+  void release(int64_t at) {
+    if (at < 0) return;
+    auto u = used.find(at);
+    uint32_t start = at, bytes = u->second;
+    used.erase(u);
+    auto next = freeBlocks.lower_bound(start);
+    if (next != freeBlocks.end() && next->first == start + bytes) {
+      bytes += next->second;
+      next = freeBlocks.erase(next);
+    }
+    if (next != freeBlocks.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second == start) {
+        prev->second += bytes;
+        return;
+      }
+    }
+    freeBlocks[start] = bytes;
+  }
+
+  // String-style growth - a new buffer, then the old one freed, as realloc does when the next block is taken
+  int64_t grow(int64_t at, uint32_t bytes) {
+    int64_t moved = alloc(bytes);
+    release(at);
+    return moved;
+  }
+
+  uint32_t freeBytes() const {
+    uint32_t n = 0;
+    for (const auto &f : freeBlocks) n += f.second;
+    return n;
+  }
+
+  uint32_t largest() const {
+    uint32_t n = 0;
+    for (const auto &f : freeBlocks) n = std::max(n, f.second);
+    return n;
+  }
+};
+
+struct DayStats {
+  double fragmentation;              // Worst hourly sample, and the free bytes at that sample
+  uint32_t freeBytes, largest;       // Largest is the smallest largest-free-block of the day
+  uint32_t bigFailures;              // Hourly 4 KB requests refused that day
+  uint32_t calls;                    // Heap allocations that day
+};
+
+// One controller's traffic - allocations go to the heap or to the pools
+struct Controller {
+  bool pooled;
+  Heap heap;
+  std::mt19937_64 rng;               // Sizes - drawn more often on the heap
+  std::mt19937_64 traffic;           // Taps, outages and sessions - the same in both runs
+  std::vector<int64_t> ring;         // Display ring - heap offsets
+  std::vector<void *> ringBlocks;    // Display ring - pool blocks
+  std::vector<int64_t> events, frames;
+  std::vector<void *> eventBlocks, frameBlocks;
+  std::vector<int64_t> wifiBuffers;
+  struct Session {
+    std::vector<int64_t> buffers;
+    uint32_t until;
+  };
+  std::vector<Session> sessions;
+  BlockPool logPool, eventPool, framePool;
+  uint8_t *poolStorage[3];
+  std::atomic<uint16_t> *poolLinks[3];
+  size_t ringNext = 0;
+  uint32_t dropped = 0;
+  bool linkUp = true;
+  uint32_t downUntil = 0;
+
+  Controller(bool usePools) : pooled(usePools), rng(7), traffic(11), ring(5, -1), ringBlocks(5, NULL) {
+    for (int i = 0; i < WIFI_BUFFERS; i++) wifiBuffers.push_back(heap.alloc(WIFI_BUFFER_BYTES));
+    if (pooled) {
+      // The pools' storage comes out of the heap once at boot and is never returned
+      uint16_t counts[3] = {8, EVENT_QUEUE_MAX, FRAME_QUEUE_MAX};
+      uint16_t sizes[3] = {LOG_LINE_BYTES, EVENT_BYTES, FRAME_BYTES};
+      BlockPool *pools[3] = {&logPool, &eventPool, &framePool};
+      for (int p = 0; p < 3; p++) {
+        heap.alloc(counts[p] * (sizes[p] + 2));
+        poolStorage[p] = new uint8_t[counts[p] * sizes[p]];
+        poolLinks[p] = new std::atomic<uint16_t>[counts[p]];
+        blockPoolInit(pools[p], poolStorage[p], sizes[p], counts[p], poolLinks[p]);
+      }
+    }
+  }
+
+  ~Controller() {
+    if (!pooled) return;
+    for (int p = 0; p < 3; p++) {
+      delete[] poolStorage[p];
+      delete[] poolLinks[p];
+    }
+  }
+
+  uint32_t between(uint32_t lo, uint32_t hi) { return lo + rng() % (hi - lo + 1); }
+
+  // Function to add one display message - with Strings, the pieces are concatenated on the heap first
+  void message() {
+    uint32_t len = between(10, 40);
+    if (pooled) {
+      blockPoolFree(&logPool, ringBlocks[ringNext]);
+      ringBlocks[ringNext] = blockPoolAlloc(&logPool);
+    }
+    else {
+      int64_t number = heap.alloc(3);                   // String(room + 1)
+      int64_t sum = heap.alloc(between(6, 12));         // "Relay " ...
+      sum = heap.grow(sum, len - between(3, 6));        // + String(...)
+      sum = heap.grow(sum, len + 1);                    // + " ON"
+      heap.release(ring[ringNext]);                     // The slot's old line
+      ring[ringNext] = heap.alloc(len + 1);             // Copied into the ring
+      heap.release(sum);
+      heap.release(number);
+    }
+    ringNext = (ringNext + 1) % 5;
+  }
+
+  // Function to queue an event record or a frame - the oldest is dropped when the queue is full
+  void queueEvent() {
+    if (pooled) {
+      void *b = blockPoolAlloc(&eventPool);
+      if (b == NULL) {
+        blockPoolFree(&eventPool, eventBlocks.front());
+        eventBlocks.erase(eventBlocks.begin());
+        dropped++;
+        b = blockPoolAlloc(&eventPool);
+      }
+      eventBlocks.push_back(b);
+      return;
+    }
+    if (events.size() == EVENT_QUEUE_MAX) {
+      heap.release(events.front());
+      events.erase(events.begin());
+      dropped++;
+    }
+    events.push_back(heap.alloc(EVENT_BYTES));
+  }
+
+  void queueFrame() {
+    uint32_t len = between(60, FRAME_BYTES);
+    if (pooled) {
+      if (frameBlocks.size() == FRAME_QUEUE_MAX) {
+        blockPoolFree(&framePool, frameBlocks.front());
+        frameBlocks.erase(frameBlocks.begin());
+        dropped++;
+      }
+      frameBlocks.push_back(blockPoolAlloc(&framePool));
+      return;
+    }
+    if (frames.size() == FRAME_QUEUE_MAX) {
+      heap.release(frames.front());
+      frames.erase(frames.begin());
+      dropped++;
+    }
+    int64_t json = heap.alloc(len * 2);                   // Serialized into a String, then copied out
+    frames.push_back(heap.alloc(len));
+    heap.release(json);
+  }
+
+  // Function to send everything queued - the link just came back, or never went
+  void flush() {
+    for (int64_t e : events) heap.release(e);
+    for (int64_t f : frames) heap.release(f);
+    for (void *b : eventBlocks) blockPoolFree(&eventPool, b);
+    for (void *b : frameBlocks) blockPoolFree(&framePool, b);
+    events.clear(), frames.clear(), eventBlocks.clear(), frameBlocks.clear();
+  }
+
+  void minute(uint32_t now) {
+    if (linkUp && traffic() % (1440 / OUTAGES_PER_DAY) == 0) {
+      linkUp = false;
+      downUntil = now + 1 + traffic() % 120;
+    }
+    if (!linkUp && now >= downUntil) {
+      linkUp = true;
+      for (int64_t &b : wifiBuffers) {  // The stack frees its buffers on disconnect and takes them again here
+        heap.release(b);
+        b = heap.alloc(WIFI_BUFFER_BYTES);
+      }
+    }
+    for (size_t i = 0; i < sessions.size();) {
+      if (now < sessions[i].until) {
+        i++;
+        continue;
+      }
+      for (int64_t b : sessions[i].buffers) heap.release(b);
+      sessions.erase(sessions.begin() + i);
+    }
+    if (linkUp && traffic() % (1440 / SESSIONS_PER_DAY) == 0) {
+      Session session;
+      for (uint32_t n = 1 + traffic() % 3; n > 0; n--) session.buffers.push_back(heap.alloc(200 + traffic() % 1800));
+      session.until = now + 1 + traffic() % 10;
+      sessions.push_back(session);
+    }
+    std::poisson_distribution<int> taps(TAPS_PER_DAY / 1440.0);
+    for (int t = taps(traffic); t > 0; t--) {
+      for (int m = 0; m < 3; m++) message();  // Card line, relay line, room line
+      queueEvent();
+    }
+    if (now % FRAME_EVERY_MIN == 0) queueFrame();
+    if (linkUp) flush();
+  }
+};
+
+// Function to run the soak - the heap is sampled every hour, and each day keeps its worst sample
+static std::vector<DayStats> soak(bool pooled, int days, uint32_t *dropped, uint32_t *poolExhausted) {
+  Controller c(pooled);
+  std::vector<DayStats> out;
+  for (int day = 0; day < days; day++) {
+    DayStats worst = {0, 0, ARENA_BYTES, 0, 0};
+    uint64_t calls = c.heap.calls;
+    for (uint32_t m = 0; m < 1440; m++) {
+      c.minute(day * 1440 + m);
+      if (m % 60 != 30) continue;
+      uint32_t freeBytes = c.heap.freeBytes(), largest = c.heap.largest();
+      double fragmentation = freeBytes ? 1.0 - (double)largest / freeBytes : 0;
+      if (fragmentation >= worst.fragmentation) worst.fragmentation = fragmentation, worst.freeBytes = freeBytes;
+      worst.largest = std::min(worst.largest, largest);
+      int64_t big = c.heap.alloc(BIG_REQUEST);
+      if (big < 0) worst.bigFailures++;
+      c.heap.release(big);
+    }
+    worst.calls = c.heap.calls - calls;
+    out.push_back(worst);
+  }
+  *dropped = c.dropped;
+  *poolExhausted = pooled ? c.logPool.exhausted + c.eventPool.exhausted + c.framePool.exhausted : 0;
+  return out;
+}
+
+// Function to hammer one pool from several threads - each block is stamped while held and checked on return
+static bool hammer(int threads, int rounds, double *nsPerPair) {
+  const uint16_t count = 64;
+  static uint64_t storage[count];
+  static std::atomic<uint16_t> links[count];
+  BlockPool pool;
+  blockPoolInit(&pool, storage, sizeof(uint64_t), count, links);
+  std::atomic<uint32_t> bad(0);
+  auto work = [&](int id) {
+    std::mt19937 rng(id);
+    std::vector<uint64_t *> held;
+    for (int r = 0; r < rounds; r++) {
+      if (held.size() < 8 && (held.empty() || rng() % 2)) {
+        uint64_t *b = (uint64_t *)blockPoolAlloc(&pool);
+        if (b == NULL) continue;
+        *b = (uint64_t)id << 32 | r;
+        held.push_back(b);
+      }
+      else {
+        uint64_t *b = held.back();
+        held.pop_back();
+        if ((*b >> 32) != (uint64_t)id) bad++;  // Someone else was handed the same block
+        blockPoolFree(&pool, b);
+      }
+    }
+    for (uint64_t *b : held) blockPoolFree(&pool, b);
+  };
+  std::vector<std::thread> pool_threads;
+  for (int t = 0; t < threads; t++) pool_threads.emplace_back(work, t);
+  for (std::thread &t : pool_threads) t.join();
+  bool ok = bad == 0 && pool.used == 0 && pool.peak <= count;
+
+  // Uncontended cost of an alloc and free, against malloc
+  const int pairs = 5000000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < pairs; i++) {
+    void *b = blockPoolAlloc(&pool);
+    *(volatile uint64_t *)b = i;
+    blockPoolFree(&pool, b);
+  }
+  nsPerPair[0] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / pairs;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < pairs; i++) {
+    void *b = malloc(8 + i % 40);
+    *(volatile uint64_t *)b = i;
+    free(b);
+  }
+  nsPerPair[1] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / pairs;
+  printf("Pool under %d threads: %d rounds each, %u blocks handed out twice, %u still out, peak %u of %u\n", threads, rounds,
+         bad.load(), pool.used.load(), pool.peak.load(), count);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int days = argc > 1 ? atoi(argv[1]) : 180;
+  if (days < 2) {
+    fprintf(stderr, "Usage: pool_soak [days]\n");
+    return 2;
+  }
+  double ns[2];
+  bool ok = hammer(4, 2000000, ns);
+  printf("Alloc + free: pool %.1f ns, malloc %.1f ns\n\n", ns[0], ns[1]);
+
+  uint32_t heapDropped, poolDropped, heapExhausted, poolExhausted;
+  std::vector<DayStats> heap = soak(false, days, &heapDropped, &heapExhausted);
+  std::vector<DayStats> pools = soak(true, days, &poolDropped, &poolExhausted);
+
+  printf("%d simulated days, %d KB heap, %d taps a day, %d outages a day, %d sessions a day\n", days, ARENA_BYTES / 1024,
+         TAPS_PER_DAY, OUTAGES_PER_DAY, SESSIONS_PER_DAY);
+  printf("Worst hourly sample of each day, over 30-day windows:\n");
+  printf("%9s | %-41s | %-41s\n", "", "everything on the heap", "messages, events and frames in pools");
+  printf("%9s | %7s %7s %8s %7s %8s | %7s %7s %8s %7s %8s\n", "days", "frag %", "worst", "largest", "4K fail", "calls/d",
+         "frag %", "worst", "largest", "4K fail", "calls/d");
+
+  // One row per window - mean and worst fragmentation, the smallest largest-free-block, refusals, heap calls a day
+  struct Window {
+    double mean, worst;
+    uint32_t largest, bigFailures, calls;
+  };
+  auto window = [](const std::vector<DayStats> &daysOf, int from, int to) {
+    Window w = {0, 0, ARENA_BYTES, 0, 0};
+    uint64_t calls = 0;
+    for (int d = from; d < to; d++) {
+      w.mean += daysOf[d].fragmentation / (to - from);
+      w.worst = std::max(w.worst, daysOf[d].fragmentation);
+      w.largest = std::min(w.largest, daysOf[d].largest);
+      w.bigFailures += daysOf[d].bigFailures;
+      calls += daysOf[d].calls;
+    }
+    w.calls = calls / (to - from);
+    return w;
+  };
+  uint32_t heapBig = 0, poolBig = 0;
+  double heapMean = 0, poolMean = 0, poolLow = 1, poolHigh = 0;
+  for (int from = 0; from < days; from += 30) {
+    int to = std::min(days, from + 30);
+    Window h = window(heap, from, to), p = window(pools, from, to);
+    printf("%4d-%-4d | %7.1f %7.1f %8u %7u %8u | %7.1f %7.1f %8u %7u %8u\n", from + 1, to, 100 * h.mean, 100 * h.worst,
+           h.largest, h.bigFailures, h.calls, 100 * p.mean, 100 * p.worst, p.largest, p.bigFailures, p.calls);
+    heapBig += h.bigFailures;
+    poolBig += p.bigFailures;
+    heapMean += h.mean * (to - from) / days;
+    poolMean += p.mean * (to - from) / days;
+    poolLow = std::min(poolLow, p.mean);
+    poolHigh = std::max(poolHigh, p.mean);
+  }
+  printf("Mean fragmentation: %.1f%% on the heap, %.1f%% with pools, whose windows stay within %.1f points\n", 100 * heapMean,
+         100 * poolMean, 100 * (poolHigh - poolLow));
+  printf("4 KB requests refused: %u on the heap, %u with pools; queued items dropped in outages: %u and %u; pool "
+         "exhaustion %u\n", heapBig, poolBig, heapDropped, poolDropped, poolExhausted);
+
+  // With pools the heap keeps only the Wi-Fi buffers and short sessions - no window may drift from the others
+  ok = ok && poolHigh - poolLow <= 0.02 && poolMean < heapMean && poolBig <= heapBig;
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+// Offline revocation propagation simulator - 200 standalone doors, a front desk and the cards moving between them
+// Each tap runs the same decode/merge/write-back steps as revocationProcessCard() in the firmware.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/revocation_sim.cpp src/revocation.cpp src/crypto_service.cpp -o revocation_sim
+// Run:           ./revocation_sim [doors] [days]
+#include "revocation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static const uint8_t siteKey[] = "change-this-site-key";
+#define SITE_KEY_LEN (sizeof(siteKey) - 1)
+
+#define STAFF_CARDS         12   // Housekeeping cards - refreshed at the desk each morning
+#define STAFF_ROOMS_PER_DAY 25   // Doors each staff card taps per shift
+#define GUEST_STAY_DAYS     2    // A fresh guest card is issued per door every stay
+#define GUEST_TAPS_PER_DAY  4    // Guest taps on their own door per day
+#define REVOCATIONS_PER_DAY 3    // Lost cards reported at the desk per day
+
+struct Card {
+  uint8_t block[REVOCATION_BLOCK_SIZE];   // Carrier sector contents
+};
+
+struct Tap {
+  int minute;     // Minute of the simulation
+  int door;       // Door tapped
+  Card *card;     // Card presented
+};
+
+static double mergeNs = 0;      // Total time spent in decode + merge + write-back
+static long tapCount = 0;
+static long writeBacks = 0;
+static long saves = 0;          // Merges that changed the list - each one is an NVS write on a door
+
+// Function to tap a carrier card on a door - mirrors revocationProcessCard()
+static void tapDoor(RevocationList *door, Card *card) {
+  auto start = std::chrono::steady_clock::now();
+  RevocationDelta delta;
+  if (revocationDecode(card->block, siteKey, SITE_KEY_LEN, &delta)) {
+    if (revocationMerge(door, &delta) != REVOCATION_STALE) saves++;
+    if ((int16_t)(door->version - delta.version) > 0) {
+      revocationMakeDelta(door, &delta);
+      revocationEncode(&delta, siteKey, SITE_KEY_LEN, card->block);
+      writeBacks++;
+    }
+  }
+  mergeNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  tapCount++;
+}
+
+// Function to refresh a card at the front desk with the desk's newest delta
+static void issueAtDesk(const RevocationList *desk, Card *card) {
+  RevocationDelta delta;
+  revocationMakeDelta(desk, &delta);
+  revocationEncode(&delta, siteKey, SITE_KEY_LEN, card->block);
+}
+
+int main(int argc, char **argv) {
+  int doorCount = argc > 1 ? atoi(argv[1]) : 200;
+  int days = argc > 2 ? atoi(argv[2]) : 14;
+  std::mt19937 rng(7);
+
+  RevocationList desk;
+  revocationInit(&desk);
+  std::vector<RevocationList> doors(doorCount);
+  for (auto &door : doors) revocationInit(&door);
+
+  std::vector<Card> staff(STAFF_CARDS);
+  std::vector<Card> guests(doorCount);
+  for (auto &card : guests) issueAtDesk(&desk, &card);
+
+  // Revocations issued so far: UID, minute issued, minute every door had it (-1 while pending)
+  struct Issued { uint8_t uid[REVOCATION_UID_SIZE]; int issued; int everywhere; };
+  std::vector<Issued> issued;
+
+  for (int day = 0; day < days; day++) {
+    std::vector<Tap> taps;
+    int dayStart = day * 1440;
+
+    // Staff cards are refreshed at the desk at 08:00 and tap doors through the shift
+    int refreshMinute = dayStart + 480;
+    for (int s = 0; s < STAFF_CARDS; s++) {
+      for (int i = 0; i < STAFF_ROOMS_PER_DAY; i++) {
+        taps.push_back({dayStart + 540 + (int)(rng() % 360), (int)(rng() % doorCount), &staff[s]});
+      }
+    }
+    // Guests tap their own door through the day
+    for (int d = 0; d < doorCount; d++) {
+      for (int i = 0; i < GUEST_TAPS_PER_DAY; i++) {
+        taps.push_back({dayStart + (int)(rng() % 1440), d, &guests[d]});
+      }
+    }
+    // Lost cards are reported through the day
+    std::vector<int> revokeMinute;
+    for (int i = 0; i < REVOCATIONS_PER_DAY; i++) revokeMinute.push_back(dayStart + (int)(rng() % 1440));
+    std::sort(revokeMinute.begin(), revokeMinute.end());
+    std::sort(taps.begin(), taps.end(), [](const Tap &a, const Tap &b) { return a.minute < b.minute; });
+
+    size_t nextRevoke = 0;
+    bool staffRefreshed = false;
+    int checkInDoorBase = day % GUEST_STAY_DAYS;
+    for (const Tap &tap : taps) {
+      while (nextRevoke < revokeMinute.size() && revokeMinute[nextRevoke] <= tap.minute) {
+        Issued rev;
+        for (int b = 0; b < REVOCATION_UID_SIZE; b++) rev.uid[b] = rng();
+        rev.issued = revokeMinute[nextRevoke++];
+        rev.everywhere = -1;
+        revocationAdd(&desk, rev.uid, desk.version + 1);
+        issued.push_back(rev);
+      }
+      if (!staffRefreshed && tap.minute >= refreshMinute) {
+        for (auto &card : staff) issueAtDesk(&desk, &card);
+        staffRefreshed = true;
+      }
+      tapDoor(&doors[tap.door], tap.card);
+    }
+
+    // New guests check in at noon on a rolling share of doors - their fresh cards carry the desk list
+    for (int d = checkInDoorBase; d < doorCount; d += GUEST_STAY_DAYS) issueAtDesk(&desk, &guests[d]);
+
+    // Record when each pending revocation reached every door - checked once per day
+    for (auto &rev : issued) {
+      if (rev.everywhere >= 0) continue;
+      bool all = true;
+      for (auto &door : doors) {
+        if (!revocationContains(&door, rev.uid)) { all = false; break; }
+      }
+      if (all) rev.everywhere = dayStart + 1440;
+    }
+  }
+
+  std::vector<double> hours;
+  int pending = 0;
+  for (auto &rev : issued) {
+    if (rev.everywhere < 0) pending++;
+    else hours.push_back((rev.everywhere - rev.issued) / 60.0);
+  }
+  std::sort(hours.begin(), hours.end());
+
+  int current = 0;
+  for (auto &door : doors) if (door.version == desk.version) current++;
+
+  printf("%d doors, %d days, %zu revocations, %ld taps\n", doorCount, days, issued.size(), tapCount);
+  if (!hours.empty()) {
+    printf("  time to reach every door (day resolution): median %.1f h, p95 %.1f h, max %.1f h\n",
+           hours[hours.size() / 2], hours[hours.size() * 95 / 100], hours.back());
+  }
+  printf("  revocations not yet everywhere: %d\n", pending);
+  printf("  doors at the desk's version at the end: %d/%d\n", current, doorCount);
+  printf("  decode+merge+write-back: %.1f us per tap, %ld write-backs\n", mergeNs / tapCount / 1000.0, writeBacks);
+  printf("  list saves (NVS writes): %ld, %.1f per door per day\n", saves, (double)saves / doorCount / days);
+
+  // A door that missed versions keeps meeting the same gap delta - only the first tap may change its list
+  RevocationList gapDoor;
+  revocationInit(&gapDoor);
+  RevocationDelta gap = {};
+  gap.baseVersion = 3;
+  gap.version = 5;
+  gap.count = 2;
+  gap.uids[0][0] = 1;
+  gap.uids[1][0] = 2;
+  RevocationMerge first = revocationMerge(&gapDoor, &gap);
+  RevocationMerge again = revocationMerge(&gapDoor, &gap);
+  bool ok = first == REVOCATION_PARTIAL && again == REVOCATION_STALE;
+  printf("  repeated gap delta: first %s, again %s\n", first == REVOCATION_PARTIAL ? "partial" : "not partial",
+         again == REVOCATION_STALE ? "unchanged" : "saved again");
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
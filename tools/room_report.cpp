@@ -0,0 +1,553 @@
+// Room report - per-room occupancy time, energy and tap counts for a billing period, read from an event
+// archive (see event_archive.h) that tap_archive built from the controllers' exports
+// The scan is split across threads by archive block. Tap counts add up in any order, so each thread keeps
+// its own totals and they are summed at the end. Occupancy does not: a stay that starts in one block ends in
+// another, and the blocks of one controller may go to different threads. So each block is reduced to a span
+// per room - its first and last relay switch and the on time between them - and once every thread is done the
+// spans are folded per room in block order. That merge is the only serial step, and it costs a few numbers
+// per block rather than per event.
+//
+// The relay is on from a check-in or a remote on until a check-out, a remote off or a vacancy; an on while
+// already on, or an off while off, changes nothing. The state at the start of the period comes from the
+// ROOM_LOOKBACK_DAYS before it - a room with no switch in that time starts off.
+//
+// Build (host):  g++ -O2 -std=c++17 -pthread -Iinclude -Itools tools/room_report.cpp tools/event_archive.cpp -o room_report
+// Run:           ./room_report file.evar --from 2026-10-01 --to 2026-11-01 [--threads n] [--watts w] [--loads loads.csv]
+//                    CSV per room: controller, room (from 1 as on the display), on hours, kWh, taps, check-ins,
+//                    staff visits, denied taps; loads.csv lines are controller,room,watts - other rooms draw --watts
+//                ./room_report --bench [rooms] [threads]
+//                    a synthetic month of every room, scanned at 1, 2, 4 ... threads; every report is checked
+//                    against the generator
+#include "event_archive.h"
+#include "event_journal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define ROOM_LOOKBACK_DAYS 31      // Events read before the period, only for the state it starts in
+#define ROOM_DEFAULT_WATTS 400     // Load of a room not in the loads file - lights, fan coil, sockets
+#define CHUNK_BLOCKS       4       // Blocks a thread takes at a time - small enough to even out, large enough to not contend
+#define BENCH_START        1767225600000ULL  // 2026-01-01 00:00 UTC, in ms
+#define BENCH_DAYS         30
+#define BENCH_ROOMS_PER    2       // Rooms per controller, as the firmware's NUM_ROOMS
+#define BENCH_GAP_S        240     // Mean time between a room's events - a busy room with sensors and BMS
+#define DAY_MS             86400000ULL
+
+// What the report says about one room
+struct RoomTotals {
+  uint64_t onMs = 0;
+  uint32_t taps = 0;               // Events with a card
+  uint32_t checkIns = 0;
+  uint32_t staff = 0;              // Staff card taps in
+  uint32_t denied = 0;             // Taps at an occupied room
+
+  bool operator==(const RoomTotals &o) const {
+    return onMs == o.onMs && taps == o.taps && checkIns == o.checkIns && staff == o.staff && denied == o.denied;
+  }
+};
+
+// What one block says about one room's relay
+struct RoomSpan {
+  uint64_t firstMs;                // First switch in the block
+  uint64_t sinceMs;                // Last change of state in the block
+  uint64_t onMs;                   // On time between the two, within the period
+  bool switched;                   // Any switch at all - the other fields are unset without one
+  bool on;                         // State the block leaves the room in
+};
+
+// Rooms and blocks of one report - rooms get dense slots, controller by controller
+struct Report {
+  uint64_t fromMs, toMs;           // Period, toMs excluded
+  uint32_t slots = 0;
+  std::vector<uint32_t> roomBase;  // First slot of each controller
+  std::vector<uint16_t> roomCount; // Rooms seen per controller
+  std::vector<size_t> spanStart;   // First span of each block
+  std::vector<uint16_t> firstRoom; // Room of each block's first span
+  std::vector<RoomSpan> spans;     // Every block's spans, written by whichever thread scans the block
+};
+
+// One scanning thread - its own decode scratch and partial totals
+struct Worker {
+  const Report *rep;
+  ArchiveScratch scratch;
+  ArchiveQueryStats stats;
+  std::vector<RoomTotals> totals;  // Per slot; onMs stays 0 here - it comes from the spans
+  RoomSpan *spans;                 // Block being scanned
+  uint16_t firstRoom;
+  uint32_t base;
+  bool ok = true;
+};
+
+// Relay change an event makes - 1 on, 0 off, -1 none
+static int switchOf(uint8_t type) {
+  switch (type) {
+    case JOURNAL_CHECK_IN:
+    case JOURNAL_REMOTE_ON:
+      return 1;
+    case JOURNAL_CHECK_OUT:
+    case JOURNAL_REMOTE_OFF:
+    case JOURNAL_VACANT:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+// Function to find how much of [a, b) lies in the period
+static uint64_t overlap(uint64_t a, uint64_t b, const Report *rep) {
+  a = std::max(a, rep->fromMs);
+  b = std::min(b, rep->toMs);
+  return b > a ? b - a : 0;
+}
+
+// Function to count one event into the thread's totals and the block's span
+static bool scanEvent(const ArchiveEvent *e, void *ctx) {
+  Worker *w = (Worker *)ctx;
+  if (e->room == ARCHIVE_NO_ROOM) return true;  // Unknown and revoked cards - no room to bill
+  if (e->timeMs >= w->rep->fromMs) {
+    RoomTotals &t = w->totals[w->base + e->room];
+    t.taps += e->uidLen > 0;
+    t.checkIns += e->type == JOURNAL_CHECK_IN;
+    t.staff += e->type == JOURNAL_STAFF_IN;
+    t.denied += e->type == JOURNAL_DENIED_OCCUPIED;
+  }
+  int on = switchOf(e->type);
+  if (on < 0) return true;
+  RoomSpan &s = w->spans[e->room - w->firstRoom];
+  if (!s.switched) {
+    s.switched = true;
+    s.firstMs = s.sinceMs = e->timeMs;
+    s.on = on;
+  }
+  else if (on != s.on) {
+    if (s.on) s.onMs += overlap(s.sinceMs, e->timeMs, w->rep);
+    s.on = on;
+    s.sinceMs = e->timeMs;
+  }
+  return true;
+}
+
+// Function to lay out a report over an archive - a slot per room, and a span per room for each block
+static void reportInit(Report *rep, const ArchiveReader *r, uint64_t fromMs, uint64_t toMs) {
+  rep->fromMs = fromMs;
+  rep->toMs = toMs;
+  rep->roomCount.assign(r->names.size(), 0);
+  rep->spanStart.resize(r->index.size() + 1);
+  rep->firstRoom.resize(r->index.size());
+  size_t spans = 0;
+  for (size_t i = 0; i < r->index.size(); i++) {
+    const ArchiveBlockInfo &b = r->index[i];  // Rooms stored + 1, 0 for none
+    uint16_t first = std::max<uint16_t>(b.minRoom, 1) - 1;
+    rep->spanStart[i] = spans;
+    rep->firstRoom[i] = first;
+    if (b.maxRoom > 0) spans += b.maxRoom - first;
+    if (b.controller < rep->roomCount.size()) rep->roomCount[b.controller] = std::max(rep->roomCount[b.controller], b.maxRoom);
+  }
+  rep->spanStart[r->index.size()] = spans;
+  rep->spans.assign(spans, RoomSpan());
+  rep->roomBase.resize(rep->roomCount.size());
+  rep->slots = 0;
+  for (size_t c = 0; c < rep->roomCount.size(); c++) {
+    rep->roomBase[c] = rep->slots;
+    rep->slots += rep->roomCount[c];
+  }
+}
+
+// Function to run a report - blocks are handed out a chunk at a time, then the partial totals are summed and
+// the spans folded per room in block order, which is time order for each controller
+static bool reportRun(Report *rep, const ArchiveReader *r, int threads, std::vector<RoomTotals> &out, ArchiveQueryStats *stats) {
+  ArchiveQuery q;
+  q.fromMs = rep->fromMs > ROOM_LOOKBACK_DAYS * DAY_MS ? rep->fromMs - ROOM_LOOKBACK_DAYS * DAY_MS : 0;
+  q.toMs = rep->toMs - 1;
+  std::fill(rep->spans.begin(), rep->spans.end(), RoomSpan());
+  std::vector<Worker> workers(threads);
+  std::atomic<size_t> next(0);
+  auto work = [&](Worker *w) {
+    for (;;) {
+      size_t first = next.fetch_add(CHUNK_BLOCKS, std::memory_order_relaxed);
+      if (first >= r->index.size()) break;
+      size_t last = std::min(first + CHUNK_BLOCKS, r->index.size());
+      for (size_t i = first; i < last && w->ok; i++) {
+        const ArchiveBlockInfo &b = r->index[i];
+        w->spans = &rep->spans[rep->spanStart[i]];
+        w->firstRoom = rep->firstRoom[i];
+        w->base = b.controller < rep->roomBase.size() ? rep->roomBase[b.controller] : 0;
+        w->ok = archiveQueryBlock(r, i, q, scanEvent, w, &w->stats, &w->scratch);
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++) {
+    workers[t].rep = rep;
+    workers[t].totals.assign(rep->slots, RoomTotals());
+    if (t > 0) pool.emplace_back(work, &workers[t]);
+  }
+  work(&workers[0]);
+  for (std::thread &t : pool) t.join();
+
+  // Merge - counts sum, spans fold
+  bool ok = true;
+  out.assign(rep->slots, RoomTotals());
+  for (const Worker &w : workers) {
+    ok = ok && w.ok;
+    for (uint32_t s = 0; s < rep->slots; s++) {
+      out[s].taps += w.totals[s].taps;
+      out[s].checkIns += w.totals[s].checkIns;
+      out[s].staff += w.totals[s].staff;
+      out[s].denied += w.totals[s].denied;
+    }
+    if (stats != NULL) {
+      stats->blocksSkipped += w.stats.blocksSkipped;
+      stats->blocksDecoded += w.stats.blocksDecoded;
+      stats->eventsDecoded += w.stats.eventsDecoded;
+      stats->bytesRead += w.stats.bytesRead;
+    }
+  }
+  std::vector<RoomSpan> state(rep->slots, RoomSpan());  // Where each room stands after the blocks folded so far
+  for (size_t i = 0; i < r->index.size(); i++) {
+    uint32_t base = rep->roomBase[r->index[i].controller];
+    for (size_t k = rep->spanStart[i]; k < rep->spanStart[i + 1]; k++) {
+      const RoomSpan &s = rep->spans[k];
+      if (!s.switched) continue;
+      uint32_t slot = base + rep->firstRoom[i] + (k - rep->spanStart[i]);
+      RoomSpan &cur = state[slot];
+      // On from before the block until its first switch - if that switch was an on, the block's own count
+      // starts from it, so the two pieces still add up to one stay
+      if (cur.switched && cur.on) out[slot].onMs += overlap(cur.sinceMs, s.firstMs, rep);
+      out[slot].onMs += s.onMs;
+      cur.switched = true;
+      cur.on = s.on;
+      cur.sinceMs = s.sinceMs;
+    }
+  }
+  for (uint32_t slot = 0; slot < rep->slots; slot++) {
+    if (state[slot].switched && state[slot].on) out[slot].onMs += overlap(state[slot].sinceMs, rep->toMs, rep);
+  }
+  return ok;
+}
+
+// ---- Report ----
+
+static bool digits(const char *s, int n, int *v) {
+  *v = 0;
+  for (int i = 0; i < n; i++) {
+    if (s[i] < '0' || s[i] > '9') return false;
+    *v = *v * 10 + s[i] - '0';
+  }
+  return true;
+}
+
+// Function to count days from 1970-01-01 to a date
+static int64_t daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+// Function to parse 2026-10-01 or 2026-10-01T06:00:00Z as UTC milliseconds
+static bool parseTime(const char *s, uint64_t *ms) {
+  int y, mo, d, h = 0, mi = 0, sec = 0;
+  size_t len = strlen(s);
+  if (len < 10 || !digits(s, 4, &y) || s[4] != '-' || !digits(s + 5, 2, &mo) || s[7] != '-' || !digits(s + 8, 2, &d)) return false;
+  if (mo < 1 || mo > 12 || d < 1 || d > 31) return false;
+  if (len > 10 && (len < 19 || s[10] != 'T' || !digits(s + 11, 2, &h) || !digits(s + 14, 2, &mi) || !digits(s + 17, 2, &sec))) return false;
+  *ms = (uint64_t)(daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec) * 1000;
+  return true;
+}
+
+// Function to read controller,room,watts lines - rooms numbered from 1
+static bool loadWatts(const char *path, const ArchiveReader *r, std::map<std::pair<uint16_t, uint16_t>, double> &watts) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) return false;
+  char line[256], name[128];
+  unsigned room;
+  double w;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "%127[^,],%u,%lf", name, &room, &w) != 3 || room == 0) continue;  // Header and comments
+    for (size_t c = 0; c < r->names.size(); c++) {
+      if (r->names[c] == name) watts[{(uint16_t)c, (uint16_t)(room - 1)}] = w;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static int runReport(int argc, char **argv) {
+  if (argc < 1) {
+    fprintf(stderr, "Usage: room_report file.evar --from date --to date [--threads n] [--watts w] [--loads file.csv]\n");
+    return 2;
+  }
+  uint64_t fromMs = 0, toMs = 0;
+  int threads = std::max(1U, std::thread::hardware_concurrency());
+  double defaultWatts = ROOM_DEFAULT_WATTS;
+  const char *loads = NULL;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *opt = argv[i], *val = argv[i + 1];
+    bool ok = true;
+    if (!strcmp(opt, "--from")) ok = parseTime(val, &fromMs);
+    else if (!strcmp(opt, "--to")) ok = parseTime(val, &toMs);
+    else if (!strcmp(opt, "--threads")) ok = (threads = atoi(val)) >= 1;
+    else if (!strcmp(opt, "--watts")) ok = (defaultWatts = atof(val)) >= 0;
+    else if (!strcmp(opt, "--loads")) loads = val;
+    else ok = false;
+    if (!ok) {
+      fprintf(stderr, "Bad option %s %s\n", opt, val);
+      return 2;
+    }
+  }
+  if (toMs <= fromMs) {
+    fprintf(stderr, "Give a period with --from and --to\n");
+    return 2;
+  }
+  ArchiveReader r;
+  if (!archiveOpen(&r, argv[0])) {
+    fprintf(stderr, "Cannot open %s\n", argv[0]);
+    return 1;
+  }
+  std::map<std::pair<uint16_t, uint16_t>, double> watts;
+  if (loads != NULL && !loadWatts(loads, &r, watts)) {
+    fprintf(stderr, "Cannot read %s\n", loads);
+    return 1;
+  }
+  Report rep;
+  reportInit(&rep, &r, fromMs, toMs);
+  std::vector<RoomTotals> totals;
+  auto start = std::chrono::steady_clock::now();
+  ArchiveQueryStats stats;
+  bool ok = reportRun(&rep, &r, threads, totals, &stats);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("controller,room,on_hours,kwh,taps,check_ins,staff,denied\n");
+  for (size_t c = 0; c < rep.roomCount.size(); c++) {
+    for (uint16_t room = 0; room < rep.roomCount[c]; room++) {
+      const RoomTotals &t = totals[rep.roomBase[c] + room];
+      auto load = watts.find({(uint16_t)c, room});
+      double w = load != watts.end() ? load->second : defaultWatts;
+      double hours = t.onMs / 3.6e6;
+      printf("%s,%u,%.3f,%.3f,%u,%u,%u,%u\n", r.names[c].c_str(), room + 1, hours, hours * w / 1000, t.taps, t.checkIns,
+             t.staff, t.denied);
+    }
+  }
+  fprintf(stderr, "%llu events in %u blocks scanned in %.3f s on %d threads, %u blocks outside the period\n",
+          (unsigned long long)stats.eventsDecoded, stats.blocksDecoded, seconds, threads, stats.blocksSkipped);
+  archiveClose(&r);
+  if (!ok) fprintf(stderr, "Corrupt block in %s\n", argv[0]);
+  return ok ? 0 : 1;
+}
+
+// ---- Benchmark ----
+
+// Function to generate one controller's events - each room goes on and off through the period with taps,
+// staff visits and BMS commands between, including repeated ons and offs; adds what the report should say
+static void generateController(uint16_t controller, int rooms, uint64_t startMs, const Report &rep, std::mt19937_64 &rng,
+                               std::vector<ArchiveEvent> &out, RoomTotals *truth) {
+  std::exponential_distribution<double> gap(1.0 / (BENCH_GAP_S * 1000));
+  out.clear();
+  for (int r = 0; r < rooms; r++) {
+    RoomTotals &t = truth[r];
+    bool on = false;
+    uint64_t since = 0;
+    uint32_t guest = 0;
+    for (uint64_t ms = startMs + (uint64_t)gap(rng);; ms += 1 + (uint64_t)gap(rng)) {
+      if (ms >= rep.toMs) break;
+      // Off: mostly check-ins and BMS on; on: mostly check-outs, taps at the occupied door and vacancies
+      static const uint8_t offTypes[] = {JOURNAL_CHECK_IN, JOURNAL_CHECK_IN, JOURNAL_CHECK_IN, JOURNAL_CHECK_IN,
+                                         JOURNAL_REMOTE_ON, JOURNAL_REMOTE_OFF, JOURNAL_VACANT, JOURNAL_STAFF_IN,
+                                         JOURNAL_STAFF_OUT, JOURNAL_DENIED_UNKNOWN};
+      static const uint8_t onTypes[] = {JOURNAL_CHECK_OUT, JOURNAL_CHECK_OUT, JOURNAL_CHECK_OUT, JOURNAL_VACANT,
+                                        JOURNAL_REMOTE_OFF, JOURNAL_DENIED_OCCUPIED, JOURNAL_DENIED_OCCUPIED,
+                                        JOURNAL_CHECK_IN, JOURNAL_REMOTE_ON, JOURNAL_STAFF_IN, JOURNAL_STAFF_OUT};
+      uint8_t type = on ? onTypes[rng() % sizeof(onTypes)] : offTypes[rng() % sizeof(offTypes)];
+      ArchiveEvent e = {};
+      e.timeMs = ms;
+      e.controller = controller;
+      e.room = type == JOURNAL_DENIED_UNKNOWN ? ARCHIVE_NO_ROOM : r;
+      e.type = type;
+      uint32_t card = 0;
+      if (type == JOURNAL_CHECK_IN && !on) guest = 1000 + rng() % 1000000;
+      if (type == JOURNAL_CHECK_IN || type == JOURNAL_CHECK_OUT || type == JOURNAL_DENIED_OCCUPIED) card = guest;
+      if (type == JOURNAL_STAFF_IN || type == JOURNAL_STAFF_OUT) card = 1 + controller * 64 + r;
+      if (type == JOURNAL_DENIED_UNKNOWN) card = 0x400000 + rng() % 5000;
+      if (card != 0) {
+        e.uidLen = 4;
+        e.uid[0] = card >> 24 | 0x80;
+        e.uid[1] = card >> 16;
+        e.uid[2] = card >> 8;
+        e.uid[3] = card;
+      }
+      out.push_back(e);
+
+      if (ms >= rep.fromMs && e.room != ARCHIVE_NO_ROOM) {
+        t.taps += card != 0;
+        t.checkIns += type == JOURNAL_CHECK_IN;
+        t.staff += type == JOURNAL_STAFF_IN;
+        t.denied += type == JOURNAL_DENIED_OCCUPIED;
+      }
+      int sw = switchOf(type);
+      if (sw >= 0 && sw != on) {
+        if (on) t.onMs += overlap(since, ms, &rep);
+        on = sw;
+        since = ms;
+      }
+    }
+    if (on) t.onMs += overlap(since, rep.toMs, &rep);
+  }
+  std::stable_sort(out.begin(), out.end(), [](const ArchiveEvent &a, const ArchiveEvent &b) { return a.timeMs < b.timeMs; });
+}
+
+// Function to report the simple way, for comparison - one pass through archiveQuery with each room's state
+// followed event by event
+struct Sequential {
+  const Report *rep;
+  std::vector<RoomTotals> totals;
+  std::vector<RoomSpan> state;
+};
+
+static bool sequentialEvent(const ArchiveEvent *e, void *ctx) {
+  Sequential *s = (Sequential *)ctx;
+  if (e->room == ARCHIVE_NO_ROOM) return true;
+  uint32_t slot = s->rep->roomBase[e->controller] + e->room;
+  RoomTotals &t = s->totals[slot];
+  if (e->timeMs >= s->rep->fromMs) {
+    t.taps += e->uidLen > 0;
+    t.checkIns += e->type == JOURNAL_CHECK_IN;
+    t.staff += e->type == JOURNAL_STAFF_IN;
+    t.denied += e->type == JOURNAL_DENIED_OCCUPIED;
+  }
+  int on = switchOf(e->type);
+  RoomSpan &st = s->state[slot];
+  if (on >= 0 && on != st.on) {
+    if (st.on) t.onMs += overlap(st.sinceMs, e->timeMs, s->rep);
+    st.on = on;
+    st.sinceMs = e->timeMs;
+  }
+  return true;
+}
+
+static bool sequentialRun(ArchiveReader *r, const Report *rep, std::vector<RoomTotals> &out) {
+  Sequential s;
+  s.rep = rep;
+  s.totals.assign(rep->slots, RoomTotals());
+  s.state.assign(rep->slots, RoomSpan());
+  ArchiveQuery q;
+  q.fromMs = rep->fromMs - ROOM_LOOKBACK_DAYS * DAY_MS;
+  q.toMs = rep->toMs - 1;
+  bool ok = archiveQuery(r, q, sequentialEvent, &s, NULL);
+  for (uint32_t slot = 0; slot < rep->slots; slot++) {
+    if (s.state[slot].on) s.totals[slot].onMs += overlap(s.state[slot].sinceMs, rep->toMs, rep);
+  }
+  out.swap(s.totals);
+  return ok;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int runBench(int rooms, int maxThreads) {
+  const char *path = "/tmp/room_report_bench.evar";
+  int controllers = (rooms + BENCH_ROOMS_PER - 1) / BENCH_ROOMS_PER;
+  Report rep;
+  rep.fromMs = BENCH_START + 7 * DAY_MS;  // A week of history before the month, so it starts with rooms on
+  rep.toMs = rep.fromMs + BENCH_DAYS * DAY_MS;
+
+  ArchiveWriter w;
+  if (!archiveCreate(&w, path)) {
+    fprintf(stderr, "Cannot create %s\n", path);
+    return 1;
+  }
+  std::mt19937_64 rng(1);
+  std::vector<RoomTotals> truth(rooms);
+  std::vector<ArchiveEvent> events;
+  auto start = std::chrono::steady_clock::now();
+  bool ok = true;
+  for (int c = 0; c < controllers; c++) {
+    int here = std::min(BENCH_ROOMS_PER, rooms - c * BENCH_ROOMS_PER);
+    archiveController(&w, "ttyACM" + std::to_string(c));  // Index c, as the generator numbers them
+    generateController(c, here, BENCH_START, rep, rng, events, &truth[c * BENCH_ROOMS_PER]);
+    for (const ArchiveEvent &e : events) ok = archiveAppend(&w, e) && ok;
+  }
+  ok = archiveFinish(&w) && ok;
+  printf("Synthetic month: %d rooms on %d controllers, %llu events (a week of history before it), %zu blocks, %.1f MB, built in %.1f s\n",
+         rooms, controllers, (unsigned long long)w.events, w.index.size(), w.bytes / 1e6, secondsSince(start));
+
+  ArchiveReader r;
+  if (!ok || !archiveOpen(&r, path)) {
+    printf("Cannot write or reopen the archive\n");
+    return 1;
+  }
+  reportInit(&rep, &r, rep.fromMs, rep.toMs);
+  ok = rep.slots == (uint32_t)rooms;
+  auto matches = [&](const std::vector<RoomTotals> &got) {
+    return got.size() == truth.size() && std::equal(got.begin(), got.end(), truth.begin());
+  };
+
+  // Best of three for each run
+  std::vector<RoomTotals> got;
+  double best = 1e9;
+  for (int run = 0; run < 3; run++) {
+    start = std::chrono::steady_clock::now();
+    ok = sequentialRun(&r, &rep, got) && ok;
+    best = std::min(best, secondsSince(start));
+  }
+  bool same = matches(got);
+  ok = ok && same;
+  uint64_t total = r.events;
+  unsigned cores = std::max(1U, std::thread::hardware_concurrency());
+  printf("Host: %u hardware threads\n\n", cores);
+  printf("%-26s %9s %12s %16s %9s %s\n", "Scan", "ms", "M events/s", "M events/s/core", "speedup", "");
+  printf("%-26s %9.1f %12.1f %16.1f %9s %s\n", "sequential archiveQuery", best * 1000, total / best / 1e6, total / best / 1e6,
+         "", same ? "" : "WRONG");
+  double single = 0;
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    best = 1e9;
+    for (int run = 0; run < 3; run++) {
+      start = std::chrono::steady_clock::now();
+      ok = reportRun(&rep, &r, threads, got, NULL) && ok;
+      best = std::min(best, secondsSince(start));
+    }
+    same = matches(got);
+    ok = ok && same;
+    if (threads == 1) single = best;
+    char label[40];
+    snprintf(label, sizeof(label), "partitioned, %d thread%s", threads, threads > 1 ? "s" : "");
+    unsigned used = std::min<unsigned>(threads, cores);
+    printf("%-26s %9.1f %12.1f %16.1f %8.2fx %s%s\n", label, best * 1000, total / best / 1e6, total / best / 1e6 / used,
+           single / best, threads > (int)cores ? "(more threads than cores) " : "", same ? "" : "WRONG");
+  }
+  uint64_t onMs = 0;
+  for (const RoomTotals &t : truth) onMs += t.onMs;
+  printf("\nRooms on %.1f%% of the month; every report matched the generator room by room: %s\n",
+         100.0 * onMs / ((double)rooms * BENCH_DAYS * DAY_MS), ok ? "yes" : "no");
+  archiveClose(&r);
+  remove(path);
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+    int rooms = argc > 2 ? atoi(argv[2]) : 1000;
+    int threads = argc > 3 ? atoi(argv[3]) : (int)std::max(4U, std::thread::hardware_concurrency());
+    if (rooms < 1 || rooms > 65536 || threads < 1 || threads > 256) {
+      fprintf(stderr, "Bad bench size\n");
+      return 2;
+    }
+    return runBench(rooms, threads);
+  }
+  if (argc >= 2) return runReport(argc - 1, argv + 1);
+  fprintf(stderr, "Usage: room_report file.evar --from date --to date ... or room_report --bench [rooms] [threads]\n");
+  return 2;
+}
@@ -0,0 +1,205 @@
+// Seqlock benchmark - what publishing the room table costs the writer, and how often readers in other tasks
+// have to copy again, measured on the host with real threads
+// The writer stands in for loop() and publishes a table whose every word is derived from its sequence
+// number, so any copy mixing two versions shows up. Readers stand in for telemetry, HTTP and display
+// tasks and copy it as fast as they can. The same run is made with a mutex around the table, which is what
+// the seqlock saves the scan path from, and with no protection at all, which is what it saves readers from.
+//
+// Build (host):  g++ -O2 -std=c++17 -pthread -Iinclude tools/seqlock_bench.cpp src/seqlock.cpp -o seqlock_bench
+// Run:           ./seqlock_bench [readers] [ms per run]
+#include "seqlock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define FIRMWARE_BYTES 24          // RoomSnapshot with NUM_ROOMS 2
+#define LARGE_BYTES    104         // RoomSnapshot with 10 rooms
+
+typedef std::chrono::steady_clock Clock;
+
+static uint32_t wordOf(uint32_t seq, size_t i) {
+  return seq * 2654435761U + (uint32_t)i * 40503U;
+}
+
+// Function to fill a table as version seq
+static void makeTable(uint32_t *words, size_t count, uint32_t seq) {
+  words[0] = seq;
+  for (size_t i = 1; i < count; i++) words[i] = wordOf(seq, i);
+}
+
+// Function to check that a copy is one version throughout
+static bool consistent(const uint32_t *words, size_t count) {
+  for (size_t i = 1; i < count; i++) {
+    if (words[i] != wordOf(words[0], i)) return false;
+  }
+  return true;
+}
+
+enum Mode { MODE_SEQLOCK, MODE_MUTEX, MODE_NONE };
+
+struct Shared {
+  Mode mode;
+  size_t words;
+  SeqLock lock;
+  std::mutex mutex;
+  uint32_t table[SEQLOCK_MAX_WORDS];                  // The mutex-protected copy
+  std::atomic<uint32_t> bare[SEQLOCK_MAX_WORDS];      // Unprotected - relaxed words, no sequence check
+  std::atomic<bool> stop;
+};
+
+struct ReaderResult {
+  uint64_t reads = 0, attempts = 0, torn = 0;
+};
+
+// Function to publish one version the way the mode does
+static void publish(Shared *s, const uint32_t *words) {
+  if (s->mode == MODE_SEQLOCK) seqlockWrite(&s->lock, words, s->words * 4);
+  else if (s->mode == MODE_MUTEX) {
+    std::lock_guard<std::mutex> hold(s->mutex);
+    memcpy(s->table, words, s->words * 4);
+  }
+  else {
+    for (size_t i = 0; i < s->words; i++) s->bare[i].store(words[i], std::memory_order_relaxed);
+  }
+}
+
+static void reader(Shared *s, ReaderResult *out) {
+  uint32_t copy[SEQLOCK_MAX_WORDS];
+  while (!s->stop.load(std::memory_order_relaxed)) {
+    if (s->mode == MODE_SEQLOCK) {
+      bool got;
+      do {
+        out->attempts++;
+        got = seqlockTryRead(&s->lock, copy, s->words * 4);
+        if (!got && seqlockWriting(&s->lock)) std::this_thread::yield();  // As roomStateSnapshot() lets loop() finish
+      } while (!got && !s->stop.load(std::memory_order_relaxed));
+      if (!got) break;
+    }
+    else if (s->mode == MODE_MUTEX) {
+      out->attempts++;
+      std::lock_guard<std::mutex> hold(s->mutex);
+      memcpy(copy, s->table, s->words * 4);
+    }
+    else {
+      out->attempts++;
+      for (size_t i = 0; i < s->words; i++) copy[i] = s->bare[i].load(std::memory_order_relaxed);
+    }
+    out->reads++;
+    if (!consistent(copy, s->words)) out->torn++;
+  }
+}
+
+struct RunResult {
+  uint64_t writes = 0, reads = 0, attempts = 0, torn = 0;
+  double writeNs = 0, p99Ns = 0, maxNs = 0;
+};
+
+// Function to run the writer flat out against the readers for a while - every publish is timed
+static RunResult run(Mode mode, size_t bytes, int readers, int ms) {
+  Shared *s = new Shared();
+  s->mode = mode;
+  s->words = (bytes + 3) / 4;
+  seqlockInit(&s->lock);
+  uint32_t words[SEQLOCK_MAX_WORDS];
+  makeTable(words, s->words, 0);
+  memcpy(s->table, words, sizeof(words));
+  for (size_t i = 0; i < SEQLOCK_MAX_WORDS; i++) s->bare[i].store(i < s->words ? words[i] : 0);
+  publish(s, words);
+  s->stop = false;
+
+  std::vector<ReaderResult> results(readers);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++) threads.emplace_back(reader, s, &results[r]);
+
+  RunResult out;
+  std::vector<uint32_t> samples;
+  samples.reserve(1 << 22);
+  auto end = Clock::now() + std::chrono::milliseconds(ms);
+  uint32_t seq = 0;
+  double total = 0;
+  while (true) {
+    makeTable(words, s->words, ++seq);  // The scan path's own work - outside the timing
+    auto start = Clock::now();
+    publish(s, words);
+    auto done = Clock::now();
+    double ns = std::chrono::duration<double, std::nano>(done - start).count();
+    total += ns;
+    if (samples.size() < samples.capacity()) samples.push_back((uint32_t)std::min(ns, 4e9));
+    if (done >= end) break;
+  }
+  s->stop = true;
+  for (std::thread &t : threads) t.join();
+
+  out.writes = seq;
+  out.writeNs = total / seq;
+  std::sort(samples.begin(), samples.end());
+  out.p99Ns = samples[samples.size() * 99 / 100];
+  out.maxNs = samples.back();
+  for (const ReaderResult &r : results) {
+    out.reads += r.reads;
+    out.attempts += r.attempts;
+    out.torn += r.torn;
+  }
+  delete s;
+  return out;
+}
+
+// Function to time a publish with nobody reading - the cost the scan path pays per room change
+static double uncontended(Mode mode, size_t bytes) {
+  Shared *s = new Shared();
+  s->mode = mode;
+  s->words = (bytes + 3) / 4;
+  seqlockInit(&s->lock);
+  uint32_t words[SEQLOCK_MAX_WORDS];
+  makeTable(words, s->words, 1);
+  const int rounds = 2000000;
+  auto start = Clock::now();
+  for (int i = 0; i < rounds; i++) {
+    words[0] = i;  // Defeats hoisting the copy out of the loop
+    publish(s, words);
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / rounds;
+  delete s;
+  return ns;
+}
+
+int main(int argc, char **argv) {
+  int readers = argc > 1 ? atoi(argv[1]) : 3;
+  int ms = argc > 2 ? atoi(argv[2]) : 1000;
+  if (readers < 1 || readers > 64 || ms < 10) {
+    fprintf(stderr, "Usage: seqlock_bench [readers] [ms per run]\n");
+    return 2;
+  }
+  static const char *modeNames[] = {"seqlock", "mutex", "unprotected"};
+  printf("Host: %u hardware threads, %d readers, %d ms per run\n\n", std::thread::hardware_concurrency(), readers, ms);
+
+  printf("Publish with nobody reading:\n");
+  for (size_t bytes : {FIRMWARE_BYTES, LARGE_BYTES}) {
+    printf("  %3zu-byte table: seqlock %.1f ns, mutex %.1f ns, plain copy %.1f ns\n", bytes, uncontended(MODE_SEQLOCK, bytes),
+           uncontended(MODE_MUTEX, bytes), uncontended(MODE_NONE, bytes));
+  }
+
+  printf("\nWriter publishing flat out, readers copying flat out:\n");
+  printf("  %-6s %-12s %11s %9s %10s %12s %10s %13s %8s\n", "table", "protection", "writes", "write ns", "p99 ns",
+         "max ns", "reads", "retries per M", "torn");
+  bool ok = true;
+  for (size_t bytes : {FIRMWARE_BYTES, LARGE_BYTES}) {
+    for (Mode mode : {MODE_SEQLOCK, MODE_MUTEX, MODE_NONE}) {
+      RunResult r = run(mode, bytes, readers, ms);
+      printf("  %-6zu %-12s %11llu %9.1f %10.0f %12.0f %10llu %13.1f %8llu\n", bytes, modeNames[mode],
+             (unsigned long long)r.writes, r.writeNs, r.p99Ns, r.maxNs, (unsigned long long)r.reads,
+             r.reads ? 1e6 * (r.attempts - r.reads) / r.reads : 0, (unsigned long long)r.torn);
+      if (mode != MODE_NONE) ok = ok && r.torn == 0 && r.reads > 0;
+    }
+  }
+  printf("\nTorn copies are only allowed without protection\n");
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Fleet collector for the state-sync protocol - follows every controller's room state over UDP
+// and asks for a snapshot only when a gap is detected.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/sync_collector.cpp src/state_sync.cpp -o sync_collector
+// Run:           ./sync_collector                 listen on the state-sync port and print room changes
+//                ./sync_collector --bench [rooms] compare bytes per check-in against a full-state JSON publish
+#include "state_sync.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+
+#define SYNC_UDP_PORT 4220  // Must match the firmware's SYNC_UDP_PORT
+
+// Function to print the rooms a message changed
+static void printChanges(const SyncReceiver &rx) {
+  for (int room = 0; room < rx.roomCount; room++) {
+    if (!(rx.changedMask & (1UL << room))) continue;
+    printf("controller %u seq %u room %d: %s", rx.controllerId, rx.seq, room + 1,
+           (rx.occupied & (1UL << room)) ? "Occupied" : "Free");
+    if (rx.owned & (1UL << room)) {
+      printf(" owner");
+      for (int i = 0; i < SYNC_UID_SIZE; i++) printf(" %02x", rx.owner[room][i]);
+    }
+    printf("\n");
+  }
+}
+
+// Function to listen for controllers and keep one receiver per controller id
+static int runCollector() {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SYNC_UDP_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (sock < 0 || bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    return 1;
+  }
+
+  std::map<uint16_t, SyncReceiver> receivers;
+  uint8_t buf[SYNC_MAX_MESSAGE];
+  for (;;) {
+    sockaddr_in from = {};
+    socklen_t fromLen = sizeof(from);
+    ssize_t len = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr *)&from, &fromLen);
+    uint8_t type;
+    uint16_t id;
+    if (len <= 0 || !syncPeek(buf, len, &type, &id)) continue;
+
+    auto it = receivers.find(id);
+    if (it == receivers.end()) {
+      it = receivers.emplace(id, SyncReceiver()).first;
+      syncReceiverInit(&it->second, id);
+    }
+    SyncReceiver &rx = it->second;
+
+    SyncResult result = syncReceive(&rx, buf, len);
+    if (result == SYNC_APPLIED) {
+      printChanges(rx);
+    }
+    else if (result == SYNC_GAP) {
+      // Ask the controller for its full state - the request goes back to the port it sent from
+      SyncRoomView none = {0, nullptr, nullptr, nullptr};
+      size_t reqLen = syncEncode(buf, sizeof(buf), SYNC_MSG_SNAPSHOT_REQ, id, rx.seq, 0, 0, none);
+      sendto(sock, buf, reqLen, 0, (sockaddr *)&from, fromLen);
+      printf("controller %u: gap at seq %u, snapshot requested\n", id, rx.seq);
+    }
+  }
+}
+
+// Function to simulate check-ins and compare wire bytes against a full-state JSON publish
+static int runBench(int roomCount) {
+  const int checkIns = 100000;
+  bool on[SYNC_MAX_ROOMS] = {};
+  bool hasOwner[SYNC_MAX_ROOMS] = {};
+  uint8_t owner[SYNC_MAX_ROOMS][SYNC_UID_SIZE] = {};
+  SyncRoomView view = {(uint8_t)roomCount, on, hasOwner, owner};
+
+  SyncReceiver rx;
+  syncReceiverInit(&rx, 1);
+  uint8_t buf[SYNC_MAX_MESSAGE];
+  std::mt19937 rng(1);
+  uint32_t seq = 0;
+  size_t deltaBytes = 0, jsonBytes = 0;
+
+  // Start the receiver from a snapshot, as the collector would on first contact
+  size_t len = syncEncode(buf, sizeof(buf), SYNC_MSG_SNAPSHOT, 1, seq, 0, (uint32_t)((1ULL << roomCount) - 1), view);
+  syncReceive(&rx, buf, len);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < checkIns; i++) {
+    int room = rng() % roomCount;
+    on[room] = !on[room];  // Alternate check-in and check-out on a random room
+    hasOwner[room] = on[room];
+    for (int b = 0; b < SYNC_UID_SIZE; b++) owner[room][b] = rng();
+    uint32_t prev = seq++;
+
+    len = syncEncode(buf, sizeof(buf), SYNC_MSG_DELTA, 1, seq, prev, 1UL << room, view);
+    deltaBytes += len;
+    jsonBytes += syncJsonSize(1, seq, view);
+    if (syncReceive(&rx, buf, len) != SYNC_APPLIED) {
+      fprintf(stderr, "delta %d not applied\n", i);
+      return 1;
+    }
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  printf("rooms %d, %d check-ins\n", roomCount, checkIns);
+  printf("  delta:     %6.1f bytes per check-in\n", (double)deltaBytes / checkIns);
+  printf("  full JSON: %6.1f bytes per check-in (%.1fx)\n", (double)jsonBytes / checkIns, (double)jsonBytes / deltaBytes);
+  printf("  encode+decode: %.3f us per check-in\n", us / checkIns);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    int rooms = argc > 2 ? atoi(argv[2]) : 2;
+    if (rooms < 1 || rooms > SYNC_MAX_ROOMS) rooms = 2;
+    return runBench(rooms);
+  }
+  return runCollector();
+}
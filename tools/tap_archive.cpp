@@ -0,0 +1,640 @@
+// Tap archive - converts controller logs into an event archive (see event_archive.h) and queries it, so
+// billing and audits read a few bytes per tap instead of re-parsing years of text
+// The converter reads the merged output of log_ingest, or a plain Serial log, and turns each card read and
+// the decision lines the firmware prints after it into one event:
+//   Card:  13 a3 50 11 / Door 2 card: 13 a3 50 11   then
+//   Room n assigned (check-in), Left Room n (check-out), Room n occupied, Access denied, Card revoked,
+//   Staff in Room n, Staff out ...
+// and, without a card, Relay n ON/OFF by BMS and Room n vacant.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude -Itools tools/tap_archive.cpp tools/event_archive.cpp -o tap_archive
+// Run:           ./tap_archive convert out.evar [log...]      logs from log_ingest, or - for stdin
+//                ./tap_archive query file.evar [--from t] [--to t] [--controller name] [--room n] [--uid hex] [--type name]
+//                    matching events as CSV; times are ISO 8601 UTC, rooms numbered from 1 as on the display
+//                ./tap_archive info file.evar
+//                ./tap_archive --bench [controllers] [rooms]
+//                    a synthetic year of hotel traffic rendered as log_ingest output, converted, and queried;
+//                    every query is checked against the generator
+#include "event_archive.h"
+#include "event_journal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+#define BENCH_START  1767225600000ULL  // 2026-01-01 00:00 UTC, in ms
+#define BENCH_DAYS   365
+#define DAY_MS       86400000ULL
+
+static const char *typeNames[] = {"", "boot", "check-in", "check-out", "denied-unknown", "denied-occupied",
+                                  "denied-revoked", "staff-in", "staff-out", "remote-on", "remote-off", "vacant",
+                                  "denied-wrong-door"};
+#define TYPE_COUNT (sizeof(typeNames) / sizeof(typeNames[0]))
+
+static bool startsWith(const char *s, size_t len, const char *prefix) {
+  size_t n = strlen(prefix);
+  return len >= n && memcmp(s, prefix, n) == 0;
+}
+
+// Function to format Unix milliseconds as 2026-10-18T09:14:03.512Z
+static void formatTime(uint64_t ms, char *out, size_t size) {
+  time_t t = ms / 1000;
+  struct tm parts;
+  gmtime_r(&t, &parts);
+  size_t n = strftime(out, size, "%Y-%m-%dT%H:%M:%S", &parts);
+  snprintf(out + n, size - n, ".%03uZ", (unsigned)(ms % 1000));
+}
+
+static bool digits(const char *s, int n, int *v) {
+  *v = 0;
+  for (int i = 0; i < n; i++) {
+    if (s[i] < '0' || s[i] > '9') return false;
+    *v = *v * 10 + s[i] - '0';
+  }
+  return true;
+}
+
+// Function to count days from 1970-01-01 to a date - every log line has a time, so no timegm()
+static int64_t daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+// Function to parse 2026-10-18T09:14:03.512204Z, 2026-10-18T09:14:03Z or 2026-10-18 - returns its length, 0 if it is none
+static size_t parseTime(const char *s, size_t len, uint64_t *ms) {
+  int y, mo, d, h = 0, mi = 0, sec = 0;
+  if (len < 10 || !digits(s, 4, &y) || s[4] != '-' || !digits(s + 5, 2, &mo) || s[7] != '-' || !digits(s + 8, 2, &d)) return 0;
+  if (mo < 1 || mo > 12 || d < 1 || d > 31) return 0;
+  size_t i = 10;
+  uint64_t frac = 0;
+  if (len >= 19 && s[10] == 'T') {
+    if (!digits(s + 11, 2, &h) || s[13] != ':' || !digits(s + 14, 2, &mi) || s[16] != ':' || !digits(s + 17, 2, &sec)) return 0;
+    i = 19;
+    if (i < len && s[i] == '.') {
+      uint64_t scale = 100;
+      for (i++; i < len && s[i] >= '0' && s[i] <= '9'; i++, scale /= 10) frac += (s[i] - '0') * scale;
+    }
+    if (i < len && s[i] == 'Z') i++;
+  }
+  *ms = (uint64_t)((daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec) * 1000) + frac;
+  return i;
+}
+
+// ---- Log converter ----
+
+struct Pending {
+  bool card;               // A card was read and its decision line is still to come
+  uint64_t timeMs;
+  uint8_t uidLen;
+  uint8_t uid[ARCHIVE_UID_MAX];
+};
+
+struct Converter {
+  ArchiveWriter *w;
+  std::vector<Pending> pending;                             // Per controller
+  std::map<std::pair<uint16_t, std::string>, uint16_t> staffRoom;  // Where each staff card went in
+  uint64_t lastTime = 0;    // For lines without a timestamp
+  bool timed = false;
+  uint64_t lines = 0, events = 0, undecided = 0, untimed = 0, rejected = 0;
+};
+
+// Function to read the room number after a prefix - the log numbers rooms from 1
+static bool roomAfter(const char *s, size_t len, const char *prefix, uint16_t *room) {
+  size_t n = strlen(prefix);
+  if (!startsWith(s, len, prefix) || n >= len || s[n] < '1' || s[n] > '9') return false;
+  *room = (uint16_t)(atoi(s + n) - 1);
+  return true;
+}
+
+static void emit(Converter *c, uint16_t controller, uint64_t timeMs, uint8_t type, uint16_t room, const uint8_t *uid, uint8_t uidLen) {
+  ArchiveEvent e;
+  e.timeMs = timeMs;
+  e.controller = controller;
+  e.type = type;
+  e.room = room;
+  e.uidLen = uidLen;
+  memcpy(e.uid, uid, uidLen);
+  if (archiveAppend(c->w, e)) c->events++;
+  else c->rejected++;  // Older than the controller's last event - logs given out of order
+}
+
+// Function to convert one log line - log_ingest's "<time> <device> <kind> <text>", or bare Serial text from source
+static void convertLine(Converter *c, const char *s, size_t len, const char *source) {
+  c->lines++;
+  uint64_t timeMs;
+  std::string device;
+  size_t used = parseTime(s, len, &timeMs);
+  if (used > 0 && used < len && s[used] == ' ') {
+    const char *dev = s + used + 1;
+    const char *devEnd = (const char *)memchr(dev, ' ', s + len - dev);
+    if (devEnd == NULL) return;
+    const char *kindEnd = (const char *)memchr(devEnd + 1, ' ', s + len - devEnd - 1);
+    if (kindEnd == NULL) return;
+    device.assign(dev, devEnd - dev);
+    len -= kindEnd + 1 - s;
+    s = kindEnd + 1;
+    c->lastTime = timeMs;
+    c->timed = true;
+  }
+  else {
+    if (!c->timed) {
+      c->untimed++;  // No time yet to give it
+      return;
+    }
+    device = source;
+    timeMs = c->lastTime;
+  }
+
+  uint16_t controller = archiveController(c->w, device);
+  if (controller >= c->pending.size()) c->pending.resize(controller + 1, Pending());
+  Pending &p = c->pending[controller];
+  uint16_t room;
+  const char *uidText = NULL;
+  if (startsWith(s, len, "Card: ")) uidText = s + 5;
+  else if (startsWith(s, len, "Door ")) {
+    const char *mark = (const char *)memmem(s, len, " card:", 6);
+    if (mark != NULL) uidText = mark + 6;
+  }
+  if (uidText != NULL) {
+    if (p.card) c->undecided++;  // A read with no decision - reset mid-tap, or a line lost
+    std::string text(uidText, s + len - uidText);
+    p.uidLen = archiveParseUid(text.c_str(), p.uid);
+    p.card = p.uidLen > 0;
+    p.timeMs = timeMs;
+    return;
+  }
+
+  static const uint8_t noUid[1] = {0};
+  if (startsWith(s, len, "Relay ") && memmem(s, len, " by BMS", 7) != NULL) {
+    if (roomAfter(s, len, "Relay ", &room)) {
+      emit(c, controller, timeMs, memmem(s, len, " ON", 3) != NULL ? JOURNAL_REMOTE_ON : JOURNAL_REMOTE_OFF, room, noUid, 0);
+    }
+    return;
+  }
+  if (roomAfter(s, len, "Room ", &room) && memmem(s, len, " vacant", 7) != NULL) {
+    emit(c, controller, timeMs, JOURNAL_VACANT, room, noUid, 0);
+    return;
+  }
+  if (!p.card) return;
+
+  uint8_t type = 0;
+  uint16_t eventRoom = ARCHIVE_NO_ROOM;
+  std::string uidKey((const char *)p.uid, p.uidLen);
+  if (roomAfter(s, len, "Room ", &room) && memmem(s, len, " assigned", 9) != NULL) type = JOURNAL_CHECK_IN, eventRoom = room;
+  else if (roomAfter(s, len, "Left Room ", &room)) type = JOURNAL_CHECK_OUT, eventRoom = room;
+  else if (roomAfter(s, len, "Room ", &room) && memmem(s, len, " occupied", 9) != NULL) type = JOURNAL_DENIED_OCCUPIED, eventRoom = room;
+  else if (startsWith(s, len, "Access denied")) type = JOURNAL_DENIED_UNKNOWN;
+  else if (startsWith(s, len, "Card revoked")) type = JOURNAL_DENIED_REVOKED;
+  else if (roomAfter(s, len, "Room ", &room) && memmem(s, len, " wrong door", 11) != NULL) type = JOURNAL_DENIED_WRONG_DOOR, eventRoom = room;
+  else if (roomAfter(s, len, "Staff in Room ", &room)) {
+    type = JOURNAL_STAFF_IN;
+    eventRoom = room;
+    c->staffRoom[{controller, uidKey}] = room;
+  }
+  else if (startsWith(s, len, "Staff out ")) {
+    type = JOURNAL_STAFF_OUT;  // The line gives the time spent, not the room - that came with the way in
+    auto found = c->staffRoom.find({controller, uidKey});
+    if (found != c->staffRoom.end()) {
+      eventRoom = found->second;
+      c->staffRoom.erase(found);
+    }
+  }
+  if (type == 0) return;  // Relay lines and anything else between the read and its decision
+  emit(c, controller, p.timeMs, type, eventRoom, p.uid, p.uidLen);
+  p.card = false;
+}
+
+// Function to convert a whole log file
+static bool convertFile(Converter *c, const char *path) {
+  bool useStdin = strcmp(path, "-") == 0;
+  FILE *f = useStdin ? stdin : fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "Cannot read %s\n", path);
+    return false;
+  }
+  const char *base = strrchr(path, '/');
+  std::string source = useStdin ? "serial" : base ? base + 1 : path;
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t n;
+  while ((n = getline(&line, &cap, f)) > 0) {
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) n--;
+    convertLine(c, line, n, source.c_str());
+  }
+  free(line);
+  if (!useStdin) fclose(f);
+  return true;
+}
+
+static int runConvert(int argc, char **argv) {
+  if (argc < 1) {
+    fprintf(stderr, "Usage: tap_archive convert out.evar [log...]\n");
+    return 2;
+  }
+  ArchiveWriter w;
+  if (!archiveCreate(&w, argv[0])) {
+    fprintf(stderr, "Cannot create %s\n", argv[0]);
+    return 1;
+  }
+  Converter c;
+  c.w = &w;
+  bool ok = true;
+  if (argc == 1) ok = convertFile(&c, "-");
+  for (int i = 1; i < argc; i++) ok = convertFile(&c, argv[i]) && ok;
+  if (!archiveFinish(&w)) {
+    fprintf(stderr, "Cannot write %s\n", argv[0]);
+    return 1;
+  }
+  printf("%llu lines, %llu events from %zu controllers, %llu bytes (%.2f bytes/event)\n", (unsigned long long)c.lines,
+         (unsigned long long)c.events, w.names.size(), (unsigned long long)w.bytes, c.events ? (double)w.bytes / c.events : 0.0);
+  if (c.undecided || c.untimed || c.rejected) {
+    printf("%llu reads without a decision, %llu lines before any timestamp, %llu events out of order\n",
+           (unsigned long long)c.undecided, (unsigned long long)c.untimed, (unsigned long long)c.rejected);
+  }
+  return ok ? 0 : 1;
+}
+
+// ---- Queries ----
+
+static bool printCsv(const ArchiveEvent *e, void *ctx) {
+  const ArchiveReader *r = (const ArchiveReader *)ctx;
+  char when[32], uid[2 * ARCHIVE_UID_MAX + 1] = "";
+  formatTime(e->timeMs, when, sizeof(when));
+  for (uint8_t i = 0; i < e->uidLen; i++) sprintf(uid + 2 * i, "%02x", e->uid[i]);
+  char room[8] = "";
+  if (e->room != ARCHIVE_NO_ROOM) snprintf(room, sizeof(room), "%u", e->room + 1);
+  printf("%s,%s,%s,%s,%s\n", when, r->names[e->controller].c_str(), room, e->type < TYPE_COUNT ? typeNames[e->type] : "?", uid);
+  return true;
+}
+
+static int runQuery(int argc, char **argv) {
+  if (argc < 1) {
+    fprintf(stderr, "Usage: tap_archive query file.evar [filters]\n");
+    return 2;
+  }
+  ArchiveReader r;
+  if (!archiveOpen(&r, argv[0])) {
+    fprintf(stderr, "Cannot open archive %s\n", argv[0]);
+    return 1;
+  }
+  ArchiveQuery q;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *opt = argv[i], *val = argv[i + 1];
+    uint64_t ms;
+    if (!strcmp(opt, "--from") && parseTime(val, strlen(val), &ms)) q.fromMs = ms;
+    else if (!strcmp(opt, "--to") && parseTime(val, strlen(val), &ms)) q.toMs = ms;
+    else if (!strcmp(opt, "--room") && atoi(val) > 0) q.room = atoi(val) - 1;
+    else if (!strcmp(opt, "--uid") && (q.uidLen = archiveParseUid(val, q.uid)) > 0) {}
+    else if (!strcmp(opt, "--controller")) {
+      auto found = std::find(r.names.begin(), r.names.end(), val);
+      if (found == r.names.end()) return 0;  // Never seen - nothing to report
+      q.controller = found - r.names.begin();
+    }
+    else if (!strcmp(opt, "--type") && std::find(typeNames + 1, typeNames + TYPE_COUNT, std::string(val)) != typeNames + TYPE_COUNT) {
+      if (q.typeMask == 0xFFFF) q.typeMask = 0;  // Repeat --type for several
+      q.typeMask |= 1U << (std::find(typeNames + 1, typeNames + TYPE_COUNT, std::string(val)) - typeNames);
+    }
+    else {
+      fprintf(stderr, "Bad filter %s %s\n", opt, val);
+      return 2;
+    }
+  }
+  printf("time,controller,room,event,uid\n");
+  ArchiveQueryStats stats;
+  bool ok = archiveQuery(&r, q, printCsv, &r, &stats);
+  fprintf(stderr, "%u blocks skipped by the index, %u by their UID dictionary, %u decoded (%llu events)\n", stats.blocksSkipped,
+          stats.blocksNoUid, stats.blocksDecoded, (unsigned long long)stats.eventsDecoded);
+  if (!ok) fprintf(stderr, "Archive is corrupt\n");
+  archiveClose(&r);
+  return ok ? 0 : 1;
+}
+
+static int runInfo(int argc, char **argv) {
+  ArchiveReader r;
+  if (argc < 1 || !archiveOpen(&r, argv[0])) {
+    fprintf(stderr, "Cannot open archive\n");
+    return 1;
+  }
+  uint64_t first = UINT64_MAX, last = 0;
+  for (const ArchiveBlockInfo &b : r.index) {
+    first = std::min(first, b.minTime);
+    last = std::max(last, b.maxTime);
+  }
+  char from[32] = "-", to[32] = "-";
+  if (!r.index.empty()) {
+    formatTime(first, from, sizeof(from));
+    formatTime(last, to, sizeof(to));
+  }
+  printf("%llu events, %zu blocks, %zu controllers, %zu bytes (%.2f bytes/event), %s to %s\n", (unsigned long long)r.events,
+         r.index.size(), r.names.size(), r.mapSize, r.events ? (double)r.mapSize / r.events : 0.0, from, to);
+  archiveClose(&r);
+  return 0;
+}
+
+// ---- Benchmark ----
+
+struct Truth {
+  uint64_t events = 0, hash = 0;
+};
+
+// Function to hash one event - summed, so the total does not depend on the order events come back in
+static uint64_t eventHash(const ArchiveEvent &e) {
+  uint64_t h = e.timeMs * 0x9E3779B97F4A7C15ULL ^ ((uint64_t)e.controller << 40 | (uint64_t)e.room << 16 | e.type << 8 | e.uidLen);
+  for (uint8_t i = 0; i < e.uidLen; i++) h = (h ^ e.uid[i]) * 0x100000001B3ULL;
+  return h ^ h >> 29;
+}
+
+static void addTruth(Truth &t, const ArchiveEvent &e) {
+  t.events++;
+  t.hash += eventHash(e);
+}
+
+static bool sumVisitor(const ArchiveEvent *e, void *ctx) {
+  addTruth(*(Truth *)ctx, *e);
+  return true;
+}
+
+static void makeUid(uint32_t id, ArchiveEvent &e) {
+  e.uidLen = 4;
+  e.uid[0] = id >> 24 | 0x80;  // Never all zero
+  e.uid[1] = id >> 16;
+  e.uid[2] = id >> 8;
+  e.uid[3] = id;
+}
+
+struct Room {
+  uint32_t guest = 0;        // Card of the current stay, 0 while empty
+  int nightsLeft = 0;
+};
+
+// Function to generate one day of one controller's events - guests stay a few nights and come and go,
+// housekeeping visits occupied rooms, the BMS and the occupancy sensors step in now and then
+static void simulateDay(uint16_t controller, std::vector<Room> &rooms, uint64_t day, uint32_t &nextGuest,
+                        std::mt19937 &rng, std::vector<ArchiveEvent> &out) {
+  size_t first = out.size();
+  auto at = [&](int fromMin, int toMin) { return day + (uint64_t)(fromMin + rng() % (toMin - fromMin)) * 60000 + rng() % 60000; };
+  auto add = [&](uint64_t t, uint8_t type, uint16_t room, uint32_t card) {
+    ArchiveEvent e = {};
+    e.timeMs = t;
+    e.controller = controller;
+    e.type = type;
+    e.room = room;
+    if (card != 0) makeUid(card, e);
+    out.push_back(e);
+  };
+  for (uint16_t r = 0; r < rooms.size(); r++) {
+    Room &room = rooms[r];
+    if (room.guest != 0 && room.nightsLeft == 0) {  // Departure - the last tap out of the stay
+      add(at(7 * 60, 11 * 60), JOURNAL_CHECK_OUT, r, room.guest);
+      room.guest = 0;
+    }
+    else if (room.guest != 0) {  // Out for the day and back
+      if (rng() % 50 == 0) add(at(8 * 60, 11 * 60), JOURNAL_VACANT, r, 0);  // Left without tapping out
+      else add(at(8 * 60, 11 * 60), JOURNAL_CHECK_OUT, r, room.guest);
+      if (rng() % 40 == 0) add(at(11 * 60, 12 * 60), JOURNAL_DENIED_OCCUPIED, r, room.guest);
+      add(at(12 * 60, 13 * 60), JOURNAL_STAFF_IN, r, 1 + controller * 64 + r);
+      add(at(13 * 60, 14 * 60), JOURNAL_STAFF_OUT, r, 1 + controller * 64 + r);
+      add(at(17 * 60, 23 * 60), JOURNAL_CHECK_IN, r, room.guest);
+      room.nightsLeft--;
+    }
+    if (room.guest == 0 && rng() % 10 < 7) {  // About 70% occupancy
+      room.guest = nextGuest++;
+      room.nightsLeft = 1 + rng() % 4;
+      add(at(14 * 60, 23 * 60), JOURNAL_CHECK_IN, r, room.guest);
+    }
+    if (rng() % 100 == 0) {  // Night setback from the BMS
+      add(at(0, 60), JOURNAL_REMOTE_OFF, r, 0);
+      add(at(5 * 60, 6 * 60), JOURNAL_REMOTE_ON, r, 0);
+    }
+  }
+  if (rng() % 3 == 0) add(at(0, 24 * 60), JOURNAL_DENIED_UNKNOWN, ARCHIVE_NO_ROOM, 0x400000 + rng() % 5000);
+  if (rng() % 60 == 0) add(at(0, 24 * 60), JOURNAL_DENIED_REVOKED, ARCHIVE_NO_ROOM, 1000 + rng() % (nextGuest - 1000));
+
+  // One tap at a time per controller - at least 2 s apart, so a read's lines never interleave with the next
+  std::sort(out.begin() + first, out.end(), [](const ArchiveEvent &a, const ArchiveEvent &b) { return a.timeMs < b.timeMs; });
+  for (size_t i = first + 1; i < out.size(); i++) {
+    if (out[i].timeMs < out[i - 1].timeMs + 2000) out[i].timeMs = out[i - 1].timeMs + 2000;
+  }
+}
+
+// Function to render an event the way the firmware prints it and log_ingest stamps it
+static void renderText(const ArchiveEvent &e, const std::vector<std::string> &names, std::mt19937 &rng, std::string &text) {
+  char line[160], stamp[40];
+  uint64_t us = e.timeMs * 1000 + rng() % 1000;
+  auto put = [&](const char *kind, const char *msg) {
+    time_t t = us / 1000000;
+    struct tm parts;
+    gmtime_r(&t, &parts);
+    size_t n = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &parts);
+    snprintf(stamp + n, sizeof(stamp) - n, ".%06uZ", (unsigned)(us % 1000000));
+    snprintf(line, sizeof(line), "%s %s %s %s\n", stamp, names[e.controller].c_str(), kind, msg);
+    text += line;
+    us += 3000 + rng() % 2000;  // Next line a few ms later
+  };
+  char msg[64];
+  unsigned room = e.room + 1;
+  if (e.uidLen > 0) {
+    snprintf(msg, sizeof(msg), "Card:  %02x %02x %02x %02x", e.uid[0], e.uid[1], e.uid[2], e.uid[3]);
+    put("card", msg);
+  }
+  switch (e.type) {
+    case JOURNAL_CHECK_IN:
+      snprintf(msg, sizeof(msg), "Relay %u ON", room), put("relay", msg);
+      snprintf(msg, sizeof(msg), "Room %u assigned", room), put("room", msg);
+      break;
+    case JOURNAL_CHECK_OUT:
+      snprintf(msg, sizeof(msg), "Relay %u OFF", room), put("relay", msg);
+      snprintf(msg, sizeof(msg), "Left Room %u", room), put("room", msg);
+      break;
+    case JOURNAL_DENIED_OCCUPIED: snprintf(msg, sizeof(msg), "Room %u occupied", room), put("room", msg); break;
+    case JOURNAL_DENIED_UNKNOWN: put("denied", "Access denied"); break;
+    case JOURNAL_DENIED_REVOKED: put("denied", "Card revoked"); break;
+    case JOURNAL_DENIED_WRONG_DOOR: snprintf(msg, sizeof(msg), "Room %u card, wrong door", room), put("denied", msg); break;
+    case JOURNAL_STAFF_IN: snprintf(msg, sizeof(msg), "Staff in Room %u", room), put("staff", msg); break;
+    case JOURNAL_STAFF_OUT: put("staff", "Staff out 42m 7s"); break;
+    case JOURNAL_REMOTE_ON: snprintf(msg, sizeof(msg), "Relay %u ON by BMS", room), put("relay", msg); break;
+    case JOURNAL_REMOTE_OFF: snprintf(msg, sizeof(msg), "Relay %u OFF by BMS", room), put("relay", msg); break;
+    case JOURNAL_VACANT:
+      us -= 5000;  // The event's time is the vacant line's; the relay line comes first
+      snprintf(msg, sizeof(msg), "Relay %u OFF", room), put("relay", msg);
+      us = e.timeMs * 1000 + rng() % 1000;
+      snprintf(msg, sizeof(msg), "Room %u vacant", room), put("room", msg);
+      break;
+  }
+}
+
+// Function to get the size of an event as one JSON line - what a JSON log would store
+static size_t jsonSize(const ArchiveEvent &e, const std::vector<std::string> &names) {
+  char when[32], line[200];
+  formatTime(e.timeMs, when, sizeof(when));
+  return snprintf(line, sizeof(line), "{\"time\":\"%s\",\"controller\":\"%s\",\"room\":%d,\"event\":\"%s\",\"uid\":\"%02x%02x%02x%02x\"}\n",
+                  when, names[e.controller].c_str(), e.room == ARCHIVE_NO_ROOM ? 0 : e.room + 1, typeNames[e.type],
+                  e.uid[0], e.uid[1], e.uid[2], e.uid[3]);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Function to time a query - best of three runs, checked against the generator's count
+static bool benchQuery(ArchiveReader *r, const char *label, const ArchiveQuery &q, const Truth &expect) {
+  double best = 1e9;
+  Truth got;
+  ArchiveQueryStats stats;
+  for (int run = 0; run < 3; run++) {
+    got = Truth();
+    stats = ArchiveQueryStats();
+    auto start = std::chrono::steady_clock::now();
+    if (!archiveQuery(r, q, sumVisitor, &got, &stats)) {
+      printf("%-22s archive corrupt\n", label);
+      return false;
+    }
+    best = std::min(best, secondsSince(start));
+  }
+  bool ok = got.events == expect.events && got.hash == expect.hash;
+  printf("%-22s %9llu events %9.2f ms  %5.1f M events/s decoded  blocks %u skipped %u no uid %u decoded  %s\n", label,
+         (unsigned long long)got.events, best * 1000, stats.eventsDecoded / best / 1e6, stats.blocksSkipped, stats.blocksNoUid,
+         stats.blocksDecoded, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+static int runBench(int controllers, int roomsPer) {
+  const char *path = "/tmp/tap_archive_bench.evar";
+  ArchiveWriter w;
+  if (!archiveCreate(&w, path)) {
+    fprintf(stderr, "Cannot create %s\n", path);
+    return 1;
+  }
+  std::vector<std::string> names;
+  for (int c = 0; c < controllers; c++) {
+    names.push_back("ttyACM" + std::to_string(c));
+    archiveController(&w, names.back());  // Index c, as the generator numbers them
+  }
+  Converter conv;
+  conv.w = &w;
+
+  std::mt19937 rng(1);
+  std::vector<std::vector<Room>> rooms(controllers, std::vector<Room>(roomsPer));
+  uint32_t nextGuest = 1000;
+  const uint64_t monthFrom = BENCH_START + 59 * DAY_MS, monthTo = BENCH_START + 90 * DAY_MS - 1;  // March
+  const uint64_t dayFrom = BENCH_START + 200 * DAY_MS, dayTo = dayFrom + DAY_MS - 1;
+  const uint16_t auditController = controllers / 2, auditRoom = roomsPer / 2;
+  Truth all, month, day, roomYear, billing;
+  std::unordered_map<uint32_t, Truth> perGuest;
+  uint64_t textBytes = 0, jsonBytes = 0, textLines = 0;
+  double convertSeconds = 0;
+  std::vector<ArchiveEvent> today;
+  std::string text;
+
+  for (int d = 0; d < BENCH_DAYS; d++) {
+    uint64_t dayStart = BENCH_START + d * DAY_MS;
+    today.clear();
+    for (int c = 0; c < controllers; c++) simulateDay(c, rooms[c], dayStart, nextGuest, rng, today);
+    std::stable_sort(today.begin(), today.end(), [](const ArchiveEvent &a, const ArchiveEvent &b) { return a.timeMs < b.timeMs; });
+    text.clear();
+    for (const ArchiveEvent &e : today) {
+      renderText(e, names, rng, text);
+      jsonBytes += jsonSize(e, names);
+      addTruth(all, e);
+      if (e.timeMs >= monthFrom && e.timeMs <= monthTo) addTruth(month, e);
+      if (e.timeMs >= monthFrom && e.timeMs <= monthTo && e.type == JOURNAL_CHECK_IN) addTruth(billing, e);
+      if (e.timeMs >= dayFrom && e.timeMs <= dayTo) addTruth(day, e);
+      if (e.controller == auditController && e.room == auditRoom) addTruth(roomYear, e);
+      if (e.uidLen > 0) addTruth(perGuest[(uint32_t)(e.uid[0] & 0x7F) << 24 | e.uid[1] << 16 | e.uid[2] << 8 | e.uid[3]], e);
+    }
+    textBytes += text.size();
+
+    // Lines are interleaved across controllers as log_ingest merges them - convert them as a file would be read
+    auto start = std::chrono::steady_clock::now();
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      convertLine(&conv, text.data() + pos, end - pos, "-");
+      pos = end + 1;
+      textLines++;
+    }
+    convertSeconds += secondsSince(start);
+  }
+  auto start = std::chrono::steady_clock::now();
+  bool ok = archiveFinish(&w);
+  convertSeconds += secondsSince(start);
+  ok = ok && conv.events == all.events && conv.undecided == 0 && conv.rejected == 0;
+
+  printf("Synthetic year: %d controllers x %d rooms, %llu events, %llu log lines\n", controllers, roomsPer,
+         (unsigned long long)all.events, (unsigned long long)textLines);
+  printf("Converter: %.2f s, %.1f M lines/s, %.1f MB/s of log text - %llu events, %llu undecided, %llu out of order\n",
+         convertSeconds, textLines / convertSeconds / 1e6, textBytes / convertSeconds / 1e6, (unsigned long long)conv.events,
+         (unsigned long long)conv.undecided, (unsigned long long)conv.rejected);
+  printf("\n%-24s %12s %12s %10s\n", "Storage", "bytes", "bytes/event", "vs text");
+  auto row = [&](const char *label, uint64_t bytes) {
+    printf("%-24s %12llu %12.2f %9.1fx\n", label, (unsigned long long)bytes, (double)bytes / all.events, (double)textBytes / bytes);
+  };
+  row("log_ingest text", textBytes);
+  row("JSON lines", jsonBytes);
+  row("fixed 16-byte records", all.events * 16);
+  row("archive", w.bytes);
+  printf("archive blocks: %zu, index %zu bytes\n\n", w.index.size(), w.index.size() * 44);
+
+  ArchiveReader r;
+  if (!archiveOpen(&r, path)) {
+    printf("Cannot reopen the archive\n");
+    return 1;
+  }
+  // The audited guest - the card with the most taps, a long-staying guest
+  uint32_t guest = 0;
+  for (auto &g : perGuest) {
+    if (g.first >= 1000 && g.first < 0x400000 && g.second.events > perGuest[guest].events) guest = g.first;
+  }
+  ArchiveQuery q;
+  ok = benchQuery(&r, "full scan", q, all) && ok;
+  q.fromMs = monthFrom, q.toMs = monthTo;
+  ok = benchQuery(&r, "one month", q, month) && ok;
+  q.typeMask = 1U << JOURNAL_CHECK_IN;
+  ok = benchQuery(&r, "month check-ins", q, billing) && ok;
+  q = ArchiveQuery();
+  q.fromMs = dayFrom, q.toMs = dayTo;
+  ok = benchQuery(&r, "one day", q, day) && ok;
+  q = ArchiveQuery();
+  q.controller = auditController, q.room = auditRoom;
+  ok = benchQuery(&r, "one room, whole year", q, roomYear) && ok;
+  q = ArchiveQuery();
+  ArchiveEvent card;
+  makeUid(guest, card);
+  q.uidLen = card.uidLen;
+  memcpy(q.uid, card.uid, card.uidLen);
+  ok = benchQuery(&r, "one guest card", q, perGuest[guest]) && ok;
+  printf("Text logs answer any of these by parsing every line again: %.2f s at the converter's rate\n", convertSeconds);
+  archiveClose(&r);
+  remove(path);
+  printf("%s\n", ok ? "All checks passed" : "CHECKS FAILED");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+    int controllers = argc > 2 ? atoi(argv[2]) : 200;
+    int rooms = argc > 3 ? atoi(argv[3]) : 8;
+    if (controllers < 1 || controllers > 4096 || rooms < 1 || rooms > 63) {
+      fprintf(stderr, "Bad bench size\n");
+      return 2;
+    }
+    return runBench(controllers, rooms);
+  }
+  if (argc >= 2 && !strcmp(argv[1], "convert")) return runConvert(argc - 2, argv + 2);
+  if (argc >= 2 && !strcmp(argv[1], "query")) return runQuery(argc - 2, argv + 2);
+  if (argc >= 2 && !strcmp(argv[1], "info")) return runInfo(argc - 2, argv + 2);
+  fprintf(stderr, "Usage: tap_archive convert|query|info ... or tap_archive --bench [controllers] [rooms]\n");
+  return 2;
+}
@@ -0,0 +1,276 @@
+// Web UI benchmark - serves the generated assets with the firmware's request handling on a loopback port
+// and measures time to first byte and heap allocated per request, for a first page load, a reload that
+// revalidates index.html, and the /api/state poll. The same requests are then answered the usual way -
+// the response assembled in a std::string with the body copied in - so the two can be compared.
+// Allocations are counted by replacing operator new, on the server thread only, while it answers.
+// The WebSocket accept key is checked against the RFC 6455 example first.
+//
+// Build (host):  python3 tools/web_pack.py && g++ -O2 -std=c++17 -pthread -Iinclude tools/web_bench.cpp src/web_ui.cpp src/crypto_service.cpp -o web_bench
+// Run:           ./web_bench [rounds]
+#include "web_ui.h"
+#include "web_assets.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define ROOMS 32
+
+typedef std::chrono::steady_clock Clock;
+
+// ---- Allocation counting - only while the server thread is answering a request ----
+
+static thread_local bool counting = false;
+static uint64_t allocCount = 0, allocBytes = 0;
+
+void *operator new(size_t n) {
+  if (counting) {
+    allocCount++;
+    allocBytes += n;
+  }
+  void *p = malloc(n ? n : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// ---- Room table, as room_state.cpp keeps it ----
+
+static bool relayOn[ROOMS];
+static bool relayHasOwner[ROOMS];
+static uint32_t roomStateSeq = 0;
+static WebStats stats;
+
+// ---- Server ----
+
+static std::atomic<bool> stopServer(false);
+static std::atomic<bool> naive(false);
+
+static void sendAll(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0) return;
+    p += n;
+    len -= n;
+  }
+}
+
+// Function to answer a request the way web_ui.cpp does - header in a stack buffer, body straight from the table
+static bool respondTable(int fd, const WebRequest &req) {
+  char header[WEB_HEADER_MAX];
+  if (strcmp(req.path, "/api/state") == 0) {
+    char json[160 + ROOMS * 22];
+    WebStateView view = {relayOn, relayHasOwner, ROOMS, roomStateSeq, 12345, 200000, &stats};
+    size_t body = webStateJson(&view, json, sizeof(json));
+    size_t len = webJsonHeader(body, req.keepAlive, header, sizeof(header));
+    sendAll(fd, header, len);
+    sendAll(fd, json, body);
+    return true;
+  }
+  const WebAsset *asset = webFindAsset(webAssets, WEB_ASSET_COUNT, req.path);
+  if (asset == NULL) {
+    sendAll(fd, header, webStatusHeader(404, header, sizeof(header)));
+    return false;
+  }
+  bool notModified;
+  sendAll(fd, header, webAssetHeader(asset, &req, &notModified, header, sizeof(header)));
+  if (!notModified) sendAll(fd, asset->data, asset->len);
+  return true;
+}
+
+// Function to answer a request the common way - the whole response built up in a string, body copied in
+static bool respondNaive(int fd, const WebRequest &req) {
+  std::string resp;
+  if (strcmp(req.path, "/api/state") == 0) {
+    std::string json = "{\"seq\":" + std::to_string(roomStateSeq) + ",\"uptime\":12345,\"heap\":200000,\"rooms\":[";
+    for (int r = 0; r < ROOMS; r++) {
+      if (r) json += ",";
+      json += "{\"on\":" + std::to_string(relayOn[r]) + ",\"owned\":" + std::to_string(relayHasOwner[r]) + "}";
+    }
+    json += "],\"web\":{\"requests\":" + std::to_string(stats.requests) + "}}";
+    resp = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(json.size()) +
+           "\r\nCache-Control: no-store\r\nConnection: keep-alive\r\n\r\n" + json;
+  }
+  else {
+    const WebAsset *asset = webFindAsset(webAssets, WEB_ASSET_COUNT, req.path);
+    if (asset == NULL) return false;
+    std::string etag = asset->etag;
+    if (std::string(req.ifNoneMatch) == etag) {
+      resp = "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nConnection: keep-alive\r\n\r\n";
+    }
+    else {
+      resp = std::string("HTTP/1.1 200 OK\r\nContent-Type: ") + asset->type + "\r\nContent-Encoding: gzip\r\n" +
+             "Content-Length: " + std::to_string(asset->len) + "\r\nETag: " + etag +
+             "\r\nConnection: keep-alive\r\n\r\n";
+      resp += std::string((const char *)asset->data, asset->len);
+    }
+  }
+  sendAll(fd, resp.data(), resp.size());
+  return true;
+}
+
+static void serve(int listener) {
+  while (!stopServer) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) continue;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    char rx[768];
+    size_t len = 0;
+    for (;;) {
+      ssize_t n = read(fd, rx + len, sizeof(rx) - len);
+      if (n <= 0) break;
+      len += n;
+      WebRequest req;
+      int used = webParseRequest(rx, len, &req);
+      if (used == 0) continue;
+      if (used < 0) break;
+      counting = true;
+      if (naive) respondNaive(fd, req);
+      else respondTable(fd, req);
+      counting = false;
+      stats.requests++;
+      memmove(rx, rx + used, len - used);
+      len -= used;
+    }
+    close(fd);
+  }
+}
+
+// ---- Client ----
+
+struct Sample {
+  double ttfbUs;
+  size_t bytes;
+  int status;
+};
+
+// Function to send one request and read its whole response - the body length comes from Content-Length
+static Sample fetch(int fd, const char *path, const char *etag) {
+  char req[256];
+  int len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: controller\r\nAccept-Encoding: gzip, deflate\r\n"
+                     "User-Agent: web_bench\r\nAccept: */*\r\n%s%s%s\r\n",
+                     path, etag ? "If-None-Match: " : "", etag ? etag : "", etag ? "\r\n" : "");
+  Sample s = {0, 0, 0};
+  auto t0 = Clock::now();
+  sendAll(fd, req, len);
+  static char buf[65536];
+  size_t got = 0, need = 0;
+  while (need == 0 || got < need) {
+    ssize_t n = read(fd, buf + got, sizeof(buf) - got);
+    if (n <= 0) break;
+    if (got == 0) s.ttfbUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+    got += n;
+    const char *end = (const char *)memmem(buf, got, "\r\n\r\n", 4);
+    if (end != NULL && need == 0) {
+      const char *cl = (const char *)memmem(buf, end - buf, "Content-Length: ", 16);
+      need = (end - buf) + 4 + (cl ? atoi(cl + 16) : 0);
+    }
+  }
+  s.bytes = got;
+  s.status = atoi(buf + 9);
+  return s;
+}
+
+static int connectTo(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// Function to run one kind of request repeatedly and print TTFB and allocations per request
+static void runCase(uint16_t port, const char *label, const std::vector<const char *> &paths, bool revalidate, int rounds) {
+  int fd = connectTo(port);
+  if (fd < 0) return;
+  std::vector<double> ttfb;
+  size_t bytes = 0;
+  int bad = 0;
+  uint64_t count0 = allocCount, bytes0 = allocBytes;
+  for (int i = 0; i < rounds; i++) {
+    for (const char *path : paths) {
+      const WebAsset *asset = webFindAsset(webAssets, WEB_ASSET_COUNT, path);
+      Sample s = fetch(fd, path, revalidate && asset ? asset->etag : NULL);
+      if (s.status != (revalidate && asset ? 304 : 200)) bad++;
+      ttfb.push_back(s.ttfbUs);
+      bytes += s.bytes;
+    }
+  }
+  close(fd);
+  usleep(1000);  // Let the server thread finish its bookkeeping
+  std::sort(ttfb.begin(), ttfb.end());
+  double requests = ttfb.size();
+  printf("  %-26s %6.0f B/resp  ttfb p50 %5.1f us, p99 %5.1f us   %5.2f allocs, %7.0f B heap per request%s\n",
+         label, bytes / requests, ttfb[ttfb.size() / 2], ttfb[ttfb.size() * 99 / 100],
+         (allocCount - count0) / requests, (allocBytes - bytes0) / requests, bad ? "  (bad status)" : "");
+}
+
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  if (rounds < 10) rounds = 2000;
+  for (int r = 0; r < ROOMS; r++) {
+    relayOn[r] = r % 3 == 0;
+    relayHasOwner[r] = relayOn[r];
+  }
+  roomStateSeq = 77;
+
+  char accept[WEB_HEADER_MAX];
+  webSocketAcceptHeader("dGhlIHNhbXBsZSBub25jZQ==", accept, sizeof(accept));
+  printf("WebSocket accept for the RFC 6455 example key: %s\n",
+         strstr(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") ? "matches" : "WRONG");
+
+  size_t raw = 0;
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    printf("  %-22s %-24s %5zu bytes gzipped, %s\n", webAssets[i].path, webAssets[i].type, webAssets[i].len,
+           webAssets[i].immutable ? "immutable" : "revalidated");
+    raw += webAssets[i].len;
+  }
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t alen = sizeof(addr);
+  if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0 ||
+      getsockname(listener, (sockaddr *)&addr, &alen) != 0) {
+    perror("listen");
+    return 1;
+  }
+  uint16_t port = ntohs(addr.sin_port);
+  std::thread server(serve, listener);
+
+  std::vector<const char *> page;
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) page.push_back(webAssets[i].path);
+  for (int pass = 0; pass < 2; pass++) {
+    naive = pass == 1;
+    printf("%s, %d rounds, %zu bytes in flash:\n", pass ? "string-built responses" : "flash table", rounds, raw);
+    runCase(port, "first load (all assets)", page, false, rounds);
+    runCase(port, "reload (index.html 304)", {"/index.html"}, true, rounds);
+    runCase(port, "/api/state", {"/api/state"}, false, rounds);
+  }
+
+  stopServer = true;
+  close(connectTo(port));  // Wake the accept
+  server.join();
+  close(listener);
+  return 0;
+}
@@ -0,0 +1,90 @@
+# Web UI packer - turns web/ into include/web_assets.h for web_ui.cpp to serve straight from flash
+# Each asset is gzip-compressed once here, so the controller never compresses or templates anything.
+# Scripts and stylesheets get a content hash in their name and are served as immutable for a year;
+# index.html keeps its name, refers to the hashed names and is revalidated by ETag on every load.
+#
+# Run: automatically before each build (extra_scripts in platformio.ini), or  python3 tools/web_pack.py
+import gzip
+import hashlib
+import os
+import re
+
+TYPES = {".html": "text/html", ".js": "application/javascript", ".css": "text/css", ".svg": "image/svg+xml", ".ico": "image/x-icon"}
+
+
+def project_dir():
+    try:
+        Import("env")  # noqa: F821 - SCons builtin, defined when PlatformIO runs this script
+        return env["PROJECT_DIR"]  # noqa: F821
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 20):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 20]) + ",")
+    return "static const uint8_t %s[%d] = {\n%s\n};\n" % (name, len(data), "\n".join(lines))
+
+
+def pack(root):
+    web = os.path.join(root, "web")
+    names = sorted(n for n in os.listdir(web) if os.path.splitext(n)[1] in TYPES)
+
+    # Hashed names first, so index.html can be rewritten to point at them
+    assets = []
+    renamed = {}
+    for name in names:
+        if name == "index.html":
+            continue
+        with open(os.path.join(web, name), "rb") as f:
+            data = f.read()
+        digest = content_hash(data)
+        base, ext = os.path.splitext(name)
+        renamed[name] = "%s.%s%s" % (base, digest, ext)
+        assets.append(("/" + renamed[name], ext, data, digest, True))
+
+    with open(os.path.join(web, "index.html"), "rb") as f:
+        index = f.read().decode("utf-8")
+    for old, new in renamed.items():
+        index = re.sub(r'(src|href)="%s"' % re.escape(old), r'\1="%s"' % new, index)
+    index = index.encode("utf-8")
+    assets.insert(0, ("/index.html", ".html", index, content_hash(index), False))
+
+    out = ["// Generated by tools/web_pack.py from web/ - do not edit, rebuild instead",
+           "#ifndef WEB_ASSETS_H", "#define WEB_ASSETS_H", "", '#include "web_ui.h"', ""]
+    table = []
+    raw_total = gz_total = 0
+    for i, (path, ext, data, digest, immutable) in enumerate(assets):
+        gz = gzip.compress(data, compresslevel=9, mtime=0)  # mtime 0 keeps the output reproducible
+        raw_total += len(data)
+        gz_total += len(gz)
+        out.append("// %s - %d bytes, %d gzipped" % (path, len(data), len(gz)))
+        out.append(c_array("webAsset%d" % i, gz))
+        table.append('  {"%s", "%s", "\\"%s\\"", %s, webAsset%d, sizeof(webAsset%d)},'
+                     % (path, TYPES[ext], digest, "true" if immutable else "false", i, i))
+    out.append("static const WebAsset webAssets[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("#define WEB_ASSET_COUNT %d" % len(assets))
+    out.append("")
+    out.append("#endif")
+    text = "\n".join(out) + "\n"
+
+    target = os.path.join(root, "include", "web_assets.h")
+    try:
+        with open(target) as f:
+            if f.read() == text:
+                return  # Unchanged - leave the timestamp alone so nothing rebuilds
+    except IOError:
+        pass
+    with open(target, "w") as f:
+        f.write(text)
+    print("web_pack: %d assets, %d bytes, %d gzipped" % (len(assets), raw_total, gz_total))
+
+
+pack(project_dir())
@@ -0,0 +1,332 @@
+// Wi-Fi outage simulator - drives the firmware's connection state machine and outbound queue (wifi_manager.h)
+// with a scripted stand-in for the Wi-Fi driver, and state-sync traffic over real loopback UDP sockets
+// The access point drops out a few times an hour for 20 s to 6 min, and once for 20 min. The stand-in driver
+// behaves as the ESP32's does: begin() and disconnect() return at once, an IP address arrives as an event a
+// second or two later if the access point is there, and a failed attempt either ends in a disconnect event or
+// in silence. A link that goes away is only reported after the beacon timeout, and frames sent meanwhile are
+// lost. The loop scans the reader every 10 ms and polls the manager on every pass, as serviceBackground() does.
+//
+// Rooms change at random and are published as state-sync deltas through the queue, from a controller socket
+// bound to its own port. A collector follows them, and on a gap sends a snapshot request back to the address
+// and port the delta came from, as sync_collector does; the controller answers from the same socket. The run
+// checks that every request reached the controller and that the collector ends with the controller's state.
+//
+// Scan latency added by the manager is the host time of each poll, reported separately for passes during an
+// outage and with the link up. A reconnect loop that waited for WL_CONNECTED would hold the scan for the
+// whole outage; that is reported as the baseline.
+//
+// Build (host):  g++ -O2 -std=c++17 -Iinclude tools/wifi_outage_sim.cpp src/wifi_manager.cpp src/state_sync.cpp -o wifi_outage_sim
+// Run:           ./wifi_outage_sim [hours] [seed]
+#include "wifi_manager.h"
+#include "state_sync.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define LOOP_MS          10         // One reader scan per loop() pass
+#define ROOMS            8
+#define CONTROLLER_ID    7
+#define ROOM_GAP_MS      20000      // Mean time between room changes
+#define HEARTBEAT_MS     10000      // SYNC_HEARTBEAT_MS
+#define OUTAGE_GAP_MS    (20 * 60 * 1000)
+#define LONG_OUTAGE_MS   (20 * 60 * 1000)
+#define SETTLE_MS        120000     // Quiet time with the access point up at the end of the run
+#define START_MS         (0xFFFFFFFFu - 3600000u)  // millis() an hour short of its wrap
+
+// UDP socket bound to a loopback port - what a WiFiUDP after begin() is in the firmware
+struct HostSocket {
+  int fd;
+  uint16_t port;
+};
+
+// Function to open a non-blocking loopback socket on a port the kernel picks
+static bool socketOpen(HostSocket *s) {
+  s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (s->fd < 0 || bind(s->fd, (sockaddr *)&addr, sizeof(addr)) < 0 || getsockname(s->fd, (sockaddr *)&addr, &len) < 0) {
+    perror("socket");
+    return false;
+  }
+  fcntl(s->fd, F_SETFL, O_NONBLOCK);
+  s->port = ntohs(addr.sin_port);
+  return true;
+}
+
+// Stand-in for the Wi-Fi driver - calls return at once, results come later as events
+struct Driver {
+  std::vector<std::pair<uint64_t, uint64_t>> outages;  // Access point away over [first, second)
+  uint32_t gotIpEvents = 0, lostEvents = 0;  // Counted by the "Wi-Fi task", as wifiOnEvent() does
+  bool associated = false;
+  int pending = 0;                           // 1 an IP address, 2 a disconnect, due at pendingMs
+  uint64_t pendingMs = 0;
+  uint64_t calls = 0;
+
+  bool apUp(uint64_t now) const {
+    for (const auto &o : outages) if (now >= o.first && now < o.second) return false;
+    return true;
+  }
+  void begin(uint64_t now, std::mt19937 &rng) {
+    calls++;
+    if (apUp(now)) {
+      pending = 1;
+      pendingMs = now + 800 + rng() % 1700;  // Association, authentication and DHCP
+    }
+    else if (rng() % 2) {
+      pending = 2;
+      pendingMs = now + 2000 + rng() % 2000;  // No access point found
+    }
+    else {
+      pending = 0;                            // Nothing at all - the manager's timeout ends the attempt
+    }
+  }
+  void disconnect() {
+    calls++;
+    associated = false;
+    pending = 0;
+  }
+  // Function to deliver events that are due - a link whose access point went away is lost after the beacon timeout
+  void deliver(uint64_t now, std::mt19937 &rng) {
+    if (associated && pending == 0 && !apUp(now)) {
+      pending = 2;
+      pendingMs = now + 3000 + rng() % 3000;
+    }
+    if (pending == 0 || now < pendingMs) return;
+    if (pending == 1 && apUp(now)) {
+      associated = true;
+      gotIpEvents++;
+    }
+    else {
+      associated = false;
+      lostEvents++;
+    }
+    pending = 0;
+  }
+};
+
+// Function to sort a sample and take a quantile
+static double quantile(std::vector<float> &v, double q) {
+  if (v.empty()) return 0;
+  size_t i = (size_t)(q * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+int main(int argc, char **argv) {
+  int hours = argc > 1 ? atoi(argv[1]) : 24;
+  uint32_t seed = argc > 2 ? (uint32_t)atoi(argv[2]) : 1;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  uint64_t runMs = (uint64_t)hours * 3600 * 1000;
+  uint64_t endMs = runMs + SETTLE_MS;
+
+  // Outage script - short ones at random, one long one six hours in
+  Driver driver;
+  for (double t = 60000;;) {
+    t += -log(1.0 - unit(rng)) * OUTAGE_GAP_MS;
+    uint64_t length = 20000 + rng() % 340000;
+    if (t + length >= runMs) break;
+    driver.outages.push_back({(uint64_t)t, (uint64_t)t + length});
+    t += length;
+  }
+  if (runMs > 7 * 3600 * 1000ULL) driver.outages.push_back({6 * 3600 * 1000ULL, 6 * 3600 * 1000ULL + LONG_OUTAGE_MS});
+  std::sort(driver.outages.begin(), driver.outages.end());
+  for (size_t i = 1; i < driver.outages.size(); i++) {  // Merge any overlap with the long one
+    if (driver.outages[i].first < driver.outages[i - 1].second) {
+      driver.outages[i].first = driver.outages[i - 1].second;
+      if (driver.outages[i].second < driver.outages[i].first) driver.outages[i].second = driver.outages[i].first;
+    }
+  }
+
+  HostSocket controller, collector;
+  if (!socketOpen(&controller) || !socketOpen(&collector)) return 1;
+
+  // Controller room table and publisher state, as stateSyncPoll() keeps them
+  bool on[ROOMS] = {}, hasOwner[ROOMS] = {};
+  uint8_t owner[ROOMS][SYNC_UID_SIZE] = {};
+  SyncRoomView view = {ROOMS, on, hasOwner, owner};
+  uint32_t seq = 0, lastSentSeq = 0, unsentMask = 0;
+  uint64_t lastHeartbeat = 0;
+  SyncReceiver rx;
+  syncReceiverInit(&rx, CONTROLLER_ID);
+
+  WifiLink link;
+  WifiQueue queue;
+  wifiQueueInit(&queue);
+  wifiLinkInit(&link, START_MS);
+  driver.begin(0, rng);
+  uint32_t gotIpSeen = 0, lostSeen = 0;
+
+  std::vector<float> outageNs, upNs;
+  uint64_t maxCallsPerPoll = 0, framesSent = 0, framesLost = 0, requestsSent = 0, requestsHeard = 0;
+  uint64_t snapshotsApplied = 0, reconnects = 0, attemptsInOutage = 0;
+  uint64_t reconnectMaxMs = 0, nextRoomMs = 0;
+  bool wasApUp = true;
+  uint64_t apBackMs = 0;
+  uint8_t buf[SYNC_MAX_MESSAGE];
+
+  // Function to encode a message and queue it from the controller socket - false if the queue is full
+  auto publish = [&](uint8_t type, uint32_t prevSeq, uint32_t mask) {
+    size_t len = syncEncode(buf, sizeof(buf), type, CONTROLLER_ID, seq, prevSeq, mask, view);
+    return wifiQueuePush(&queue, &controller, htonl(INADDR_LOOPBACK), collector.port, buf, len);
+  };
+
+  for (uint64_t now = 0; now < endMs; now += LOOP_MS) {
+    uint32_t nowMs = START_MS + (uint32_t)now;
+    bool apUp = driver.apUp(now);
+    if (apUp && !wasApUp) apBackMs = now;
+    wasApUp = apUp;
+    driver.deliver(now, rng);
+
+    // A room changes - published as a delta, or folded into the next one while the queue is full
+    if (now < runMs && now >= nextRoomMs) {
+      int room = rng() % ROOMS;
+      on[room] = hasOwner[room] = !on[room];
+      for (auto &b : owner[room]) b = rng();
+      seq++;
+      unsentMask |= 1u << room;
+      nextRoomMs = now + (uint64_t)(-log(1.0 - unit(rng)) * ROOM_GAP_MS);
+    }
+    if (unsentMask && publish(SYNC_MSG_DELTA, lastSentSeq, unsentMask)) {
+      lastSentSeq = seq;
+      unsentMask = 0;
+    }
+    if (link.up && now - lastHeartbeat >= HEARTBEAT_MS) {
+      publish(SYNC_MSG_HEARTBEAT, lastSentSeq, 0);
+      lastHeartbeat = now;
+    }
+
+    // The poll, timed - what wifiManagerPoll() adds to this pass of loop()
+    uint64_t callsBefore = driver.calls;
+    auto t0 = std::chrono::steady_clock::now();
+    bool gotIp = driver.gotIpEvents != gotIpSeen;
+    bool lost = driver.lostEvents != lostSeen;
+    gotIpSeen = driver.gotIpEvents;
+    lostSeen = driver.lostEvents;
+    bool wasUp = link.up;
+    WifiAction action = wifiLinkStep(&link, nowMs, gotIp, lost, gotIp && driver.associated, rng());
+    if (action == WIFI_ACTION_CONNECT) driver.begin(now, rng);
+    else if (action == WIFI_ACTION_DISCONNECT) driver.disconnect();
+    uint32_t sent = 0;
+    for (int i = 0; link.up && i < WIFI_FLUSH_PER_POLL; i++) {
+      const WifiFrame *frame = wifiQueuePop(&queue);
+      if (frame == NULL) break;
+      if (!apUp) {
+        framesLost++;               // Sent before the driver noticed the access point had gone
+        continue;
+      }
+      HostSocket *from = (HostSocket *)frame->socket;
+      sockaddr_in to = {};
+      to.sin_family = AF_INET;
+      to.sin_addr.s_addr = frame->dest;
+      to.sin_port = htons(frame->port);
+      sendto(from->fd, frame->data, frame->len, 0, (sockaddr *)&to, sizeof(to));
+      sent++;
+    }
+    float ns = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    (apUp ? upNs : outageNs).push_back(ns);
+    maxCallsPerPoll = std::max(maxCallsPerPoll, driver.calls - callsBefore);
+    if (action == WIFI_ACTION_CONNECT && !apUp) attemptsInOutage++;
+    if (link.up && !wasUp) {
+      reconnects++;
+      if (apBackMs) reconnectMaxMs = std::max(reconnectMaxMs, now - apBackMs);
+    }
+    framesSent += sent;
+
+    // Collector - follows the controller and asks for a snapshot on a gap, to the address the message came from
+    for (;;) {
+      sockaddr_in from = {};
+      socklen_t fromLen = sizeof(from);
+      ssize_t len = recvfrom(collector.fd, buf, sizeof(buf), 0, (sockaddr *)&from, &fromLen);
+      if (len <= 0) break;
+      uint8_t type;
+      uint16_t id;
+      bool snapshot = syncPeek(buf, len, &type, &id) && type == SYNC_MSG_SNAPSHOT;
+      SyncResult result = syncReceive(&rx, buf, len);
+      if (result == SYNC_APPLIED && snapshot) snapshotsApplied++;
+      if (result == SYNC_GAP) {
+        SyncRoomView none = {0, nullptr, nullptr, nullptr};
+        size_t reqLen = syncEncode(buf, sizeof(buf), SYNC_MSG_SNAPSHOT_REQ, CONTROLLER_ID, rx.seq, 0, 0, none);
+        sendto(collector.fd, buf, reqLen, 0, (sockaddr *)&from, fromLen);
+        requestsSent++;
+      }
+    }
+
+    // Controller - answers snapshot requests on its bound socket, as stateSyncPoll() does on syncUdp
+    for (;;) {
+      ssize_t len = recv(controller.fd, buf, sizeof(buf), 0);
+      if (len <= 0) break;
+      uint8_t type;
+      uint16_t id;
+      if (syncPeek(buf, len, &type, &id) && type == SYNC_MSG_SNAPSHOT_REQ && id == CONTROLLER_ID) {
+        requestsHeard++;
+        publish(SYNC_MSG_SNAPSHOT, 0, (1u << ROOMS) - 1);
+      }
+    }
+  }
+
+  uint64_t outageMs = 0, longestMs = 0;
+  for (const auto &o : driver.outages) {
+    outageMs += o.second - o.first;
+    longestMs = std::max(longestMs, o.second - o.first);
+  }
+  uint32_t occupied = 0;
+  for (int room = 0; room < ROOMS; room++) if (on[room]) occupied |= 1u << room;
+
+  printf("%d h, seed %u: %zu outages, %.1f min down in all, longest %.1f min\n\n", hours, seed,
+         driver.outages.size(), outageMs / 60000.0, longestMs / 60000.0);
+  printf("Poll cost, link down:  median %.0f ns, p99.9 %.0f ns, max %.0f ns over %zu passes\n",
+         quantile(outageNs, 0.5), quantile(outageNs, 0.999), quantile(outageNs, 1.0), outageNs.size());
+  printf("Poll cost, link up:    median %.0f ns, p99.9 %.0f ns, max %.0f ns over %zu passes\n",
+         quantile(upNs, 0.5), quantile(upNs, 0.999), quantile(upNs, 1.0), upNs.size());
+  printf("Driver calls per poll: at most %llu\n", (unsigned long long)maxCallsPerPoll);
+  printf("Blocking reconnect:    would have held the scan %.1f min in all, %.1f min at once\n\n",
+         outageMs / 60000.0, longestMs / 60000.0);
+  printf("Reconnects:            %llu, at most %.1f s after the access point came back; %llu attempts during outages\n",
+         (unsigned long long)reconnects, reconnectMaxMs / 1000.0, (unsigned long long)attemptsInOutage);
+  printf("Frames:                %llu sent, %llu lost before the loss event, %u pushes refused by a full queue and retried\n",
+         (unsigned long long)framesSent, (unsigned long long)framesLost, queue.dropped);
+  printf("Gap recovery:          %llu snapshot requests sent, %llu reached the controller, %llu snapshots applied\n",
+         (unsigned long long)requestsSent, (unsigned long long)requestsHeard, (unsigned long long)snapshotsApplied);
+  printf("Collector at the end:  seq %u of %u, occupancy %02x of %02x\n\n", rx.seq, seq, rx.occupied, occupied);
+
+  bool ok = true;
+  if (maxCallsPerPoll > 1) {
+    printf("FAIL: a poll made more than one driver call\n");
+    ok = false;
+  }
+  if (quantile(outageNs, 0.999) > quantile(upNs, 0.999) + 1000) {  // Host scheduling noise aside
+    printf("FAIL: polls during outages cost more than with the link up\n");
+    ok = false;
+  }
+  if (reconnectMaxMs > WIFI_BACKOFF_MAX_MS * 5 / 4 + WIFI_CONNECT_TIMEOUT_MS + 5000) {
+    printf("FAIL: a reconnect took longer than the longest backoff and attempt\n");
+    ok = false;
+  }
+  if (requestsSent == 0 || requestsHeard != requestsSent) {
+    printf("FAIL: snapshot requests did not all come back to the controller socket\n");
+    ok = false;
+  }
+  if (!rx.synced || rx.seq != seq || rx.occupied != occupied) {
+    printf("FAIL: the collector did not end with the controller's state\n");
+    ok = false;
+  }
+  printf(ok ? "All checks passed\n" : "CHECKS FAILED\n");
+  close(controller.fd);
+  close(collector.fd);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+// Live view - room state pushed over a WebSocket, with /api/state polling while the socket is down
+(function () {
+  'use strict';
+  var rooms = document.getElementById('rooms');
+  var link = document.getElementById('link');
+  var pollTimer = null;
+
+  function text(id, value) {
+    document.getElementById(id).textContent = value;
+  }
+
+  function duration(s) {
+    var d = Math.floor(s / 86400), h = Math.floor(s % 86400 / 3600), m = Math.floor(s % 3600 / 60);
+    return (d ? d + 'd ' : '') + h + 'h ' + m + 'm';
+  }
+
+  function render(state) {
+    while (rooms.children.length < state.rooms.length) {
+      var tile = document.createElement('div');
+      tile.className = 'room';
+      tile.innerHTML = '<b></b><span></span>';
+      rooms.appendChild(tile);
+    }
+    state.rooms.forEach(function (room, i) {
+      var tile = rooms.children[i];
+      tile.className = room.on ? 'room on' : 'room';
+      tile.firstChild.textContent = 'Room ' + (i + 1);
+      tile.lastChild.textContent = room.on ? (room.owned ? 'Occupied' : 'On (BMS)') : 'Free';
+    });
+    text('seq', state.seq);
+    text('uptime', duration(state.uptime));
+    text('heap', Math.round(state.heap / 1024) + ' KB');
+    text('requests', state.web.requests);
+    text('ttfb', state.web.ttfbAvgUs + ' us avg, ' + state.web.ttfbMaxUs + ' us max');
+    text('reqheap', state.web.heapMax + ' B max');
+  }
+
+  function setLink(up) {
+    link.textContent = up ? 'live' : 'polling';
+    link.className = up ? 'link up' : 'link down';
+  }
+
+  function poll() {
+    fetch('/api/state', {cache: 'no-store'})
+      .then(function (r) { return r.json(); })
+      .then(render)
+      .catch(function () { link.textContent = 'offline'; });
+  }
+
+  function startPolling() {
+    if (!pollTimer) pollTimer = setInterval(poll, 2000);
+    poll();
+  }
+
+  function connect() {
+    var ws = new WebSocket('ws://' + location.host + '/ws');
+    ws.onopen = function () {
+      setLink(true);
+      clearInterval(pollTimer);
+      pollTimer = null;
+    };
+    ws.onmessage = function (e) { render(JSON.parse(e.data)); };
+    ws.onclose = function () {
+      setLink(false);
+      startPolling();
+      setTimeout(connect, 5000);
+    };
+  }
+
+  startPolling();
+  connect();
+})();